@@ -16,8 +16,10 @@
 
 #include <elf.h>
 
+#include <algorithm>
 #include <memory>
 
+#include "libs/base/crc32.h"
 #include "libs/base/filesystem.h"
 #include "libs/base/reset.h"
 #include "libs/base/tasks.h"
@@ -41,13 +43,162 @@ void elfloader_main(void *param);
 TimerHandle_t usb_timer;
 uint8_t *elfloader_recv_image = nullptr;
 char *elfloader_recv_path = nullptr;
-uint8_t elfloader_data[64];
+uint8_t elfloader_data[kElfloaderReportSize];
+ElfloaderAck elfloader_ack;
+// The one-byte acknowledgement of a command. Only `kDone` reports errors.
+ElfloaderStatus elfloader_reply = ElfloaderStatus::kOk;
 class_handle_t elfloader_class_handle;
 ElfloaderTarget elfloader_target = ElfloaderTarget::kRam;
 lfs_file_t file_handle;
+bool file_open = false;
 bool filesystem_formatted = false;
 
-void elfloader_recv(const uint8_t *buffer, uint32_t length) {
+// Progress of the current `kChunk` transfer.
+uint32_t chunk_next_offset = 0;
+ElfloaderStatus chunk_status = ElfloaderStatus::kOk;
+
+// File data is collected into block-sized writes, which are programmed to
+// flash in the background while the next block is received.
+std::unique_ptr<coralmicro::LfsBufferedWriter> file_writer;
+size_t file_size = 0;
+bool file_patching = false;
+
+uint8_t elfloader_response[kElfloaderReportSize];
+uint8_t query_buffer[2048];
+
+bool elfloader_flush_file() { return !file_writer || file_writer->Flush(); }
+
+bool elfloader_write_file(const uint8_t *data, size_t size) {
+  if (!file_open) return false;
+  if (!file_writer) {
+    return lfs_file_write(Lfs(), &file_handle, data, size) ==
+           static_cast<lfs_ssize_t>(size);
+  }
+  return file_writer->Write(data, size);
+}
+
+bool elfloader_write(size_t offset, const uint8_t *data, size_t size) {
+  switch (elfloader_target) {
+    case ElfloaderTarget::kRam:
+      memcpy(elfloader_recv_image + offset, data, size);
+      break;
+    case ElfloaderTarget::kPath:
+    case ElfloaderTarget::kPatchPath:
+      memcpy(elfloader_recv_path + offset, data, size);
+      break;
+    case ElfloaderTarget::kFilesystem:
+      return elfloader_write_file(data, size);
+  }
+  return true;
+}
+
+// Answers with the size and CRC-32 of a file, and optionally of each of its
+// blocks, so the host can skip sending data the device already has.
+void elfloader_query(const uint8_t *buffer, uint32_t length) {
+  auto *response = reinterpret_cast<ElfloaderQueryResponse *>(
+      elfloader_response);
+  uint8_t *block_crcs = elfloader_response + sizeof(ElfloaderQueryResponse);
+  response->size = -1;
+  response->crc32 = 0;
+  response->num_block_crcs = 0;
+
+  const ElfloaderQuery *query =
+      reinterpret_cast<const ElfloaderQuery *>(&buffer[1]);
+  const char *path =
+      reinterpret_cast<const char *>(&buffer[1] + sizeof(ElfloaderQuery));
+  size_t max_path = length > sizeof(ElfloaderQuery) + 1
+                        ? length - sizeof(ElfloaderQuery) - 1
+                        : 0;
+  lfs_file_t file;
+  if (max_path && strnlen(path, max_path) < max_path &&
+      lfs_file_open(Lfs(), &file, path, LFS_O_RDONLY) >= 0) {
+    uint32_t block_size = query->block_size;
+    uint32_t crc = 0, block_crc = 0, block_used = 0;
+    size_t num_blocks = 0;
+    lfs_ssize_t size = 0;
+    while (true) {
+      lfs_ssize_t n =
+          lfs_file_read(Lfs(), &file, query_buffer, sizeof(query_buffer));
+      if (n <= 0) {
+        if (n < 0) size = -1;
+        break;
+      }
+      crc = coralmicro::Crc32Update(crc, query_buffer, n);
+      size += n;
+      for (lfs_ssize_t i = 0; block_size && i < n;) {
+        uint32_t m = std::min<uint32_t>(n - i, block_size - block_used);
+        block_crc = coralmicro::Crc32Update(block_crc, query_buffer + i, m);
+        block_used += m;
+        i += m;
+        if (block_used == block_size) {
+          if (num_blocks < kElfloaderMaxBlockCrcs) {
+            memcpy(block_crcs + num_blocks * sizeof(block_crc), &block_crc,
+                   sizeof(block_crc));
+          }
+          ++num_blocks;
+          block_crc = 0;
+          block_used = 0;
+        }
+      }
+    }
+    if (block_used) {
+      if (num_blocks < kElfloaderMaxBlockCrcs) {
+        memcpy(block_crcs + num_blocks * sizeof(block_crc), &block_crc,
+               sizeof(block_crc));
+      }
+      ++num_blocks;
+    }
+    lfs_file_close(Lfs(), &file);
+    response->size = size;
+    response->crc32 = crc;
+    if (size >= 0 && num_blocks <= kElfloaderMaxBlockCrcs) {
+      response->num_block_crcs = num_blocks;
+    }
+  }
+  USB_DeviceHidSend(elfloader_class_handle,
+                    elfloader_hid_endpoints[kTxEndpoint].endpointAddress,
+                    elfloader_response,
+                    sizeof(ElfloaderQueryResponse) +
+                        response->num_block_crcs * sizeof(uint32_t));
+}
+
+void elfloader_send_ack() {
+  elfloader_ack.status = chunk_status;
+  elfloader_ack.next_offset = chunk_next_offset;
+  USB_DeviceHidSend(elfloader_class_handle,
+                    elfloader_hid_endpoints[kTxEndpoint].endpointAddress,
+                    reinterpret_cast<uint8_t *>(&elfloader_ack),
+                    sizeof(elfloader_ack));
+}
+
+void elfloader_recv_chunk(const uint8_t *buffer, uint32_t length) {
+  const ElfloaderChunk *chunk =
+      reinterpret_cast<const ElfloaderChunk *>(&buffer[1]);
+  const uint8_t *payload = &buffer[1] + sizeof(ElfloaderChunk);
+  if (length < sizeof(ElfloaderChunk) + 1 ||
+      chunk->size > length - sizeof(ElfloaderChunk) - 1) {
+    if (chunk_status == ElfloaderStatus::kOk) {
+      chunk_status = ElfloaderStatus::kCrcError;
+    }
+  } else if (chunk->offset == chunk_next_offset &&
+             chunk_status != ElfloaderStatus::kWriteError) {
+    if (coralmicro::Crc32(payload, chunk->size) != chunk->crc32) {
+      chunk_status = ElfloaderStatus::kCrcError;
+    } else if (!elfloader_write(chunk->offset, payload, chunk->size)) {
+      chunk_status = ElfloaderStatus::kWriteError;
+    } else {
+      chunk_status = ElfloaderStatus::kOk;
+      chunk_next_offset += chunk->size;
+    }
+  }
+  if (length > sizeof(ElfloaderChunk) &&
+      (chunk->flags & kElfloaderChunkFlagAck)) {
+    elfloader_send_ack();
+  }
+}
+
+// Returns whether the host expects the one-byte acknowledgement.
+bool elfloader_recv(const uint8_t *buffer, uint32_t length) {
   ElfloaderCommand cmd = static_cast<ElfloaderCommand>(buffer[0]);
   const ElfloaderSetSize *set_size =
       reinterpret_cast<const ElfloaderSetSize *>(&buffer[1]);
@@ -56,16 +207,27 @@ void elfloader_recv(const uint8_t *buffer, uint32_t length) {
   const ElfloaderTarget *target =
       reinterpret_cast<const ElfloaderTarget *>(&buffer[1]);
   xTimerStop(usb_timer, 0);
+  elfloader_reply = ElfloaderStatus::kOk;
   switch (cmd) {
     case ElfloaderCommand::kSetSize:
       assert(length >= sizeof(ElfloaderSetSize) + 1);
+      chunk_next_offset = 0;
+      chunk_status = ElfloaderStatus::kOk;
       switch (elfloader_target) {
         case ElfloaderTarget::kFilesystem:
+          file_size = set_size->size;
+          file_writer.reset();
+          if (file_open && file_size != 0) {
+            file_writer = std::make_unique<coralmicro::LfsBufferedWriter>(
+                &file_handle, std::min(file_size, coralmicro::kLfsBlockSize),
+                /*background=*/true);
+          }
           break;
         case ElfloaderTarget::kRam:
           elfloader_recv_image = new uint8_t[set_size->size];
           break;
         case ElfloaderTarget::kPath:
+        case ElfloaderTarget::kPatchPath:
           elfloader_recv_path = static_cast<char *>(malloc(set_size->size + 1));
           memset(elfloader_recv_path, 0, set_size->size + 1);
           break;
@@ -73,21 +235,31 @@ void elfloader_recv(const uint8_t *buffer, uint32_t length) {
       break;
     case ElfloaderCommand::kBytes:
       assert(length >= sizeof(ElfloaderBytes) + 1);
-      switch (elfloader_target) {
-        case ElfloaderTarget::kRam:
-          memcpy(elfloader_recv_image + bytes->offset,
-                 &buffer[1] + sizeof(ElfloaderBytes), bytes->size);
-          break;
-        case ElfloaderTarget::kPath:
-          memcpy(elfloader_recv_path + bytes->offset,
-                 &buffer[1] + sizeof(ElfloaderBytes), bytes->size);
-          break;
-        case ElfloaderTarget::kFilesystem:
-          lfs_file_write(Lfs(), &file_handle,
-                         &buffer[1] + sizeof(ElfloaderBytes), bytes->size);
-          break;
-      }
+      elfloader_write(bytes->offset, &buffer[1] + sizeof(ElfloaderBytes),
+                      bytes->size);
       break;
+    case ElfloaderCommand::kChunk:
+      elfloader_recv_chunk(buffer, length);
+      return false;
+    case ElfloaderCommand::kQuery:
+      elfloader_query(buffer, length);
+      return false;
+    case ElfloaderCommand::kSeek: {
+      assert(length >= sizeof(ElfloaderSeek) + 1);
+      const ElfloaderSeek *seek =
+          reinterpret_cast<const ElfloaderSeek *>(&buffer[1]);
+      if (elfloader_target != ElfloaderTarget::kFilesystem ||
+          chunk_status == ElfloaderStatus::kWriteError) {
+        break;
+      }
+      if (!elfloader_flush_file() ||
+          lfs_file_seek(Lfs(), &file_handle, seek->offset, LFS_SEEK_SET) < 0) {
+        chunk_status = ElfloaderStatus::kWriteError;
+        break;
+      }
+      chunk_next_offset = seek->offset;
+      chunk_status = ElfloaderStatus::kOk;
+    } break;
     case ElfloaderCommand::kDone:
       switch (elfloader_target) {
         case ElfloaderTarget::kRam:
@@ -95,19 +267,43 @@ void elfloader_recv(const uint8_t *buffer, uint32_t length) {
                       configMINIMAL_STACK_SIZE * 10, elfloader_recv_image,
                       coralmicro::kAppTaskPriority, nullptr);
           break;
-        case ElfloaderTarget::kPath: {
-          // TODO(atv): This stuff can fail. We should propagate errors back to
-          // the Python side if possible.
+        case ElfloaderTarget::kPath:
+        case ElfloaderTarget::kPatchPath: {
           auto dir = coralmicro::LfsDirname(elfloader_recv_path);
           coralmicro::LfsMakeDirs(dir.c_str());
-          lfs_file_open(Lfs(), &file_handle, elfloader_recv_path,
-                        LFS_O_TRUNC | LFS_O_CREAT | LFS_O_RDWR);
+          file_patching = elfloader_target == ElfloaderTarget::kPatchPath;
+          if (file_open) lfs_file_close(Lfs(), &file_handle);
+          file_open =
+              lfs_file_open(Lfs(), &file_handle, elfloader_recv_path,
+                            file_patching
+                                ? LFS_O_CREAT | LFS_O_RDWR
+                                : LFS_O_TRUNC | LFS_O_CREAT | LFS_O_RDWR) >= 0;
           free(elfloader_recv_path);
           elfloader_recv_path = nullptr;
+          if (!file_open) {
+            elfloader_reply = ElfloaderStatus::kWriteError;
+          }
+        } break;
+        case ElfloaderTarget::kFilesystem: {
+          // The file is only complete once it is closed, so every step is
+          // checked before the host is told it was stored.
+          bool ok = file_open && chunk_status != ElfloaderStatus::kWriteError &&
+                    elfloader_flush_file();
+          file_writer.reset();
+          if (file_open) {
+            // A patched file keeps its old tail if the new one is shorter.
+            if (ok && file_patching &&
+                lfs_file_size(Lfs(), &file_handle) >
+                    static_cast<lfs_soff_t>(file_size)) {
+              ok = lfs_file_truncate(Lfs(), &file_handle, file_size) >= 0;
+            }
+            ok = lfs_file_close(Lfs(), &file_handle) >= 0 && ok;
+            file_open = false;
+          }
+          if (!ok) {
+            elfloader_reply = ElfloaderStatus::kWriteError;
+          }
         } break;
-        case ElfloaderTarget::kFilesystem:
-          lfs_file_close(Lfs(), &file_handle);
-          break;
       }
       break;
     case ElfloaderCommand::kResetToBootloader:
@@ -124,6 +320,7 @@ void elfloader_recv(const uint8_t *buffer, uint32_t length) {
       filesystem_formatted = true;
       break;
   }
+  return true;
 }
 
 bool elfloader_HandleEvent(uint32_t event, void *param) {
@@ -155,18 +352,17 @@ void elfloader_SetClassHandle(class_handle_t class_handle) {
 
 usb_status_t elfloader_Handler(class_handle_t class_handle, uint32_t event,
                                void *param) {
-  uint8_t dummy = 0;
   usb_status_t ret = kStatus_USB_Success;
   usb_device_endpoint_callback_message_struct_t *message =
       static_cast<usb_device_endpoint_callback_message_struct_t *>(param);
   switch (event) {
     case kUSB_DeviceHidEventRecvResponse:
-      if (message->length != USB_UNINITIALIZED_VAL_32) {
-        elfloader_recv(message->buffer, message->length);
+      if (message->length == USB_UNINITIALIZED_VAL_32 ||
+          elfloader_recv(message->buffer, message->length)) {
+        USB_DeviceHidSend(elfloader_class_handle,
+                          elfloader_hid_endpoints[kTxEndpoint].endpointAddress,
+                          reinterpret_cast<uint8_t *>(&elfloader_reply), 1);
       }
-      USB_DeviceHidSend(elfloader_class_handle,
-                        elfloader_hid_endpoints[kTxEndpoint].endpointAddress,
-                        &dummy, 1);
       USB_DeviceHidRecv(elfloader_class_handle,
                         elfloader_hid_endpoints[kRxEndpoint].endpointAddress,
                         elfloader_data, sizeof(elfloader_data));
@@ -191,52 +387,115 @@ usb_device_class_config_struct_t elfloader_config_data_ = {
 };
 
 typedef void (*entry_point)(void);
-void elfloader_main(void *param) {
-  ssize_t elf_size = -1;
-  std::unique_ptr<uint8_t[]> application_elf;
-  if (!param) {
-    elf_size = coralmicro::LfsSize("/default.elf");
-    if (elf_size != -1) {
-      application_elf = std::make_unique<uint8_t[]>(elf_size);
-      if (coralmicro::LfsReadFile("/default.elf", application_elf.get(),
-                                  elf_size) != static_cast<size_t>(elf_size)) {
-        application_elf.reset();
-      }
-    }
-  } else {
-    application_elf.reset(reinterpret_cast<uint8_t *>(param));
+
+// Reads part of the ELF, either from the image received over USB or from
+// `/default.elf`.
+bool elfloader_read(const uint8_t *image, lfs_file_t *file, uint32_t offset,
+                    void *dst, size_t size) {
+  if (image) {
+    memcpy(dst, image + offset, size);
+    return true;
   }
+  return lfs_file_seek(Lfs(), file, offset, LFS_SEEK_SET) >= 0 &&
+         lfs_file_read(Lfs(), file, dst, size) ==
+             static_cast<lfs_ssize_t>(size);
+}
 
-  // If we do not have an application for any reason, suspend this thread.
-  // Otherwise, suspend the USB thread so that the host cannot try to talk to us
-  // and cause confusion.
-  if (!application_elf || (!param && elf_size == -1)) {
-    vTaskSuspend(nullptr);
-  } else {
-    vTaskSuspend(reinterpret_cast<TaskHandle_t>(pvTimerGetTimerID(usb_timer)));
+// Copies each loadable segment straight to its physical address. Only the
+// headers and the segments themselves are read, so a file in the filesystem
+// is never held in memory as a whole. If `expected_crc` is given, the loaded
+// bytes must match it.
+bool elfloader_load(const uint8_t *image, lfs_file_t *file,
+                    const uint32_t *expected_crc, entry_point *entry) {
+  Elf32_Ehdr elf_header;
+  if (!elfloader_read(image, file, 0, &elf_header, sizeof(elf_header)) ||
+      memcmp(elf_header.e_ident, ELFMAG, SELFMAG) != 0) {
+    return false;
   }
+  assert(EF_ARM_EABI_VERSION(elf_header.e_flags) == EF_ARM_EABI_VER5);
+  assert(elf_header.e_phentsize == sizeof(Elf32_Phdr));
 
-  Elf32_Ehdr *elf_header =
-      reinterpret_cast<Elf32_Ehdr *>(application_elf.get());
-  assert(EF_ARM_EABI_VERSION(elf_header->e_flags) == EF_ARM_EABI_VER5);
-  assert(elf_header->e_phentsize == sizeof(Elf32_Phdr));
+  auto program_headers = std::make_unique<Elf32_Phdr[]>(elf_header.e_phnum);
+  if (!elfloader_read(image, file, elf_header.e_phoff, program_headers.get(),
+                      sizeof(Elf32_Phdr) * elf_header.e_phnum)) {
+    return false;
+  }
 
-  for (int i = 0; i < elf_header->e_phnum; ++i) {
-    Elf32_Phdr *program_header = reinterpret_cast<Elf32_Phdr *>(
-        application_elf.get() + elf_header->e_phoff + sizeof(Elf32_Phdr) * i);
-    if (program_header->p_type != PT_LOAD) {
+  uint32_t crc = 0;
+  for (int i = 0; i < elf_header.e_phnum; ++i) {
+    const Elf32_Phdr &program_header = program_headers[i];
+    if (program_header.p_type != PT_LOAD) {
       continue;
     }
-    if (program_header->p_filesz == 0) {
+    // Segments without file data are the application's .bss, which sits in
+    // memory the loader itself is running from; the application's startup
+    // code clears it.
+    if (program_header.p_filesz == 0) {
       continue;
     }
-    memcpy(reinterpret_cast<void *>(program_header->p_paddr),
-           application_elf.get() + program_header->p_offset,
-           program_header->p_filesz);
+    auto *dst = reinterpret_cast<uint8_t *>(program_header.p_paddr);
+    if (!elfloader_read(image, file, program_header.p_offset, dst,
+                        program_header.p_filesz)) {
+      return false;
+    }
+    crc = coralmicro::Crc32Update(crc, dst, program_header.p_filesz);
+    // Zero-fill the rest of a segment that runs where it is loaded.
+    if (program_header.p_memsz > program_header.p_filesz &&
+        program_header.p_paddr == program_header.p_vaddr) {
+      memset(dst + program_header.p_filesz, 0,
+             program_header.p_memsz - program_header.p_filesz);
+    }
+  }
+  if (expected_crc && crc != *expected_crc) {
+    return false;
   }
 
-  entry_point entry_point_fn =
-      reinterpret_cast<entry_point>(elf_header->e_entry);
+  *entry = reinterpret_cast<entry_point>(elf_header.e_entry);
+  return true;
+}
+
+void elfloader_main(void *param) {
+  std::unique_ptr<uint8_t[]> application_elf(
+      reinterpret_cast<uint8_t *>(param));
+  lfs_file_t file;
+  bool have_file = false;
+  // flashtool stores the size of /default.elf and the CRC-32 of its loaded
+  // segments next to it. Check them only if the file still has that size, in
+  // case /default.elf was replaced by other means.
+  uint32_t elf_crc[2];
+  bool have_crc = false;
+  if (!application_elf) {
+    have_file =
+        lfs_file_open(Lfs(), &file, "/default.elf", LFS_O_RDONLY) >= 0;
+    have_crc = have_file &&
+               coralmicro::LfsReadFile(
+                   "/default.elf.crc32", reinterpret_cast<uint8_t *>(elf_crc),
+                   sizeof(elf_crc)) == sizeof(elf_crc) &&
+               lfs_file_size(Lfs(), &file) ==
+                   static_cast<lfs_soff_t>(elf_crc[0]);
+  }
+
+  // If we do not have an application for any reason, suspend this thread.
+  // Otherwise, suspend the USB thread so that the host cannot try to talk to us
+  // and cause confusion.
+  if (!application_elf && !have_file) {
+    vTaskSuspend(nullptr);
+  }
+  auto usb_task = reinterpret_cast<TaskHandle_t>(pvTimerGetTimerID(usb_timer));
+  vTaskSuspend(usb_task);
+
+  entry_point entry_point_fn;
+  bool loaded = elfloader_load(application_elf.get(), &file,
+                               have_crc ? &elf_crc[1] : nullptr,
+                               &entry_point_fn);
+  if (have_file) {
+    lfs_file_close(Lfs(), &file);
+  }
+  // On a bad image, stay in the loader so the host can flash a new one.
+  if (!loaded) {
+    vTaskResume(usb_task);
+    vTaskSuspend(nullptr);
+  }
   entry_point_fn();
 
   vTaskSuspend(nullptr);
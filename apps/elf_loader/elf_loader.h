@@ -32,12 +32,18 @@ enum class ElfloaderCommand : uint8_t {
   kTarget = 4,
   kResetToFlash = 5,
   kFormat = 6,
+  kChunk = 7,
+  kQuery = 8,
+  kSeek = 9,
 };
 
 enum class ElfloaderTarget : uint8_t {
   kRam = 0,
   kPath = 1,
   kFilesystem = 2,
+  // Like `kPath`, but keeps the file's contents so `kSeek` and `kChunk` can
+  // rewrite just the parts that changed.
+  kPatchPath = 3,
 };
 
 enum BootModes {
@@ -55,6 +61,60 @@ struct ElfloaderBytes {
   size_t offset;
 } __attribute__((packed));
 
+// Header of a `kChunk` report. Chunks must arrive in order; one that does not
+// start at the next expected offset, or fails its CRC, is dropped and the host
+// resends from the offset reported in the next ack.
+struct ElfloaderChunk {
+  uint32_t offset;
+  uint16_t size;
+  uint8_t flags;
+  uint32_t crc32;  // Of the payload only.
+} __attribute__((packed));
+
+// Set in `ElfloaderChunk::flags` on the last chunk of a window to have the
+// device answer with an `ElfloaderAck`.
+constexpr uint8_t kElfloaderChunkFlagAck = 1 << 0;
+
+// Reported in `ElfloaderAck`, and as the one-byte reply to `kDone`, which is
+// `kWriteError` if the file couldn't be opened, written or closed.
+enum class ElfloaderStatus : uint8_t {
+  kOk = 0,
+  kCrcError = 1,
+  kWriteError = 2,
+};
+
+struct ElfloaderAck {
+  ElfloaderStatus status;
+  uint32_t next_offset;
+} __attribute__((packed));
+
+// Header of a `kQuery` report, followed by the NUL-terminated file path.
+// A non-zero `block_size` also asks for the CRC-32 of each block of that size.
+struct ElfloaderQuery {
+  uint32_t block_size;
+} __attribute__((packed));
+
+// Answer to `kQuery`, followed by `num_block_crcs` CRC-32s. `size` is -1 if
+// the file does not exist; `num_block_crcs` is 0 if none were asked for or
+// they don't fit in one report.
+struct ElfloaderQueryResponse {
+  int32_t size;
+  uint32_t crc32;
+  uint16_t num_block_crcs;
+} __attribute__((packed));
+
+// Moves the write position of a `kFilesystem` transfer; the next `kChunk`
+// must start at `offset`.
+struct ElfloaderSeek {
+  uint32_t offset;
+} __attribute__((packed));
+
+// Size of the HID input and output reports. One report fits in a single
+// high-speed interrupt packet.
+constexpr size_t kElfloaderReportSize = 1024;
+constexpr size_t kElfloaderMaxBlockCrcs =
+    (kElfloaderReportSize - sizeof(ElfloaderQueryResponse)) / sizeof(uint32_t);
+
 constexpr int kTxEndpoint = 0;
 constexpr int kRxEndpoint = 1;
 extern uint8_t elfloader_hid_report[];
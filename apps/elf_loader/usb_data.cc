@@ -15,25 +15,25 @@
 #include "apps/elf_loader/elf_loader.h"
 
 uint8_t elfloader_hid_report[] = {
-    0x05, 0x81, /* Usage Page (Vendor defined) */
-    0x09, 0x82, /* Usage (Vendor defined) */
-    0xa1, 0x01, /* Collection (Application) */
-    0x09, 0x83, /* Usage (Vendor defined) */
+    0x05, 0x81,       /* Usage Page (Vendor defined) */
+    0x09, 0x82,       /* Usage (Vendor defined) */
+    0xa1, 0x01,       /* Collection (Application) */
+    0x09, 0x83,       /* Usage (Vendor defined) */
 
-    0x09, 0x84, /* Usage (Vendor defined) */
-    0x15, 0x80, /* Logical Minimum (-128) */
-    0x25, 0x7f, /* Logical Maximum (127) */
-    0x75, 0x08, /* Report Size (8U bits) */
-    0x95, 0x40, /* Report count (64U bytes) */
-    0x81, 0x02, /* Input(Data, Variable, Absolute) */
+    0x09, 0x84,       /* Usage (Vendor defined) */
+    0x15, 0x80,       /* Logical Minimum (-128) */
+    0x25, 0x7f,       /* Logical Maximum (127) */
+    0x75, 0x08,       /* Report Size (8U bits) */
+    0x96, 0x00, 0x04, /* Report count (1024U bytes) */
+    0x81, 0x02,       /* Input(Data, Variable, Absolute) */
 
-    0x09, 0x84, /* Usage (Vendor defined) */
-    0x15, 0x80, /* Logical Minimum (-128) */
-    0x25, 0x7f, /* Logical Maximum (127) */
-    0x75, 0x08, /* Report Size (8U bits) */
-    0x95, 0x40, /* Report Count (64U) */
-    0x91, 0x02, /* Output (Data, Variable, Absolute) */
-    0xc0        /* End collection */
+    0x09, 0x84,       /* Usage (Vendor defined) */
+    0x15, 0x80,       /* Logical Minimum (-128) */
+    0x25, 0x7f,       /* Logical Maximum (127) */
+    0x75, 0x08,       /* Report Size (8U bits) */
+    0x96, 0x00, 0x04, /* Report Count (1024U) */
+    0x91, 0x02,       /* Output (Data, Variable, Absolute) */
+    0xc0              /* End collection */
 };
 uint16_t elfloader_hid_report_size = sizeof(elfloader_hid_report);
 
@@ -54,16 +54,16 @@ coralmicro::HidClassDescriptor elfloader_descriptor_data = {
         5,
         0 /* set by code */,
         0x03,
-        512,
-        3,
+        kElfloaderReportSize,
+        1,
     },  // EndpointDescriptor
     {
         sizeof(coralmicro::EndpointDescriptor),
         5,
         0 /* set by code */,
         0x03,
-        512,
-        3,
+        kElfloaderReportSize,
+        1,
     },  // EndpointDescriptor
 };
 
@@ -71,12 +71,12 @@ usb_device_endpoint_struct_t elfloader_hid_endpoints[2] = {
     {
         0,  // in
         USB_ENDPOINT_INTERRUPT,
-        128,
+        kElfloaderReportSize,
     },
     {
         0,  // out
         USB_ENDPOINT_INTERRUPT,
-        128,
+        kElfloaderReportSize,
     }};
 
 usb_device_interface_struct_t elfloader_hid_interface[1] = {
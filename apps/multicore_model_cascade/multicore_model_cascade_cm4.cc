@@ -94,8 +94,8 @@ bool DetectPerson(tflite::MicroInterpreter* interpreter) {
   // Map the model into a usable data structure. This doesn't involve any
   // copying or parsing, it's a very lightweight operation.
   std::vector<uint8_t> person_detect_model_data;
-  if (!coralmicro::LfsReadFile("/models/person_detect_model.tflite",
-                               &person_detect_model_data)) {
+  if (!coralmicro::LfsReadCompressedFile(
+          "/models/person_detect_model.tflite", &person_detect_model_data)) {
     printf("Error: Cannot load model\r\n");
     vTaskSuspend(nullptr);
   }
@@ -24,6 +24,7 @@
 #include "libs/camera/camera.h"
 #include "libs/libjpeg/jpeg.h"
 #include "libs/rpc/rpc_http_server.h"
+#include "libs/rpc/rpc_utils.h"
 #include "libs/tensorflow/posenet.h"
 #include "libs/tpu/edgetpu_manager.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
@@ -377,7 +378,7 @@ void reset_count_rpc(struct jsonrpc_request* r) {
     vTaskSuspend(nullptr);
   }
   std::vector<uint8_t> posenet_tflite;
-  if (!LfsReadFile(kModelPath, &posenet_tflite)) {
+  if (!LfsReadCompressedFile(kModelPath, &posenet_tflite)) {
     printf("ERROR: Failed to read model: %s\r\n", kModelPath);
     vTaskSuspend(nullptr);
   }
@@ -420,7 +421,10 @@ void reset_count_rpc(struct jsonrpc_request* r) {
   JsonRpcHttpServer http_server;
   jsonrpc_init(nullptr, nullptr);
   jsonrpc_export("reset_count", reset_count_rpc);
+  jsonrpc_export("get_metrics", JsonRpcGetMetrics);
   http_server.AddUriHandler(TaskStatsUriHandler{});
+  http_server.AddUriHandler(TraceUriHandler{});
+  http_server.AddUriHandler(MetricsUriHandler{});
   http_server.AddUriHandler(FileSystemUriHandler{});
   UseHttpServer(&http_server);
 
@@ -0,0 +1,623 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <vector>
+
+#if defined(NET_BENCHMARK_ETHERNET)
+#include "libs/base/ethernet.h"
+#elif defined(NET_BENCHMARK_WIFI)
+#include "libs/base/wifi.h"
+#endif
+
+#include "libs/base/check.h"
+#include "libs/base/led.h"
+#include "libs/base/mutex.h"
+#include "libs/base/network.h"
+#include "libs/base/strings.h"
+#include "libs/base/tasks.h"
+#include "libs/base/timer.h"
+#include "libs/base/utils.h"
+#include "libs/rpc/rpc_http_server.h"
+#include "libs/rpc/rpc_utils.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/queue.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/freertos_kernel/include/task.h"
+#include "third_party/mjson/src/mjson.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/inet.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/opt.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/sockets.h"
+
+// Measures the TCP and UDP throughput and the round-trip time of a network
+// link, so that camera and audio streams can be sized for it. The results
+// are reported over JSON-RPC, together with the lwIP tuning profile that the
+// app was built with (see the LWIP_PROFILE CMake option).
+//
+// The board is always the client: it connects to the servers run by
+// net_benchmark.py on the computer, which picks the link by the address it
+// gives the board. Each test runs in the background; start it with the
+// `benchmark_start` RPC and poll `benchmark_result` for the outcome.
+//
+// There are three variants of the app: the USB variant (CDC-EEM) flashed
+// with `python3 scripts/flashtool.py -a net_benchmark`, and the Ethernet and
+// Wi-Fi variants, which also bring up that interface:
+/*
+python3 scripts/flashtool.py -a net_benchmark --subapp net_benchmark_ethernet
+python3 scripts/flashtool.py -a net_benchmark --subapp net_benchmark_wifi \
+        --wifi_ssid network-name --wifi_psk network-password
+*/
+// Then run the benchmarks from the computer, with the board's address on the
+// link to measure:
+//    python3 apps/net_benchmark/net_benchmark.py --device 10.10.10.1
+
+namespace coralmicro {
+namespace {
+// Request bytes that start a TCP test, sent by the board after connecting.
+constexpr uint8_t kTcpRequestSink = 'S';    // The computer discards data.
+constexpr uint8_t kTcpRequestSource = 'R';  // The computer sends data.
+
+// Types of UDP packets.
+constexpr uint8_t kUdpPacketData = 'D';
+constexpr uint8_t kUdpPacketSourceRequest = 'R';
+constexpr uint8_t kUdpPacketEcho = 'E';
+
+// Header of all UDP packets, in little-endian. The rest of a packet is
+// padding up to the requested size.
+struct UdpPacketHeader {
+  uint8_t type;
+  uint8_t reserved[3];
+  uint32_t sequence;
+  // Source requests only: the size of the packets to send, for how long,
+  // and at what rate (0 for as fast as possible).
+  uint32_t size;
+  uint32_t duration_ms;
+  uint32_t rate_kbps;
+} __attribute__((packed));
+
+constexpr int kMaxDurationMs = 60 * 1000;
+constexpr int kMaxTcpWriteSize = 64 * 1024;
+// Larger datagrams would be fragmented by IP on Ethernet-sized links.
+constexpr int kMaxUdpPacketSize = 1472;
+constexpr int kMaxRttCount = 10000;
+constexpr int kReceiveTimeoutMs = 1000;
+// How long a TCP send waits for the computer to acknowledge the last data.
+constexpr int kSendTimeoutMs = 5000;
+
+enum class Test { kTcpSend, kTcpReceive, kUdpSend, kUdpReceive, kRtt };
+
+constexpr const char* kTestNames[] = {"tcp_send", "tcp_receive", "udp_send",
+                                      "udp_receive", "rtt"};
+
+struct TestParams {
+  Test test;
+  // The computer's address and port, in network byte order.
+  uint32_t host;
+  uint16_t port;
+  int duration_ms;
+  int size;
+  int rate_kbps;
+  int count;
+  bool no_copy;
+};
+
+struct TestResult {
+  std::string local_ip;
+  uint64_t bytes;
+  uint64_t duration_us;
+  uint32_t packets;
+  uint32_t packets_lost;
+  uint32_t rtt_min_us;
+  uint32_t rtt_avg_us;
+  uint32_t rtt_max_us;
+  std::string error;
+};
+
+enum class State { kIdle, kRunning, kDone, kFailed };
+
+constexpr const char* kStateNames[] = {"idle", "running", "done", "failed"};
+
+struct BenchmarkContext {
+  SemaphoreHandle_t mutex;
+  QueueHandle_t queue;
+  State state = State::kIdle;
+  TestParams params;
+  TestResult result;
+};
+
+BenchmarkContext g_benchmark;
+
+// The data of TCP sends. It's never modified and never freed, so zero-copy
+// writes from it are always safe.
+uint8_t g_tcp_data[kMaxTcpWriteSize];
+
+const char* LwipProfileName() {
+  switch (CORAL_MICRO_LWIP_PROFILE) {
+    case CORAL_MICRO_LWIP_PROFILE_LOW_MEMORY:
+      return "low_memory";
+    case CORAL_MICRO_LWIP_PROFILE_HIGH_THROUGHPUT:
+      return "high_throughput";
+    default:
+      return "balanced";
+  }
+}
+
+void SetReceiveTimeout(int fd, int timeout_ms) {
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// Connects a socket to the computer. UDP sockets are connected too, so that
+// they only receive the computer's packets.
+int Connect(const TestParams& params, bool tcp, TestResult* result) {
+  const int fd = lwip_socket(AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM,
+                             tcp ? IPPROTO_TCP : IPPROTO_UDP);
+  if (fd == -1) {
+    result->error = "socket failed";
+    return -1;
+  }
+  struct sockaddr_in address = {};
+  address.sin_len = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_port = params.port;
+  address.sin_addr.s_addr = params.host;
+  if (lwip_connect(fd, reinterpret_cast<struct sockaddr*>(&address),
+                   sizeof(address)) == -1) {
+    lwip_close(fd);
+    result->error = "connect failed";
+    return -1;
+  }
+
+  // The local address tells which interface the test runs on.
+  struct sockaddr_in local = {};
+  socklen_t local_size = sizeof(local);
+  if (lwip_getsockname(fd, reinterpret_cast<struct sockaddr*>(&local),
+                       &local_size) == 0) {
+    char ip[IP4ADDR_STRLEN_MAX];
+    if (inet_ntoa_r(local.sin_addr, ip, sizeof(ip))) result->local_ip = ip;
+  }
+  return fd;
+}
+
+bool SendUdpPacket(int fd, std::vector<uint8_t>* packet, uint8_t type,
+                   uint32_t sequence) {
+  UdpPacketHeader header = {};
+  header.type = type;
+  header.sequence = sequence;
+  std::memcpy(packet->data(), &header, sizeof(header));
+  return lwip_send(fd, packet->data(), packet->size(), 0) >= 0;
+}
+
+void RunTcpSend(const TestParams& params, TestResult* result) {
+  const int fd = Connect(params, /*tcp=*/true, result);
+  if (fd == -1) return;
+
+  const size_t size = params.size;
+  auto status = WriteBytes(fd, &kTcpRequestSink, 1);
+  const uint64_t start = TimerMicros();
+  const uint64_t end = start + params.duration_ms * 1000ull;
+  while (status == IOStatus::kOk && TimerMicros() < end) {
+    status = params.no_copy ? WriteBytesNoCopy(fd, g_tcp_data, size)
+                            : WriteBytes(fd, g_tcp_data, size);
+    if (status == IOStatus::kOk) result->bytes += size;
+  }
+  // Only count data that the computer received.
+  if (status == IOStatus::kOk) status = SocketWaitSent(fd, kSendTimeoutMs);
+  result->duration_us = TimerMicros() - start;
+  if (status != IOStatus::kOk) result->error = "connection lost";
+  lwip_close(fd);
+}
+
+void RunTcpReceive(const TestParams& params, TestResult* result) {
+  const int fd = Connect(params, /*tcp=*/true, result);
+  if (fd == -1) return;
+
+  SetReceiveTimeout(fd, kReceiveTimeoutMs);
+  std::vector<uint8_t> data(params.size);
+  if (WriteBytes(fd, &kTcpRequestSource, 1) != IOStatus::kOk) {
+    result->error = "connection lost";
+    lwip_close(fd);
+    return;
+  }
+  const uint64_t start = TimerMicros();
+  const uint64_t end = start + params.duration_ms * 1000ull;
+  while (TimerMicros() < end) {
+    const auto ret = lwip_recv(fd, data.data(), data.size(), 0);
+    if (ret <= 0) {
+      result->error = ret == 0 ? "connection closed" : "receive failed";
+      break;
+    }
+    result->bytes += ret;
+  }
+  result->duration_us = TimerMicros() - start;
+  lwip_close(fd);
+}
+
+void RunUdpSend(const TestParams& params, TestResult* result) {
+  const int fd = Connect(params, /*tcp=*/false, result);
+  if (fd == -1) return;
+
+  std::vector<uint8_t> packet(params.size, 0xA5);
+  uint32_t sequence = 0;
+  const uint64_t start = TimerMicros();
+  const uint64_t end = start + params.duration_ms * 1000ull;
+  uint64_t now = start;
+  while (now < end) {
+    // Packets are paced to the requested rate, one tick at a time.
+    if (params.rate_kbps > 0) {
+      const uint64_t due =
+          start + 8000ull * sequence * packet.size() / params.rate_kbps;
+      if (due > now + 1000) {
+        vTaskDelay(1);
+        now = TimerMicros();
+        continue;
+      }
+    }
+    // Packets that the network stack has no buffer for are lost, like on
+    // the wire.
+    if (SendUdpPacket(fd, &packet, kUdpPacketData, sequence)) {
+      result->bytes += packet.size();
+      ++result->packets;
+    } else {
+      ++result->packets_lost;
+    }
+    ++sequence;
+    now = TimerMicros();
+  }
+  result->duration_us = now - start;
+  lwip_close(fd);
+}
+
+void RunUdpReceive(const TestParams& params, TestResult* result) {
+  const int fd = Connect(params, /*tcp=*/false, result);
+  if (fd == -1) return;
+
+  SetReceiveTimeout(fd, kReceiveTimeoutMs);
+  std::vector<uint8_t> packet(std::max<size_t>(params.size,
+                                               sizeof(UdpPacketHeader)));
+  UdpPacketHeader request = {};
+  request.type = kUdpPacketSourceRequest;
+  request.size = params.size;
+  request.duration_ms = params.duration_ms;
+  request.rate_kbps = params.rate_kbps;
+  if (lwip_send(fd, &request, sizeof(request), 0) < 0) {
+    result->error = "send failed";
+    lwip_close(fd);
+    return;
+  }
+
+  // Measured from the first to the last packet, ending when the computer
+  // stops sending.
+  uint64_t first = 0;
+  uint64_t last = 0;
+  uint32_t max_sequence = 0;
+  while (true) {
+    const auto ret = lwip_recv(fd, packet.data(), packet.size(), 0);
+    if (ret < static_cast<int>(sizeof(UdpPacketHeader))) break;
+    UdpPacketHeader header;
+    std::memcpy(&header, packet.data(), sizeof(header));
+    if (header.type != kUdpPacketData) continue;
+    last = TimerMicros();
+    if (result->packets == 0) first = last;
+    ++result->packets;
+    result->bytes += ret;
+    max_sequence = std::max(max_sequence, header.sequence);
+  }
+  if (result->packets == 0) {
+    result->error = "no packets received";
+  } else {
+    result->duration_us = last - first;
+    result->packets_lost = max_sequence + 1 - result->packets;
+  }
+  lwip_close(fd);
+}
+
+void RunRtt(const TestParams& params, TestResult* result) {
+  const int fd = Connect(params, /*tcp=*/false, result);
+  if (fd == -1) return;
+
+  SetReceiveTimeout(fd, kReceiveTimeoutMs);
+  std::vector<uint8_t> packet(params.size);
+  std::vector<uint8_t> reply(params.size);
+  uint64_t total_us = 0;
+  result->rtt_min_us = UINT32_MAX;
+  const uint64_t start = TimerMicros();
+  for (int i = 0; i < params.count; ++i) {
+    const uint64_t sent = TimerMicros();
+    if (!SendUdpPacket(fd, &packet, kUdpPacketEcho, i)) {
+      ++result->packets_lost;
+      continue;
+    }
+    // Late replies to earlier packets are skipped.
+    bool replied = false;
+    while (!replied) {
+      const auto ret = lwip_recv(fd, reply.data(), reply.size(), 0);
+      if (ret < static_cast<int>(sizeof(UdpPacketHeader))) break;
+      UdpPacketHeader header;
+      std::memcpy(&header, reply.data(), sizeof(header));
+      replied = header.type == kUdpPacketEcho &&
+                header.sequence == static_cast<uint32_t>(i);
+    }
+    if (!replied) {
+      ++result->packets_lost;
+      continue;
+    }
+    const auto rtt_us = static_cast<uint32_t>(TimerMicros() - sent);
+    result->rtt_min_us = std::min(result->rtt_min_us, rtt_us);
+    result->rtt_max_us = std::max(result->rtt_max_us, rtt_us);
+    total_us += rtt_us;
+    ++result->packets;
+    result->bytes += 2 * packet.size();
+  }
+  result->duration_us = TimerMicros() - start;
+  if (result->packets == 0) {
+    result->rtt_min_us = 0;
+    result->error = "no replies received";
+  } else {
+    result->rtt_avg_us = total_us / result->packets;
+  }
+  lwip_close(fd);
+}
+
+[[noreturn]] void BenchmarkTask(void* param) {
+  (void)param;
+  while (true) {
+    TestParams params;
+    CHECK(xQueueReceive(g_benchmark.queue, &params, portMAX_DELAY) == pdTRUE);
+    printf("Running %s\r\n", kTestNames[static_cast<int>(params.test)]);
+
+    TestResult result{};
+    switch (params.test) {
+      case Test::kTcpSend:
+        RunTcpSend(params, &result);
+        break;
+      case Test::kTcpReceive:
+        RunTcpReceive(params, &result);
+        break;
+      case Test::kUdpSend:
+        RunUdpSend(params, &result);
+        break;
+      case Test::kUdpReceive:
+        RunUdpReceive(params, &result);
+        break;
+      case Test::kRtt:
+        RunRtt(params, &result);
+        break;
+    }
+
+    MutexLock lock(g_benchmark.mutex);
+    // A test that was cut short still reports what it measured.
+    g_benchmark.state = (result.error.empty() || result.bytes)
+                             ? State::kDone
+                             : State::kFailed;
+    g_benchmark.result = std::move(result);
+  }
+}
+
+std::optional<std::string> GetInterfaceIp(const char* name) {
+  if (std::strcmp(name, "usb") == 0) {
+    std::string ip;
+    if (GetUsbIpAddress(&ip)) return ip;
+  }
+#if defined(NET_BENCHMARK_ETHERNET)
+  if (std::strcmp(name, "ethernet") == 0) return EthernetGetIp();
+#elif defined(NET_BENCHMARK_WIFI)
+  if (std::strcmp(name, "wifi") == 0) return WiFiGetIp();
+#endif
+  return std::nullopt;
+}
+
+// Gets an optional integer param. `JsonRpcGetIntegerParam()` would answer the
+// request with an error if the param is missing.
+int GetOptionalInt(struct jsonrpc_request* request, const char* name,
+                   int default_value) {
+  const std::string path = std::string("$[0].") + name;
+  double value;
+  if (mjson_get_number(request->params, request->params_len, path.c_str(),
+                       &value) == 0)
+    return default_value;
+  return static_cast<int>(value);
+}
+
+// Returns the interfaces, their addresses and the lwIP options that bound
+// the throughput.
+void GetNetworkInfo(struct jsonrpc_request* request) {
+  std::string json;
+  StrAppend(&json, "{\"lwip_profile\": \"%s\"", LwipProfileName());
+  StrAppend(&json, ", \"tcp_mss\": %d, \"tcp_wnd\": %d", TCP_MSS, TCP_WND);
+  StrAppend(&json, ", \"tcp_snd_buf\": %d", TCP_SND_BUF);
+  StrAppend(&json, ", \"pbuf_pool_size\": %d", PBUF_POOL_SIZE);
+  StrAppend(&json, ", \"interfaces\": {");
+  bool first = true;
+  for (const char* name : {"usb", "ethernet", "wifi"}) {
+    auto ip = GetInterfaceIp(name);
+    if (!ip.has_value()) continue;
+    StrAppend(&json, "%s\"%s\": \"%s\"", first ? "" : ", ", name, ip->c_str());
+    first = false;
+  }
+  StrAppend(&json, "}");
+#if defined(NET_BENCHMARK_WIFI)
+  if (auto rssi = WiFiGetRssi(); rssi.has_value())
+    StrAppend(&json, ", \"wifi_rssi\": %ld", static_cast<long>(*rssi));
+#endif
+  StrAppend(&json, "}");
+  jsonrpc_return_success(request, "%s", json.c_str());
+}
+
+// Starts a test in the background. Params:
+//   test: One of "tcp_send", "tcp_receive", "udp_send", "udp_receive" and
+//     "rtt".
+//   host: The computer's IP address.
+//   port: The port of the computer's servers.
+//   duration_ms: How long throughput tests run (default 5000).
+//   size: The write size for TCP, or the packet size for UDP.
+//   rate_kbps: The UDP send rate, or 0 for as fast as possible (default 0).
+//   count: The number of RTT measurements (default 100).
+//   no_copy: Whether TCP sends use `WriteBytesNoCopy()` (default false).
+void BenchmarkStart(struct jsonrpc_request* request) {
+  std::string test_name;
+  if (!JsonRpcGetStringParam(request, "test", &test_name)) return;
+  const auto* it = std::find_if(
+      std::begin(kTestNames), std::end(kTestNames),
+      [&test_name](const char* name) { return test_name == name; });
+  if (it == std::end(kTestNames)) {
+    JsonRpcReturnBadParam(request, "unknown test", "test");
+    return;
+  }
+
+  TestParams params{};
+  params.test = static_cast<Test>(it - std::begin(kTestNames));
+
+  std::string host;
+  if (!JsonRpcGetStringParam(request, "host", &host)) return;
+  ip4_addr_t host_addr;
+  if (!ip4addr_aton(host.c_str(), &host_addr)) {
+    JsonRpcReturnBadParam(request, "host must be an IPv4 address", "host");
+    return;
+  }
+  params.host = host_addr.addr;
+
+  int port;
+  if (!JsonRpcGetIntegerParam(request, "port", &port)) return;
+  if (port <= 0 || port > UINT16_MAX) {
+    JsonRpcReturnBadParam(request, "port out of range", "port");
+    return;
+  }
+  params.port = PP_HTONS(port);
+
+  const bool tcp =
+      params.test == Test::kTcpSend || params.test == Test::kTcpReceive;
+  params.duration_ms = GetOptionalInt(request, "duration_ms", 5000);
+  params.size = GetOptionalInt(
+      request, "size",
+      tcp ? 16 * 1024 : (params.test == Test::kRtt ? 64 : 1400));
+  params.rate_kbps = GetOptionalInt(request, "rate_kbps", 0);
+  params.count = GetOptionalInt(request, "count", 100);
+  int no_copy = 0;
+  mjson_get_bool(request->params, request->params_len, "$[0].no_copy",
+                 &no_copy);
+  params.no_copy = no_copy;
+  params.duration_ms = std::clamp(params.duration_ms, 100, kMaxDurationMs);
+  params.size =
+      std::clamp(params.size, static_cast<int>(sizeof(UdpPacketHeader)),
+                 tcp ? kMaxTcpWriteSize : kMaxUdpPacketSize);
+  params.rate_kbps = std::max(params.rate_kbps, 0);
+  params.count = std::clamp(params.count, 1, kMaxRttCount);
+
+  MutexLock lock(g_benchmark.mutex);
+  if (g_benchmark.state == State::kRunning) {
+    jsonrpc_return_error(request, -1, "a test is already running", nullptr);
+    return;
+  }
+  if (xQueueSend(g_benchmark.queue, &params, 0) != pdTRUE) {
+    jsonrpc_return_error(request, -1, "failed to start the test", nullptr);
+    return;
+  }
+  g_benchmark.state = State::kRunning;
+  g_benchmark.params = params;
+  jsonrpc_return_success(request, "{}");
+}
+
+// Returns the state of the latest test, and its results once it's done.
+void BenchmarkResult(struct jsonrpc_request* request) {
+  MutexLock lock(g_benchmark.mutex);
+  const auto& params = g_benchmark.params;
+  const auto& result = g_benchmark.result;
+  std::string json;
+  StrAppend(&json, "{\"state\": \"%s\"",
+            kStateNames[static_cast<int>(g_benchmark.state)]);
+  if (g_benchmark.state == State::kDone ||
+      g_benchmark.state == State::kFailed) {
+    // newlib-nano can't print 64-bit integers, and tests are too short for
+    // these to overflow.
+    const auto duration_us = static_cast<unsigned long>(result.duration_us);
+    const auto kbps = static_cast<unsigned long>(
+        result.duration_us ? result.bytes * 8000 / result.duration_us : 0);
+    StrAppend(&json, ", \"test\": \"%s\"",
+              kTestNames[static_cast<int>(params.test)]);
+    StrAppend(&json, ", \"local_ip\": \"%s\"", result.local_ip.c_str());
+    StrAppend(&json, ", \"size\": %d", params.size);
+    StrAppend(&json, ", \"bytes\": %lu",
+              static_cast<unsigned long>(result.bytes));
+    StrAppend(&json, ", \"duration_us\": %lu", duration_us);
+    StrAppend(&json, ", \"kbps\": %lu", kbps);
+    StrAppend(&json, ", \"packets\": %lu",
+              static_cast<unsigned long>(result.packets));
+    StrAppend(&json, ", \"packets_lost\": %lu",
+              static_cast<unsigned long>(result.packets_lost));
+    if (params.test == Test::kRtt) {
+      StrAppend(&json, ", \"rtt_min_us\": %lu, \"rtt_avg_us\": %lu",
+                static_cast<unsigned long>(result.rtt_min_us),
+                static_cast<unsigned long>(result.rtt_avg_us));
+      StrAppend(&json, ", \"rtt_max_us\": %lu",
+                static_cast<unsigned long>(result.rtt_max_us));
+    }
+    if (!result.error.empty())
+      StrAppend(&json, ", \"error\": \"%s\"", result.error.c_str());
+  }
+  StrAppend(&json, "}");
+  jsonrpc_return_success(request, "%s", json.c_str());
+}
+
+void Main() {
+  printf("Network Benchmark!\r\n");
+  // Turn on Status LED to show the board is on.
+  LedSet(Led::kStatus, true);
+
+#if defined(NET_BENCHMARK_ETHERNET)
+  if (!EthernetInit(/*default_iface=*/false)) {
+    printf("Failed to initialize Ethernet\r\n");
+    vTaskSuspend(nullptr);
+  }
+#elif defined(NET_BENCHMARK_WIFI)
+  if (!WiFiTurnOn(/*default_iface=*/false) || !WiFiConnect()) {
+    printf("Failed to connect to Wi-Fi\r\n");
+    vTaskSuspend(nullptr);
+  }
+#endif
+  for (const char* name : {"usb", "ethernet", "wifi"}) {
+    if (auto ip = GetInterfaceIp(name); ip.has_value())
+      printf("%s: %s\r\n", name, ip->c_str());
+  }
+  printf("lwIP profile: %s\r\n", LwipProfileName());
+
+  g_benchmark.mutex = xSemaphoreCreateMutex();
+  CHECK(g_benchmark.mutex);
+  g_benchmark.queue = xQueueCreate(1, sizeof(TestParams));
+  CHECK(g_benchmark.queue);
+  CHECK(xTaskCreate(BenchmarkTask, "net_benchmark",
+                    configMINIMAL_STACK_SIZE * 10, nullptr, kAppTaskPriority,
+                    nullptr) == pdPASS);
+
+  jsonrpc_init(nullptr, nullptr);
+  jsonrpc_export("get_network_info", GetNetworkInfo);
+  jsonrpc_export("benchmark_start", BenchmarkStart);
+  jsonrpc_export("benchmark_result", BenchmarkResult);
+  UseHttpServer(new JsonRpcHttpServer);
+  printf("Benchmark RPC server ready\r\n");
+}
+}  // namespace
+}  // namespace coralmicro
+
+extern "C" void app_main(void* param) {
+  (void)param;
+  coralmicro::Main();
+  vTaskSuspend(nullptr);
+}
@@ -0,0 +1,273 @@
+# Copyright 2022 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse
+import json
+import socket
+import struct
+import sys
+import threading
+import time
+
+import requests
+
+"""
+Measures the throughput and round-trip time of the link to a Dev Board Micro
+running net_benchmark, and prints them with the board's lwIP configuration.
+
+First load net_benchmark onto the Dev Board Micro, for example the Ethernet
+variant:
+
+    python3 scripts/flashtool.py -a net_benchmark \
+        --subapp net_benchmark_ethernet
+
+Then run the benchmarks against the board's address on the link to measure:
+
+    python3 apps/net_benchmark/net_benchmark.py --device 192.168.0.42
+
+This script runs the servers that the board connects to, so the board must be
+able to reach this computer on --port (TCP and UDP).
+"""
+
+TCP_REQUEST_SINK = b'S'
+TCP_REQUEST_SOURCE = b'R'
+
+UDP_HEADER = struct.Struct('<B3xIIII')
+UDP_DATA = ord('D')
+UDP_SOURCE_REQUEST = ord('R')
+UDP_ECHO = ord('E')
+
+TESTS = ('rtt', 'tcp_send', 'tcp_receive', 'udp_send', 'udp_receive')
+
+
+class Servers:
+  """The TCP and UDP servers that the board runs its tests against."""
+
+  def __init__(self, port):
+    self._lock = threading.Lock()
+    self.udp_packets = 0
+    self.tcp_bytes = 0
+
+    self._tcp = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    self._tcp.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    self._tcp.bind(('', port))
+    self._tcp.listen(1)
+    self._udp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    self._udp.bind(('', port))
+
+    for target in (self._serve_tcp, self._serve_udp):
+      threading.Thread(target=target, daemon=True).start()
+
+  def reset(self):
+    with self._lock:
+      self.udp_packets = 0
+      self.tcp_bytes = 0
+
+  def _serve_tcp(self):
+    while True:
+      conn, _ = self._tcp.accept()
+      threading.Thread(target=self._handle_tcp, args=(conn,),
+                       daemon=True).start()
+
+  def _handle_tcp(self, conn):
+    with conn:
+      request = conn.recv(1)
+      if request == TCP_REQUEST_SINK:
+        while True:
+          data = conn.recv(65536)
+          if not data:
+            break
+          with self._lock:
+            self.tcp_bytes += len(data)
+      elif request == TCP_REQUEST_SOURCE:
+        data = bytes(65536)
+        try:
+          while True:
+            conn.sendall(data)
+        except OSError:
+          pass  # The board closes the connection when it's done.
+
+  def _serve_udp(self):
+    while True:
+      packet, address = self._udp.recvfrom(65536)
+      if len(packet) < UDP_HEADER.size:
+        continue
+      packet_type, _, size, duration_ms, rate_kbps = \
+          UDP_HEADER.unpack_from(packet)
+      if packet_type == UDP_DATA:
+        with self._lock:
+          self.udp_packets += 1
+      elif packet_type == UDP_ECHO:
+        self._udp.sendto(packet, address)
+      elif packet_type == UDP_SOURCE_REQUEST:
+        threading.Thread(target=self._send_udp,
+                         args=(address, size, duration_ms, rate_kbps),
+                         daemon=True).start()
+
+  def _send_udp(self, address, size, duration_ms, rate_kbps):
+    padding = bytes(max(0, size - UDP_HEADER.size))
+    start = time.monotonic()
+    sequence = 0
+    while time.monotonic() - start < duration_ms / 1000:
+      if rate_kbps:
+        due = start + sequence * size * 8 / (rate_kbps * 1000)
+        delay = due - time.monotonic()
+        if delay > 0:
+          time.sleep(delay)
+      header = UDP_HEADER.pack(UDP_DATA, sequence, 0, 0, 0)
+      try:
+        self._udp.sendto(header + padding, address)
+      except OSError:
+        pass  # Lost like on the wire.
+      sequence += 1
+
+
+class Board:
+  """Calls the board's JSON-RPC methods."""
+
+  def __init__(self, address):
+    self._url = f'http://{address}:80/jsonrpc'
+    self._id = 0
+
+  def call(self, method, **params):
+    self._id += 1
+    response = requests.post(self._url, json={
+        'method': method,
+        'jsonrpc': '2.0',
+        'params': [params],
+        'id': self._id,
+    }, timeout=10).json()
+    if 'error' in response:
+      raise RuntimeError(f'{method}: {response["error"]}')
+    return response['result']
+
+
+def local_address(device):
+  """Returns the address of this computer on the link to the board."""
+  with socket.socket(socket.AF_INET, socket.SOCK_DGRAM) as s:
+    s.connect((device, 80))
+    return s.getsockname()[0]
+
+
+def run_test(board, servers, test, params, poll_interval):
+  servers.reset()
+  board.call('benchmark_start', test=test, **params)
+  while True:
+    time.sleep(poll_interval)
+    result = board.call('benchmark_result')
+    if result['state'] not in ('running', 'idle'):
+      break
+  # The board's counts of sent data can't see losses on the way.
+  if test == 'udp_send':
+    time.sleep(0.5)  # Let the last packets arrive.
+    result['packets_received'] = servers.udp_packets
+    result['packets_lost'] += result['packets'] - servers.udp_packets
+  elif test == 'tcp_send':
+    result['bytes_received'] = servers.tcp_bytes
+  return result
+
+
+def format_result(result):
+  if result['test'] == 'rtt':
+    text = 'min %.2f ms, avg %.2f ms, max %.2f ms' % (
+        result['rtt_min_us'] / 1000, result['rtt_avg_us'] / 1000,
+        result['rtt_max_us'] / 1000)
+  else:
+    text = '%.2f Mbit/s' % (result['kbps'] / 1000)
+  if result['test'].startswith('udp') or result['test'] == 'rtt':
+    total = result['packets'] + result['packets_lost']
+    text += ', %d/%d packets lost' % (result['packets_lost'], total)
+  if 'error' in result:
+    text += f' ({result["error"]})'
+  return text
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Measure the network throughput of a Dev Board Micro',
+      formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument('--device', type=str, default='10.10.10.1',
+                      help='IP address of the Dev Board Micro on the link to '
+                      'measure')
+  parser.add_argument('--host', type=str, default=None,
+                      help='IP address of this computer on the link, found '
+                      'automatically by default')
+  parser.add_argument('--port', type=int, default=5201,
+                      help='TCP and UDP port of the servers on this computer')
+  parser.add_argument('--tests', type=str, nargs='+', default=TESTS,
+                      choices=TESTS, help='tests to run')
+  parser.add_argument('--duration_ms', type=int, default=5000,
+                      help='duration of each throughput test')
+  parser.add_argument('--tcp_size', type=int, default=16384,
+                      help='size of each TCP write on the board')
+  parser.add_argument('--udp_size', type=int, default=1400,
+                      help='size of UDP packets')
+  parser.add_argument('--rate_kbps', type=int, default=0,
+                      help='UDP send rate, 0 for as fast as possible')
+  parser.add_argument('--rtt_count', type=int, default=100,
+                      help='number of round-trip time measurements')
+  parser.add_argument('--rtt_size', type=int, default=64,
+                      help='size of round-trip time packets')
+  parser.add_argument('--no_copy', action='store_true',
+                      help='send TCP data with zero-copy writes')
+  parser.add_argument('--output', '-o', type=str, default=None,
+                      metavar='FILENAME',
+                      help='write the board info and results to a JSON file')
+  args = parser.parse_args()
+
+  board = Board(args.device)
+  host = args.host or local_address(args.device)
+  servers = Servers(args.port)
+
+  info = board.call('get_network_info')
+  print('lwIP profile: %s (TCP_WND %d, TCP_SND_BUF %d, PBUF_POOL_SIZE %d)' % (
+      info['lwip_profile'], info['tcp_wnd'], info['tcp_snd_buf'],
+      info['pbuf_pool_size']))
+  for name, address in info['interfaces'].items():
+    print(f'{name}: {address}')
+
+  results = []
+  for test in args.tests:
+    params = {'host': host, 'port': args.port}
+    if test == 'rtt':
+      params.update(count=args.rtt_count, size=args.rtt_size)
+      poll_interval = 0.2
+    else:
+      params.update(duration_ms=args.duration_ms,
+                    size=args.tcp_size if test.startswith('tcp') else
+                    args.udp_size)
+      poll_interval = 0.5
+    if test.startswith('udp'):
+      params['rate_kbps'] = args.rate_kbps
+    if test == 'tcp_send':
+      params['no_copy'] = args.no_copy
+    result = run_test(board, servers, test, params, poll_interval)
+    results.append(result)
+    print('%-12s %s' % (test, format_result(result)))
+
+  if args.output:
+    with open(args.output, 'w') as f:
+      json.dump({'info': info, 'results': results}, f, indent=2)
+    print(f'Results written to {args.output}')
+
+
+if __name__ == '__main__':
+  try:
+    main()
+  except requests.exceptions.ConnectionError:
+    msg = 'ERROR: Cannot connect to Coral Dev Board Micro, make sure you ' \
+          'specify the correct IP address with --device.'
+    if sys.platform == 'darwin':
+      msg += ' Network over USB is not supported on macOS.'
+    print(msg, file=sys.stderr)
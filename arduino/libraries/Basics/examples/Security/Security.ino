@@ -58,24 +58,20 @@ void setup() {
     return;
   }
 
-  // Get the sha256 and ecc signature for this model file.
-  std::vector<uint8_t> model;
+  // Get the sha256 and ecc signature for this model file. The file is hashed
+  // in chunks on the M7, so it can be any size, and only the 32-byte hash is
+  // sent to the A71.
   constexpr char kModelPath[] = "/models/testconv1-edgetpu.tflite";
-  if (!coralmicro::LfsReadFile(kModelPath, &model)) {
+  coralmicro::Sha256Digest digest;
+  if (!coralmicro::LfsSha256File(kModelPath, &digest)) {
     Serial.println("/models/testconv1-edgetpu.tflite missing");
     return;
   }
-  auto maybe_sha = coralmicro::A71ChGetSha256(model);
-  if (maybe_sha.has_value()) {
-    Serial.print("testconv1-edgetpu.tflite sha");
-    Serial.println(coralmicro::StrToHex(maybe_sha.value()).c_str());
-  } else {
-    Serial.println("failed to generate sha256 for testconv1-edgetpu.tflite");
-    return;
-  }
+  const std::string sha(digest.begin(), digest.end());
+  Serial.print("testconv1-edgetpu.tflite sha");
+  Serial.println(coralmicro::StrToHex(sha).c_str());
 
   // Get signature for this model with the key public key in index 0.
-  const auto& sha = maybe_sha.value();
   auto maybe_signature = coralmicro::A71ChGetEccSignature(kKeyIdx, sha);
   if (maybe_signature.has_value()) {
     Serial.print("Signature: ");
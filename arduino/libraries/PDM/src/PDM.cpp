@@ -16,6 +16,9 @@
 
 #include "PDM.h"
 
+#include <algorithm>
+#include <type_traits>
+
 namespace coralmicro {
 namespace arduino {
 
@@ -26,7 +29,8 @@ PDMClass::PDMClass()
       on_receive_{nullptr},
       mutex_(xSemaphoreCreateMutex()),
       read_pos_{0},
-      available_{0} {}
+      available_{0},
+      overruns_{0} {}
 
 PDMClass::~PDMClass() { end(); }
 
@@ -49,6 +53,7 @@ int PDMClass::begin(int sample_rate_hz, size_t sample_size_ms,
   samples_.resize(MsToSamples(config_->sample_rate, sample_size_ms));
   read_pos_ = 0;
   available_ = 0;
+  overruns_ = 0;
   if (current_audio_cb_id_.has_value()) {
     audio_service_->RemoveCallback(current_audio_cb_id_.value());
   }
@@ -70,22 +75,45 @@ void PDMClass::end() {
   }
 }
 
-int PDMClass::available() { return available_; }
+int PDMClass::available() {
+  MutexLock lock(mutex_);
+  return available_;
+}
 
 int PDMClass::read(std::vector<int32_t>& buffer, size_t size) {
   // Disallow reading more than what's available.
-  auto read = size < available_ ? size : available_;
-  buffer.clear();
-  {
-    MutexLock lock(mutex_);
-    std::rotate(std::begin(samples_), std::begin(samples_) + read_pos_,
-                std::end(samples_));
-    read_pos_ = 0;
-    buffer.assign(samples_.begin(), samples_.begin() + read);
-    available_ -= read;
-    std::rotate(std::begin(samples_), std::begin(samples_) + available_,
-                std::end(samples_));
+  buffer.resize(std::min(size, static_cast<size_t>(available())));
+  // Samples can only have been added since, so this fills the whole vector.
+  return Read(buffer.data(), buffer.size());
+}
+
+int PDMClass::read(int32_t* buffer, size_t size) { return Read(buffer, size); }
+
+int PDMClass::read(int16_t* buffer, size_t size) { return Read(buffer, size); }
+
+size_t PDMClass::overruns() {
+  MutexLock lock(mutex_);
+  return overruns_;
+}
+
+template <typename T>
+int PDMClass::Read(T* buffer, size_t size) {
+  MutexLock lock(mutex_);
+  const size_t read = std::min(size, available_);
+  // Copy out in at most two runs, up to the end of the ring and from its start.
+  size_t done = 0;
+  while (done < read) {
+    const size_t run = std::min(read - done, samples_.size() - read_pos_);
+    const int32_t* src = samples_.data() + read_pos_;
+    if constexpr (std::is_same_v<T, int32_t>) {
+      std::copy(src, src + run, buffer + done);
+    } else {
+      for (size_t i = 0; i < run; ++i) buffer[done + i] = src[i] >> 16;
+    }
+    read_pos_ = (read_pos_ + run) % samples_.size();
+    done += run;
   }
+  available_ -= read;
   return read;
 }
 
@@ -100,14 +128,32 @@ void PDMClass::setBufferSize(int bufferSize) {
 }
 
 void PDMClass::Append(const int32_t* samples, size_t num_samples) {
-  {
-    MutexLock lock(mutex_);
-    for (size_t i = 0; i < num_samples; ++i)
-      samples_[(read_pos_ + i) % samples_.size()] = samples[i];
-    read_pos_ = (read_pos_ + num_samples) % samples_.size();
-    available_ += num_samples;
-    available_ = available_ < samples_.size() ? available_ : samples_.size();
+  MutexLock lock(mutex_);
+  const size_t size = samples_.size();
+  // Nothing can be kept before the ring is sized.
+  if (size == 0) {
+    overruns_ += num_samples;
+    return;
+  }
+  // Only the newest `size` samples can be kept.
+  if (num_samples > size) {
+    overruns_ += num_samples - size;
+    samples += num_samples - size;
+    num_samples = size;
+  }
+  // Make room by dropping the oldest unread samples.
+  const size_t free = size - available_;
+  if (num_samples > free) {
+    const size_t dropped = num_samples - free;
+    overruns_ += dropped;
+    read_pos_ = (read_pos_ + dropped) % size;
+    available_ -= dropped;
   }
+  const size_t write_pos = (read_pos_ + available_) % size;
+  const size_t run = std::min(num_samples, size - write_pos);
+  std::copy(samples, samples + run, samples_.begin() + write_pos);
+  std::copy(samples + run, samples + num_samples, samples_.begin());
+  available_ += num_samples;
 }
 
 }  // namespace arduino
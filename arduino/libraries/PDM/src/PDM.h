@@ -90,6 +90,28 @@ class PDMClass {
   // @return The amount of audio data values that were copied.
   int read(std::vector<int32_t>& buffer, size_t size);
 
+  // Reads data from the audio buffer into a caller-provided array, without
+  // allocating. Samples are returned oldest first.
+  //
+  // @param buffer The array that will receive up to `size` samples.
+  // @param size The maximum amount of audio data values to copy.
+  // @return The amount of audio data values that were copied.
+  int read(int32_t* buffer, size_t size);
+
+  // Reads data from the audio buffer as 16-bit samples (the upper 16 bits of
+  // each value), as expected by most audio models.
+  //
+  // @param buffer The array that will receive up to `size` samples.
+  // @param size The maximum amount of audio data values to copy.
+  // @return The amount of audio data values that were copied.
+  int read(int16_t* buffer, size_t size);
+
+  // Gets the number of samples dropped because the buffer was full when new
+  // data arrived. The oldest samples are the ones dropped.
+  //
+  // @return The number of samples dropped since `begin()`.
+  size_t overruns();
+
   // @cond Do not generate docs.
   // Not Implemented
   void setGain(int gain);
@@ -98,6 +120,8 @@ class PDMClass {
 
  private:
   void Append(const int32_t* samples, size_t num_samples);
+  template <typename T>
+  int Read(T* buffer, size_t size);
 
   coralmicro::AudioDriverBuffers<
       /*NumDmaBuffers=*/kNumDmaBuffers,
@@ -109,9 +133,12 @@ class PDMClass {
   std::optional<int> current_audio_cb_id_;
   void (*on_receive_)(void);
   SemaphoreHandle_t mutex_;
+  // Ring buffer of the most recent samples; the oldest unread one is at
+  // `read_pos_` and new ones are written at `read_pos_ + available_`.
   std::vector<int32_t> samples_;  // Protected by mutex_.
   size_t read_pos_;               // Protected by mutex_.
   size_t available_;              // Protected by mutex_.
+  size_t overruns_;               // Protected by mutex_.
 };
 
 }  // namespace arduino
@@ -30,7 +30,6 @@
 namespace {
 bool setup_success{false};
 
-std::vector<int32_t> current_samples;
 tflite::MicroMutableOpResolver</*tOpsCount=*/3> resolver;
 const tflite::Model* model = nullptr;
 std::vector<uint8_t> model_data;
@@ -110,11 +109,7 @@ void loop() {
   if (Mic.available() < coralmicro::tensorflow::kYamnetAudioSize) {
     return;  // Wait until we have enough data.
   }
-  Mic.read(current_samples, coralmicro::tensorflow::kYamnetAudioSize);
-
-  for (int i = 0; i < coralmicro::tensorflow::kYamnetAudioSize; ++i) {
-    audio_input[i] = current_samples[i] >> 16;
-  }
+  Mic.read(audio_input.data(), coralmicro::tensorflow::kYamnetAudioSize);
 
   coralmicro::tensorflow::YamNetPreprocessInput(
       audio_input.data(), interpreter->input_tensor(0), &frontend_state);
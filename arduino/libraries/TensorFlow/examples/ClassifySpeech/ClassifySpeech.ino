@@ -26,7 +26,6 @@
 namespace {
 bool setup_success{false};
 
-std::vector<int32_t> current_samples;
 std::vector<int16_t> current_samples_16;
 tflite::MicroMutableOpResolver</*tOpsCount=*/1> resolver;
 const tflite::Model* model = nullptr;
@@ -112,7 +111,6 @@ void setup() {
     return;
   }
 
-  current_samples.resize(coralmicro::tensorflow::kKeywordDetectorAudioSize);
   current_samples_16.resize(coralmicro::tensorflow::kKeywordDetectorAudioSize);
   setup_success = true;
   Serial.println("Classify Speech Setup Complete\r\n\n");
@@ -127,11 +125,8 @@ void loop() {
   if (Mic.available() < coralmicro::tensorflow::kKeywordDetectorAudioSize) {
     return;  // Wait until we have enough data.
   }
-  Mic.read(current_samples, coralmicro::tensorflow::kKeywordDetectorAudioSize);
-
-  for (int i = 0; i < coralmicro::tensorflow::kKeywordDetectorAudioSize; ++i) {
-    current_samples_16[i] = current_samples[i] >> 16;
-  }
+  Mic.read(current_samples_16.data(),
+           coralmicro::tensorflow::kKeywordDetectorAudioSize);
 
   coralmicro::tensorflow::KeywordDetectorPreprocessInput(
       current_samples_16.data(), interpreter->input_tensor(0), &frontend_state);
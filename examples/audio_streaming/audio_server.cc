@@ -14,11 +14,16 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <optional>
 
 #include "libs/audio/audio_service.h"
 #include "libs/base/led.h"
+#include "libs/base/mutex.h"
 #include "libs/base/network.h"
+#include "libs/base/tasks.h"
+#include "libs/base/udp_streamer.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/freertos_kernel/include/task.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/sockets.h"
 
@@ -35,6 +40,10 @@
 // Then receive the audio stream over USB:
 //    python3 -m pip install -r examples/audio_server/requirements.txt
 //    python3 examples/audio_server/audio_client.py
+//
+// Or receive it as UDP packets, which keeps the stream live on lossy links
+// (such as Wi-Fi) because lost packets are never retransmitted:
+//    python3 examples/audio_server/udp_client.py
 
 namespace coralmicro {
 namespace {
@@ -42,54 +51,59 @@ AudioDriverBuffers</*NumDmaBuffers*/ 16, /*CombinedDmaBufferSize=*/28 * 1024>
     g_audio_buffers;
 
 constexpr int kPort = 33000;
-constexpr int kNumSampleFormats = 2;
-constexpr const char* kSampleFormatNames[] = {"S16_LE", "S32_LE"};
+constexpr int kUdpPort = 33001;
+// The TCP stream only supports the first two formats.
+constexpr int kNumTcpSampleFormats = 2;
+constexpr int kNumUdpSampleFormats = 3;
+constexpr const char* kSampleFormatNames[] = {"S16_LE", "S32_LE",
+                                              "IMA_ADPCM"};
 enum SampleFormat {
   kS16LE = 0,
   kS32LE = 1,
+  kImaAdpcm = 2,
 };
+constexpr UdpPayloadType kUdpPayloadTypes[] = {UdpPayloadType::kAudioS16,
+                                               UdpPayloadType::kAudioS32,
+                                               UdpPayloadType::kAudioAdpcm};
 
-void ProcessClient(int client_socket) {
-  int32_t params[5];
-  if (ReadArray(client_socket, params, std::size(params)) != IOStatus::kOk) {
-    printf("ERROR: Cannot read params from client socket\r\n");
-    return;
-  }
+// Only one client can use the microphone at a time.
+SemaphoreHandle_t g_audio_mutex;
 
+// Validates the parameters sent by a client and prints the format.
+std::optional<AudioDriverConfig> CheckParams(const int32_t* params,
+                                             int num_sample_formats) {
   const int sample_rate_hz = params[0];
   const int sample_format = params[1];
   const int dma_buffer_size_ms = params[2];
   const int num_dma_buffers = params[3];
-  const int drop_first_samples_ms = params[4];
 
   auto sample_rate = CheckSampleRate(sample_rate_hz);
   if (!sample_rate.has_value()) {
     printf("ERROR: Invalid sample rate (Hz): %d\r\n", sample_rate_hz);
-    return;
+    return std::nullopt;
   }
 
-  if (sample_format < 0 || sample_format >= kNumSampleFormats) {
+  if (sample_format < 0 || sample_format >= num_sample_formats) {
     printf("ERROR: Invalid sample format: %d\r\n", sample_format);
-    return;
+    return std::nullopt;
   }
 
   if (dma_buffer_size_ms <= 0) {
     printf("ERROR: Invalid DMA buffer size (ms): %d\r\n", dma_buffer_size_ms);
-    return;
+    return std::nullopt;
   }
 
   if (num_dma_buffers <= 0) {
     printf("ERROR: Invalid number of DMA buffers: %d\r\n", num_dma_buffers);
-    return;
+    return std::nullopt;
   }
 
-  AudioDriver driver(g_audio_buffers);
   const AudioDriverConfig config{*sample_rate,
                                  static_cast<size_t>(num_dma_buffers),
                                  static_cast<size_t>(dma_buffer_size_ms)};
   if (!g_audio_buffers.CanHandle(config)) {
     printf("ERROR: Not enough static memory for DMA buffers\r\n");
-    return;
+    return std::nullopt;
   }
 
   printf("Format:\r\n");
@@ -103,13 +117,28 @@ void ProcessClient(int client_socket) {
   printf("  Combined DMA buffer size (samples): %d (max %d)\r\n",
          config.num_dma_buffers * config.dma_buffer_size_samples(),
          g_audio_buffers.kCombinedDmaBufferSize);
-  printf("Sending audio samples...\r\n");
+  return config;
+}
+
+void ProcessClient(int client_socket) {
+  int32_t params[5];
+  if (ReadArray(client_socket, params, std::size(params)) != IOStatus::kOk) {
+    printf("ERROR: Cannot read params from client socket\r\n");
+    return;
+  }
+  auto config = CheckParams(params, kNumTcpSampleFormats);
+  if (!config.has_value()) return;
+  const int sample_format = params[1];
+  const int drop_first_samples_ms = params[4];
 
-  AudioReader reader(&driver, config);
+  MutexLock lock(g_audio_mutex);
+  printf("Sending audio samples...\r\n");
+  AudioDriver driver(g_audio_buffers);
+  AudioReader reader(&driver, *config);
   const auto& buffer32 = reader.Buffer();
 
   const int num_dropped_samples =
-      reader.Drop(MsToSamples(*sample_rate, drop_first_samples_ms));
+      reader.Drop(MsToSamples(config->sample_rate, drop_first_samples_ms));
 
   int total_bytes = 0;
   if (sample_format == kS32LE) {
@@ -137,11 +166,66 @@ void ProcessClient(int client_socket) {
   printf("Done.\r\n\r\n");
 }
 
+// Streams audio as UDP packets for as long as the client keeps sending its
+// request.
+void ProcessUdpClient(UdpStreamer* streamer, const int32_t* params) {
+  auto config = CheckParams(params, kNumUdpSampleFormats);
+  if (!config.has_value()) return;
+  const auto type = kUdpPayloadTypes[params[1]];
+  const int drop_first_samples_ms = params[4];
+
+  MutexLock lock(g_audio_mutex);
+  printf("Sending audio packets...\r\n");
+  AudioDriver driver(g_audio_buffers);
+  AudioReader reader(&driver, *config);
+  const auto& buffer32 = reader.Buffer();
+  reader.Drop(MsToSamples(config->sample_rate, drop_first_samples_ms));
+
+  streamer->Reset();
+  while (streamer->HasClient()) {
+    auto size = reader.FillBuffer();
+    streamer->SendAudio(buffer32.data(), size, type);
+  }
+
+  const auto stats = streamer->GetStats();
+  printf("Packets sent: %lu\r\n",
+         static_cast<unsigned long>(stats.packets_sent));
+  printf("Packets dropped: %lu\r\n",
+         static_cast<unsigned long>(stats.packets_dropped));
+  printf("Ring buffer overflows: %d\r\n", reader.OverflowCount());
+  printf("Done.\r\n\r\n");
+}
+
+void UdpServerTask(void* param) {
+  (void)param;
+  UdpStreamer streamer;
+  if (!streamer.Listen(kUdpPort)) {
+    printf("ERROR: Cannot start UDP server.\r\n");
+    vTaskSuspend(nullptr);
+  }
+
+  while (true) {
+    int32_t params[5];
+    if (streamer.ReceiveRequest(params, sizeof(params)) !=
+        static_cast<int>(sizeof(params)))
+      continue;
+    printf("INFO: UDP client connected.\r\n");
+    ProcessUdpClient(&streamer, params);
+    printf("INFO: UDP client disconnected.\r\n");
+  }
+}
+
 [[noreturn]] void Main() {
   printf("Audio Streaming Example!\r\n");
   // Turn on Status LED to show the board is on.
   LedSet(Led::kStatus, true);
 
+  g_audio_mutex = xSemaphoreCreateMutex();
+  CHECK(g_audio_mutex);
+  CHECK(xTaskCreate(UdpServerTask, "udp_audio_server",
+                    configMINIMAL_STACK_SIZE * 10, nullptr, kAppTaskPriority,
+                    nullptr) == pdPASS);
+
   const int server_socket = SocketServer(kPort, 5);
   if (server_socket == -1) {
     printf("ERROR: Cannot start server.\r\n");
@@ -0,0 +1,304 @@
+# Copyright 2022 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import argparse
+import collections
+import os
+import socket
+import struct
+import sys
+import threading
+
+from audio_client import FORMATS, PLAYERS, SAMPLE_FORMATS, Null, SampleFormat
+
+"""
+Receives audio packets from the audio_server running on the connected
+Dev Board Micro over UDP, and receives JPEG frames from any app that streams
+them with `coralmicro::UdpStreamer`.
+
+First load audio_server onto the Dev Board Micro:
+
+    python3 scripts/flashtool.py -b build -e audio_streaming
+
+Then start this client on your computer:
+
+    python3 examples/audio_streaming/udp_client.py
+
+Unlike audio_client.py, lost packets are never retransmitted, so the stream
+stays live on a lossy link. Packets are reordered within a jitter buffer, and
+lost audio packets are replaced with silence or with the previous packet.
+"""
+
+HEADER = struct.Struct('<BBHIIIHH')
+VERSION = 1
+AUDIO_S16, AUDIO_S32, AUDIO_ADPCM, JPEG = range(4)
+
+ADPCM = SampleFormat(name='IMA_ADPCM', id=2, bytes=2, ffplay='s16le')
+UDP_SAMPLE_FORMATS = dict(SAMPLE_FORMATS, IMA_ADPCM=ADPCM)
+
+ADPCM_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+    230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+    963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+    3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767]
+ADPCM_INDEX_CHANGES = [-1, -1, -1, -1, 2, 4, 6, 8] * 2
+
+
+def adpcm_decode(payload, sample_count):
+  """Decodes an IMA ADPCM payload to 16-bit little-endian samples."""
+  predictor, index = struct.unpack_from('<hB', payload)
+  samples = []
+  for i in range(sample_count):
+    code = payload[4 + i // 2] >> (4 * (i % 2)) & 0xF
+    step = ADPCM_STEPS[index]
+    delta = step >> 3
+    if code & 4:
+      delta += step
+    if code & 2:
+      delta += step >> 1
+    if code & 1:
+      delta += step >> 2
+    predictor += -delta if code & 8 else delta
+    predictor = max(-32768, min(32767, predictor))
+    index = max(0, min(len(ADPCM_STEPS) - 1, index + ADPCM_INDEX_CHANGES[code]))
+    samples.append(predictor)
+  return struct.pack('<%dh' % sample_count, *samples)
+
+
+class JitterBuffer:
+  """Reorders audio packets by timestamp and hides lost packets.
+
+  A missing packet is waited for until packets `jitter_samples` later arrived,
+  then it is replaced by silence or by the previous packet. Packets arriving
+  after that are dropped as late.
+  """
+
+  def __init__(self, sample_bytes, jitter_samples, concealment):
+    self._sample_bytes = sample_bytes
+    self._jitter_samples = jitter_samples
+    self._concealment = concealment
+    self._packets = {}
+    self._next = None
+    self._last = b''
+    self.late = 0
+    self.concealed_samples = 0
+
+  def push(self, timestamp, samples):
+    """Adds a packet and returns the samples that are ready to play."""
+    if self._next is None:
+      self._next = timestamp
+    if timestamp < self._next:
+      self.late += 1
+      return b''
+    self._packets[timestamp] = samples
+
+    out = bytearray()
+    while self._packets:
+      if self._next in self._packets:
+        samples = self._packets.pop(self._next)
+        out += samples
+        self._last = samples
+        self._next += len(samples) // self._sample_bytes
+        continue
+      newest = max(self._packets)
+      if newest - self._next < self._jitter_samples:
+        break
+      oldest = min(self._packets)
+      out += self._conceal(oldest - self._next)
+      self._next = oldest
+    return bytes(out)
+
+  def _conceal(self, count):
+    self.concealed_samples += count
+    size = count * self._sample_bytes
+    if self._concealment == 'repeat' and self._last:
+      return (self._last * (size // len(self._last) + 1))[:size]
+    return bytes(size)
+
+
+class FrameAssembler:
+  """Collects the fragments of JPEG frames and drops incomplete frames."""
+
+  def __init__(self):
+    self._frames = collections.OrderedDict()
+    self._latest = -1
+    self.complete = 0
+    self.incomplete = 0
+
+  def push(self, frame, fragment, fragment_count, payload):
+    """Adds a fragment and returns the JPEG frame once it is complete."""
+    if frame <= self._latest:
+      return None
+    fragments = self._frames.setdefault(frame, [None] * fragment_count)
+    fragments[fragment] = payload
+    if any(f is None for f in fragments):
+      return None
+    # Older frames can't complete in time anymore.
+    for older in [f for f in self._frames if f < frame]:
+      del self._frames[older]
+      self.incomplete += 1
+    del self._frames[frame]
+    self._latest = frame
+    self.complete += 1
+    return b''.join(fragments)
+
+
+def send_requests(sock, address, request, stop):
+  """Sends the request every second, which keeps the stream alive."""
+  while not stop.is_set():
+    sock.sendto(request, address)
+    stop.wait(1.0)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      formatter_class=argparse.ArgumentDefaultsHelpFormatter,
+      description='Play or/and save audio streamed over UDP from the '
+      'Dev Board Micro mic')
+  parser.add_argument('--host', type=str, default='10.10.10.1',
+                      help='host to connect')
+  parser.add_argument('--port', type=int, default=33001,
+                      help='UDP port to connect')
+  parser.add_argument('--sample_rate_hz', '-sr', type=int,
+                      default=48000, choices=(16000, 48000),
+                      help='audio sample rate in Hz')
+  parser.add_argument('--sample_format', '-sf', type=UDP_SAMPLE_FORMATS.get,
+                      default='S16_LE', choices=UDP_SAMPLE_FORMATS.values(),
+                      metavar='{%s}' % ','.join(UDP_SAMPLE_FORMATS.keys()),
+                      help='audio sample format, IMA_ADPCM is decoded to '
+                      'S16_LE')
+  parser.add_argument('--num_dma_buffers', '-n', type=int, default=2,
+                      metavar='N', help='number of DMA buffers')
+  parser.add_argument('--dma_buffer_size_ms', '-b', type=int, default=50,
+                      metavar='MS',
+                      help='size of each DMA buffer in ms')
+  parser.add_argument('--drop_first_samples_ms', '-d', type=int, default=0,
+                      metavar='MS',
+                      help='do not send first audio samples to avoid clicks')
+  parser.add_argument('--jitter_ms', '-j', type=int, default=100,
+                      metavar='MS',
+                      help='how long to wait for late packets')
+  parser.add_argument('--concealment', '-c', default='silence',
+                      choices=('silence', 'repeat'),
+                      help='what replaces lost audio packets')
+  parser.add_argument('--player', '-p', type=str,
+                      default='callback' if 'callback' in PLAYERS else 'none',
+                      choices=PLAYERS.keys(),
+                      help='audio player type')
+  parser.add_argument('--format', '-f', default='wav', choices=FORMATS.keys(),
+                      help='audio file format')
+  parser.add_argument('--output', '-o', type=str, default='output.wav',
+                      metavar='FILENAME',
+                      help='record audio to file')
+  parser.add_argument('--jpeg_dir', type=str, default=None,
+                      metavar='DIR',
+                      help='save received JPEG frames to this directory')
+  args = parser.parse_args()
+
+  # IMA ADPCM is decoded to 16-bit samples before playing and saving.
+  out_format = SAMPLE_FORMATS['S16_LE'] if args.sample_format is ADPCM \
+      else args.sample_format
+  sample_bytes = out_format.bytes
+  jitter = JitterBuffer(sample_bytes,
+                        args.sample_rate_hz * args.jitter_ms // 1000,
+                        args.concealment)
+  frames = FrameAssembler()
+  if args.jpeg_dir:
+    os.makedirs(args.jpeg_dir, exist_ok=True)
+
+  sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+  sock.settimeout(10)
+  request = struct.pack('<iiiii', args.sample_rate_hz,
+                        args.sample_format.id,
+                        args.dma_buffer_size_ms,
+                        args.num_dma_buffers,
+                        args.drop_first_samples_ms)
+  stop = threading.Event()
+  sender = threading.Thread(target=send_requests,
+                            args=(sock, (args.host, args.port), request, stop),
+                            daemon=True)
+  sender.start()
+
+  received = 0
+  lost = 0
+  next_sequence = None
+  Player = PLAYERS[args.player]
+  FileWriter = FORMATS[args.format] if args.output else Null
+  try:
+    with FileWriter(filename=args.output,
+                    sample_format=out_format,
+                    sample_rate_hz=args.sample_rate_hz) as write, \
+        Player(sample_format=out_format,
+               sample_rate_hz=args.sample_rate_hz,
+               frames_per_callback_ms=max(args.dma_buffer_size_ms, 50)) as play:
+
+      print(f'Recording audio to {args.output}...')
+      print('Press CTRL+C to quit.')
+      while True:
+        try:
+          packet = sock.recv(65536)
+        except socket.timeout:
+          print('No packets for 10 seconds, make sure you specify the '
+                'correct IP address with --host.', file=sys.stderr)
+          break
+        if len(packet) < HEADER.size:
+          continue
+        (version, payload_type, sample_count, sequence, timestamp, frame,
+         fragment, fragment_count) = HEADER.unpack_from(packet)
+        if version != VERSION:
+          continue
+        payload = packet[HEADER.size:]
+
+        received += 1
+        if next_sequence is None or sequence >= next_sequence:
+          if next_sequence is not None:
+            lost += sequence - next_sequence
+          next_sequence = sequence + 1
+        else:
+          lost -= 1  # Reordered, counted as lost before.
+
+        if payload_type == JPEG:
+          jpeg = frames.push(frame, fragment, fragment_count, payload)
+          if jpeg and args.jpeg_dir:
+            path = os.path.join(args.jpeg_dir, 'frame_%06d.jpg' % frame)
+            with open(path, 'wb') as f:
+              f.write(jpeg)
+          continue
+
+        if payload_type == AUDIO_ADPCM:
+          payload = adpcm_decode(payload, sample_count)
+        elif payload_type not in (AUDIO_S16, AUDIO_S32):
+          continue
+        samples = jitter.push(timestamp, payload)
+        if samples:
+          play(samples)
+          write(samples)
+  except KeyboardInterrupt:
+    pass
+  finally:
+    stop.set()
+    print('Packets received:', received)
+    print('Packets lost:', lost)
+    print('Late packets:', jitter.late)
+    print('Concealed samples:', jitter.concealed_samples)
+    if frames.complete or frames.incomplete:
+      print('JPEG frames received:', frames.complete)
+      print('JPEG frames incomplete:', frames.incomplete)
+
+
+if __name__ == '__main__':
+  main()
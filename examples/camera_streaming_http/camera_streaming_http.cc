@@ -13,10 +13,12 @@
 // limitations under the License.
 
 #include <cstdio>
+#include <utility>
 #include <vector>
 
 #include "libs/base/http_server.h"
 #include "libs/base/led.h"
+#include "libs/base/mjpeg_streamer.h"
 #include "libs/base/strings.h"
 #include "libs/base/utils.h"
 #include "libs/camera/camera.h"
@@ -39,11 +41,19 @@ namespace {
 
 constexpr char kIndexFileName[] = "/coral_micro_camera.html";
 constexpr char kCameraStreamUrlPrefix[] = "/camera_stream";
+constexpr char kCameraMjpegUrl[] = "/camera_mjpeg";
+// Frame-rate cap for each client of the MJPEG stream.
+constexpr int kMaxClientFps = 15;
+constexpr int kJpegQuality = 75;
+
+MjpegStreamer* g_mjpeg_streamer = nullptr;
 
 HttpServer::Content UriHandler(const char* uri) {
   if (StrEndsWith(uri, "index.shtml") ||
       StrEndsWith(uri, "coral_micro_camera.html")) {
     return std::string(kIndexFileName);
+  } else if (StrEndsWith(uri, kCameraMjpegUrl)) {
+    return g_mjpeg_streamer->Stream();
   } else if (StrEndsWith(uri, kCameraStreamUrlPrefix)) {
     // [start-snippet:jpeg]
     std::vector<uint8_t> buf(CameraTask::kWidth * CameraTask::kHeight *
@@ -60,13 +70,41 @@ HttpServer::Content UriHandler(const char* uri) {
     }
 
     std::vector<uint8_t> jpeg;
-    JpegCompressRgb(buf.data(), fmt.width, fmt.height, /*quality=*/75, &jpeg);
+    JpegCompressRgb(buf.data(), fmt.width, fmt.height, kJpegQuality, &jpeg);
     // [end-snippet:jpeg]
     return jpeg;
   }
   return {};
 }
 
+// Captures frames for the MJPEG stream while any client is connected. The RGB
+// buffer, the JPEG encoder and the JPEG buffers are reused for every frame.
+[[noreturn]] void StreamFrames(MjpegStreamer* streamer) {
+  JpegEncoder encoder;
+  std::vector<uint8_t> rgb(CameraTask::kWidth * CameraTask::kHeight *
+                           CameraFormatBpp(CameraFormat::kRgb));
+  auto fmt = CameraFrameFormat{
+      CameraFormat::kRgb,       CameraFilterMethod::kBilinear,
+      CameraRotation::k0,       CameraTask::kWidth,
+      CameraTask::kHeight,
+      /*preserve_ratio=*/false, rgb.data(),
+      /*while_balance=*/true};
+  while (true) {
+    if (!streamer->HasClients()) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+    if (!CameraTask::GetSingleton()->GetFrame({fmt})) {
+      printf("Unable to get frame from camera\r\n");
+      continue;
+    }
+    auto jpeg = streamer->AcquireFrame();
+    encoder.Encode(rgb.data(), fmt.width, fmt.height, JpegPixelFormat::kRgb,
+                   kJpegQuality, jpeg.get());
+    streamer->PublishFrame(std::move(jpeg));
+  }
+}
+
 void Main() {
   printf("Camera HTTP Example!\r\n");
   // Turn on Status LED to show the board is on.
@@ -110,11 +148,14 @@ void Main() {
   }
 #endif  // defined(CAMERA_STREAMING_HTTP_ETHERNET)
 
+  MjpegStreamer mjpeg_streamer(kMaxClientFps);
+  g_mjpeg_streamer = &mjpeg_streamer;
+
   HttpServer http_server;
   http_server.AddUriHandler(UriHandler);
   UseHttpServer(&http_server);
 
-  vTaskSuspend(nullptr);
+  StreamFrames(&mjpeg_streamer);
 }
 }  // namespace
 }  // namespace coralmicro
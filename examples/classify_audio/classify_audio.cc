@@ -97,7 +97,7 @@ void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> yamnet_tflite;
-  if (!LfsReadFile(kModelName, &yamnet_tflite)) {
+  if (!LfsReadCompressedFile(kModelName, &yamnet_tflite)) {
     printf("Failed to load model\r\n");
     vTaskSuspend(nullptr);
   }
@@ -153,7 +153,7 @@ void ClassifyConsole(tflite::MicroInterpreter* interpreter) {
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> model;
-  if (!LfsReadFile(kModelPath.c_str(), &model)) {
+  if (!LfsReadCompressedFile(kModelPath.c_str(), &model)) {
     printf("ERROR: Failed to load %s\r\n", kModelPath.c_str());
     vTaskSuspend(nullptr);
   }
@@ -87,7 +87,7 @@ void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
 [[noreturn]] void Main() {
   printf("Keyword Detector!!!\r\n");
   std::vector<uint8_t> keyword_tflite;
-  if (!LfsReadFile(kModelName, &keyword_tflite)) {
+  if (!LfsReadCompressedFile(kModelName, &keyword_tflite)) {
     printf("Failed to load model\r\n");
     vTaskSuspend(nullptr);
   }
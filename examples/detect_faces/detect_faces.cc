@@ -52,7 +52,7 @@ STATIC_TENSOR_ARENA_IN_SDRAM(tensor_arena, kTensorArenaSize);
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> model;
-  if (!LfsReadFile(kModelPath, &model)) {
+  if (!LfsReadCompressedFile(kModelPath, &model)) {
     printf("ERROR: Failed to load %s\r\n", kModelPath);
     vTaskSuspend(nullptr);
   }
@@ -151,7 +151,7 @@ void DetectConsole(tflite::MicroInterpreter* interpreter) {
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> model;
-  if (!LfsReadFile(kModelPath, &model)) {
+  if (!LfsReadCompressedFile(kModelPath, &model)) {
     printf("ERROR: Failed to load %s\r\n", kModelPath);
     vTaskSuspend(nullptr);
   }
@@ -49,7 +49,7 @@ void Main() {
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> model;
-  if (!LfsReadFile(kModelPath, &model)) {
+  if (!LfsReadCompressedFile(kModelPath, &model)) {
     printf("ERROR: Failed to load %s\r\n", kModelPath);
     return;
   }
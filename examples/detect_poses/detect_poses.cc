@@ -59,7 +59,7 @@ void Main() {
   }
   // Reads the model and checks version.
   std::vector<uint8_t> posenet_tflite;
-  if (!LfsReadFile(kModelPath, &posenet_tflite)) {
+  if (!LfsReadCompressedFile(kModelPath, &posenet_tflite)) {
     TF_LITE_REPORT_ERROR(&error_reporter, "Failed to load model!");
     vTaskSuspend(nullptr);
   }
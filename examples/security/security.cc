@@ -77,24 +77,20 @@ void Main() {
     vTaskSuspend(nullptr);
   }
 
-  // Get the sha256 and ecc signature for this model file.
-  std::vector<uint8_t> model;
+  // Get the sha256 and ecc signature for this model file. The file is hashed
+  // in chunks on the M7, so it can be any size, and only the 32-byte hash is
+  // sent to the A71.
   constexpr char kModelPath[] = "/models/testconv1-edgetpu.tflite";
-  if (!coralmicro::LfsReadFile(kModelPath, &model)) {
+  coralmicro::Sha256Digest digest;
+  if (!coralmicro::LfsSha256File(kModelPath, &digest)) {
     printf("%s missing\r\n", kModelPath);
     vTaskSuspend(nullptr);
   }
-  auto maybe_sha = coralmicro::A71ChGetSha256(model);
-  if (maybe_sha.has_value()) {
-    printf("testconv1-edgetpu.tflite sha: %s\r\n",
-           coralmicro::StrToHex(maybe_sha.value()).c_str());
-  } else {
-    printf("failed to generate sha256 for testconv1-edgetpu.tflite\r\n");
-    vTaskSuspend(nullptr);
-  }
+  const std::string sha(digest.begin(), digest.end());
+  printf("testconv1-edgetpu.tflite sha: %s\r\n",
+         coralmicro::StrToHex(sha).c_str());
 
   // Get signature for this model with the key public key in index 0.
-  const auto& sha = maybe_sha.value();
   auto maybe_signature = coralmicro::A71ChGetEccSignature(kKeyIdx, sha);
   if (maybe_signature.has_value()) {
     printf("Signature: %s\r\n",
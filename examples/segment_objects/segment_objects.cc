@@ -18,6 +18,7 @@
 #include "libs/base/led.h"
 #include "libs/camera/camera.h"
 #include "libs/rpc/rpc_http_server.h"
+#include "libs/rpc/rpc_utils.h"
 #include "libs/tensorflow/utils.h"
 #include "libs/tpu/edgetpu_manager.h"
 #include "libs/tpu/edgetpu_op.h"
@@ -104,10 +105,12 @@ void SegmentFromCamera(struct jsonrpc_request* r) {
   const auto& output_tensor = interpreter->output_tensor(0);
   const auto& output_mask = tflite::GetTensorData<uint8_t>(output_tensor);
   const auto mask_size = tensorflow::TensorSize(output_tensor);
-  jsonrpc_return_success(r, "{%Q: %d, %Q: %d, %Q: %V, %Q: %V}", "width",
+  std::vector<uint8_t> mask(output_mask, output_mask + mask_size);
+  // Over /binrpc, the image and mask are sent as raw blobs.
+  jsonrpc_return_success(r, "{%Q: %d, %Q: %d, %Q: %M, %Q: %M}", "width",
                          model_width, "height", model_height, "base64_data",
-                         image.size(), image.data(), "output_mask", mask_size,
-                         output_mask);
+                         JsonRpcPrintBlob, r, &image, "output_mask",
+                         JsonRpcPrintBlob, r, &mask);
 }
 
 void Main() {
@@ -116,7 +119,7 @@ void Main() {
   LedSet(Led::kStatus, true);
 
   std::vector<uint8_t> model;
-  if (!LfsReadFile(kModelPath, &model)) {
+  if (!LfsReadCompressedFile(kModelPath, &model)) {
     printf("ERROR: Failed to load %s\r\n", kModelPath);
     return;
   }
@@ -15,8 +15,10 @@
 
 import argparse
 import base64
+import json
 import numpy as np
 import requests
+import struct
 import sys
 
 from PIL import Image
@@ -34,6 +36,9 @@ Then start this client on your connected Linux computer:
     python3 -m pip install examples/segment_objects/requirements.txt
     python3 examples/segment_objects/segment_objects_client.py
 
+Pass --binary to fetch the image and mask as raw blobs over the /binrpc
+transport instead of base64 strings over /jsonrpc.
+
 You should see the image result appear in a new window.
 
 When using the default model (keras_post_training_unet_mv2_128_quant_edgetpu.tflite),
@@ -85,6 +90,48 @@ def label_to_color_image(label):
   return colormap[label]
 
 
+def binary_rpc(host, method, timeout=10):
+  """Calls a JSON-RPC method over the binary /binrpc transport.
+
+  Each message is a little-endian uint32 JSON size, the JSON envelope, a uint32
+  blob count, then each blob as a uint32 size followed by its bytes. Any
+  {"blob": N} object in the response is replaced by the bytes of blob N.
+  """
+  envelope = json.dumps({'method': method, 'jsonrpc': '2.0', 'id': 0}).encode()
+  body = struct.pack('<I', len(envelope)) + envelope + struct.pack('<I', 0)
+  data = requests.post(f'http://{host}:80/binrpc', data=body,
+                       timeout=timeout).content
+
+  offset = 0
+
+  def take(size):
+    nonlocal offset
+    if offset + size > len(data):
+      raise ValueError('Truncated binary RPC response')
+    chunk = data[offset:offset + size]
+    offset += size
+    return chunk
+
+  (json_size,) = struct.unpack('<I', take(4))
+  response = json.loads(take(json_size))
+  (blob_count,) = struct.unpack('<I', take(4))
+  blobs = []
+  for _ in range(blob_count):
+    (blob_size,) = struct.unpack('<I', take(4))
+    blobs.append(take(blob_size))
+
+  def resolve(value):
+    if isinstance(value, dict):
+      if len(value) == 1 and isinstance(value.get('blob'), int):
+        return blobs[value['blob']]
+      return {k: resolve(v) for k, v in value.items()}
+    if isinstance(value, list):
+      return [resolve(v) for v in value]
+    return value
+
+  return resolve(response)
+
+
 def get_field_or_die(data, field_name):
   if field_name not in data:
     print(f'Unable to parse {field_name} from data: {data}\r\n')
@@ -98,14 +145,19 @@ def main():
       formatter_class=argparse.ArgumentDefaultsHelpFormatter)
   parser.add_argument('--host', type=str, default='10.10.10.1',
                       help='Hostname or IP Address of Coral Dev Board Micro')
+  parser.add_argument('--binary', action='store_true',
+                      help='Receive raw image and mask bytes over /binrpc')
   args = parser.parse_args()
 
   # Send RPC request
-  response = requests.post(f'http://{args.host}:80/jsonrpc', json={
-      'method': 'segment_from_camera',
-      'jsonrpc': '2.0',
-      'id': 0,
-  }, timeout=10).json()
+  if args.binary:
+    response = binary_rpc(args.host, 'segment_from_camera')
+  else:
+    response = requests.post(f'http://{args.host}:80/jsonrpc', json={
+        'method': 'segment_from_camera',
+        'jsonrpc': '2.0',
+        'id': 0,
+    }, timeout=10).json()
 
   # Get the image size
   result = get_field_or_die(response, 'result')
@@ -113,13 +165,13 @@ def main():
   height = get_field_or_die(result, 'height')
 
   # Decode the image and mask data
-  image_data_base64 = get_field_or_die(result, 'base64_data')
-  image_data = base64.b64decode(image_data_base64)
+  image_data = get_field_or_die(result, 'base64_data')
+  mask_data = get_field_or_die(result, 'output_mask')
+  if not args.binary:
+    image_data = base64.b64decode(image_data)
+    mask_data = base64.b64decode(mask_data)
   im = Image.frombytes('RGB', (width, height), image_data, 'raw')
 
-  mask_data_base64 = get_field_or_die(result, 'output_mask')
-  mask_data = base64.b64decode(mask_data_base64)
-
   num_classes = len(mask_data) / (width * height)
 
   predicted_mask = np.frombuffer(
@@ -116,7 +116,7 @@ void Main() {
 
   // Reads the model and checks version.
   std::vector<uint8_t> bodypix_tflite;
-  if (!LfsReadFile(kModelPath, &bodypix_tflite)) {
+  if (!LfsReadCompressedFile(kModelPath, &bodypix_tflite)) {
     TF_LITE_REPORT_ERROR(&error_reporter, "Failed to load model!");
     vTaskSuspend(nullptr);
   }
@@ -57,8 +57,8 @@ void setup() {
 
   // Map the model into a usable data structure. This doesn't involve any
   // copying or parsing, it's a very lightweight operation.
-  if (!coralmicro::LfsReadFile("/models/person_detect_model.tflite",
-                               &g_person_detect_model_data_fs)) {
+  if (!coralmicro::LfsReadCompressedFile("/models/person_detect_model.tflite",
+                                         &g_person_detect_model_data_fs)) {
     printf("Failed to read model\r\n");
     return;
   }
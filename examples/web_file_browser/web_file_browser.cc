@@ -154,18 +154,23 @@ class FileHttpServer : public HttpServer {
                       LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT) < 0)
       return ERR_ARG;
 
-    files_[connection] = {std::move(file), std::move(dirname)};
+    // Network packets carry much less than a flash page, so they are
+    // collected into whole blocks, written while the next ones arrive.
+    auto writer = std::make_unique<LfsBufferedWriter>(
+        file.get(), kLfsBlockSize, /*background=*/true);
+    files_[connection] = {std::move(file), std::move(writer), std::move(path),
+                          std::move(dirname), content_len};
     return ERR_OK;
   }
 
   err_t PostReceiveData(void* connection, struct pbuf* p) override {
-    auto* file = files_[connection].file.get();
+    auto* writer = files_[connection].writer.get();
 
-    struct pbuf* cp = p;
-    while (cp) {
-      if (lfs_file_write(Lfs(), file, cp->payload, cp->len) != cp->len)
+    for (struct pbuf* cp = p; cp; cp = cp->next) {
+      if (!writer->Write(cp->payload, cp->len)) {
+        pbuf_free(p);
         return ERR_ARG;
-      cp = p->next;
+      }
     }
 
     pbuf_free(p);
@@ -174,17 +179,32 @@ class FileHttpServer : public HttpServer {
 
   void PostFinished(void* connection, char* response_uri,
                     u16_t response_uri_len) override {
-    const auto& entry = files_[connection];
-    lfs_file_close(Lfs(), entry.file.get());
-    snprintf(response_uri, response_uri_len, "%s%s", kUrlPrefix,
-             entry.dirname.c_str() + 1);
+    auto& entry = files_[connection];
+    // This is also called when the upload failed or the connection closed
+    // early, so the file is only reported as stored if all of it was written.
+    bool ok = entry.writer->Flush();
+    ok = ok && (entry.content_len < 0 ||
+                entry.writer->stats().bytes ==
+                    static_cast<uint32_t>(entry.content_len));
+    entry.writer.reset();
+    ok = lfs_file_close(Lfs(), entry.file.get()) >= 0 && ok;
+    // Leaving `response_uri` untouched answers with an error.
+    if (ok) {
+      snprintf(response_uri, response_uri_len, "%s%s", kUrlPrefix,
+               entry.dirname.c_str() + 1);
+    } else {
+      printf("Failed to write %s\r\n", entry.path.c_str());
+    }
     files_.erase(connection);
   }
 
  private:
   struct Entry {
     std::unique_ptr<lfs_file_t> file;
+    std::unique_ptr<LfsBufferedWriter> writer;
+    std::string path;
     std::string dirname;
+    int content_len;
   };
   std::map<void*, Entry> files_;  // connection-to-entry map
 };
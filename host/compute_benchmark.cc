@@ -0,0 +1,424 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput and heap use of the compute kernels that run on the
+// M7, built natively for the development machine (see CMakeLists.txt).
+//
+// Inputs come from models/ (with synthetic fallbacks), so runs are comparable
+// between changes. Absolute numbers don't transfer to the board, but relative changes
+// to a kernel mostly do.
+//
+// Flags:
+//   --data_dir=PATH    Root of the coralmicro tree (default: the source tree).
+//   --min_time=SECONDS Minimum run time of each benchmark (default: 0.5).
+//   --filter=TEXT      Only run benchmarks whose name contains TEXT.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "libs/base/crc32.h"
+#include "libs/base/lz4.h"
+#include "libs/base/sha256.h"
+#include "libs/camera/image_utils.h"
+#include "libs/tensorflow/posenet_decoder.h"
+
+#if CORALMICRO_HOST_HAVE_LIBJPEG
+#include "libs/libjpeg/jpeg.h"
+#endif
+
+namespace {
+// Counts every C++ heap allocation, so allocations per iteration can be
+// reported next to the timings. Allocations made with malloc() directly (such
+// as libjpeg's) are not counted.
+size_t g_allocations = 0;
+size_t g_allocated_bytes = 0;
+}  // namespace
+
+void* operator new(size_t size) {
+  ++g_allocations;
+  g_allocated_bytes += size;
+  void* ptr = std::malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace coralmicro {
+namespace {
+constexpr int kWidth = 324;
+constexpr int kHeight = 324;
+constexpr int kResizedWidth = 224;
+constexpr int kResizedHeight = 224;
+constexpr int kJpegQuality = 75;
+
+constexpr char kRgbImagePath[] = "models/posenet_test_input_324.bin";
+constexpr char kModelPath[] =
+    "models/posenet_mobilenet_v1_075_324_324_16_quant_decoder_edgetpu.tflite";
+
+// Output size of the 324x324 PoseNet/BodyPix models (stride 16).
+constexpr int kPoseStride = 16;
+constexpr int kPoseHeight = (kHeight - 1) / kPoseStride + 1;
+constexpr int kPoseWidth = (kWidth - 1) / kPoseStride + 1;
+constexpr int kPoseMaxDetections = 10;
+constexpr int kPosePeople = 3;
+
+struct Options {
+  std::string data_dir = CORALMICRO_SOURCE_DIR;
+  double min_time = 0.5;
+  std::string filter;
+};
+
+Options g_options;
+
+std::vector<uint8_t> ReadFile(const std::string& path) {
+  std::ifstream file(g_options.data_dir + "/" + path, std::ios::binary);
+  if (!file) return {};
+  return {std::istreambuf_iterator<char>(file),
+          std::istreambuf_iterator<char>()};
+}
+
+// Runs `fn` repeatedly for at least `--min_time` seconds and prints the time,
+// throughput (over `bytes` processed per call) and allocations per call.
+void Run(const char* name, size_t bytes, const std::function<void()>& fn) {
+  if (!g_options.filter.empty() &&
+      std::strstr(name, g_options.filter.c_str()) == nullptr)
+    return;
+
+  using Clock = std::chrono::steady_clock;
+  fn();  // Warm up caches and any lazily initialized state.
+
+  const size_t allocations = g_allocations;
+  const size_t allocated_bytes = g_allocated_bytes;
+  const auto start = Clock::now();
+  long iterations = 0;
+  double elapsed;
+  do {
+    fn();
+    ++iterations;
+    elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+  } while (elapsed < g_options.min_time);
+
+  const double us = elapsed * 1e6 / iterations;
+  std::printf("%-36s %10.1f %10.1f %10.1f %12.0f\n", name, us,
+              bytes / us, static_cast<double>(g_allocations - allocations) /
+                              iterations,
+              static_cast<double>(g_allocated_bytes - allocated_bytes) /
+                  iterations);
+}
+
+// Fixed-seed generator, so synthetic inputs are identical on every host.
+class Random {
+ public:
+  float Uniform(float min, float max) {
+    state_ = state_ * 1664525u + 1013904223u;
+    return min + (max - min) * static_cast<float>(state_ >> 8) / (1 << 24);
+  }
+
+ private:
+  uint32_t state_ = 1;
+};
+
+// Loads the 324x324 RGB test image, falling back to a gradient when the
+// models/ directory is not available.
+std::vector<uint8_t> LoadRgbImage() {
+  std::vector<uint8_t> rgb = ReadFile(kRgbImagePath);
+  if (rgb.size() == static_cast<size_t>(kWidth * kHeight * 3)) return rgb;
+
+  std::printf("%s not found, using a gradient\n", kRgbImagePath);
+  rgb.resize(kWidth * kHeight * 3);
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x) {
+      uint8_t* pixel = &rgb[(y * kWidth + x) * 3];
+      pixel[0] = x * 255 / kWidth;
+      pixel[1] = y * 255 / kHeight;
+      pixel[2] = (x + y) * 255 / (kWidth + kHeight);
+    }
+  }
+  return rgb;
+}
+
+// Samples an RGB image into the camera's BGGR Bayer pattern, to stand in for a
+// raw frame.
+std::vector<uint8_t> MosaicBggr(const std::vector<uint8_t>& rgb) {
+  std::vector<uint8_t> raw(kWidth * kHeight);
+  for (int y = 0; y < kHeight; ++y) {
+    for (int x = 0; x < kWidth; ++x) {
+      int channel;
+      if ((y & 1) == 0) {
+        channel = (x & 1) == 0 ? 2 : 1;
+      } else {
+        channel = (x & 1) == 0 ? 1 : 0;
+      }
+      raw[y * kWidth + x] = rgb[(y * kWidth + x) * 3 + channel];
+    }
+  }
+  return raw;
+}
+
+// Compresses `data` into a single LZ4 block with a greedy single-probe match
+// finder. It only needs to produce valid input for `Lz4DecompressBlock()`.
+std::vector<uint8_t> Lz4CompressBlock(const std::vector<uint8_t>& data) {
+  constexpr int kHashBits = 16;
+  constexpr size_t kMinMatch = 4;
+  // The format requires the last match to start at least 12 bytes before the
+  // end of the block and the last 5 bytes to be literals.
+  constexpr size_t kMatchStartMargin = 12;
+  constexpr size_t kLastLiterals = 5;
+
+  std::vector<uint8_t> out;
+  out.reserve(Lz4CompressBound(data.size()));
+  auto write_length = [&out](size_t len) {
+    for (; len >= 255; len -= 255) out.push_back(255);
+    out.push_back(static_cast<uint8_t>(len));
+  };
+  auto write_sequence = [&](size_t literals, size_t literal_len,
+                            size_t match_len, size_t offset) {
+    const size_t match_code = match_len ? match_len - kMinMatch : 0;
+    out.push_back(static_cast<uint8_t>(
+        ((literal_len < 15 ? literal_len : 15) << 4) |
+        (match_code < 15 ? match_code : 15)));
+    if (literal_len >= 15) write_length(literal_len - 15);
+    out.insert(out.end(), data.begin() + literals,
+               data.begin() + literals + literal_len);
+    if (!match_len) return;
+    out.push_back(offset & 0xFF);
+    out.push_back(offset >> 8);
+    if (match_code >= 15) write_length(match_code - 15);
+  };
+
+  std::vector<int64_t> table(1 << kHashBits, -1);
+  const size_t size = data.size();
+  size_t anchor = 0;
+  size_t i = 0;
+  while (size >= kMatchStartMargin && i < size - kMatchStartMargin) {
+    uint32_t sequence;
+    std::memcpy(&sequence, &data[i], sizeof(sequence));
+    const uint32_t hash = (sequence * 2654435761u) >> (32 - kHashBits);
+    const int64_t candidate = table[hash];
+    table[hash] = i;
+    if (candidate < 0 || i - candidate > 0xFFFF ||
+        std::memcmp(&data[candidate], &data[i], kMinMatch) != 0) {
+      ++i;
+      continue;
+    }
+    size_t match_len = kMinMatch;
+    while (i + match_len < size - kLastLiterals &&
+           data[candidate + match_len] == data[i + match_len])
+      ++match_len;
+    write_sequence(anchor, i - anchor, match_len, i - candidate);
+    i += match_len;
+    anchor = i;
+  }
+  write_sequence(anchor, size - anchor, 0, 0);
+  return out;
+}
+
+void BenchmarkCamera() {
+  const std::vector<uint8_t> rgb = LoadRgbImage();
+  const std::vector<uint8_t> raw = MosaicBggr(rgb);
+  std::vector<uint8_t> out_rgb(kWidth * kHeight * 3);
+  std::vector<uint8_t> out_gray(kWidth * kHeight);
+  std::vector<uint8_t> out_resized(kResizedWidth * kResizedHeight * 3);
+
+  Run("camera/BayerToRgb/bilinear", raw.size(), [&] {
+    BayerToRgb(raw.data(), out_rgb.data(), kWidth, kHeight,
+               CameraFilterMethod::kBilinear, CameraRotation::k0);
+  });
+  Run("camera/BayerToRgb/bilinear/k270", raw.size(), [&] {
+    BayerToRgb(raw.data(), out_rgb.data(), kWidth, kHeight,
+               CameraFilterMethod::kBilinear, CameraRotation::k270);
+  });
+  Run("camera/BayerToRgb/nearest", raw.size(), [&] {
+    BayerToRgb(raw.data(), out_rgb.data(), kWidth, kHeight,
+               CameraFilterMethod::kNearestNeighbor, CameraRotation::k0);
+  });
+  Run("camera/BayerToRgbRow/bilinear", raw.size(), [&] {
+    for (int y = 0; y < kHeight; ++y) {
+      BayerToRgbRow(raw.data(), kWidth, kHeight, y,
+                    CameraFilterMethod::kBilinear, &out_rgb[y * kWidth * 3]);
+    }
+  });
+  Run("camera/BayerToGrayscale/bilinear", raw.size(), [&] {
+    BayerToGrayscale(raw.data(), out_gray.data(), kWidth, kHeight,
+                     CameraFilterMethod::kBilinear, CameraRotation::k0);
+  });
+  Run("camera/AutoWhiteBalance", rgb.size(), [&] {
+    std::memcpy(out_rgb.data(), rgb.data(), rgb.size());
+    AutoWhiteBalance(out_rgb.data(), kWidth, kHeight);
+  });
+  Run("camera/ResizeNearestNeighbor", rgb.size(), [&] {
+    ResizeNearestNeighbor(rgb.data(), kWidth, kHeight, out_resized.data(),
+                          kResizedWidth, kResizedHeight, 3, true);
+  });
+  Run("camera/RgbToGrayscale", rgb.size(), [&] {
+    RgbToGrayscale(rgb.data(), out_gray.data(), kWidth, kHeight);
+  });
+}
+
+void BenchmarkPosenet() {
+  using posenet_decoder_op::kNumEdges;
+  using posenet_decoder_op::kNumKeypoints;
+  constexpr int kCells = kPoseHeight * kPoseWidth;
+
+  // Low scores everywhere, except for a few people whose keypoints are
+  // scattered around a center, so decoding has poses to follow.
+  Random random;
+  std::vector<float> scores(kCells * kNumKeypoints);
+  for (float& score : scores) score = random.Uniform(-8.0f, -4.0f);
+  for (int person = 0; person < kPosePeople; ++person) {
+    const float cy = random.Uniform(4, kPoseHeight - 4);
+    const float cx = random.Uniform(4, kPoseWidth - 4);
+    for (int k = 0; k < kNumKeypoints; ++k) {
+      const int y = static_cast<int>(cy + random.Uniform(-3, 3));
+      const int x = static_cast<int>(cx + random.Uniform(-3, 3));
+      scores[(y * kPoseWidth + x) * kNumKeypoints + k] =
+          random.Uniform(1.0f, 4.0f);
+    }
+  }
+  std::vector<float> short_offsets(kCells * 2 * kNumKeypoints);
+  for (float& offset : short_offsets) offset = random.Uniform(-0.5f, 0.5f);
+  std::vector<float> mid_offsets(kCells * 2 * 2 * kNumEdges);
+  for (float& offset : mid_offsets) offset = random.Uniform(-2.0f, 2.0f);
+  std::vector<float> long_offsets(kCells * 2 * kNumKeypoints);
+  for (float& offset : long_offsets) offset = random.Uniform(-4.0f, 4.0f);
+
+  std::vector<posenet_decoder_op::PoseKeypoints> poses(kPoseMaxDetections);
+  std::vector<posenet_decoder_op::PoseKeypointScores> keypoint_scores(
+      kPoseMaxDetections);
+  std::vector<float> pose_scores(kPoseMaxDetections);
+  int num_poses = 0;
+  auto decode = [&] {
+    num_poses = posenet_decoder_op::DecodeAllPoses(
+        scores.data(), short_offsets.data(), mid_offsets.data(), kPoseHeight,
+        kPoseWidth, kPoseMaxDetections, /*score_threshold=*/0.5f,
+        /*mid_short_offset_refinement_steps=*/5,
+        /*nms_radius=*/10.0f / kPoseStride, kPoseStride, poses.data(),
+        keypoint_scores.data(), pose_scores.data());
+  };
+  Run("posenet/DecodeAllPoses", scores.size() * sizeof(float), decode);
+
+  decode();
+  std::vector<float> masks(kCells * kPoseMaxDetections);
+  Run("posenet/DecodeInstanceMasks", long_offsets.size() * sizeof(float), [&] {
+    posenet_decoder_op::DecodeInstanceMasks(
+        long_offsets.data(), kPoseHeight, kPoseWidth, poses.data(), num_poses,
+        /*refinement_steps=*/2, kPoseStride, masks.data());
+  });
+}
+
+void BenchmarkChecksums() {
+  const std::vector<uint8_t> model = ReadFile(kModelPath);
+  if (model.empty()) {
+    std::printf("%s not found, skipping the checksum benchmarks\n",
+                kModelPath);
+    return;
+  }
+
+  Run("base/Crc32", model.size(),
+      [&model] { Crc32(model.data(), model.size()); });
+  Run("base/Sha256", model.size(),
+      [&model] { Sha256Hash(model.data(), model.size()); });
+
+  const std::vector<uint8_t> compressed = Lz4CompressBlock(model);
+  std::vector<uint8_t> decompressed(model.size());
+  int decompressed_size = 0;
+  Run("base/Lz4DecompressBlock", model.size(), [&] {
+    decompressed_size =
+        Lz4DecompressBlock(compressed.data(), compressed.size(),
+                           decompressed.data(), decompressed.size());
+  });
+  if (decompressed_size != static_cast<int>(model.size()) ||
+      decompressed != model) {
+    std::printf("base/Lz4DecompressBlock: round trip mismatch\n");
+    std::exit(EXIT_FAILURE);
+  }
+}
+
+#if CORALMICRO_HOST_HAVE_LIBJPEG
+void BenchmarkJpeg() {
+  std::vector<uint8_t> rgb = LoadRgbImage();
+  const std::vector<uint8_t> raw = MosaicBggr(rgb);
+  std::vector<uint8_t> out;
+
+  Run("jpeg/JpegCompressRgb", rgb.size(), [&] {
+    JpegCompressRgb(rgb.data(), kWidth, kHeight, kJpegQuality, &out);
+  });
+
+  JpegEncoder encoder;
+  Run("jpeg/JpegEncoder/rgb", rgb.size(), [&] {
+    encoder.Encode(rgb.data(), kWidth, kHeight, JpegPixelFormat::kRgb,
+                   kJpegQuality, &out);
+  });
+  Run("jpeg/JpegEncoder/bayer_rows", raw.size(), [&] {
+    encoder.Encode(kWidth, kHeight, JpegPixelFormat::kRgb, kJpegQuality,
+                   [&raw](int y, uint8_t* row) {
+                     BayerToRgbRow(raw.data(), kWidth, kHeight, y,
+                                   CameraFilterMethod::kBilinear, row);
+                   },
+                   &out);
+  });
+}
+#endif  // CORALMICRO_HOST_HAVE_LIBJPEG
+
+bool ParseFlags(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    auto value = [&arg](const char* flag) -> const char* {
+      const size_t len = std::strlen(flag);
+      if (arg.compare(0, len, flag) != 0) return nullptr;
+      return arg.c_str() + len;
+    };
+    if (const char* v = value("--data_dir=")) {
+      g_options.data_dir = v;
+    } else if (const char* v = value("--min_time=")) {
+      g_options.min_time = std::atof(v);
+    } else if (const char* v = value("--filter=")) {
+      g_options.filter = v;
+    } else {
+      std::fprintf(stderr, "Unknown flag: %s\n", arg.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+}  // namespace
+}  // namespace coralmicro
+
+int main(int argc, char** argv) {
+  if (!coralmicro::ParseFlags(argc, argv)) return EXIT_FAILURE;
+
+  std::printf("%-36s %10s %10s %10s %12s\n", "benchmark", "us/iter", "MB/s",
+              "allocs", "alloc bytes");
+  coralmicro::BenchmarkCamera();
+  coralmicro::BenchmarkPosenet();
+  coralmicro::BenchmarkChecksums();
+#if CORALMICRO_HOST_HAVE_LIBJPEG
+  coralmicro::BenchmarkJpeg();
+#endif
+  return EXIT_SUCCESS;
+}
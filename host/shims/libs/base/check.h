@@ -0,0 +1,36 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host replacement for libs/base/check.h. It keeps the same include guard so
+// that only one of the two can ever be seen, and aborts instead of writing to
+// the board's console and suspending the scheduler.
+
+#ifndef LIBS_BASE_CHECK_H_
+#define LIBS_BASE_CHECK_H_
+
+#include <cstdio>
+#include <cstdlib>
+
+#define CHECK(a)                                                          \
+  do {                                                                    \
+    if (!(a)) {                                                           \
+      std::fprintf(stderr, "%s:%d %s was not true.\n", __FILE__, __LINE__, \
+                   #a);                                                   \
+      std::abort();                                                       \
+    }                                                                     \
+  } while (0)
+
+#endif  // LIBS_BASE_CHECK_H_
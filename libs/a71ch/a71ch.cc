@@ -16,6 +16,8 @@
 
 #include "libs/a71ch/a71ch.h"
 
+#include <limits>
+
 #include "libs/base/gpio.h"
 #include "third_party/a71ch-crypto-support/hostlib/hostLib/inc/a71ch_api.h"
 #include "third_party/a71ch-crypto-support/sss/ex/inc/ex_sss_boot.h"
@@ -88,6 +90,7 @@ std::optional<std::string> A71ChGetSha256(uint8_t* data, uint16_t data_len) {
 }
 
 std::optional<std::string> A71ChGetSha256(const std::vector<uint8_t>& data) {
+  if (data.size() > std::numeric_limits<uint16_t>::max()) return std::nullopt;
   return A71ChGetSha256(const_cast<uint8_t*>(data.data()), data.size());
 }
 
@@ -52,17 +52,23 @@ std::optional<std::string> A71ChGetRandomBytes(uint8_t num_bytes);
 // retrieve.
 std::optional<std::string> A71ChGetEccPublicKey(uint8_t key_idx);
 
-// Gets the sha256 hash for a buffer of data.
+// Gets the sha256 hash for a buffer of data, computed by the A71.
+//
+// The data is sent to the A71 over I2C, so this is slow and limited to 64 KB.
+// To hash files or larger buffers, use `LfsSha256File()` or `Sha256` (from
+// `libs/base/`), which run on the M7, and use the A71 only to sign or verify
+// the resulting hash.
 //
 // @param data The buffer to the raw data to generate the hash.
 // @param data_len The length of the data buffer.
 // @return The sha256 hash for data or std::nullopt on failure.
 std::optional<std::string> A71ChGetSha256(uint8_t* data, uint16_t data_len);
 
-// Gets the sha256 hash for a vector of data.
+// Gets the sha256 hash for a vector of data, computed by the A71.
 //
-// @param data The raw data to generate the hash.
-// @return The sha256 hash for data or std::nullopt on failure.
+// @param data The raw data to generate the hash, up to 64 KB.
+// @return The sha256 hash for data or std::nullopt on failure (including if
+// data is too large).
 std::optional<std::string> A71ChGetSha256(const std::vector<uint8_t>& data);
 
 // Gets the Elliptical Curve signature for a hash.
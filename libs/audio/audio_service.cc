@@ -19,9 +19,20 @@
 #include <memory>
 
 #include "libs/base/check.h"
+#include "libs/base/metrics.h"
 
 namespace coralmicro {
 namespace {
+Counter g_overflows("coralmicro_audio_overflows_total",
+                    "DMA buffers of audio samples dropped because the ring "
+                    "buffer was full.");
+Counter g_underflows("coralmicro_audio_underflows_total",
+                     "Audio reads that timed out before a full buffer of "
+                     "samples arrived.");
+Histogram g_callbacks_latency(
+    "coralmicro_audio_callbacks_microseconds",
+    "Time spent in AudioService callbacks for each buffer of samples.");
+
 enum class MessageType : uint8_t {
   kAddCallback,
   kRemoveCallback,
@@ -76,7 +87,10 @@ AudioReader::~AudioReader() { driver_->Disable(); }
 size_t AudioReader::FillBuffer() {
   auto received_size = ring_buffer_.Receive(
       buffer_.data(), buffer_.size(), pdMS_TO_TICKS(2 * dma_buffer_size_ms_));
-  if (received_size != buffer_.size()) ++underflow_count_;
+  if (received_size != buffer_.size()) {
+    ++underflow_count_;
+    g_underflows.Increment();
+  }
   return received_size;
 }
 
@@ -85,7 +99,10 @@ void AudioReader::Callback(void* ctx, const int32_t* buf, size_t size) {
   auto* self = static_cast<AudioReader*>(ctx);
   auto sent_size =
       self->ring_buffer_.SendFromISR(buf, size, &xHigherPriorityTaskWoken);
-  if (size != sent_size) ++self->overflow_count_;
+  if (size != sent_size) {
+    ++self->overflow_count_;
+    g_overflows.Increment();
+  }
   portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
@@ -192,9 +209,12 @@ void AudioService::Run() const {
     auto size = reader->FillBuffer();
 
     callbacks_to_remove.clear();
-    for (const auto& cb : callbacks)
-      if (!cb.fn(cb.ctx, reader->Buffer().data(), size))
-        callbacks_to_remove.push_back(cb.id);
+    {
+      HistogramTimer timer(&g_callbacks_latency);
+      for (const auto& cb : callbacks)
+        if (!cb.fn(cb.ctx, reader->Buffer().data(), size))
+          callbacks_to_remove.push_back(cb.id);
+    }
 
     for (int id : callbacks_to_remove) EraseCallbackById(callbacks, id);
 
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_CRC32_H_
+#define LIBS_BASE_CRC32_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coralmicro {
+
+// Updates a running CRC-32 (IEEE 802.3, same as zlib's `crc32()`) with more
+// data.
+//
+// Pass 0 as `crc` to start a new checksum, and the previously returned value to
+// continue it, so data can be checksummed in chunks as it is streamed.
+//
+// @param crc The CRC-32 of the data seen so far, or 0 to start.
+// @param data The data to add to the checksum.
+// @param size The size of `data` in bytes.
+// @returns The CRC-32 of all data seen so far.
+uint32_t Crc32Update(uint32_t crc, const void* data, size_t size);
+
+// Computes the CRC-32 (IEEE 802.3) of a memory buffer.
+//
+// @param data The data to checksum.
+// @param size The size of `data` in bytes.
+// @returns The CRC-32 of the data.
+inline uint32_t Crc32(const void* data, size_t size) {
+  return Crc32Update(0, data, size);
+}
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_CRC32_H_
@@ -21,10 +21,20 @@
 #include <cstring>
 #include <memory>
 
+#include "libs/base/crc32.h"
+#include "libs/base/lz4.h"
+#include "libs/base/tasks.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/queue.h"
 #include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/freertos_kernel/include/task.h"
 #include "third_party/nxp/rt1176-sdk/components/flash/nand/fsl_nand_flash.h"
 
+#if CORAL_MICRO_CAAM_SHA256 && (__CORTEX_M == 7)
+#include "libs/base/mutex.h"
+#include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_caam.h"
+#endif
+
 extern "C" nand_handle_t* BOARD_GetNANDHandle(void);
 
 namespace coralmicro {
@@ -35,13 +45,59 @@ SemaphoreHandle_t g_lfs_mutex;
 
 constexpr int kPagesPerBlock = 64;
 constexpr int kFilesystemBaseBlock = 12;
-constexpr lfs_size_t kPageSize = 2048;
+constexpr lfs_size_t kPageSize = kLfsPageSize;
+
+// Layout of files written by scripts/compress_file.py. All fields are
+// little-endian. The header is followed by blocks, each prefixed with a
+// uint32_t holding the stored size; if kStoredBlockFlag is set the block is
+// kept uncompressed, otherwise it is a raw LZ4 block.
+constexpr char kCompressedMagic[4] = {'C', 'M', 'Z', '1'};
+constexpr uint32_t kStoredBlockFlag = 0x80000000;
+constexpr uint32_t kMaxCompressedBlockSize = 1024 * 1024;
+// An LZ4 block can't expand its input by more than this factor, which bounds
+// the uncompressed size that a header may claim for a file of a given size.
+constexpr size_t kMaxLz4Ratio = 255;
+
+struct CompressedHeader {
+  char magic[4];
+  uint32_t size;
+  uint32_t block_size;
+  uint32_t crc32;
+} __attribute__((packed));
+
+// Full buffers of all background `LfsBufferedWriter`s are written by one task,
+// which is started the first time it is needed. Each writer has at most one
+// buffer in flight, so this is the number of writers that never block on the
+// queue itself.
+constexpr int kFlushQueueLength = 4;
+QueueHandle_t g_flush_queue;
+// Guards starting the task. Unlike `g_lfs_mutex`, it is never replaced by
+// `LfsInit()`.
+SemaphoreHandle_t g_flush_task_mutex;
+
+// Size of the chunks read by `LfsSha256File()`. Whole pages are read by
+// littlefs straight into the caller's buffer, bypassing its page cache.
+constexpr size_t kHashChunkSize = 4 * kPageSize;
+
+#if CORAL_MICRO_CAAM_SHA256 && (__CORTEX_M == 7)
+// The CAAM reads its input and context with DMA, so they are kept in
+// non-cacheable memory, shared by all callers under `g_caam_mutex`.
+SemaphoreHandle_t g_caam_mutex;
+AT_NONCACHEABLE_SECTION_ALIGN(caam_hash_ctx_t g_caam_ctx, 16);
+AT_NONCACHEABLE_SECTION_ALIGN(uint8_t g_caam_chunk[kPageSize], 16);
+AT_NONCACHEABLE_SECTION_ALIGN(uint8_t g_caam_digest[kSha256DigestSize], 16);
+#endif
 
 struct AutoClose {
   lfs_file_t* file;
   ~AutoClose() { lfs_file_close(&g_lfs, file); }
 };
 
+bool ReadExactly(lfs_file_t* file, void* buffer, size_t size) {
+  auto n = lfs_file_read(&g_lfs, file, buffer, size);
+  return n >= 0 && static_cast<size_t>(n) == size;
+}
+
 int LfsRead(const struct lfs_config* c, lfs_block_t block, lfs_off_t off,
             void* buffer, lfs_size_t size) {
   nand_handle_t* nand = BOARD_GetNANDHandle();
@@ -104,6 +160,33 @@ int LfsUnlock(const struct lfs_config* c) {
   if (xSemaphoreGive(g_lfs_mutex) != pdTRUE) return -1;
   return 0;
 }
+
+#if CORAL_MICRO_CAAM_SHA256 && (__CORTEX_M == 7)
+bool CaamSha256File(lfs_file_t* file, Sha256Digest* digest) {
+  MutexLock lock(g_caam_mutex);
+  caam_handle_t handle;
+  // Job ring 0 is used by `RandomGenerate()`.
+  handle.jobRing = kCAAM_JobRing1;
+  if (CAAM_HASH_Init(CAAM, &handle, &g_caam_ctx, kCAAM_Sha256, nullptr, 0) !=
+      kStatus_Success)
+    return false;
+
+  while (true) {
+    auto n = lfs_file_read(&g_lfs, file, g_caam_chunk, sizeof(g_caam_chunk));
+    if (n < 0) return false;
+    if (n == 0) break;
+    if (CAAM_HASH_Update(&g_caam_ctx, g_caam_chunk, n) != kStatus_Success)
+      return false;
+  }
+
+  size_t size = sizeof(g_caam_digest);
+  if (CAAM_HASH_Finish(&g_caam_ctx, g_caam_digest, &size) != kStatus_Success ||
+      size != digest->size())
+    return false;
+  std::memcpy(digest->data(), g_caam_digest, size);
+  return true;
+}
+#endif
 }  // namespace
 
 lfs_t* Lfs() { return &g_lfs; }
@@ -113,6 +196,13 @@ bool LfsInit(bool force_format) {
 
   g_lfs_mutex = xSemaphoreCreateMutex();
   if (!g_lfs_mutex) return false;
+  if (!g_flush_task_mutex) g_flush_task_mutex = xSemaphoreCreateMutex();
+  if (!g_flush_task_mutex) return false;
+
+#if CORAL_MICRO_CAAM_SHA256 && (__CORTEX_M == 7)
+  if (!g_caam_mutex) g_caam_mutex = xSemaphoreCreateMutex();
+  if (!g_caam_mutex) return false;
+#endif
 
   std::memset(&g_lfs_config, 0, sizeof(g_lfs_config));
   g_lfs_config.read = LfsRead;
@@ -123,7 +213,7 @@ bool LfsInit(bool force_format) {
   g_lfs_config.unlock = LfsUnlock;
   g_lfs_config.read_size = kPageSize;
   g_lfs_config.prog_size = kPageSize;
-  g_lfs_config.block_size = 131072;
+  g_lfs_config.block_size = kLfsBlockSize;
   g_lfs_config.block_count = 512;
   g_lfs_config.block_cycles = 250;
   g_lfs_config.cache_size = kPageSize;
@@ -271,6 +361,93 @@ size_t LfsReadFile(const char* path, uint8_t* buf, size_t size) {
   return 0;
 }
 
+bool LfsReadCompressedFile(const char* path, std::vector<uint8_t>* buf) {
+  lfs_file_t file;
+  if (lfs_file_open(&g_lfs, &file, path, LFS_O_RDONLY) < 0) return false;
+  AutoClose close{&file};
+
+  auto file_size = lfs_file_size(&g_lfs, &file);
+  if (file_size < 0) return false;
+
+  CompressedHeader header;
+  if (static_cast<size_t>(file_size) < sizeof(header) ||
+      !ReadExactly(&file, &header, sizeof(header)) ||
+      std::memcmp(header.magic, kCompressedMagic, sizeof(kCompressedMagic)) !=
+          0) {
+    // Not a compressed container, read it as a plain file.
+    if (lfs_file_rewind(&g_lfs, &file) < 0) return false;
+    buf->resize(file_size);
+    return ReadExactly(&file, buf->data(), buf->size());
+  }
+
+  if (header.block_size == 0 || header.block_size > kMaxCompressedBlockSize)
+    return false;
+  // Don't let a truncated or corrupt header make us allocate more than the
+  // file could possibly hold, which would abort instead of failing.
+  const size_t payload_size = file_size - sizeof(header);
+  if (header.size > payload_size * kMaxLz4Ratio) return false;
+
+  buf->resize(header.size);
+  auto scratch_size = Lz4CompressBound(header.block_size);
+  auto scratch = std::make_unique<uint8_t[]>(scratch_size);
+
+  uint32_t crc = 0;
+  size_t offset = 0;
+  while (offset < header.size) {
+    uint32_t block_header;
+    if (!ReadExactly(&file, &block_header, sizeof(block_header)))
+      return false;
+
+    const bool stored = block_header & kStoredBlockFlag;
+    const size_t block_size = block_header & ~kStoredBlockFlag;
+    const size_t remaining = header.size - offset;
+    auto* out = buf->data() + offset;
+
+    size_t out_size;
+    if (stored) {
+      if (block_size > header.block_size || block_size > remaining)
+        return false;
+      // Uncompressed blocks go straight into the destination buffer.
+      if (!ReadExactly(&file, out, block_size)) return false;
+      out_size = block_size;
+    } else {
+      if (block_size > scratch_size) return false;
+      if (!ReadExactly(&file, scratch.get(), block_size)) return false;
+      auto ret = Lz4DecompressBlock(
+          scratch.get(), block_size, out,
+          std::min(remaining, static_cast<size_t>(header.block_size)));
+      if (ret <= 0) return false;
+      out_size = ret;
+    }
+
+    crc = Crc32Update(crc, out, out_size);
+    offset += out_size;
+  }
+
+  return crc == header.crc32;
+}
+
+bool LfsSha256File(const char* path, Sha256Digest* digest) {
+  lfs_file_t file;
+  if (lfs_file_open(&g_lfs, &file, path, LFS_O_RDONLY) < 0) return false;
+  AutoClose close{&file};
+
+#if CORAL_MICRO_CAAM_SHA256 && (__CORTEX_M == 7)
+  return CaamSha256File(&file, digest);
+#else
+  auto chunk = std::make_unique<uint8_t[]>(kHashChunkSize);
+  Sha256 sha;
+  while (true) {
+    auto n = lfs_file_read(&g_lfs, &file, chunk.get(), kHashChunkSize);
+    if (n < 0) return false;
+    if (n == 0) break;
+    sha.Update(chunk.get(), n);
+  }
+  *digest = sha.Finish();
+  return true;
+#endif
+}
+
 bool LfsWriteFile(const char* path, const uint8_t* buf, size_t size) {
   lfs_file_t file;
   if (lfs_file_open(&g_lfs, &file, path,
@@ -286,4 +463,145 @@ bool LfsWriteFile(const char* path, const std::string& str) {
   return LfsWriteFile(path, reinterpret_cast<const uint8_t*>(str.c_str()),
                       str.size());
 }
+
+LfsBufferedWriter::LfsBufferedWriter(lfs_file_t* file, size_t buffer_size,
+                                     bool background)
+    : file_(file),
+      buffer_size_((std::max<size_t>(buffer_size, 1) + kPageSize - 1) /
+                   kPageSize * kPageSize) {
+  buffers_[0].reset(new (std::nothrow) uint8_t[buffer_size_]);
+  if (!buffers_[0] || !background) return;
+
+  // Without a second buffer or the task, full buffers are written in place.
+  buffers_[1].reset(new (std::nothrow) uint8_t[buffer_size_]);
+  flush_done_ = xSemaphoreCreateBinary();
+  background_ = buffers_[1] && flush_done_ && StartFlushTask();
+  if (!background_) buffers_[1].reset();
+}
+
+LfsBufferedWriter::~LfsBufferedWriter() {
+  Flush();
+  if (flush_done_) vSemaphoreDelete(flush_done_);
+}
+
+bool LfsBufferedWriter::Write(const void* data, size_t size) {
+  const auto* p = static_cast<const uint8_t*>(data);
+  ++stats_.writes;
+  stats_.bytes += size;
+  if (!ok_) return false;
+  if (!buffers_[0]) return ok_ = WriteChunk(p, size);
+
+  // Whole buffers are written straight from the caller's memory when nothing
+  // is buffered, saving a copy.
+  if (used_ == 0 && size >= buffer_size_) {
+    if (!WaitForFlush()) return false;
+    const size_t n = size / buffer_size_ * buffer_size_;
+    if (!(ok_ = WriteChunk(p, n))) return false;
+    p += n;
+    size -= n;
+  }
+
+  while (size != 0) {
+    const size_t n = std::min(size, buffer_size_ - used_);
+    std::memcpy(buffers_[active_].get() + used_, p, n);
+    used_ += n;
+    p += n;
+    size -= n;
+    if (used_ == buffer_size_ && !Submit()) return false;
+  }
+  return ok_;
+}
+
+bool LfsBufferedWriter::Flush() {
+  Submit();
+  return WaitForFlush();
+}
+
+bool LfsBufferedWriter::WriteChunk(const uint8_t* data, size_t size) {
+  uint32_t ms;
+  const bool ok = WriteToFile(data, size, &ms);
+  stats_.flush_ms += ms;
+  ++stats_.flushes;
+  return ok;
+}
+
+// Also runs on the background task, so it leaves `stats_` to the caller.
+bool LfsBufferedWriter::WriteToFile(const uint8_t* data, size_t size,
+                                    uint32_t* ms) {
+  const TickType_t start = xTaskGetTickCount();
+  auto n = lfs_file_write(&g_lfs, file_, data, size);
+  *ms = (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+  return n >= 0 && static_cast<size_t>(n) == size;
+}
+
+// Writes the active buffer, or hands it to the background task and switches
+// to the other one.
+bool LfsBufferedWriter::Submit() {
+  if (used_ == 0 || !ok_) {
+    used_ = 0;
+    return ok_;
+  }
+  if (!background_) {
+    ok_ = WriteChunk(buffers_[0].get(), used_);
+    used_ = 0;
+    return ok_;
+  }
+
+  if (!WaitForFlush()) {
+    used_ = 0;
+    return false;
+  }
+  flush_data_ = buffers_[active_].get();
+  flush_size_ = used_;
+  flushing_ = true;
+  LfsBufferedWriter* writer = this;
+  xQueueSend(g_flush_queue, &writer, portMAX_DELAY);
+  active_ ^= 1;
+  used_ = 0;
+  return true;
+}
+
+bool LfsBufferedWriter::WaitForFlush() {
+  if (flushing_) {
+    const TickType_t start = xTaskGetTickCount();
+    xSemaphoreTake(flush_done_, portMAX_DELAY);
+    stats_.wait_ms += (xTaskGetTickCount() - start) * portTICK_PERIOD_MS;
+    stats_.flush_ms += flush_ms_;
+    ++stats_.flushes;
+    flushing_ = false;
+    ok_ = ok_ && flush_ok_;
+  }
+  return ok_;
+}
+
+void LfsBufferedWriter::StaticFlushTaskFn(void* param) {
+  (void)param;
+  while (true) {
+    LfsBufferedWriter* writer;
+    if (xQueueReceive(g_flush_queue, &writer, portMAX_DELAY) != pdTRUE)
+      continue;
+    writer->flush_ok_ = writer->WriteToFile(
+        writer->flush_data_, writer->flush_size_, &writer->flush_ms_);
+    xSemaphoreGive(writer->flush_done_);
+  }
+}
+
+bool LfsBufferedWriter::StartFlushTask() {
+  if (!g_flush_task_mutex) return false;
+  xSemaphoreTake(g_flush_task_mutex, portMAX_DELAY);
+  if (!g_flush_queue) {
+    g_flush_queue = xQueueCreate(kFlushQueueLength, sizeof(LfsBufferedWriter*));
+    if (g_flush_queue &&
+        xTaskCreate(StaticFlushTaskFn, "lfs_flush_task",
+                    configMINIMAL_STACK_SIZE * 10, nullptr,
+                    kLfsFlushTaskPriority, nullptr) != pdPASS) {
+      vQueueDelete(g_flush_queue);
+      g_flush_queue = nullptr;
+    }
+  }
+  const bool started = g_flush_queue != nullptr;
+  xSemaphoreGive(g_flush_task_mutex);
+  return started;
+}
+
 }  // namespace coralmicro
@@ -18,13 +18,23 @@
 #define LIBS_BASE_FILESYSTEM_H_
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "libs/base/sha256.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/nxp/rt1176-sdk/middleware/littlefs/lfs.h"
 
 namespace coralmicro {
 
+// Size of a flash page, the smallest unit littlefs reads and programs.
+inline constexpr size_t kLfsPageSize = 2048;
+
+// Size of a flash erase block.
+inline constexpr size_t kLfsBlockSize = 128 * 1024;
+
 // Returns littlefs instance to use with functions from `lfs.h`.
 //
 // @returns Pointer to littlefs instance.
@@ -86,6 +96,36 @@ bool LfsReadFile(const char* path, std::string* str);
 // @returns Number of read bytes not exceeding `size`.
 size_t LfsReadFile(const char* path, uint8_t* buf, size_t size);
 
+// Reads a file that may be stored as a compressed container and stores the
+// uncompressed content in `std::vector<uint8_t>`.
+//
+// Compressed containers are created on the host with
+// `scripts/compress_file.py` (or `flashtool.py --compress_models`). They are
+// decompressed block by block while being read from flash, so no buffer for
+// the whole compressed file is needed, and the result is checked against the
+// CRC-32 stored in the container. Files that are not compressed containers
+// are read as-is, exactly like `LfsReadFile()`.
+//
+// @param path File path to read.
+// @param buf Instance of `std::vector<uint8_t>` to read data in.
+// @returns True upon success, false otherwise (including a CRC mismatch).
+bool LfsReadCompressedFile(const char* path, std::vector<uint8_t>* buf);
+
+// Computes the SHA-256 digest of a file.
+//
+// The file is read and hashed in chunks, so it can be any size and no buffer
+// for the whole file is needed. The digest can be signed or verified with the
+// A71CH secure element (see `A71ChGetEccSignature()` and `A71ChEccVerify()`).
+//
+// The digest is computed in software by default. If the firmware is built
+// with `-DUSE_CAAM_SHA256=ON`, files are hashed by the M7's CAAM crypto engine
+// instead.
+//
+// @param path File path to hash.
+// @param digest Receives the SHA-256 digest of the file.
+// @returns True upon success, false otherwise.
+bool LfsSha256File(const char* path, Sha256Digest* digest);
+
 // Writes content of the memory buffer to file.
 //
 // @param path File path to write.
@@ -101,6 +141,108 @@ bool LfsWriteFile(const char* path, const uint8_t* buf, size_t size);
 // @returns True upon success, false otherwise.
 bool LfsWriteFile(const char* path, const std::string& str);
 
+// Counters kept by `LfsBufferedWriter`.
+struct LfsWriterStats {
+  // Bytes passed to `LfsBufferedWriter::Write()`.
+  uint32_t bytes;
+  // Calls to `LfsBufferedWriter::Write()`.
+  uint32_t writes;
+  // Chunks written to the file.
+  uint32_t flushes;
+  // Milliseconds spent writing chunks to the file.
+  uint32_t flush_ms;
+  // Milliseconds spent waiting for a background flush to finish.
+  uint32_t wait_ms;
+};
+
+// Collects many small writes to an open file into chunks that are a multiple
+// of the flash page size.
+//
+// Each `lfs_file_write()` call that doesn't cover whole pages goes through
+// the single-page littlefs cache, which is flushed to flash every time it
+// fills. Data that arrives in small fragments (such as network packets or USB
+// transfers) is therefore written much faster through this class, which lets
+// littlefs program whole pages straight from the buffer:
+//
+// ```
+// lfs_file_t file;
+// lfs_file_open(Lfs(), &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+// {
+//   LfsBufferedWriter writer(&file);
+//   while (auto n = Receive(fragment, sizeof(fragment)))
+//     writer.Write(fragment, n);
+// }  // Remaining data is written when the writer goes out of scope.
+// lfs_file_close(Lfs(), &file);
+// ```
+//
+// With `background` set, the writer uses two buffers: while one is written to
+// flash by a shared background task, the next one is filled. The caller then
+// only blocks when data arrives faster than flash can take it, which makes it
+// possible to continuously record audio or camera frames to a file.
+//
+// Don't use the file directly, or from another writer, until `Flush()`
+// returns. The writer doesn't sync or close the file.
+class LfsBufferedWriter {
+ public:
+  // @param file An open file to write to.
+  // @param buffer_size Size of each buffer, rounded up to a multiple of
+  // `kLfsPageSize`. The default of one erase block gives the best throughput.
+  // @param background True to write full buffers from a background task.
+  LfsBufferedWriter(lfs_file_t* file, size_t buffer_size = kLfsBlockSize,
+                    bool background = false);
+  ~LfsBufferedWriter();
+  LfsBufferedWriter(const LfsBufferedWriter&) = delete;
+  LfsBufferedWriter& operator=(const LfsBufferedWriter&) = delete;
+
+  // Appends data to the file.
+  //
+  // If the buffers can't be allocated, data is written to the file directly.
+  //
+  // @param data The data to write.
+  // @param size The size of `data` in bytes.
+  // @returns True upon success, false if this or any earlier write failed.
+  // A failed background flush is reported by the next call.
+  bool Write(const void* data, size_t size);
+
+  // Writes all buffered data to the file and waits for it to be written.
+  //
+  // @returns True if all data so far was written, false otherwise.
+  bool Flush();
+
+  // Gets the counters of the writer. They are only up to date after
+  // `Flush()`.
+  //
+  // @returns The counters of the writer.
+  const LfsWriterStats& stats() const { return stats_; }
+
+ private:
+  static void StaticFlushTaskFn(void* param);
+  static bool StartFlushTask();
+
+  bool WriteChunk(const uint8_t* data, size_t size);
+  bool WriteToFile(const uint8_t* data, size_t size, uint32_t* ms);
+  bool Submit();
+  bool WaitForFlush();
+
+  lfs_file_t* file_;
+  size_t buffer_size_;
+  std::unique_ptr<uint8_t[]> buffers_[2];
+  int active_ = 0;
+  size_t used_ = 0;
+  bool ok_ = true;
+
+  // Handed over to the background task.
+  bool background_ = false;
+  SemaphoreHandle_t flush_done_ = nullptr;
+  bool flushing_ = false;
+  const uint8_t* flush_data_ = nullptr;
+  size_t flush_size_ = 0;
+  bool flush_ok_ = true;
+  uint32_t flush_ms_ = 0;
+
+  LfsWriterStats stats_ = {};
+};
+
 }  // namespace coralmicro
 
 #endif  // LIBS_BASE_FILESYSTEM_H_
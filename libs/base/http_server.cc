@@ -16,20 +16,60 @@
 
 #include "libs/base/http_server.h"
 
+#include <strings.h>
+
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
+#include <list>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "libs/base/crc32.h"
 #include "libs/base/filesystem.h"
+#include "libs/base/metrics.h"
+#include "libs/base/strings.h"
+#include "libs/nxp/rt1176-sdk/lwip_hooks.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/priv/tcp_priv.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/tcp.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/tcpip.h"
 
 namespace coralmicro {
 namespace {
 
 HttpServer* g_server = nullptr;
 
+Counter g_responses("coralmicro_http_responses_total",
+                    "Responses started from HttpServer content.");
+Gauge g_open_responses("coralmicro_http_open_responses",
+                       "Responses from HttpServer content still being sent.");
+Counter g_streamed_bytes(
+    "coralmicro_http_streamed_bytes_total",
+    "Bytes read from files and generators served by HttpServer.");
+Counter g_not_modified("coralmicro_http_not_modified_total",
+                       "File responses answered with 304 Not Modified.");
+Counter g_partial_responses("coralmicro_http_partial_responses_total",
+                            "File responses answered with a byte range.");
+Counter g_file_cache_hits("coralmicro_http_file_cache_hits_total",
+                          "File responses served from the RAM cache.");
+
 constexpr uintptr_t kTagVector = 0b01;
 constexpr uintptr_t kTagFileHolder = 0b10;
+constexpr uintptr_t kTagGenerator = 0b11;
 constexpr uintptr_t kTagMask = 0b11;
 
+// Every chunk is framed as "XXXXXXXX\r\n<data>\r\n". The chunk size is
+// written with a fixed number of hex digits so that the data can be generated
+// in place, before its size is known.
+constexpr size_t kChunkSizeDigits = 8;
+constexpr size_t kChunkHeaderSize = kChunkSizeDigits + 2;
+constexpr size_t kChunkOverhead = kChunkHeaderSize + 2;
+constexpr size_t kMinChunkSize = 256;
+constexpr char kLastChunk[] = "0\r\n\r\n";
+
 template <uintptr_t Tag, typename T>
 void* TaggedPointer(T* p) {
   assert((reinterpret_cast<uintptr_t>(p) & kTagMask) == 0);
@@ -46,17 +86,571 @@ T* Pointer(void* p) {
 struct FileHolder {
   lfs_file_t file;
   bool opened = false;
-
-  ~FileHolder() {
+  // The response headers, sent before the body.
+  std::string headers;
+  size_t headers_offset = 0;
+  // The whole file, if it is served from memory rather than from `file`.
+  std::shared_ptr<const std::vector<uint8_t>> data;
+  // Range of the file sent as the body.
+  size_t offset = 0;
+  size_t end = 0;
+
+  void Close() {
     if (opened) lfs_file_close(Lfs(), &file);
+    opened = false;
   }
+
+  ~FileHolder() { Close(); }
+};
+
+// lwIP's httpd doesn't pass the request headers on to custom files. Instead,
+// each TCP segment sent to the server is observed right before httpd parses
+// it, and the request line found there is saved for that connection. While
+// httpd parses the segment, `tcp_input_pcb` is the connection that sent it,
+// so only its saved request is matched with the URI that httpd opens, and it
+// is forgotten once a file was opened for it. Both run on the lwIP TCP/IP
+// thread. Requests whose headers don't fit in one segment, or that httpd only
+// parses later, are answered as if they had no conditional or range headers,
+// which HTTP allows.
+constexpr char kGetMethod[] = "GET ";
+constexpr size_t kMaxRequestSize = 1024;
+// Requests of connections that closed before httpd opened a file for them
+// are dropped, oldest first, to bound the memory use.
+constexpr size_t kMaxRequests = 4;
+
+struct ObservedRequest {
+  struct tcp_pcb* pcb;
+  std::string request;
 };
+std::list<ObservedRequest> g_requests;
+
+auto FindRequest(const struct tcp_pcb* pcb) {
+  return std::find_if(
+      g_requests.begin(), g_requests.end(),
+      [pcb](const ObservedRequest& request) { return request.pcb == pcb; });
+}
+
+void ForgetRequest(const struct tcp_pcb* pcb) {
+  auto it = FindRequest(pcb);
+  if (it != g_requests.end()) g_requests.erase(it);
+}
+
+void ObserveTcpInput(struct tcp_pcb* pcb, const struct pbuf* p) {
+  if (pcb->local_port != HTTPD_SERVER_PORT) return;
+  ForgetRequest(pcb);
+  if (pbuf_memcmp(p, 0, kGetMethod, StrLen(kGetMethod)) != 0) return;
+  if (g_requests.size() >= kMaxRequests) g_requests.pop_front();
+  std::string request(std::min<size_t>(p->tot_len, kMaxRequestSize), '\0');
+  pbuf_copy_partial(p, request.data(), request.size(), 0);
+  g_requests.push_back({pcb, std::move(request)});
+}
+
+// Returns the headers of the request for `uri` that the connection being
+// parsed sent, starting with the CRLF that ends the request line, or nullptr
+// if they aren't known.
+const char* RequestHeaders(const char* uri) {
+  if (!tcp_input_pcb) return nullptr;
+  auto it = FindRequest(tcp_input_pcb);
+  if (it == g_requests.end()) return nullptr;
+  const char* request = it->request.c_str();
+  if (!StrStartsWith(request, kGetMethod)) return nullptr;
+  const char* target = request + StrLen(kGetMethod);
+  const size_t size = std::strcspn(target, " ?\r\n");
+  if (std::strncmp(uri, target, size) != 0) return nullptr;
+  // httpd opens an index file for a target that ends with '/'.
+  const bool index = size > 0 && target[size - 1] == '/' &&
+                     std::strchr(uri + size, '/') == nullptr;
+  if (uri[size] != '\0' && !index) return nullptr;
+
+  const char* headers = std::strstr(target, "\r\n");
+  if (!headers || !std::strstr(headers, "\r\n\r\n")) return nullptr;
+  return headers;
+}
+
+// Returns the value of a header, or an empty string if it is missing.
+std::string RequestHeader(const char* headers, const char* name) {
+  const size_t name_size = std::strlen(name);
+  const char* line = headers + 2;
+  while (const char* line_end = std::strstr(line, "\r\n")) {
+    if (line == line_end) break;
+    if (strncasecmp(line, name, name_size) == 0 && line[name_size] == ':') {
+      auto is_space = [](char c) { return c == ' ' || c == '\t'; };
+      const char* value = line + name_size + 1;
+      while (value < line_end && is_space(*value)) ++value;
+      const char* value_end = line_end;
+      while (value_end > value && is_space(value_end[-1])) --value_end;
+      return std::string(value, value_end);
+    }
+    line = line_end + 2;
+  }
+  return {};
+}
+
+// Returns whether the value of an If-None-Match header matches `etag`.
+bool EtagMatches(const std::string& etags, const std::string& etag) {
+  size_t begin = 0;
+  while (begin < etags.size()) {
+    size_t end = std::min(etags.find(',', begin), etags.size());
+    auto token = etags.substr(begin, end - begin);
+    token.erase(0, token.find_first_not_of(" \t"));
+    token.erase(token.find_last_not_of(" \t") + 1);
+    if (token == "*") return true;
+    if (token.compare(0, 2, "W/") == 0) token.erase(0, 2);
+    if (token == etag) return true;
+    begin = end + 1;
+  }
+  return false;
+}
+
+enum class Range {
+  kNone,           // No valid single byte range, the whole file is sent.
+  kSatisfiable,    // A part of the file is sent.
+  kUnsatisfiable,  // The range is outside of the file.
+};
+
+// Parses the value of a Range header for a file of `size` bytes into the
+// range [*begin, *end). Only a single byte range is supported.
+Range ParseRange(const std::string& value, size_t size, size_t* begin,
+                 size_t* end) {
+  constexpr char kBytes[] = "bytes=";
+  if (value.compare(0, StrLen(kBytes), kBytes) != 0 ||
+      value.find(',') != std::string::npos)
+    return Range::kNone;
+  const char* first = value.c_str() + StrLen(kBytes);
+  char* rest;
+
+  // The last bytes of the file.
+  if (*first == '-') {
+    const size_t count = std::strtoul(first + 1, &rest, 10);
+    if (rest == first + 1 || *rest != '\0') return Range::kNone;
+    if (count == 0 || size == 0) return Range::kUnsatisfiable;
+    *begin = size - std::min(count, size);
+    *end = size;
+    return Range::kSatisfiable;
+  }
+
+  const size_t first_byte = std::strtoul(first, &rest, 10);
+  if (rest == first || *rest != '-') return Range::kNone;
+  const char* last = rest + 1;
+  size_t last_byte = std::numeric_limits<size_t>::max();
+  if (*last != '\0') {
+    last_byte = std::strtoul(last, &rest, 10);
+    if (rest == last || *rest != '\0' || last_byte < first_byte)
+      return Range::kNone;
+  }
+  if (first_byte >= size) return Range::kUnsatisfiable;
+  *begin = first_byte;
+  *end = std::min(last_byte, size - 1) + 1;
+  return Range::kSatisfiable;
+}
+
+const char* ContentType(const std::string& path) {
+  static constexpr struct {
+    const char* extension;
+    const char* type;
+  } kContentTypes[] = {
+      {"html", "text/html"},        {"htm", "text/html"},
+      {"shtml", "text/html"},       {"css", "text/css"},
+      {"js", "application/javascript"},
+      {"json", "application/json"}, {"txt", "text/plain"},
+      {"xml", "text/xml"},          {"svg", "image/svg+xml"},
+      {"png", "image/png"},         {"jpg", "image/jpeg"},
+      {"jpeg", "image/jpeg"},       {"gif", "image/gif"},
+      {"bmp", "image/bmp"},         {"ico", "image/x-icon"},
+      {"wav", "audio/wav"},         {"pdf", "application/pdf"},
+  };
+  auto dot = path.rfind('.');
+  if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+    return "application/octet-stream";
+  for (const auto& content_type : kContentTypes) {
+    if (strcasecmp(path.c_str() + dot + 1, content_type.extension) == 0)
+      return content_type.type;
+  }
+  return "application/octet-stream";
+}
+
+// Small files are kept in memory after they are read, as long as their size
+// and generation (the first block of their data, which littlefs changes
+// whenever the file is written) stay the same. Only accessed from the lwIP
+// TCP/IP thread.
+constexpr size_t kMaxCachedFileSize = 16 * 1024;
+constexpr size_t kFileCacheCapacity = 64 * 1024;
+
+struct CachedFile {
+  std::string path;
+  size_t size;
+  uint32_t generation;
+  std::shared_ptr<const std::vector<uint8_t>> data;
+};
+std::list<CachedFile> g_file_cache;  // Most recently used first.
+size_t g_file_cache_size = 0;
+
+std::shared_ptr<const std::vector<uint8_t>> LookUpCachedFile(
+    const std::string& path, size_t size, uint32_t generation) {
+  auto it = std::find_if(
+      g_file_cache.begin(), g_file_cache.end(),
+      [&path](const CachedFile& cached) { return cached.path == path; });
+  if (it == g_file_cache.end()) return nullptr;
+  if (it->size != size || it->generation != generation) {
+    g_file_cache_size -= it->size;
+    g_file_cache.erase(it);
+    return nullptr;
+  }
+  g_file_cache.splice(g_file_cache.begin(), g_file_cache, it);
+  return it->data;
+}
+
+void CacheFile(const std::string& path, size_t size, uint32_t generation,
+               std::shared_ptr<const std::vector<uint8_t>> data) {
+  while (!g_file_cache.empty() &&
+         g_file_cache_size + size > kFileCacheCapacity) {
+    g_file_cache_size -= g_file_cache.back().size;
+    g_file_cache.pop_back();
+  }
+  g_file_cache.push_front({path, size, generation, std::move(data)});
+  g_file_cache_size += size;
+}
+
+std::shared_ptr<const std::vector<uint8_t>> ReadWholeFile(lfs_file_t* file,
+                                                           size_t size) {
+  auto data = std::make_shared<std::vector<uint8_t>>(size);
+  auto n = lfs_file_read(Lfs(), file, data->data(), size);
+  if (n < 0 || static_cast<size_t>(n) != size) return nullptr;
+  return data;
+}
+
+// Opens a file response for `uri`, answering conditional and range requests.
+std::unique_ptr<FileHolder> OpenFile(const char* uri, const std::string& path) {
+  auto holder = std::make_unique<FileHolder>();
+  if (lfs_file_open(Lfs(), &holder->file, path.c_str(), LFS_O_RDONLY) < 0)
+    return nullptr;
+  holder->opened = true;
+  const size_t size = lfs_file_size(Lfs(), &holder->file);
+  const uint32_t generation = holder->file.ctz.head;
+
+  std::string etag;
+  if (generation < Lfs()->cfg->block_count) {
+    holder->data = LookUpCachedFile(path, size, generation);
+    if (holder->data) g_file_cache_hits.Increment();
+    StrAppend(&etag, "\"%lx-%lx\"", static_cast<unsigned long>(size),
+              static_cast<unsigned long>(generation));
+  } else {
+    // Small files are stored inline in littlefs metadata, where changes don't
+    // show in their generation, so they are identified by their content. They
+    // are read along with the metadata when opened.
+    holder->data = ReadWholeFile(&holder->file, size);
+    if (!holder->data) return nullptr;
+    StrAppend(&etag, "\"%lx-c%08lx\"", static_cast<unsigned long>(size),
+              static_cast<unsigned long>(
+                  Crc32(holder->data->data(), holder->data->size())));
+  }
+
+  size_t begin = 0, end = size;
+  auto range = Range::kNone;
+  bool not_modified = false;
+  if (const char* request = RequestHeaders(uri)) {
+    auto if_none_match = RequestHeader(request, "If-None-Match");
+    not_modified = !if_none_match.empty() && EtagMatches(if_none_match, etag);
+    auto if_range = RequestHeader(request, "If-Range");
+    if (!not_modified && (if_range.empty() || if_range == etag))
+      range = ParseRange(RequestHeader(request, "Range"), size, &begin, &end);
+  }
+
+  auto& headers = holder->headers;
+  if (not_modified) {
+    g_not_modified.Increment();
+    headers = "HTTP/1.1 304 Not Modified\r\n";
+  } else if (range == Range::kUnsatisfiable) {
+    headers = "HTTP/1.1 416 Range Not Satisfiable\r\n";
+    StrAppend(&headers, "Content-Range: bytes */%lu\r\n",
+              static_cast<unsigned long>(size));
+    headers += "Content-Length: 0\r\n";
+  } else {
+    if (range == Range::kSatisfiable) {
+      g_partial_responses.Increment();
+      headers = "HTTP/1.1 206 Partial Content\r\n";
+      StrAppend(&headers, "Content-Range: bytes %lu-%lu/%lu\r\n",
+                static_cast<unsigned long>(begin),
+                static_cast<unsigned long>(end - 1),
+                static_cast<unsigned long>(size));
+    } else {
+      headers = "HTTP/1.1 200 OK\r\n";
+    }
+    StrAppend(&headers, "Content-Type: %s\r\n", ContentType(path));
+    StrAppend(&headers, "Content-Length: %lu\r\n",
+              static_cast<unsigned long>(end - begin));
+    holder->offset = begin;
+    holder->end = end;
+
+    if (!holder->data && size <= kMaxCachedFileSize) {
+      holder->data = ReadWholeFile(&holder->file, size);
+      if (!holder->data) return nullptr;
+      CacheFile(path, size, generation, holder->data);
+    }
+    if (!holder->data && begin != 0 &&
+        lfs_file_seek(Lfs(), &holder->file, begin, LFS_SEEK_SET) < 0)
+      return nullptr;
+  }
+  StrAppend(&headers, "ETag: %s\r\n", etag.c_str());
+  // Clients check with the server before using a cached copy, which is then
+  // answered with 304 Not Modified if the file didn't change.
+  headers += "Cache-Control: no-cache\r\n";
+  headers += "Accept-Ranges: bytes\r\n";
+  headers += "Connection: close\r\n\r\n";
+
+  if (holder->data) holder->Close();
+  return holder;
+}
+
+// Returns the number of bytes read, or FS_READ_EOF at the end of the response.
+int ReadFile(FileHolder* holder, char* buffer, int count) {
+  size_t total = 0;
+  const size_t size = count;
+  if (holder->headers_offset < holder->headers.size()) {
+    total = std::min(size, holder->headers.size() - holder->headers_offset);
+    std::memcpy(buffer, holder->headers.data() + holder->headers_offset,
+                total);
+    holder->headers_offset += total;
+  }
+
+  const size_t len = std::min(size - total, holder->end - holder->offset);
+  if (len > 0 && holder->data) {
+    std::memcpy(buffer + total, holder->data->data() + holder->offset, len);
+    holder->offset += len;
+    total += len;
+  } else if (len > 0) {
+    auto n = lfs_file_read(Lfs(), &holder->file, buffer + total, len);
+    if (n < 0 && total == 0) return FS_READ_EOF;
+    if (n > 0) {
+      holder->offset += n;
+      total += n;
+    }
+  }
+  if (total == 0) return FS_READ_EOF;
+  return total;
+}
+
+struct GeneratorHolder {
+  HttpServer::Generator generator;
+  // Bytes that must go out before the generator is called again: the HTTP
+  // headers, a chunk that did not fit, or the last chunk.
+  std::string pending;
+  size_t pending_offset = 0;
+  size_t generated = 0;
+  bool done = false;
+  // Set while the generator is paused, to continue the response later.
+  fs_wait_cb wait_callback = nullptr;
+  void* wait_arg = nullptr;
+
+  bool known_size() const {
+    return generator.size != HttpServer::kUnknownSize;
+  }
+  bool chunked() const { return !known_size() && generator.chunked; }
+};
+
+// Paused generators, only accessed from the lwIP TCP/IP thread.
+std::vector<GeneratorHolder*> g_paused_generators;
+
+void PauseGenerator(GeneratorHolder* holder, fs_wait_cb callback, void* arg) {
+  holder->wait_callback = callback;
+  holder->wait_arg = arg;
+  if (std::find(g_paused_generators.begin(), g_paused_generators.end(),
+                holder) == g_paused_generators.end())
+    g_paused_generators.push_back(holder);
+}
+
+bool ForgetGenerator(GeneratorHolder* holder) {
+  auto it = std::find(g_paused_generators.begin(), g_paused_generators.end(),
+                      holder);
+  if (it == g_paused_generators.end()) return false;
+  g_paused_generators.erase(it);
+  return true;
+}
+
+void ResumeGeneratorsCallback(void* arg) {
+  (void)arg;
+  // A callback may close other connections, so every generator is looked up
+  // again before it is resumed.
+  auto paused = g_paused_generators;
+  for (auto* holder : paused) {
+    if (!ForgetGenerator(holder)) continue;
+    auto callback = holder->wait_callback;
+    holder->wait_callback = nullptr;
+    callback(holder->wait_arg);
+  }
+}
+
+std::string GeneratorHeaders(const HttpServer::Generator& generator) {
+  if (!generator.headers.empty()) return generator.headers;
+  std::string headers = "HTTP/1.1 200 OK\r\n";
+  StrAppend(&headers, "Content-Type: %s\r\n", generator.content_type);
+  if (generator.size != HttpServer::kUnknownSize) {
+    StrAppend(&headers, "Content-Length: %u\r\n",
+              static_cast<unsigned>(generator.size));
+  } else if (generator.chunked) {
+    headers += "Transfer-Encoding: chunked\r\n";
+  } else {
+    headers += "Cache-Control: no-cache\r\n";
+  }
+  headers += "Connection: close\r\n\r\n";
+  return headers;
+}
+
+// Wraps `size` bytes of data at `chunk + kChunkHeaderSize` into a chunk.
+void FrameChunk(char* chunk, size_t size) {
+  constexpr char kHexDigits[] = "0123456789ABCDEF";
+  for (size_t i = 0; i < kChunkSizeDigits; ++i)
+    chunk[kChunkSizeDigits - 1 - i] = kHexDigits[(size >> (4 * i)) & 0xF];
+  chunk[kChunkSizeDigits] = '\r';
+  chunk[kChunkSizeDigits + 1] = '\n';
+  chunk[kChunkHeaderSize + size] = '\r';
+  chunk[kChunkHeaderSize + size + 1] = '\n';
+}
+
+size_t ReadPending(GeneratorHolder* holder, char* buffer, size_t count) {
+  auto len = std::min(count, holder->pending.size() - holder->pending_offset);
+  std::memcpy(buffer, holder->pending.data() + holder->pending_offset, len);
+  holder->pending_offset += len;
+  if (holder->pending_offset == holder->pending.size()) {
+    holder->pending.clear();
+    holder->pending_offset = 0;
+  }
+  return len;
+}
+
+// Generates one chunk into `buffer`, which must have room for more than
+// kChunkOverhead bytes. Returns the number of bytes used, 0 after queueing the
+// last chunk, or the negative value returned by the generator.
+int GenerateChunk(GeneratorHolder* holder, char* buffer, size_t count) {
+  auto len = holder->generator.fill(
+      reinterpret_cast<uint8_t*>(buffer + kChunkHeaderSize),
+      count - kChunkOverhead);
+  if (len < 0) return len;
+  if (len == 0) {
+    holder->done = true;
+    holder->pending = kLastChunk;
+    return 0;
+  }
+  FrameChunk(buffer, len);
+  return len + kChunkOverhead;
+}
+
+// Returns the number of bytes read, FS_READ_DELAYED if the generator has
+// nothing to write yet, or FS_READ_EOF at the end of the response.
+int ReadGenerator(GeneratorHolder* holder, char* buffer, int count) {
+  size_t total = 0;
+  const size_t size = count;
+  while (total < size) {
+    if (!holder->pending.empty()) {
+      total += ReadPending(holder, buffer + total, size - total);
+      continue;
+    }
+    if (holder->done) break;
+
+    const size_t space = size - total;
+    int len;
+    if (holder->chunked()) {
+      if (space > kChunkOverhead) {
+        len = GenerateChunk(holder, buffer + total, space);
+        if (len > 0) total += len;
+      } else {
+        // Not enough room for a chunk, generate a small one to send later.
+        holder->pending.resize(kMinChunkSize);
+        len = GenerateChunk(holder, holder->pending.data(), kMinChunkSize);
+        if (len > 0) holder->pending.resize(len);
+        if (len < 0) holder->pending.clear();
+      }
+    } else {
+      auto remaining = space;
+      if (holder->known_size()) {
+        remaining = holder->generator.size - holder->generated;
+        if (remaining == 0) {
+          holder->done = true;
+          break;
+        }
+      }
+      len = holder->generator.fill(reinterpret_cast<uint8_t*>(buffer + total),
+                                   std::min(space, remaining));
+      if (len == 0) {
+        // Ending early would leave the client waiting for Content-Length
+        // bytes.
+        if (holder->known_size()) return FS_READ_EOF;
+        holder->done = true;
+      }
+      if (len > 0) {
+        holder->generated += len;
+        total += len;
+      }
+    }
+    if (len == HttpServer::Generator::kPending)
+      return total > 0 ? static_cast<int>(total) : FS_READ_DELAYED;
+    if (len < 0) return FS_READ_EOF;
+  }
+  if (total == 0 && holder->done) return FS_READ_EOF;
+  return total;
+}
+
+// Generators that receive the data sent by their client, by connection. Only
+// accessed from the lwIP TCP/IP thread.
+std::vector<std::pair<struct tcp_pcb*, GeneratorHolder*>> g_receivers;
+
+auto FindReceiver(struct tcp_pcb* pcb) {
+  return std::find_if(g_receivers.begin(), g_receivers.end(),
+                      [pcb](const auto& receiver) {
+                        return receiver.first == pcb;
+                      });
+}
+
+void ForgetReceiver(GeneratorHolder* holder) {
+  g_receivers.erase(std::remove_if(g_receivers.begin(), g_receivers.end(),
+                                   [holder](const auto& receiver) {
+                                     return receiver.second == holder;
+                                   }),
+                    g_receivers.end());
+}
+
+// Replaces the receive callback of httpd, which discards everything the
+// client sends after its request.
+err_t ReceiveCallback(void* arg, struct tcp_pcb* pcb, struct pbuf* p,
+                      err_t err) {
+  (void)arg;
+  (void)err;
+  auto it = FindReceiver(pcb);
+  GeneratorHolder* holder = it != g_receivers.end() ? it->second : nullptr;
+  if (!p) {
+    if (holder) holder->generator.receive(nullptr, 0);
+    return ERR_OK;
+  }
+  if (holder) {
+    for (struct pbuf* q = p; q; q = q->next)
+      holder->generator.receive(static_cast<const uint8_t*>(q->payload),
+                                q->len);
+  }
+  tcp_recved(pcb, p->tot_len);
+  pbuf_free(p);
+  return ERR_OK;
+}
+
+GeneratorHolder* GetGeneratorHolder(struct fs_file* file) {
+  if (Tag(file->pextension) != kTagGenerator) return nullptr;
+  return Pointer<GeneratorHolder>(file->pextension);
+}
 }  // namespace
 
+std::string HttpServer::RequestHeader(const char* uri, const char* name) {
+  const char* headers = RequestHeaders(uri);
+  return headers ? coralmicro::RequestHeader(headers, name) : std::string();
+}
+
+void HttpServer::ResumeGenerators() {
+  tcpip_callback(ResumeGeneratorsCallback, nullptr);
+}
+
 void UseHttpServer(HttpServer* server) {
   static bool initialized = false;
   if (!initialized) {
     LOCK_TCPIP_CORE();
+    lwip_set_tcp_input_observer(ObserveTcpInput);
     httpd_init();
     UNLOCK_TCPIP_CORE();
     initialized = true;
@@ -71,15 +665,12 @@ int HttpServer::FsOpenCustom(struct fs_file* file, const char* name) {
     auto content = uri_handler(name);
 
     if (auto* filename = std::get_if<std::string>(&content)) {
-      auto file_holder = std::make_unique<FileHolder>();
-
-      if (lfs_file_open(Lfs(), &file_holder->file, filename->c_str(),
-                        LFS_O_RDONLY) >= 0) {
-        file_holder->opened = true;
+      if (auto file_holder = OpenFile(name, *filename)) {
         file->data = nullptr;
-        file->len = lfs_file_size(Lfs(), &file_holder->file);
+        file->len = file_holder->headers.size() +
+                    (file_holder->end - file_holder->offset);
         file->index = 0;
-        file->flags = FS_FILE_FLAGS_HEADER_PERSISTENT;
+        file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
         file->pextension = TaggedPointer<kTagFileHolder>(file_holder.release());
         return 1;
       }
@@ -94,6 +685,24 @@ int HttpServer::FsOpenCustom(struct fs_file* file, const char* name) {
       return 1;
     }
 
+    if (auto* generator = std::get_if<Generator>(&content)) {
+      auto holder = std::make_unique<GeneratorHolder>();
+      holder->pending = GeneratorHeaders(*generator);
+      holder->generator = std::move(*generator);
+      if (holder->generator.receive && RequestHeaders(name)) {
+        g_receivers.emplace_back(tcp_input_pcb, holder.get());
+        tcp_recv(tcp_input_pcb, ReceiveCallback);
+      }
+      file->data = nullptr;
+      file->len = holder->known_size()
+                      ? holder->pending.size() + holder->generator.size
+                      : std::numeric_limits<int>::max();
+      file->index = 0;
+      file->flags = FS_FILE_FLAGS_HEADER_INCLUDED;
+      file->pextension = TaggedPointer<kTagGenerator>(holder.release());
+      return 1;
+    }
+
     if (auto* v = std::get_if<std::vector<uint8_t>>(&content)) {
       file->data = reinterpret_cast<char*>(v->data());
       file->len = v->size();
@@ -112,10 +721,8 @@ int HttpServer::FsReadCustom(struct fs_file* file, char* buffer, int count) {
   auto tag = Tag(file->pextension);
 
   if (tag == kTagFileHolder) {
-    auto* file_holder = Pointer<FileHolder>(file->pextension);
-
-    auto len = lfs_file_read(Lfs(), &file_holder->file, buffer, count);
-    if (len < 0) return FS_READ_EOF;
+    auto len = ReadFile(Pointer<FileHolder>(file->pextension), buffer, count);
+    if (len < 0) return len;
     file->index += len;
     return len;
   }
@@ -127,6 +734,14 @@ int HttpServer::FsReadCustom(struct fs_file* file, char* buffer, int count) {
     return count;
   }
 
+  if (tag == kTagGenerator) {
+    auto len = ReadGenerator(Pointer<GeneratorHolder>(file->pextension), buffer,
+                             count);
+    if (len < 0) return len;
+    file->index += len;
+    return len;
+  }
+
   return FS_READ_EOF;
 };
 
@@ -136,6 +751,11 @@ void HttpServer::FsCloseCustom(struct fs_file* file) {
     delete Pointer<FileHolder>(file->pextension);
   } else if (tag == kTagVector) {
     delete Pointer<std::vector<uint8_t>>(file->pextension);
+  } else if (tag == kTagGenerator) {
+    auto* holder = Pointer<GeneratorHolder>(file->pextension);
+    ForgetGenerator(holder);
+    ForgetReceiver(holder);
+    delete holder;
   }
 }
 
@@ -164,13 +784,45 @@ void httpd_cgi_handler(struct fs_file* file, const char* uri, int iNumParams,
 }
 
 int fs_open_custom(struct fs_file* file, const char* name) {
-  return g_server->FsOpenCustom(file, name);
+  auto opened = g_server->FsOpenCustom(file, name);
+  if (opened) {
+    // httpd tries several index files for one request, so the request is only
+    // used up by the file that opens.
+    if (tcp_input_pcb) ForgetRequest(tcp_input_pcb);
+    g_responses.Increment();
+    g_open_responses.Add(1);
+  }
+  return opened;
+}
+
+int fs_read_async_custom(struct fs_file* file, char* buffer, int count,
+                         fs_wait_cb callback_fn, void* callback_arg) {
+  auto len = g_server->FsReadCustom(file, buffer, count);
+  if (len == FS_READ_DELAYED) {
+    auto* holder = GetGeneratorHolder(file);
+    assert(holder);
+    PauseGenerator(holder, callback_fn, callback_arg);
+  }
+  if (len > 0) g_streamed_bytes.Increment(len);
+  return len;
 }
 
-int fs_read_custom(struct fs_file* file, char* buffer, int count) {
-  return g_server->FsReadCustom(file, buffer, count);
+u8_t fs_canread_custom(struct fs_file* file) {
+  auto* holder = GetGeneratorHolder(file);
+  return holder == nullptr || holder->wait_callback == nullptr;
 }
 
-void fs_close_custom(struct fs_file* file) { g_server->FsCloseCustom(file); }
+u8_t fs_wait_read_custom(struct fs_file* file, fs_wait_cb callback_fn,
+                         void* callback_arg) {
+  auto* holder = GetGeneratorHolder(file);
+  if (holder == nullptr || holder->wait_callback == nullptr) return 0;
+  PauseGenerator(holder, callback_fn, callback_arg);
+  return 1;
+}
+
+void fs_close_custom(struct fs_file* file) {
+  g_server->FsCloseCustom(file);
+  g_open_responses.Add(-1);
+}
 }  // extern "C"
 }  // namespace coralmicro
@@ -17,8 +17,10 @@
 #ifndef LIBS_BASE_HTTP_SERVER_H_
 #define LIBS_BASE_HTTP_SERVER_H_
 
+#include <climits>
 #include <cstring>
 #include <functional>
+#include <string>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -132,14 +134,75 @@ class HttpServer {
     size_t size;
   };
 
+  // Size of a `Generator` response that is not known in advance.
+  static constexpr size_t kUnknownSize = static_cast<size_t>(-1);
+
+  // Defines a response that is produced incrementally while it is being sent,
+  // so it never has to be held in memory as a whole.
+  struct Generator {
+    // Returned by `fill` when no data is available yet. The response is then
+    // paused until `ResumeGenerators()` is called.
+    static constexpr int kPending = INT_MIN;
+
+    // Called repeatedly to write the next part of the response into `buffer`,
+    // which has room for `size` bytes. It must return the number of bytes
+    // written, 0 once the response is complete, `kPending` if there is
+    // nothing to write yet, or any other negative value to abort the response.
+    //
+    // This runs on the lwIP TCP/IP thread, so it must not block.
+    std::function<int(uint8_t* buffer, size_t size)> fill;
+    // Total size of the response in bytes, or `kUnknownSize`.
+    size_t size = kUnknownSize;
+    // Whether a response of unknown size is sent with chunked transfer
+    // encoding. Otherwise the response ends when the connection is closed,
+    // which suits endless streams.
+    bool chunked = true;
+    // Value of the Content-Type header.
+    const char* content_type = "application/octet-stream";
+    // The status line and headers of the response, ending with an empty
+    // line. If empty, they are derived from the fields above.
+    std::string headers;
+    // If set, called with the data that the client sends after its request,
+    // such as the frames of a protocol the connection was upgraded to (which
+    // are otherwise discarded), and with `size` 0 once the client closed the
+    // connection. Only available for requests whose headers are known (see
+    // `RequestHeader()`).
+    //
+    // This runs on the lwIP TCP/IP thread, so it must not block.
+    std::function<void(const uint8_t* data, size_t size)> receive;
+  };
+
+  // Gets a header of the request being handled. Call this from a
+  // `UriHandler`.
+  //
+  // Headers are only known for GET requests whose headers arrived in a single
+  // TCP segment, which is the case for nearly all requests.
+  //
+  // @param uri The URI passed to the `UriHandler`.
+  // @param name The header name, which is not case sensitive.
+  // @returns The header value, or an empty string if the header is missing or
+  //   the request headers aren't known.
+  static std::string RequestHeader(const char* uri, const char* name);
+
+  // Resumes all `Generator` responses that are paused because their `fill`
+  // function returned `Generator::kPending`. This can be called from any task.
+  static void ResumeGenerators();
+
   // Defines the allowed response types returned by `AddUriHandler()`.
   // Successful requests will typically respond with the content in
-  // a string, a dynamic buffer (a vector), or a `StaticBuffer`, or an
-  // empty vector if the URI is unhandled.
+  // a string, a dynamic buffer (a vector), a `StaticBuffer`, or a `Generator`,
+  // or an empty vector if the URI is unhandled.
+  //
+  // Files (given by their filename) are sent with an `ETag` header, and
+  // support conditional requests (`If-None-Match`, answered with 304 Not
+  // Modified) and single byte-range requests (`Range`, answered with 206
+  // Partial Content), so clients can revalidate cached copies and resume
+  // downloads. Small files are kept in memory as long as they don't change.
   using Content = std::variant<std::monostate,        // Not found
                                std::string,           // Filename
                                std::vector<uint8_t>,  // Dynamic buffer
-                               StaticBuffer>;         // Static buffer
+                               StaticBuffer,          // Static buffer
+                               Generator>;            // Generated content
 
   // Represents the callback function type required by `AddUriHandler()`.
   using UriHandler = std::function<Content(const char* uri)>;
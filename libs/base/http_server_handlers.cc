@@ -18,50 +18,90 @@
 
 #include <algorithm>
 #include <cstring>
-#include <numeric>
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "libs/base/metrics.h"
 #include "libs/base/strings.h"
+#include "libs/base/trace.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
 #include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/freertos_kernel/include/task.h"
 
 namespace coralmicro {
 namespace {
-void GenerateStatsHtml(std::vector<uint8_t>* html) {
-  std::vector<TaskStatus_t> infos(uxTaskGetNumberOfTasks());
-  uint32_t total_runtime;
-  auto n = uxTaskGetSystemState(infos.data(), infos.size(), &total_runtime);
-  std::vector<int> indices(infos.size());
-  std::iota(std::begin(indices), std::end(indices), 0);
-  std::sort(std::begin(indices), std::end(indices), [&infos](int i, int j) {
-    return infos[i].ulRunTimeCounter > infos[j].ulRunTimeCounter;
-  });
+constexpr char kStatsHtmlHead[] =
+    "<!DOCTYPE html>\r\n"
+    "<html lang=\"en\">\r\n"
+    "<head>\r\n"
+    "<title>Run-time statistics</title>\r\n"
+    "  <style>\r\n"
+    "    th,td {padding: 2px;}\r\n"
+    "  </style>\r\n"
+    "</head>\r\n"
+    "<body>\r\n"
+    "  <table>\r\n"
+    "    <tr><th>Task</th><th>Abs Time</th><th>% Time</th></tr>\r\n";
+constexpr char kStatsHtmlTail[] =
+    "  </table>\r\n"
+    "</body>\r\n";
 
-  StrAppend(html, "<!DOCTYPE html>\r\n");
-  StrAppend(html, "<html lang=\"en\">\r\n");
-  StrAppend(html, "<head>\r\n");
-  StrAppend(html, "<title>Run-time statistics</title>\r\n");
-  StrAppend(html, "  <style>\r\n");
-  StrAppend(html, "    th,td {padding: 2px;}\r\n");
-  StrAppend(html, "  </style>\r\n"), StrAppend(html, "</head>\r\n");
-  StrAppend(html, "<body>\r\n");
-  StrAppend(html, "  <table>\r\n");
-  StrAppend(html,
-            "    <tr><th>Task</th><th>Abs Time</th><th>% Time</th></tr>\r\n");
-  for (auto i = 0u; i < n; ++i) {
-    const auto& info = infos[indices[i]];
-    auto name = info.pcTaskName;
-    auto runtime = info.ulRunTimeCounter;
-    float percent = static_cast<float>(runtime) / (total_runtime / 100.0);
-    coralmicro::StrAppend(
-        html, "    <tr><td>%s</td><td>%lu</td><td>%.1f%%</td></tr>\r\n", name,
-        runtime, percent);
+// Produces the run-time statistics page one table row at a time, so the page
+// is never held in memory as a whole.
+class StatsHtmlGenerator {
+ public:
+  StatsHtmlGenerator() : infos_(uxTaskGetNumberOfTasks()) {
+    auto n =
+        uxTaskGetSystemState(infos_.data(), infos_.size(), &total_runtime_);
+    infos_.resize(n);
+    std::sort(std::begin(infos_), std::end(infos_),
+              [](const TaskStatus_t& a, const TaskStatus_t& b) {
+                return a.ulRunTimeCounter > b.ulRunTimeCounter;
+              });
+    line_ = kStatsHtmlHead;
   }
-  StrAppend(html, "  </table>\r\n");
-  StrAppend(html, "</body>\r\n");
-}
+
+  int operator()(uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      if (offset_ == line_.size() && !NextLine()) break;
+      auto len = std::min(size - written, line_.size() - offset_);
+      std::memcpy(buffer + written, line_.data() + offset_, len);
+      offset_ += len;
+      written += len;
+    }
+    return written;
+  }
+
+ private:
+  bool NextLine() {
+    line_.clear();
+    offset_ = 0;
+    if (row_ < infos_.size()) {
+      const auto& info = infos_[row_++];
+      auto runtime = info.ulRunTimeCounter;
+      float percent = static_cast<float>(runtime) / (total_runtime_ / 100.0);
+      StrAppend(&line_,
+                "    <tr><td>%s</td><td>%lu</td><td>%.1f%%</td></tr>\r\n",
+                info.pcTaskName, runtime, percent);
+      return true;
+    }
+    if (!tail_sent_) {
+      tail_sent_ = true;
+      line_ = kStatsHtmlTail;
+      return true;
+    }
+    return false;
+  }
+
+  std::vector<TaskStatus_t> infos_;
+  uint32_t total_runtime_;
+  size_t row_ = 0;
+  bool tail_sent_ = false;
+  std::string line_;
+  size_t offset_ = 0;
+};
 }  // namespace
 
 HttpServer::Content FileSystemUriHandler::operator()(const char* uri) {
@@ -73,10 +113,39 @@ HttpServer::Content FileSystemUriHandler::operator()(const char* uri) {
 
 HttpServer::Content TaskStatsUriHandler::operator()(const char* uri) {
   if (std::strcmp(uri, name) == 0) {
-    std::vector<uint8_t> html;
-    html.reserve(2048);
-    GenerateStatsHtml(&html);
-    return html;
+    HttpServer::Generator generator;
+    generator.fill = [stats = std::make_shared<StatsHtmlGenerator>()](
+                         uint8_t* buffer, size_t size) {
+      return (*stats)(buffer, size);
+    };
+    generator.content_type = "text/html";
+    return generator;
+  }
+  return {};
+}
+
+HttpServer::Content TraceUriHandler::operator()(const char* uri) {
+  if (std::strcmp(uri, name) == 0) {
+    HttpServer::Generator generator;
+    generator.fill = [trace = std::make_shared<TraceJsonGenerator>()](
+                         uint8_t* buffer, size_t size) {
+      return (*trace)(buffer, size);
+    };
+    generator.content_type = "application/json";
+    return generator;
+  }
+  return {};
+}
+
+HttpServer::Content MetricsUriHandler::operator()(const char* uri) {
+  if (std::strcmp(uri, name) == 0) {
+    HttpServer::Generator generator;
+    generator.fill = [metrics = std::make_shared<PrometheusTextGenerator>()](
+                         uint8_t* buffer, size_t size) {
+      return (*metrics)(buffer, size);
+    };
+    generator.content_type = "text/plain; version=0.0.4";
+    return generator;
   }
   return {};
 }
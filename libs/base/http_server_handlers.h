@@ -31,6 +31,20 @@ struct TaskStatsUriHandler {
   HttpServer::Content operator()(const char* uri);
 };
 
+// Serves the trace zones of the current core as Chrome trace-event JSON (see
+// `TRACE_ZONE()` in libs/base/trace.h).
+struct TraceUriHandler {
+  const char* name = "/trace.json";
+  HttpServer::Content operator()(const char* uri);
+};
+
+// Serves the metrics of the current core in the Prometheus text format (see
+// libs/base/metrics.h).
+struct MetricsUriHandler {
+  const char* name = "/metrics";
+  HttpServer::Content operator()(const char* uri);
+};
+
 }  // namespace coralmicro
 
 #endif  // LIBS_BASE_HTTP_SERVER_HANDLERS_H_
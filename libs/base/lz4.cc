@@ -0,0 +1,82 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/lz4.h"
+
+#include <cstring>
+
+namespace coralmicro {
+namespace {
+constexpr int kMinMatch = 4;
+
+// Reads an LZ4 length continuation (a run of 255 bytes ended by a smaller
+// byte) and adds it to `len`. Returns false if the input ends prematurely.
+bool ReadLength(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+  uint8_t b;
+  do {
+    if (*ip >= iend) return false;
+    b = *(*ip)++;
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+}  // namespace
+
+int Lz4DecompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst,
+                       size_t dst_capacity) {
+  const uint8_t* ip = src;
+  const uint8_t* const iend = src + src_size;
+  uint8_t* op = dst;
+  uint8_t* const oend = dst + dst_capacity;
+
+  while (ip < iend) {
+    const uint8_t token = *ip++;
+
+    size_t literal_len = token >> 4;
+    if (literal_len == 15 && !ReadLength(&ip, iend, &literal_len)) return -1;
+    if (literal_len > static_cast<size_t>(iend - ip) ||
+        literal_len > static_cast<size_t>(oend - op))
+      return -1;
+    std::memcpy(op, ip, literal_len);
+    ip += literal_len;
+    op += literal_len;
+
+    // The last sequence of a block has literals only.
+    if (ip == iend) break;
+
+    if (iend - ip < 2) return -1;
+    const size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > static_cast<size_t>(op - dst)) return -1;
+
+    size_t match_len = token & 0x0F;
+    if (match_len == 15 && !ReadLength(&ip, iend, &match_len)) return -1;
+    match_len += kMinMatch;
+    if (match_len > static_cast<size_t>(oend - op)) return -1;
+
+    const uint8_t* match = op - offset;
+    if (offset >= match_len) {
+      std::memcpy(op, match, match_len);
+      op += match_len;
+    } else {
+      // Overlapping copy repeats the last `offset` bytes.
+      while (match_len--) *op++ = *match++;
+    }
+  }
+  return static_cast<int>(op - dst);
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_LZ4_H_
+#define LIBS_BASE_LZ4_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coralmicro {
+
+// Returns the worst-case size of an LZ4 block holding `size` bytes of input.
+//
+// @param size Uncompressed size in bytes.
+// @returns Maximum compressed size in bytes.
+constexpr size_t Lz4CompressBound(size_t size) {
+  return size + size / 255 + 16;
+}
+
+// Decompresses a single LZ4 block (the raw block format, without the LZ4
+// frame header).
+//
+// Malformed input is detected and never causes reads or writes outside of the
+// given buffers.
+//
+// @param src The compressed block.
+// @param src_size The size of `src` in bytes.
+// @param dst The buffer to decompress into.
+// @param dst_capacity The size of `dst` in bytes.
+// @returns The number of bytes written to `dst`, or -1 if the block is
+// malformed or does not fit in `dst`.
+int Lz4DecompressBlock(const uint8_t* src, size_t src_size, uint8_t* dst,
+                       size_t dst_capacity);
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_LZ4_H_
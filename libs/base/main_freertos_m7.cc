@@ -29,8 +29,10 @@
 #include "libs/base/tasks.h"
 #include "libs/base/tempsense.h"
 #include "libs/base/timer.h"
+#include "libs/base/trace.h"
 #include "libs/camera/camera.h"
 #include "libs/cdc_eem/cdc_eem.h"
+#include "libs/cdc_ncm/cdc_ncm.h"
 #include "libs/nxp/rt1176-sdk/board_hardware.h"
 #include "libs/pmic/pmic.h"
 #include "libs/tpu/edgetpu_dfu_task.h"
@@ -46,6 +48,25 @@
 
 namespace {
 lpi2c_rtos_handle_t g_i2c5_handle;
+#if defined(USE_USB_NCM)
+coralmicro::CdcNcm g_cdc_ncm;
+
+void InitializeCDCNCM() {
+  using namespace std::placeholders;
+  auto* usb_device_task = coralmicro::UsbDeviceTask::GetSingleton();
+  uint8_t mac_address_string =
+      usb_device_task->AddString(coralmicro::CdcNcm::kHostMacAddress);
+  g_cdc_ncm.Init(usb_device_task->next_descriptor_value(),
+                 usb_device_task->next_descriptor_value(),
+                 usb_device_task->next_interface_value(),
+                 usb_device_task->next_interface_value(), mac_address_string);
+  usb_device_task->AddDevice(
+      g_cdc_ncm.config_data(),
+      std::bind(&coralmicro::CdcNcm::SetClassHandle, &g_cdc_ncm, _1),
+      std::bind(&coralmicro::CdcNcm::HandleEvent, &g_cdc_ncm, _1, _2),
+      g_cdc_ncm.descriptor_data(), g_cdc_ncm.descriptor_data_size());
+}
+#else
 coralmicro::CdcEem g_cdc_eem;
 
 void InitializeCDCEEM() {
@@ -60,6 +81,7 @@ void InitializeCDCEEM() {
       std::bind(&coralmicro::CdcEem::HandleEvent, &g_cdc_eem, _1, _2),
       g_cdc_eem.descriptor_data(), g_cdc_eem.descriptor_data_size());
 }
+#endif  // defined(USE_USB_NCM)
 }  // namespace
 
 extern "C" lpi2c_rtos_handle_t* I2C5Handle() { return &g_i2c5_handle; }
@@ -77,15 +99,20 @@ extern "C" int real_main(int argc, char** argv, bool init_console_tx,
   SEMA4_Init(SEMA4);
   coralmicro::ResetStoreStats();
   coralmicro::TimerInit();
+  coralmicro::TraceInit();
   coralmicro::GpioInit();
   coralmicro::IpcM7::GetSingleton()->Init();
   coralmicro::RandomInit();
   coralmicro::ConsoleM7::GetSingleton()->Init(init_console_tx, init_console_rx);
   CHECK(coralmicro::LfsInit());
-  // Make sure this happens before EEM or WICED are initialized.
+  // Make sure this happens before EEM/NCM or WICED are initialized.
   tcpip_init(nullptr, nullptr);
   coralmicro::DnsInit();
+#if defined(USE_USB_NCM)
+  InitializeCDCNCM();
+#else
   InitializeCDCEEM();
+#endif
   coralmicro::UsbDeviceTask::GetSingleton()->Init();
   coralmicro::UsbHostTask::GetSingleton()->Init();
   coralmicro::EdgeTpuDfuTask::GetSingleton()->Init();
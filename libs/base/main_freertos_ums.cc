@@ -25,6 +25,7 @@
 #include "libs/base/tasks.h"
 #include "libs/base/tempsense.h"
 #include "libs/base/timer.h"
+#include "libs/base/trace.h"
 #include "libs/msc_ums/msc_ums.h"
 #include "libs/nxp/rt1176-sdk/board_hardware.h"
 #include "libs/pmic/pmic.h"
@@ -68,6 +69,7 @@ extern "C" int real_main(int argc, char** argv, bool init_console_tx,
   SEMA4_Init(SEMA4);
   coralmicro::ResetStoreStats();
   coralmicro::TimerInit();
+  coralmicro::TraceInit();
   coralmicro::GpioInit();
   coralmicro::RandomInit();
   coralmicro::ConsoleM7::GetSingleton()->Init(init_console_tx, init_console_rx);
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/metrics.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "libs/base/strings.h"
+
+namespace coralmicro {
+namespace {
+// Head of the registry, a singly linked list of all metrics. Metrics are only
+// ever added, so readers can walk the list without locking.
+std::atomic<Metric*> g_metrics{nullptr};
+
+const char* TypeName(MetricType type) {
+  switch (type) {
+    case MetricType::kCounter:
+      return "counter";
+    case MetricType::kGauge:
+      return "gauge";
+    case MetricType::kHistogram:
+      return "histogram";
+  }
+  return "untyped";
+}
+}  // namespace
+
+Metric::Metric(const char* name, const char* help, MetricType type)
+    : name_(name), help_(help), type_(type) {
+  next_ = g_metrics.load(std::memory_order_relaxed);
+  while (!g_metrics.compare_exchange_weak(next_, this,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+const Metric* MetricsBegin() {
+  return g_metrics.load(std::memory_order_acquire);
+}
+
+void Histogram::Record(uint32_t value) {
+  int index = value <= 1 ? 0 : 32 - __builtin_clz(value - 1);
+  buckets_[std::min(index, kBucketCount - 1)].fetch_add(
+      1, std::memory_order_relaxed);
+
+  // Carry into the high word when the low word wraps around.
+  uint32_t low = sum_low_.fetch_add(value, std::memory_order_relaxed);
+  if (low + value < low) sum_high_.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t Histogram::sum() const {
+  uint32_t high, low;
+  do {
+    high = sum_high_.load(std::memory_order_relaxed);
+    low = sum_low_.load(std::memory_order_relaxed);
+  } while (high != sum_high_.load(std::memory_order_relaxed));
+  return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+int PrometheusTextGenerator::operator()(uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    if (offset_ == line_.size() && !NextLine()) break;
+    auto len = std::min(size - written, line_.size() - offset_);
+    std::memcpy(buffer + written, line_.data() + offset_, len);
+    offset_ += len;
+    written += len;
+  }
+  return written;
+}
+
+bool PrometheusTextGenerator::NextLine() {
+  line_.clear();
+  offset_ = 0;
+  if (!metric_) return false;
+
+  const char* name = metric_->name();
+  if (metric_line_ == 0) {
+    StrAppend(&line_, "# HELP %s %s\n# TYPE %s %s\n", name, metric_->help(),
+              name, TypeName(metric_->type()));
+  }
+
+  switch (metric_->type()) {
+    case MetricType::kCounter:
+      StrAppend(&line_, "%s %lu\n", name,
+                static_cast<const Counter*>(metric_)->value());
+      break;
+    case MetricType::kGauge:
+      StrAppend(&line_, "%s %ld\n", name,
+                static_cast<const Gauge*>(metric_)->value());
+      break;
+    case MetricType::kHistogram: {
+      const auto* histogram = static_cast<const Histogram*>(metric_);
+      if (metric_line_ == 0) cumulative_ = 0;
+      if (metric_line_ < Histogram::kBucketCount) {
+        const int bucket = metric_line_++;
+        cumulative_ += histogram->bucket(bucket);
+        if (bucket < Histogram::kBucketCount - 1) {
+          StrAppend(&line_, "%s_bucket{le=\"%lu\"} %lu\n", name,
+                    Histogram::BucketUpperBound(bucket), cumulative_);
+        } else {
+          StrAppend(&line_, "%s_bucket{le=\"+Inf\"} %lu\n", name,
+                    cumulative_);
+        }
+        return true;
+      }
+      // Buckets are read one at a time while values may still be recorded, so
+      // the count is taken from the buckets to stay consistent with them. The
+      // sum is printed as a double because newlib-nano's printf has no 64-bit
+      // integer support.
+      StrAppend(&line_, "%s_sum %.0f\n%s_count %lu\n", name,
+                static_cast<double>(histogram->sum()), name, cumulative_);
+      break;
+    }
+  }
+
+  metric_ = metric_->next();
+  metric_line_ = 0;
+  return true;
+}
+
+std::string MetricsJson() {
+  std::string json = "{";
+  for (const auto* metric = MetricsBegin(); metric; metric = metric->next()) {
+    StrAppend(&json, "%s\"%s\":{\"type\":\"%s\"", json.size() > 1 ? "," : "",
+              metric->name(), TypeName(metric->type()));
+    switch (metric->type()) {
+      case MetricType::kCounter:
+        StrAppend(&json, ",\"value\":%lu",
+                  static_cast<const Counter*>(metric)->value());
+        break;
+      case MetricType::kGauge:
+        StrAppend(&json, ",\"value\":%ld",
+                  static_cast<const Gauge*>(metric)->value());
+        break;
+      case MetricType::kHistogram: {
+        const auto* histogram = static_cast<const Histogram*>(metric);
+        uint32_t count = 0;
+        std::string bounds, buckets;
+        for (int i = 0; i < Histogram::kBucketCount; ++i) {
+          const char* separator = i ? "," : "";
+          if (i < Histogram::kBucketCount - 1) {
+            StrAppend(&bounds, "%s%lu", separator,
+                      Histogram::BucketUpperBound(i));
+          }
+          const uint32_t n = histogram->bucket(i);
+          StrAppend(&buckets, "%s%lu", separator, n);
+          count += n;
+        }
+        StrAppend(&json,
+                  ",\"count\":%lu,\"sum\":%.0f,\"bounds\":[%s],"
+                  "\"buckets\":[%s]",
+                  count, static_cast<double>(histogram->sum()), bounds.c_str(),
+                  buckets.c_str());
+        break;
+      }
+    }
+    json += '}';
+  }
+  json += '}';
+  return json;
+}
+
+}  // namespace coralmicro
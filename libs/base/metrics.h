@@ -0,0 +1,245 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_METRICS_H_
+#define LIBS_BASE_METRICS_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "libs/base/timer.h"
+
+namespace coralmicro {
+
+// The kind of value held by a `Metric`.
+enum class MetricType {
+  // A value that only goes up, such as a number of events.
+  kCounter,
+  // A value that can go up and down, such as a queue depth.
+  kGauge,
+  // A distribution of values, such as latencies.
+  kHistogram,
+};
+
+// Base class of all metrics.
+//
+// Metrics register themselves in a registry of the current core when they are
+// constructed, so they must have static storage duration, for example:
+//
+// ```
+// Counter g_frames("app_frames_total", "Frames processed.");
+// Histogram g_latency("app_frame_latency_microseconds", "Frame latency.");
+//
+// void ProcessFrame() {
+//   HistogramTimer timer(&g_latency);
+//   ...
+//   g_frames.Increment();
+// }
+// ```
+//
+// Names should follow the Prometheus conventions (`[a-z_][a-z0-9_]*`, with a
+// unit suffix such as `_microseconds` and a `_total` suffix for counters).
+// Updates are lock-free, so metrics can be updated from any task or interrupt
+// handler. All registered metrics are exported by `PrometheusTextGenerator`
+// and `MetricsJson()`.
+class Metric {
+ public:
+  Metric(const Metric&) = delete;
+  Metric& operator=(const Metric&) = delete;
+
+  // Gets the metric's name.
+  const char* name() const { return name_; }
+
+  // Gets the metric's description.
+  const char* help() const { return help_; }
+
+  // Gets the kind of value held by the metric.
+  MetricType type() const { return type_; }
+
+  // Gets the next metric in the registry.
+  //
+  // @returns The next metric, or nullptr if this is the last one.
+  const Metric* next() const { return next_; }
+
+ protected:
+  Metric(const char* name, const char* help, MetricType type);
+  ~Metric() = default;
+
+ private:
+  const char* name_;
+  const char* help_;
+  MetricType type_;
+  Metric* next_;
+};
+
+// Counts events.
+class Counter : public Metric {
+ public:
+  Counter(const char* name, const char* help)
+      : Metric(name, help, MetricType::kCounter) {}
+
+  // Adds to the counter.
+  //
+  // @param n The number of events to add.
+  void Increment(uint32_t n = 1) {
+    value_.fetch_add(n, std::memory_order_relaxed);
+  }
+
+  // Gets the number of events counted so far.
+  uint32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint32_t> value_{0};
+};
+
+// Holds a value that can go up and down.
+class Gauge : public Metric {
+ public:
+  Gauge(const char* name, const char* help)
+      : Metric(name, help, MetricType::kGauge) {}
+
+  // Sets the value.
+  void Set(int32_t value) { value_.store(value, std::memory_order_relaxed); }
+
+  // Adds to the value.
+  //
+  // @param delta The amount to add, which may be negative.
+  void Add(int32_t delta) {
+    value_.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // Gets the value.
+  int32_t value() const { return value_.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<int32_t> value_{0};
+};
+
+// Counts values in buckets of exponentially increasing size.
+//
+// Bucket `i` counts the values in (2^(i-1), 2^i], except that bucket 0 counts
+// all values up to 1 and the last bucket counts all values above
+// 2^(kBucketCount - 2). For latencies in microseconds, the buckets range from
+// 1 us to about 4 seconds, and the relative error of any quantile is at most
+// a factor of 2.
+class Histogram : public Metric {
+ public:
+  // Number of buckets, including the last one for values that are too large.
+  static constexpr int kBucketCount = 24;
+
+  Histogram(const char* name, const char* help)
+      : Metric(name, help, MetricType::kHistogram) {}
+
+  // Gets the inclusive upper bound of a bucket.
+  //
+  // @param bucket The bucket index, less than `kBucketCount - 1` (the last
+  // bucket has no upper bound).
+  // @returns The largest value counted in the bucket.
+  static uint32_t BucketUpperBound(int bucket) { return 1u << bucket; }
+
+  // Adds a value to the histogram.
+  void Record(uint32_t value);
+
+  // Gets the number of values in a bucket.
+  //
+  // @param index The bucket index, less than `kBucketCount`.
+  uint32_t bucket(int index) const {
+    return buckets_[index].load(std::memory_order_relaxed);
+  }
+
+  // Gets the sum of all values recorded.
+  uint64_t sum() const;
+
+ private:
+  std::atomic<uint32_t> buckets_[kBucketCount] = {};
+  // The sum is split in two words because 64-bit atomics are not lock-free on
+  // Cortex-M.
+  std::atomic<uint32_t> sum_low_{0};
+  std::atomic<uint32_t> sum_high_{0};
+};
+
+// Records the time from its construction to its destruction (in microseconds)
+// into a histogram.
+class HistogramTimer {
+ public:
+  explicit HistogramTimer(Histogram* histogram)
+      : histogram_(histogram), start_(TimerMicros()) {}
+  ~HistogramTimer() {
+    histogram_->Record(static_cast<uint32_t>(TimerMicros() - start_));
+  }
+
+  HistogramTimer(const HistogramTimer&) = delete;
+  HistogramTimer& operator=(const HistogramTimer&) = delete;
+
+ private:
+  Histogram* histogram_;
+  uint64_t start_;
+};
+
+// Gets the first metric in the registry of the current core.
+//
+// @returns The most recently registered metric, or nullptr if there are none.
+// Use `Metric::next()` to iterate over the others.
+const Metric* MetricsBegin();
+
+// Produces all metrics of the current core in the Prometheus text exposition
+// format, one line at a time, so the whole text is never held in memory.
+//
+// Histograms are exported with cumulative `_bucket` series, plus `_sum` and
+// `_count`, as Prometheus expects.
+class PrometheusTextGenerator {
+ public:
+  PrometheusTextGenerator() : metric_(MetricsBegin()) {}
+
+  // Writes the next part of the text into `buffer`.
+  //
+  // @param buffer The buffer to write into.
+  // @param size The size of `buffer` in bytes.
+  // @returns The number of bytes written, or 0 once the text is complete.
+  int operator()(uint8_t* buffer, size_t size);
+
+ private:
+  bool NextLine();
+
+  const Metric* metric_;
+  // Next line of the current metric: 0 is the header, and histograms have one
+  // line per bucket followed by the sum and count.
+  int metric_line_ = 0;
+  uint32_t cumulative_ = 0;
+  std::string line_;
+  size_t offset_ = 0;
+};
+
+// Gets all metrics of the current core as a JSON object, such as:
+//
+// ```
+// {"coralmicro_camera_frames_total": {"type": "counter", "value": 12},
+//  "coralmicro_tpu_invoke_microseconds": {"type": "histogram",
+//      "count": 3, "sum": 10512, "bounds": [1, 2, ...],
+//      "buckets": [0, 0, ...]}}
+// ```
+//
+// Histogram buckets are not cumulative, and `bounds` holds the inclusive upper
+// bound of each bucket except the last one.
+//
+// @returns The JSON object.
+std::string MetricsJson();
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_METRICS_H_
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/mjpeg_streamer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "libs/base/check.h"
+#include "libs/base/mutex.h"
+#include "third_party/freertos_kernel/include/task.h"
+
+namespace coralmicro {
+namespace {
+constexpr char kContentType[] =
+    "multipart/x-mixed-replace; boundary=coralmicroframe";
+constexpr char kPartHeader[] =
+    "--coralmicroframe\r\n"
+    "Content-Type: image/jpeg\r\n"
+    "Content-Length: %u\r\n\r\n";
+constexpr char kPartTrailer[] = "\r\n";
+constexpr size_t kPartTrailerSize = sizeof(kPartTrailer) - 1;
+constexpr size_t kMaxPartHeaderSize = 96;
+
+TickType_t FrameInterval(int max_fps) {
+  return max_fps > 0 ? pdMS_TO_TICKS(1000 / max_fps) : 0;
+}
+}  // namespace
+
+// Sends frames to one HTTP client. This runs on the lwIP TCP/IP thread.
+class MjpegStreamer::Client {
+ public:
+  Client(MjpegStreamer* streamer, TickType_t interval)
+      : streamer_(streamer), interval_(interval) {
+    MutexLock lock(streamer_->mutex_);
+    ++streamer_->stats_.clients;
+  }
+
+  ~Client() {
+    MutexLock lock(streamer_->mutex_);
+    --streamer_->stats_.clients;
+  }
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  int Fill(uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      if (!frame_ && !NextFrame()) break;
+      written += Copy(buffer + written, size - written);
+    }
+    return written > 0 ? written : HttpServer::Generator::kPending;
+  }
+
+ private:
+  // Takes the latest frame if it is new and the frame-rate cap allows it.
+  bool NextFrame() {
+    MutexLock lock(streamer_->mutex_);
+    if (!streamer_->latest_ || streamer_->sequence_ == sequence_) return false;
+
+    auto now = xTaskGetTickCount();
+    if (started_) {
+      if (now - last_frame_ticks_ < interval_) return false;
+      streamer_->stats_.frames_dropped += streamer_->sequence_ - sequence_ - 1;
+    }
+    started_ = true;
+    last_frame_ticks_ = now;
+    sequence_ = streamer_->sequence_;
+    frame_ = streamer_->latest_;
+    ++streamer_->stats_.frames_sent;
+
+    header_size_ = std::snprintf(header_, sizeof(header_), kPartHeader,
+                                 static_cast<unsigned>(frame_->size()));
+    CHECK(header_size_ < sizeof(header_));
+    offset_ = 0;
+    return true;
+  }
+
+  // Copies the next bytes of the current part: header, frame, and trailer.
+  size_t Copy(uint8_t* buffer, size_t size) {
+    const size_t frame_end = header_size_ + frame_->size();
+    const void* data;
+    size_t len;
+    if (offset_ < header_size_) {
+      data = header_ + offset_;
+      len = header_size_ - offset_;
+    } else if (offset_ < frame_end) {
+      data = frame_->data() + (offset_ - header_size_);
+      len = frame_end - offset_;
+    } else {
+      data = kPartTrailer + (offset_ - frame_end);
+      len = frame_end + kPartTrailerSize - offset_;
+    }
+    len = std::min(len, size);
+    std::memcpy(buffer, data, len);
+    offset_ += len;
+    // Releases the frame so that its buffer can be reused.
+    if (offset_ == frame_end + kPartTrailerSize) frame_.reset();
+    return len;
+  }
+
+  MjpegStreamer* streamer_;
+  TickType_t interval_;
+  TickType_t last_frame_ticks_ = 0;
+  bool started_ = false;
+  uint32_t sequence_ = 0;
+  std::shared_ptr<const Frame> frame_;
+  char header_[kMaxPartHeaderSize];
+  size_t header_size_ = 0;
+  size_t offset_ = 0;
+};
+
+MjpegStreamer::MjpegStreamer(int max_fps)
+    : mutex_(xSemaphoreCreateMutex()),
+      default_interval_(FrameInterval(max_fps)) {
+  CHECK(mutex_);
+}
+
+MjpegStreamer::~MjpegStreamer() { vSemaphoreDelete(mutex_); }
+
+HttpServer::Content MjpegStreamer::Stream(int max_fps) {
+  auto interval = max_fps < 0 ? default_interval_ : FrameInterval(max_fps);
+  auto client = std::make_shared<Client>(this, interval);
+
+  HttpServer::Generator generator;
+  generator.fill = [client](uint8_t* buffer, size_t size) {
+    return client->Fill(buffer, size);
+  };
+  generator.chunked = false;
+  generator.content_type = kContentType;
+  return generator;
+}
+
+bool MjpegStreamer::HasClients() {
+  MutexLock lock(mutex_);
+  return stats_.clients > 0;
+}
+
+std::shared_ptr<MjpegStreamer::Frame> MjpegStreamer::AcquireFrame() {
+  MutexLock lock(mutex_);
+  // A buffer only referenced by the pool is not being sent to any client.
+  for (auto& frame : pool_) {
+    if (frame != latest_ && frame.use_count() == 1) {
+      frame->clear();
+      return frame;
+    }
+  }
+  pool_.push_back(std::make_shared<Frame>());
+  return pool_.back();
+}
+
+void MjpegStreamer::PublishFrame(std::shared_ptr<Frame> frame) {
+  {
+    MutexLock lock(mutex_);
+    latest_ = std::move(frame);
+    ++sequence_;
+    ++stats_.frames_published;
+    if (stats_.clients == 0) return;
+  }
+  HttpServer::ResumeGenerators();
+}
+
+MjpegStreamer::Stats MjpegStreamer::GetStats() {
+  MutexLock lock(mutex_);
+  return stats_;
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_MJPEG_STREAMER_H_
+#define LIBS_BASE_MJPEG_STREAMER_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "libs/base/http_server.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+
+namespace coralmicro {
+
+// Streams JPEG frames to HTTP clients as a `multipart/x-mixed-replace`
+// response, which browsers display like a video in an `<img>` element.
+//
+// A producer task encodes each frame into a buffer from `AcquireFrame()` and
+// passes it to `PublishFrame()`. Frame buffers are recycled once no client is
+// sending them, so their memory is reused from frame to frame. Each client
+// keeps its connection open and always receives the latest frame: frames
+// published while a slow client is still sending an earlier frame, or that
+// would exceed the client's frame-rate cap, are dropped for that client.
+//
+// The streamer must outlive all streams returned by `Stream()`.
+class MjpegStreamer {
+ public:
+  // Buffer holding one JPEG-encoded frame.
+  using Frame = std::vector<uint8_t>;
+
+  // Counters describing the streamer's activity.
+  struct Stats {
+    // Number of connected clients.
+    int clients;
+    // Number of frames passed to `PublishFrame()`.
+    uint32_t frames_published;
+    // Number of frames sent, summed over all clients.
+    uint32_t frames_sent;
+    // Number of frames skipped, summed over all clients.
+    uint32_t frames_dropped;
+  };
+
+  // @param max_fps The default frame-rate cap for each client, or 0 for no
+  //   cap.
+  explicit MjpegStreamer(int max_fps = 0);
+  ~MjpegStreamer();
+
+  MjpegStreamer(const MjpegStreamer&) = delete;
+  MjpegStreamer& operator=(const MjpegStreamer&) = delete;
+
+  // Starts a stream for a new client. Return this from an
+  // `HttpServer::UriHandler`.
+  //
+  // @param max_fps The frame-rate cap for this client, or a negative value to
+  //   use the default cap.
+  // @returns The response content.
+  HttpServer::Content Stream(int max_fps = -1);
+
+  // Returns whether any client is connected. Producers can use this to skip
+  // capturing frames that nobody receives.
+  bool HasClients();
+
+  // Gets an empty buffer to encode the next frame into. The buffer keeps its
+  // capacity from previous frames.
+  //
+  // @returns The frame buffer.
+  std::shared_ptr<Frame> AcquireFrame();
+
+  // Sends a frame to all clients that are ready for it.
+  //
+  // @param frame The JPEG-encoded frame, typically from `AcquireFrame()`. It
+  //   must not be modified afterwards.
+  void PublishFrame(std::shared_ptr<Frame> frame);
+
+  // Gets the streamer's counters.
+  Stats GetStats();
+
+ private:
+  class Client;
+
+  SemaphoreHandle_t mutex_;
+  TickType_t default_interval_;
+  std::vector<std::shared_ptr<Frame>> pool_;
+  std::shared_ptr<Frame> latest_;
+  uint32_t sequence_ = 0;
+  Stats stats_{};
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_MJPEG_STREAMER_H_
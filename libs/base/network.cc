@@ -21,18 +21,45 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <iterator>
 
 #include "libs/base/filesystem.h"
 #include "libs/base/utils.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/api.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/task.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/dns.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/priv/sockets_priv.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/sockets.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/tcp.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/tcpip.h"
 
 namespace coralmicro {
 
 namespace {
 inline constexpr const char kDnsServerPath[] = "/dns_server";
+
+// Size of the `WriteMessage()` prefix.
+constexpr size_t kMessageHeaderSize = 5;
+
+// Returns the netconn behind a TCP socket, or nullptr for other sockets.
+struct netconn* GetTcpConn(int fd) {
+  struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+  if (!sock || !sock->conn) return nullptr;
+  if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP)
+    return nullptr;
+  return sock->conn;
+}
+
+void MakeMessageHeader(uint8_t type, size_t size,
+                       uint8_t header[kMessageHeaderSize]) {
+  header[0] = static_cast<uint8_t>(size);
+  header[1] = static_cast<uint8_t>(size >> 8);
+  header[2] = static_cast<uint8_t>(size >> 16);
+  header[3] = static_cast<uint8_t>(size >> 24);
+  header[4] = type;
 }
+}  // namespace
 
 IOStatus ReadBytes(int fd, void* bytes, size_t size) {
   assert(fd >= 0);
@@ -64,18 +91,64 @@ IOStatus WriteBytes(int fd, const void* bytes, size_t size, size_t chunk_size) {
       if (errno == EINTR) continue;
       return IOStatus::kError;
     }
-    size -= len;
-    buf += len;
+    size -= ret;
+    buf += ret;
   }
 
   return IOStatus::kOk;
 }
 
+IOStatus WriteVectors(int fd, const IoVector* vectors, size_t count,
+                      WriteMode mode) {
+  assert(fd >= 0);
+  assert(vectors || count == 0);
+
+  struct netconn* conn = GetTcpConn(fd);
+  if (!conn) return IOStatus::kError;
+
+  // Vectors go to the stack in batches. The stack queues all vectors of a
+  // batch before it sends anything, but sends what it can after each batch.
+  // NETCONN_MORE only leaves PSH off the segments of all but the last batch.
+  constexpr size_t kMaxBatch = 8;
+  struct netvector batch[kMaxBatch];
+  for (size_t start = 0; start < count; start += kMaxBatch) {
+    const size_t n = std::min(kMaxBatch, count - start);
+    size_t size = 0;
+    for (size_t i = 0; i < n; ++i) {
+      batch[i].ptr = vectors[start + i].data;
+      batch[i].len = vectors[start + i].size;
+      size += batch[i].len;
+    }
+    if (size == 0) continue;
+
+    uint8_t flags = mode == WriteMode::kNoCopy ? NETCONN_NOCOPY : NETCONN_COPY;
+    if (start + n < count) flags |= NETCONN_MORE;
+    // Blocking netconns only return once everything is queued, waiting for
+    // room in the send buffer as needed.
+    size_t written = 0;
+    if (netconn_write_vectors_partly(conn, batch, n, flags, &written) !=
+            ERR_OK ||
+        written != size)
+      return IOStatus::kError;
+  }
+  return IOStatus::kOk;
+}
+
+IOStatus WriteBytesNoCopy(int fd, const void* bytes, size_t size) {
+  const IoVector vector = {bytes, size};
+  return WriteVectors(fd, &vector, 1, WriteMode::kNoCopy);
+}
+
 IOStatus WriteMessage(int fd, uint8_t type, const void* bytes, size_t size,
                       size_t chunk_size) {
-  const uint8_t header[] = {
-      static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
-      static_cast<uint8_t>(size >> 16), static_cast<uint8_t>(size >> 24), type};
+  uint8_t header[kMessageHeaderSize];
+  MakeMessageHeader(type, size, header);
+
+  // For TCP, the prefix shares the first segment with the bytes.
+  if (GetTcpConn(fd)) {
+    const IoVector vectors[] = {{header, sizeof(header)}, {bytes, size}};
+    return WriteVectors(fd, vectors, std::size(vectors));
+  }
 
   auto ret = WriteBytes(fd, header, sizeof(header), chunk_size);
   if (ret != IOStatus::kOk) return ret;
@@ -83,6 +156,70 @@ IOStatus WriteMessage(int fd, uint8_t type, const void* bytes, size_t size,
   return WriteBytes(fd, bytes, size, chunk_size);
 }
 
+IOStatus WriteMessageNoCopy(int fd, uint8_t type, const void* bytes,
+                            size_t size) {
+  struct netconn* conn = GetTcpConn(fd);
+  if (!conn) return IOStatus::kError;
+
+  // The prefix is on the stack, so it's copied. netconn sends after every
+  // write, which would put the prefix in a segment of its own, so it's queued
+  // with as much of the bytes as fits in the send buffer and both are sent
+  // together.
+  uint8_t header[kMessageHeaderSize];
+  MakeMessageHeader(type, size, header);
+  const uint8_t more = size != 0 ? TCP_WRITE_FLAG_MORE : 0;
+  size_t queued = 0;
+  LOCK_TCPIP_CORE();
+  struct tcp_pcb* pcb = conn->pcb.tcp;
+  err_t err = ERR_CONN;
+  if (pcb && tcp_sndbuf(pcb) >= sizeof(header)) {
+    err = tcp_write(pcb, header, sizeof(header), TCP_WRITE_FLAG_COPY | more);
+    if (err == ERR_OK) {
+      queued = std::min<size_t>(size, tcp_sndbuf(pcb));
+      const uint8_t flags = queued < size ? TCP_WRITE_FLAG_MORE : 0;
+      // Out of segments: the netconn write below sends the prefix with the
+      // bytes once there is room.
+      if (queued != 0 && tcp_write(pcb, bytes, queued, flags) != ERR_OK) {
+        queued = 0;
+      } else {
+        tcp_output(pcb);
+      }
+    }
+  }
+  UNLOCK_TCPIP_CORE();
+
+  // Without room for the prefix, wait for it like any other write.
+  if (err != ERR_OK &&
+      netconn_write(conn, header, sizeof(header),
+                    NETCONN_COPY | (size != 0 ? NETCONN_MORE : 0)) != ERR_OK)
+    return IOStatus::kError;
+  if (queued == size) return IOStatus::kOk;
+  return WriteBytesNoCopy(fd, static_cast<const uint8_t*>(bytes) + queued,
+                          size - queued);
+}
+
+IOStatus SocketWaitSent(int fd, int timeout_ms) {
+  struct netconn* conn = GetTcpConn(fd);
+  if (!conn) return IOStatus::kError;
+
+  const TickType_t start = xTaskGetTickCount();
+  const TickType_t timeout = pdMS_TO_TICKS(std::max(timeout_ms, 0));
+  while (true) {
+    LOCK_TCPIP_CORE();
+    struct tcp_pcb* pcb = conn->pcb.tcp;
+    const bool sent = pcb && !pcb->unsent && !pcb->unacked;
+    const bool expired = xTaskGetTickCount() - start >= timeout;
+    // Aborting frees the queued segments, and with them the references to
+    // the written buffers. The netconn sees the connection as reset.
+    if (pcb && !sent && expired) tcp_abort(pcb);
+    UNLOCK_TCPIP_CORE();
+    if (sent) return IOStatus::kOk;
+    // The segments of a reset or aborted connection are freed with its pcb.
+    if (!pcb || expired) return IOStatus::kError;
+    vTaskDelay(1);
+  }
+}
+
 bool SocketHasPendingInput(int sockfd) {
   char buf;
   return lwip_recv(sockfd, &buf, 1, MSG_DONTWAIT) == 1;
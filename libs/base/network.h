@@ -54,6 +54,34 @@ IOStatus ReadArray(int fd, T* array, size_t array_size) {
   return ReadBytes(fd, array, array_size * sizeof(T));
 }
 
+// The default chunk size of `WriteBytes()` and `WriteMessage()`. Each chunk is
+// a separate call into the TCP/IP thread, so larger chunks cost less CPU per
+// byte; lwIP still splits them into segments that fit the send buffer.
+inline constexpr size_t kDefaultWriteChunkSize = 16 * 1024;
+
+// The default time that `SocketWaitSent()` waits for the peer to acknowledge
+// the data written to a socket.
+inline constexpr int kDefaultWaitSentTimeoutMs = 10000;
+
+// How the network stack handles the data passed to `WriteVectors()`.
+enum class WriteMode {
+  // The data is copied into network buffers, so the caller can reuse its
+  // buffers as soon as the write returns.
+  kCopy,
+  // The data is referenced in place until the peer acknowledges it, which
+  // saves a copy of every byte. The caller must keep its buffers unchanged
+  // until `SocketWaitSent()` returns.
+  kNoCopy,
+};
+
+// A buffer for `WriteVectors()`.
+struct IoVector {
+  // The data to write.
+  const void* data;
+  // The size of the data.
+  size_t size;
+};
+
 // Writes data from a buffer into a socket file descriptor.
 //
 // @param fd The file descriptor to write to.
@@ -62,7 +90,7 @@ IOStatus ReadArray(int fd, T* array, size_t array_size) {
 // @param chunk_size The size of the chunk to write.
 // @return The status result of the operation.
 IOStatus WriteBytes(int fd, const void* bytes, size_t size,
-                    size_t chunk_size = 1024);
+                    size_t chunk_size = kDefaultWriteChunkSize);
 
 // Writes data from an array into a socket file descriptor.
 //
@@ -77,6 +105,30 @@ IOStatus WriteArray(int fd, const T* array, size_t array_size) {
   return WriteBytes(fd, array, array_size * sizeof(T));
 }
 
+// Writes several buffers into a TCP socket file descriptor. Up to eight
+// buffers are queued in a single call into the network stack before any of
+// them is sent, so that small buffers such as headers share TCP segments with
+// the data that follows them.
+//
+// @param fd The TCP socket file descriptor to write to.
+// @param vectors The buffers to write, in order.
+// @param count The number of buffers.
+// @param mode Whether the data is copied or referenced in place.
+// @return The status result of the operation.
+IOStatus WriteVectors(int fd, const IoVector* vectors, size_t count,
+                      WriteMode mode = WriteMode::kCopy);
+
+// Writes data from a buffer into a TCP socket file descriptor without copying
+// it, which suits large buffers such as camera frames.
+//
+// The buffer must stay unchanged until `SocketWaitSent()` returns.
+//
+// @param fd The TCP socket file descriptor to write to.
+// @param bytes The buffer of data to write.
+// @param size The size of the buffer.
+// @return The status result of the operation.
+IOStatus WriteBytesNoCopy(int fd, const void* bytes, size_t size);
+
 // Writes a `message` with custom type from a buffer into a socket file
 // descriptor.
 //
@@ -87,10 +139,43 @@ IOStatus WriteArray(int fd, const T* array, size_t array_size) {
 // custom message type.
 // @param bytes The buffer of data to write.
 // @param size The size of the buffer.
-// @param chunk_size The size of the chunk to write.
+// @param chunk_size The size of the chunk to write. Ignored for TCP sockets,
+// which get the prefix and the bytes in a single write.
 // @return The status result of the operation.
 IOStatus WriteMessage(int fd, uint8_t type, const void* bytes, size_t size,
-                      size_t chunk_size = 1024);
+                      size_t chunk_size = kDefaultWriteChunkSize);
+
+// Writes a `message` like `WriteMessage()`, but without copying the bytes.
+//
+// The prefix is copied and sent in the same segment as the start of the
+// bytes. The buffer must stay unchanged until `SocketWaitSent()` returns.
+//
+// @param fd The TCP socket file descriptor to write to.
+// @param type The type of the message.
+// @param bytes The buffer of data to write.
+// @param size The size of the buffer.
+// @return The status result of the operation.
+IOStatus WriteMessageNoCopy(int fd, uint8_t type, const void* bytes,
+                            size_t size);
+
+// Waits until the peer acknowledged all data written to a TCP socket, after
+// which buffers written with `WriteMode::kNoCopy` can be reused.
+//
+// If the peer doesn't acknowledge the data within `timeout_ms`, for example
+// because it stopped reading, the connection is aborted so that the network
+// stack releases the buffers; the socket must still be closed.
+//
+// The socket must not be closed by another task while this or one of the
+// `NoCopy()` writes is running, because they use the socket without holding
+// a reference to it.
+//
+// @param fd The TCP socket file descriptor to wait for.
+// @param timeout_ms The longest time to wait for the peer, in milliseconds.
+// @return `IOStatus::kOk` once all data is acknowledged, or
+// `IOStatus::kError` if the connection was closed or reset first, or the
+// timeout expired. In all cases the network stack no longer references the
+// written buffers.
+IOStatus SocketWaitSent(int fd, int timeout_ms = kDefaultWaitSentTimeoutMs);
 
 // Checks whether a socket file descriptor still has some bytes to read.
 //
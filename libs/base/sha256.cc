@@ -0,0 +1,192 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/sha256.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace coralmicro {
+namespace {
+constexpr uint32_t kInitialState[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+                                       0xa54ff53a, 0x510e527f, 0x9b05688c,
+                                       0x1f83d9ab, 0x5be0cd19};
+
+constexpr uint32_t kRoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+// Compiles to a single ROR on ARM.
+inline uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+// Compiles to a single REV on ARM, and works on unaligned data.
+inline uint32_t LoadBigEndian(const uint8_t* p) {
+  uint32_t x;
+  std::memcpy(&x, p, sizeof(x));
+  return __builtin_bswap32(x);
+}
+
+inline void StoreBigEndian(uint32_t x, uint8_t* p) {
+  x = __builtin_bswap32(x);
+  std::memcpy(p, &x, sizeof(x));
+}
+
+inline uint32_t Sigma0(uint32_t x) {
+  return Rotr(x, 2) ^ Rotr(x, 13) ^ Rotr(x, 22);
+}
+inline uint32_t Sigma1(uint32_t x) {
+  return Rotr(x, 6) ^ Rotr(x, 11) ^ Rotr(x, 25);
+}
+inline uint32_t Gamma0(uint32_t x) {
+  return Rotr(x, 7) ^ Rotr(x, 18) ^ (x >> 3);
+}
+inline uint32_t Gamma1(uint32_t x) {
+  return Rotr(x, 17) ^ Rotr(x, 19) ^ (x >> 10);
+}
+inline uint32_t Choose(uint32_t e, uint32_t f, uint32_t g) {
+  return g ^ (e & (f ^ g));
+}
+inline uint32_t Majority(uint32_t a, uint32_t b, uint32_t c) {
+  return (a & b) | (c & (a | b));
+}
+}  // namespace
+
+// One round, with the working variables passed in rotated order instead of
+// being shifted, so that all eight stay in registers.
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, i, w)                           \
+  do {                                                                       \
+    uint32_t t1 =                                                            \
+        h + Sigma1(e) + Choose(e, f, g) + kRoundConstants[i] + (w);          \
+    d += t1;                                                                 \
+    h = t1 + Sigma0(a) + Majority(a, b, c);                                  \
+  } while (0)
+
+// Eight rounds starting at round `i`, getting the message word of each round
+// from `W(round)`.
+#define SHA256_EIGHT_ROUNDS(i, W)                                            \
+  do {                                                                       \
+    SHA256_ROUND(a, b, c, d, e, f, g, h, (i) + 0, W((i) + 0));               \
+    SHA256_ROUND(h, a, b, c, d, e, f, g, (i) + 1, W((i) + 1));               \
+    SHA256_ROUND(g, h, a, b, c, d, e, f, (i) + 2, W((i) + 2));               \
+    SHA256_ROUND(f, g, h, a, b, c, d, e, (i) + 3, W((i) + 3));               \
+    SHA256_ROUND(e, f, g, h, a, b, c, d, (i) + 4, W((i) + 4));               \
+    SHA256_ROUND(d, e, f, g, h, a, b, c, (i) + 5, W((i) + 5));               \
+    SHA256_ROUND(c, d, e, f, g, h, a, b, (i) + 6, W((i) + 6));               \
+    SHA256_ROUND(b, c, d, e, f, g, h, a, (i) + 7, W((i) + 7));               \
+  } while (0)
+
+void Sha256::Transform(const uint8_t* blocks, size_t count) {
+  uint32_t w[16];
+  // The message schedule is kept in a rolling window of 16 words.
+#define SHA256_LOAD(i) (w[i] = LoadBigEndian(blocks + (i) * 4))
+#define SHA256_NEXT(i)                                                       \
+  (w[(i) & 15] += Gamma1(w[((i) - 2) & 15]) + w[((i) - 7) & 15] +            \
+                  Gamma0(w[((i) - 15) & 15]))
+  for (; count; --count, blocks += kBlockSize) {
+    uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+    uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+
+    SHA256_EIGHT_ROUNDS(0, SHA256_LOAD);
+    SHA256_EIGHT_ROUNDS(8, SHA256_LOAD);
+    for (int i = 16; i < 64; i += 16) {
+      SHA256_EIGHT_ROUNDS(i, SHA256_NEXT);
+      SHA256_EIGHT_ROUNDS(i + 8, SHA256_NEXT);
+    }
+
+    state_[0] += a;
+    state_[1] += b;
+    state_[2] += c;
+    state_[3] += d;
+    state_[4] += e;
+    state_[5] += f;
+    state_[6] += g;
+    state_[7] += h;
+  }
+#undef SHA256_LOAD
+#undef SHA256_NEXT
+}
+
+#undef SHA256_EIGHT_ROUNDS
+#undef SHA256_ROUND
+
+void Sha256::Reset() {
+  std::memcpy(state_, kInitialState, sizeof(state_));
+  length_low_ = 0;
+  length_high_ = 0;
+  buffered_ = 0;
+}
+
+void Sha256::Update(const void* data, size_t size) {
+  const auto* p = static_cast<const uint8_t*>(data);
+
+  // The length is kept in two words because it is 64-bit in the padding, and
+  // 64-bit arithmetic is slower on Cortex-M.
+  const uint32_t low = length_low_;
+  length_low_ += size;
+  if (length_low_ < low) ++length_high_;
+
+  if (buffered_) {
+    const size_t n = std::min(size, kBlockSize - buffered_);
+    std::memcpy(buffer_ + buffered_, p, n);
+    buffered_ += n;
+    p += n;
+    size -= n;
+    if (buffered_ < kBlockSize) return;
+    Transform(buffer_, 1);
+    buffered_ = 0;
+  }
+
+  // Whole blocks are hashed straight from the caller's buffer.
+  const size_t blocks = size / kBlockSize;
+  Transform(p, blocks);
+  p += blocks * kBlockSize;
+  size -= blocks * kBlockSize;
+
+  std::memcpy(buffer_, p, size);
+  buffered_ = size;
+}
+
+Sha256Digest Sha256::Finish() {
+  const uint32_t bits_high = (length_high_ << 3) | (length_low_ >> 29);
+  const uint32_t bits_low = length_low_ << 3;
+
+  buffer_[buffered_++] = 0x80;
+  if (buffered_ > kBlockSize - 8) {
+    std::memset(buffer_ + buffered_, 0, kBlockSize - buffered_);
+    Transform(buffer_, 1);
+    buffered_ = 0;
+  }
+  std::memset(buffer_ + buffered_, 0, kBlockSize - 8 - buffered_);
+  StoreBigEndian(bits_high, buffer_ + kBlockSize - 8);
+  StoreBigEndian(bits_low, buffer_ + kBlockSize - 4);
+  Transform(buffer_, 1);
+  buffered_ = 0;
+
+  Sha256Digest digest;
+  for (int i = 0; i < 8; ++i) StoreBigEndian(state_[i], &digest[i * 4]);
+  return digest;
+}
+
+}  // namespace coralmicro
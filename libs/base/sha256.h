@@ -0,0 +1,88 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_SHA256_H_
+#define LIBS_BASE_SHA256_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace coralmicro {
+
+// Size of a SHA-256 digest in bytes.
+inline constexpr size_t kSha256DigestSize = 32;
+
+// A SHA-256 digest.
+using Sha256Digest = std::array<uint8_t, kSha256DigestSize>;
+
+// Computes a SHA-256 digest (FIPS 180-4) incrementally, so data can be hashed
+// in chunks as it is streamed, without holding all of it in memory:
+//
+// ```
+// Sha256 sha;
+// while (auto n = ReadChunk(buffer, sizeof(buffer))) sha.Update(buffer, n);
+// Sha256Digest digest = sha.Finish();
+// ```
+//
+// This runs on the CPU, so unlike `A71ChGetSha256()` it has no size limit and
+// doesn't have to send the data over I2C. To hash a file, use
+// `LfsSha256File()`.
+class Sha256 {
+ public:
+  Sha256() { Reset(); }
+
+  // Starts a new digest, discarding all data seen so far.
+  void Reset();
+
+  // Adds data to the digest.
+  //
+  // @param data The data to hash.
+  // @param size The size of `data` in bytes.
+  void Update(const void* data, size_t size);
+
+  // Completes the digest of all data seen since the last `Reset()`. The
+  // object must be reset before it is updated again.
+  //
+  // @returns The SHA-256 digest.
+  Sha256Digest Finish();
+
+ private:
+  static constexpr size_t kBlockSize = 64;
+
+  void Transform(const uint8_t* blocks, size_t count);
+
+  uint32_t state_[8];
+  uint32_t length_low_;
+  uint32_t length_high_;
+  uint8_t buffer_[kBlockSize];
+  size_t buffered_;
+};
+
+// Computes the SHA-256 digest of a memory buffer.
+//
+// @param data The data to hash.
+// @param size The size of `data` in bytes.
+// @returns The SHA-256 digest.
+inline Sha256Digest Sha256Hash(const void* data, size_t size) {
+  Sha256 sha;
+  sha.Update(data, size);
+  return sha.Finish();
+}
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_SHA256_H_
@@ -41,10 +41,12 @@ enum {
   kUsbHostTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kEdgeTpuDfuTaskPriority = TaskPriority<configMAX_PRIORITIES - 2>,
   kEdgeTpuTaskPriority = TaskPriority<configMAX_PRIORITIES - 2>,
+  kEdgeTpuQueueTaskPriority = TaskPriority<configMAX_PRIORITIES - 2>,
   kRandomTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kPmicTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kCameraTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kAudioTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
+  kLfsFlushTaskPriority = TaskPriority<configMAX_PRIORITIES - 2>,
 };
 #elif (__CORTEX_M == 4)
 enum {
@@ -53,6 +55,7 @@ enum {
   kAppTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kCameraTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
   kPmicTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
+  kLfsFlushTaskPriority = TaskPriority<configMAX_PRIORITIES - 1>,
 };
 #else
 #error "__CORTEX_M not defined"
@@ -0,0 +1,195 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+
+#include "libs/base/strings.h"
+#include "libs/base/timer.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/task.h"
+#include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_gpt.h"
+#include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/fsl_device_registers.h"
+
+namespace coralmicro {
+namespace {
+constexpr uint32_t kInterruptTask = 0;
+
+struct Zone {
+  const char* name;
+  // Handle of the task that recorded the zone, or `kInterruptTask`.
+  uint32_t task;
+  uint32_t start_micros;
+  uint32_t micros;
+  uint32_t cycles;
+  // Index of the zone plus one once it is completely written, 0 while it is
+  // being written.
+  std::atomic<uint32_t> sequence;
+};
+
+// Index of the next zone to record. `g_zones` holds the last
+// `kTraceZoneCount` zones.
+std::atomic<uint32_t> g_next_zone{0};
+__attribute__((section(".sdram_bss,\"aw\",%nobits @")))
+__attribute__((aligned(64))) Zone g_zones[kTraceZoneCount];
+
+// GPT1 counts microseconds for `TimerMicros()`. It is shared by both cores, so
+// their zones are on the same time base.
+inline uint32_t Micros() { return GPT_GetCurrentTimerCount(GPT1); }
+
+inline uint32_t Cycles() { return DWT->CYCCNT; }
+
+// Copies zone `index` if it has not been overwritten. This is a sequence lock:
+// the zone is only valid if its sequence is unchanged after the copy.
+bool ReadZone(uint32_t index, Zone* copy) {
+  const Zone& zone = g_zones[index % kTraceZoneCount];
+  if (zone.sequence.load(std::memory_order_acquire) != index + 1) return false;
+  copy->name = zone.name;
+  copy->task = zone.task;
+  copy->start_micros = zone.start_micros;
+  copy->micros = zone.micros;
+  copy->cycles = zone.cycles;
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return zone.sequence.load(std::memory_order_relaxed) == index + 1;
+}
+}  // namespace
+
+void TraceInit() {
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#if (__CORTEX_M == 7)
+  // The M7's DWT is locked after reset.
+  DWT->LAR = 0xC5ACCE55;
+#endif
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+  // .sdram_bss is not zeroed at boot.
+  for (auto& zone : g_zones) zone.sequence.store(0, std::memory_order_relaxed);
+  g_next_zone.store(0, std::memory_order_release);
+}
+
+TraceZone::TraceZone(const char* name)
+    : name_(name), start_micros_(Micros()), start_cycles_(Cycles()) {}
+
+TraceZone::~TraceZone() {
+  const uint32_t cycles = Cycles() - start_cycles_;
+  const uint32_t micros = Micros() - start_micros_;
+  const uint32_t task =
+      __get_IPSR() ? kInterruptTask
+                   : reinterpret_cast<uint32_t>(xTaskGetCurrentTaskHandle());
+
+  const uint32_t index = g_next_zone.fetch_add(1, std::memory_order_relaxed);
+  Zone& zone = g_zones[index % kTraceZoneCount];
+  zone.sequence.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  zone.name = name_;
+  zone.task = task;
+  zone.start_micros = start_micros_;
+  zone.micros = micros;
+  zone.cycles = cycles;
+  zone.sequence.store(index + 1, std::memory_order_release);
+}
+
+TraceJsonGenerator::TraceJsonGenerator()
+    : end_zone_(g_next_zone.load(std::memory_order_acquire)),
+      now_micros_(TimerMicros()) {
+  next_zone_ = end_zone_ > kTraceZoneCount ? end_zone_ - kTraceZoneCount : 0;
+
+  std::vector<TaskStatus_t> infos(uxTaskGetNumberOfTasks());
+  infos.resize(uxTaskGetSystemState(infos.data(), infos.size(), nullptr));
+  tasks_.reserve(infos.size() + 1);
+  tasks_.emplace_back(kInterruptTask, "interrupts");
+  for (const auto& info : infos) {
+    tasks_.emplace_back(reinterpret_cast<uint32_t>(info.xHandle),
+                        info.pcTaskName);
+  }
+
+  line_ = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+}
+
+int TraceJsonGenerator::operator()(uint8_t* buffer, size_t size) {
+  size_t written = 0;
+  while (written < size) {
+    if (offset_ == line_.size() && !NextLine()) break;
+    auto len = std::min(size - written, line_.size() - offset_);
+    std::memcpy(buffer + written, line_.data() + offset_, len);
+    offset_ += len;
+    written += len;
+  }
+  return written;
+}
+
+bool TraceJsonGenerator::NextLine() {
+  line_ = first_event_ ? "\n" : ",\n";
+  offset_ = 0;
+  first_event_ = false;
+
+  const int pid = __CORTEX_M;
+  if (!process_sent_) {
+    process_sent_ = true;
+    StrAppend(&line_,
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"args\":{\"name\":\"M%d\"}}",
+              pid, pid);
+    return true;
+  }
+
+  if (next_task_ < tasks_.size()) {
+    const auto& [handle, name] = tasks_[next_task_++];
+    StrAppend(&line_,
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+              pid, handle, name.c_str());
+    return true;
+  }
+
+  while (next_zone_ != end_zone_) {
+    Zone zone;
+    if (!ReadZone(next_zone_++, &zone)) continue;
+    // Zone times are the low 32 bits of `TimerMicros()`, so they are converted
+    // relative to when the generator was created. The timestamp is printed as
+    // a double because newlib-nano's printf has no 64-bit integer support.
+    const uint32_t age = static_cast<uint32_t>(now_micros_) - zone.start_micros;
+    StrAppend(&line_,
+              "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%lu,"
+              "\"ts\":%.0f,\"dur\":%lu,\"args\":{\"cycles\":%lu}}",
+              zone.name, pid, zone.task,
+              static_cast<double>(now_micros_ - age), zone.micros, zone.cycles);
+    return true;
+  }
+
+  if (!tail_sent_) {
+    tail_sent_ = true;
+    line_ = "\n]}\n";
+    return true;
+  }
+  return false;
+}
+
+void TracePrintJson() {
+  TraceJsonGenerator generator;
+  uint8_t buffer[256];
+  int size;
+  while ((size = generator(buffer, sizeof(buffer))) > 0) {
+    printf("%.*s", size, reinterpret_cast<char*>(buffer));
+  }
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_TRACE_H_
+#define LIBS_BASE_TRACE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Records the time spent in the enclosing scope as a trace zone, for example:
+//
+// ```
+// void ProcessFrame() {
+//   TRACE_ZONE("app/ProcessFrame");
+//   ...
+// }
+// ```
+//
+// `name` must be a string literal (only the pointer is stored) and must not
+// contain quotes or backslashes.
+//
+// Zones compile to nothing unless the build is configured with
+// `-DUSE_TRACE=ON`, so they can be left in hot paths.
+#if CORAL_MICRO_TRACE
+#define TRACE_ZONE_CONCAT_INNER(a, b) a##b
+#define TRACE_ZONE_CONCAT(a, b) TRACE_ZONE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) \
+  ::coralmicro::TraceZone TRACE_ZONE_CONCAT(trace_zone_, __LINE__)(name)
+#else
+#define TRACE_ZONE(name) static_cast<void>(0)
+#endif
+
+namespace coralmicro {
+
+// Number of zones kept by each core. Once full, the oldest zones are
+// overwritten.
+inline constexpr size_t kTraceZoneCount = 2048;
+
+// Starts the cycle counter and clears the trace buffer of the current core.
+//
+// Programs do not need to call this because it is automatically called
+// internally on both cores.
+void TraceInit();
+
+// Records a zone from its construction to its destruction. Use `TRACE_ZONE()`
+// instead of using this directly.
+//
+// Zones are stored in a lock-free ring buffer of the current core, so they can
+// be recorded from any task or interrupt handler. Each zone stores its wall
+// clock time (in microseconds, comparable across cores) and the number of CPU
+// cycles counted by the DWT cycle counter. The cycle count excludes time when
+// the core was asleep, but includes time spent in other tasks.
+class TraceZone {
+ public:
+  explicit TraceZone(const char* name);
+  ~TraceZone();
+
+  TraceZone(const TraceZone&) = delete;
+  TraceZone& operator=(const TraceZone&) = delete;
+
+ private:
+  const char* name_;
+  uint32_t start_micros_;
+  uint32_t start_cycles_;
+};
+
+// Produces the zones recorded on the current core as Chrome trace-event JSON,
+// which can be opened with https://ui.perfetto.dev or chrome://tracing.
+//
+// The JSON is produced one zone at a time, so it is never held in memory as a
+// whole, and zones keep being recorded while it is produced. Zones that are
+// overwritten before they are reached are left out.
+class TraceJsonGenerator {
+ public:
+  TraceJsonGenerator();
+
+  // Writes the next part of the JSON into `buffer`.
+  //
+  // @param buffer The buffer to write into.
+  // @param size The size of `buffer` in bytes.
+  // @returns The number of bytes written, or 0 once the JSON is complete.
+  int operator()(uint8_t* buffer, size_t size);
+
+ private:
+  bool NextLine();
+
+  // Handle and name of every task that exists when the generator is created.
+  std::vector<std::pair<uint32_t, std::string>> tasks_;
+  uint32_t next_zone_;
+  uint32_t end_zone_;
+  uint64_t now_micros_;
+  bool process_sent_ = false;
+  size_t next_task_ = 0;
+  bool first_event_ = true;
+  bool tail_sent_ = false;
+  std::string line_;
+  size_t offset_ = 0;
+};
+
+// Prints the zones recorded on the current core to the serial console as
+// Chrome trace-event JSON (see `TraceJsonGenerator`).
+void TracePrintJson();
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_TRACE_H_
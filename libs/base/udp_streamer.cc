@@ -0,0 +1,282 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/udp_streamer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "third_party/freertos_kernel/include/task.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/sockets.h"
+
+namespace coralmicro {
+namespace {
+// Size of the decoder state at the start of ADPCM payloads.
+constexpr size_t kAdpcmStateSize = 4;
+
+// IMA ADPCM tables.
+constexpr int16_t kAdpcmSteps[] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+constexpr int kMaxAdpcmIndex = std::size(kAdpcmSteps) - 1;
+constexpr int8_t kAdpcmIndexChanges[] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                         -1, -1, -1, -1, 2, 4, 6, 8};
+
+// Encodes one sample, updating the predictor and step index like the decoder
+// does.
+uint8_t AdpcmEncode(int16_t sample, int16_t* predictor, uint8_t* index) {
+  int step = kAdpcmSteps[*index];
+  int diff = sample - *predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+  int delta = step >> 3;
+  for (uint8_t bit = 4; bit; bit >>= 1) {
+    if (diff >= step) {
+      code |= bit;
+      diff -= step;
+      delta += step;
+    }
+    step >>= 1;
+  }
+  const int value = *predictor + (code & 8 ? -delta : delta);
+  *predictor = std::clamp(value, -32768, 32767);
+  *index = std::clamp(*index + kAdpcmIndexChanges[code], 0, kMaxAdpcmIndex);
+  return code;
+}
+
+size_t SamplesPerPacket(UdpPayloadType type, size_t payload_size) {
+  switch (type) {
+    case UdpPayloadType::kAudioS16:
+      return payload_size / sizeof(int16_t);
+    case UdpPayloadType::kAudioS32:
+      return payload_size / sizeof(int32_t);
+    case UdpPayloadType::kAudioAdpcm:
+      return (payload_size - kAdpcmStateSize) * 2;
+    default:
+      return 0;
+  }
+}
+}  // namespace
+
+UdpStreamer::UdpStreamer(const Options& options)
+    : options_(options),
+      packet_(std::max(options.max_packet_size,
+                       sizeof(UdpPacketHeader) + kAdpcmStateSize + 1)) {}
+
+UdpStreamer::~UdpStreamer() {
+  if (socket_ != -1) lwip_close(socket_);
+}
+
+bool UdpStreamer::Listen(int port) {
+  if (socket_ != -1) lwip_close(socket_);
+  socket_ = lwip_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (socket_ == -1) return false;
+
+  struct sockaddr_in bind_address = {};
+  bind_address.sin_family = AF_INET;
+  bind_address.sin_port = PP_HTONS(port);
+  bind_address.sin_addr.s_addr = PP_HTONL(INADDR_ANY);
+  if (lwip_bind(socket_, reinterpret_cast<struct sockaddr*>(&bind_address),
+                sizeof(bind_address)) == -1) {
+    lwip_close(socket_);
+    socket_ = -1;
+    return false;
+  }
+  return true;
+}
+
+int UdpStreamer::ReceiveRequest(void* buffer, size_t size, int timeout_ms) {
+  if (socket_ == -1) return -1;
+  struct timeval timeout;
+  timeout.tv_sec = timeout_ms / 1000;
+  timeout.tv_usec = (timeout_ms % 1000) * 1000;
+  lwip_setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_in address;
+  socklen_t address_size = sizeof(address);
+  auto ret = lwip_recvfrom(socket_, buffer, size, 0,
+                           reinterpret_cast<struct sockaddr*>(&address),
+                           &address_size);
+  if (ret < 0) return -1;
+  has_client_ = true;
+  client_ip_ = address.sin_addr.s_addr;
+  client_port_ = address.sin_port;
+  last_request_ticks_ = xTaskGetTickCount();
+  return ret;
+}
+
+bool UdpStreamer::HasClient() {
+  if (socket_ == -1) return false;
+  uint8_t request[64];
+  struct sockaddr_in address;
+  socklen_t address_size = sizeof(address);
+  while (lwip_recvfrom(socket_, request, sizeof(request), MSG_DONTWAIT,
+                       reinterpret_cast<struct sockaddr*>(&address),
+                       &address_size) >= 0) {
+    has_client_ = true;
+    client_ip_ = address.sin_addr.s_addr;
+    client_port_ = address.sin_port;
+    last_request_ticks_ = xTaskGetTickCount();
+    address_size = sizeof(address);
+  }
+  if (has_client_ && xTaskGetTickCount() - last_request_ticks_ >
+                         pdMS_TO_TICKS(options_.client_timeout_ms))
+    has_client_ = false;
+  return has_client_;
+}
+
+void UdpStreamer::Reset() {
+  start_ticks_ = xTaskGetTickCount();
+  sequence_ = 0;
+  sample_index_ = 0;
+  audio_chunk_ = 0;
+  jpeg_frame_ = 0;
+  adpcm_ = {};
+  stats_ = {};
+}
+
+bool UdpStreamer::SendPacket(size_t payload_size) {
+  if (!has_client_) return false;
+  // The sequence number counts dropped packets too, so that receivers see the
+  // loss.
+  auto* header = reinterpret_cast<UdpPacketHeader*>(packet_.data());
+  header->sequence = sequence_++;
+
+  struct sockaddr_in address = {};
+  address.sin_len = sizeof(address);
+  address.sin_family = AF_INET;
+  address.sin_port = client_port_;
+  address.sin_addr.s_addr = client_ip_;
+  const int attempts =
+      options_.loss_policy == UdpLossPolicy::kRetry ? 1 + options_.max_retries
+                                                    : 1;
+  for (int i = 0; i < attempts; ++i) {
+    if (i > 0) {
+      ++stats_.retries;
+      vTaskDelay(1);
+    }
+    if (lwip_sendto(socket_, packet_.data(),
+                    sizeof(UdpPacketHeader) + payload_size, 0,
+                    reinterpret_cast<struct sockaddr*>(&address),
+                    sizeof(address)) >= 0) {
+      ++stats_.packets_sent;
+      return true;
+    }
+  }
+  ++stats_.packets_dropped;
+  return false;
+}
+
+bool UdpStreamer::SendAudio(const int32_t* samples, size_t count,
+                            UdpPayloadType type) {
+  const size_t samples_per_packet = SamplesPerPacket(type, MaxPayloadSize());
+  if (samples_per_packet == 0) return false;
+  const size_t packets = (count + samples_per_packet - 1) / samples_per_packet;
+
+  bool ok = true;
+  auto* header = reinterpret_cast<UdpPacketHeader*>(packet_.data());
+  for (size_t i = 0; i < packets; ++i) {
+    const size_t n = std::min(samples_per_packet, count);
+    uint8_t* payload = Payload();
+    size_t payload_size = 0;
+    if (type == UdpPayloadType::kAudioS32) {
+      payload_size = n * sizeof(int32_t);
+      std::memcpy(payload, samples, payload_size);
+    } else if (type == UdpPayloadType::kAudioS16) {
+      payload_size = n * sizeof(int16_t);
+      for (size_t j = 0; j < n; ++j) {
+        const int16_t sample = samples[j] >> 16;
+        std::memcpy(payload + j * sizeof(sample), &sample, sizeof(sample));
+      }
+    } else {
+      std::memcpy(payload, &adpcm_.predictor, sizeof(adpcm_.predictor));
+      payload[2] = adpcm_.index;
+      payload[3] = 0;
+      uint8_t* codes = payload + kAdpcmStateSize;
+      for (size_t j = 0; j < n; ++j) {
+        const uint8_t code =
+            AdpcmEncode(samples[j] >> 16, &adpcm_.predictor, &adpcm_.index);
+        if (j % 2 == 0)
+          codes[j / 2] = code;
+        else
+          codes[j / 2] |= code << 4;
+      }
+      payload_size = kAdpcmStateSize + (n + 1) / 2;
+    }
+
+    header->version = kUdpStreamVersion;
+    header->payload_type = static_cast<uint8_t>(type);
+    header->sample_count = n;
+    header->timestamp = sample_index_;
+    header->frame = audio_chunk_;
+    header->fragment = i;
+    header->fragment_count = packets;
+    // A lost audio packet only leaves a gap, so the rest is still sent.
+    ok = SendPacket(payload_size) && ok;
+
+    samples += n;
+    count -= n;
+    sample_index_ += n;
+  }
+  ++audio_chunk_;
+  return ok;
+}
+
+bool UdpStreamer::SendJpeg(const uint8_t* jpeg, size_t size) {
+  const size_t max_payload_size = MaxPayloadSize();
+  const size_t packets =
+      std::max<size_t>(1, (size + max_payload_size - 1) / max_payload_size);
+  const uint32_t frame = jpeg_frame_++;
+  if (packets > UINT16_MAX) {
+    ++stats_.frames_dropped;
+    return false;
+  }
+
+  auto* header = reinterpret_cast<UdpPacketHeader*>(packet_.data());
+  const uint32_t timestamp =
+      (xTaskGetTickCount() - start_ticks_) * portTICK_PERIOD_MS;
+  for (size_t i = 0; i < packets; ++i) {
+    const size_t n = std::min(max_payload_size, size);
+    std::memcpy(Payload(), jpeg, n);
+    header->version = kUdpStreamVersion;
+    header->payload_type = static_cast<uint8_t>(UdpPayloadType::kJpeg);
+    header->sample_count = 0;
+    header->timestamp = timestamp;
+    header->frame = frame;
+    header->fragment = i;
+    header->fragment_count = packets;
+    if (!SendPacket(n)) {
+      ++stats_.frames_dropped;
+      return false;
+    }
+    jpeg += n;
+    size -= n;
+  }
+  return true;
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,207 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_UDP_STREAMER_H_
+#define LIBS_BASE_UDP_STREAMER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+
+namespace coralmicro {
+
+// Version of the packet format, in `UdpPacketHeader::version`.
+inline constexpr uint8_t kUdpStreamVersion = 1;
+
+// Payload types of UDP stream packets.
+enum class UdpPayloadType : uint8_t {
+  // Mono 16-bit little-endian samples.
+  kAudioS16 = 0,
+  // Mono 32-bit little-endian samples.
+  kAudioS32 = 1,
+  // Mono IMA ADPCM, 4 bits per 16-bit sample. The payload starts with the
+  // decoder state before the first sample (`int16_t` predictor, `uint8_t`
+  // step index, and a padding byte), so each packet decodes on its own. The
+  // first sample of each byte is in its low nibble.
+  kAudioAdpcm = 2,
+  // A fragment of a JPEG frame. A frame is the concatenation of the payloads
+  // of its fragments.
+  kJpeg = 3,
+};
+
+// Header at the start of every UDP stream packet. All fields are
+// little-endian.
+struct UdpPacketHeader {
+  // Always `kUdpStreamVersion`.
+  uint8_t version;
+  // A `UdpPayloadType`.
+  uint8_t payload_type;
+  // Number of audio samples in the packet, 0 for JPEG.
+  uint16_t sample_count;
+  // Incremented by one for each packet, so receivers can detect losses and
+  // reordering.
+  uint32_t sequence;
+  // Audio: index of the first sample in the stream. JPEG: milliseconds since
+  // the stream started.
+  uint32_t timestamp;
+  // Number of the frame (JPEG) or audio chunk that the packet belongs to.
+  uint32_t frame;
+  // Index of the packet within its frame.
+  uint16_t fragment;
+  // Number of packets that make up the frame.
+  uint16_t fragment_count;
+} __attribute__((packed));
+
+static_assert(sizeof(UdpPacketHeader) == 20, "Packet header size changed");
+
+// What to do when the network stack has no buffer for a packet.
+enum class UdpLossPolicy {
+  // Drop the packet. For JPEG, the rest of the frame is dropped too, because
+  // the receiver can't decode an incomplete frame. This never delays the
+  // caller, which suits live audio.
+  kDrop,
+  // Wait one tick and retry, up to `UdpStreamer::Options::max_retries` times,
+  // then drop as above.
+  kRetry,
+};
+
+// Streams audio and JPEG frames as sequence-numbered, timestamped UDP
+// packets.
+//
+// Unlike a TCP stream, a lost packet never delays the packets after it, and
+// sending never waits for the receiver, so a capture loop keeps up with the
+// microphone or camera on a lossy link. Receivers reorder packets, hide lost
+// audio packets, and discard incomplete frames (see
+// `examples/audio_streaming/udp_client.py`).
+//
+// Clients subscribe by sending any datagram to the port passed to
+// `Listen()`, and must keep sending one at least every
+// `Options::client_timeout_ms` to keep receiving packets. Packets go to the
+// client that sent the latest datagram.
+//
+// The streamer is not thread-safe: call it from one task.
+class UdpStreamer {
+ public:
+  // Streaming options.
+  struct Options {
+    // The largest packet, including the header. Keep it below the path MTU:
+    // a datagram split by IP is lost as a whole when any of its parts is.
+    size_t max_packet_size = 1400;
+    // What to do when the network stack has no buffer for a packet.
+    UdpLossPolicy loss_policy = UdpLossPolicy::kDrop;
+    // Number of retries with `UdpLossPolicy::kRetry`.
+    int max_retries = 3;
+    // Time after the client's latest datagram until the client is considered
+    // gone.
+    int client_timeout_ms = 5000;
+  };
+
+  // Counters describing the stream.
+  struct Stats {
+    // Number of packets sent.
+    uint32_t packets_sent;
+    // Number of packets dropped because the network stack had no buffer.
+    uint32_t packets_dropped;
+    // Number of retries with `UdpLossPolicy::kRetry`.
+    uint32_t retries;
+    // Number of JPEG frames not sent completely.
+    uint32_t frames_dropped;
+  };
+
+  UdpStreamer() : UdpStreamer(Options()) {}
+  explicit UdpStreamer(const Options& options);
+  ~UdpStreamer();
+
+  UdpStreamer(const UdpStreamer&) = delete;
+  UdpStreamer& operator=(const UdpStreamer&) = delete;
+
+  // Opens a UDP socket that receives client datagrams.
+  //
+  // @param port The port to receive datagrams on.
+  // @returns True upon success, false otherwise.
+  bool Listen(int port);
+
+  // Waits for a datagram from a client, which becomes the destination of the
+  // stream.
+  //
+  // @param buffer The buffer to receive the datagram in, such as a request
+  //   with stream parameters.
+  // @param size The size of the buffer.
+  // @param timeout_ms The maximum time to wait, or 0 to wait forever.
+  // @returns The size of the datagram, or -1 upon timeout or error.
+  int ReceiveRequest(void* buffer, size_t size, int timeout_ms = 0);
+
+  // Reads the client's pending datagrams without waiting, and returns whether
+  // the client is still subscribed.
+  bool HasClient();
+
+  // Starts a new stream: sequence numbers, timestamps and frame numbers
+  // restart from 0 and the counters are cleared.
+  void Reset();
+
+  // Sends audio samples, as many packets as needed.
+  //
+  // @param samples Samples as captured by `AudioReader`.
+  // @param count The number of samples.
+  // @param type The encoding of the samples, one of the audio payload types.
+  // @returns True if all packets were sent, false if any was dropped.
+  bool SendAudio(const int32_t* samples, size_t count, UdpPayloadType type);
+
+  // Sends a JPEG frame, fragmented into as many packets as needed.
+  //
+  // @param jpeg The JPEG-encoded frame.
+  // @param size The size of the frame.
+  // @returns True if the whole frame was sent, false if it was dropped.
+  bool SendJpeg(const uint8_t* jpeg, size_t size);
+
+  // Gets the stream's counters.
+  Stats GetStats() const { return stats_; }
+
+ private:
+  // Encoder state of `UdpPayloadType::kAudioAdpcm`.
+  struct AdpcmState {
+    int16_t predictor;
+    uint8_t index;
+  };
+
+  bool SendPacket(size_t payload_size);
+  uint8_t* Payload() { return packet_.data() + sizeof(UdpPacketHeader); }
+  size_t MaxPayloadSize() const {
+    return packet_.size() - sizeof(UdpPacketHeader);
+  }
+
+  Options options_;
+  int socket_ = -1;
+  bool has_client_ = false;
+  // Client address and port, in network byte order.
+  uint32_t client_ip_ = 0;
+  uint16_t client_port_ = 0;
+  TickType_t last_request_ticks_ = 0;
+  TickType_t start_ticks_ = 0;
+  std::vector<uint8_t> packet_;
+  uint32_t sequence_ = 0;
+  uint32_t sample_index_ = 0;
+  uint32_t audio_chunk_ = 0;
+  uint32_t jpeg_frame_ = 0;
+  AdpcmState adpcm_{};
+  Stats stats_{};
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_UDP_STREAMER_H_
@@ -0,0 +1,593 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/base/websocket_server.h"
+
+#include <strings.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <utility>
+
+#include "libs/base/check.h"
+#include "libs/base/mutex.h"
+
+namespace coralmicro {
+namespace {
+// Frame opcodes (RFC 6455, section 5.2).
+constexpr uint8_t kContinuation = 0x0;
+constexpr uint8_t kText = 0x1;
+constexpr uint8_t kBinary = 0x2;
+constexpr uint8_t kClose = 0x8;
+constexpr uint8_t kPing = 0x9;
+constexpr uint8_t kPong = 0xA;
+
+constexpr uint8_t kFinBit = 0x80;
+constexpr uint8_t kReservedBits = 0x70;
+constexpr uint8_t kOpcodeBits = 0x0F;
+constexpr uint8_t kControlBit = 0x08;
+constexpr uint8_t kMaskBit = 0x80;
+constexpr uint8_t kLengthBits = 0x7F;
+constexpr uint8_t kLength16 = 126;
+constexpr uint8_t kLength64 = 127;
+constexpr size_t kMaxControlPayloadSize = 125;
+constexpr size_t kMaskSize = 4;
+constexpr size_t kMaxHeaderSize = 2 + 8 + kMaskSize;
+
+// Close status codes (RFC 6455, section 7.4.1).
+constexpr uint16_t kProtocolError = 1002;
+constexpr uint16_t kMessageTooBig = 1009;
+
+constexpr char kAcceptGuid[] = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+constexpr char kBadRequest[] =
+    "HTTP/1.1 400 Bad Request\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+constexpr char kUpgradeRequired[] =
+    "HTTP/1.1 426 Upgrade Required\r\n"
+    "Sec-WebSocket-Version: 13\r\n"
+    "Content-Length: 0\r\n"
+    "Connection: close\r\n\r\n";
+
+uint32_t RotateLeft(uint32_t value, int bits) {
+  return (value << bits) | (value >> (32 - bits));
+}
+
+// SHA-1 is only used for the handshake, which needs no hardware acceleration.
+std::array<uint8_t, 20> Sha1(const std::string& data) {
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  std::string message = data;
+  message.push_back('\x80');
+  while (message.size() % 64 != 56) message.push_back('\0');
+  const uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+  for (int i = 7; i >= 0; --i)
+    message.push_back(static_cast<char>(bits >> (8 * i)));
+
+  for (size_t block = 0; block < message.size(); block += 64) {
+    const auto* p = reinterpret_cast<const uint8_t*>(message.data() + block);
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+      w[i] = static_cast<uint32_t>(p[4 * i]) << 24 |
+             static_cast<uint32_t>(p[4 * i + 1]) << 16 |
+             static_cast<uint32_t>(p[4 * i + 2]) << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; ++i)
+      w[i] = RotateLeft(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+      uint32_t f, k;
+      if (i < 20) {
+        f = (b & c) | (~b & d);
+        k = 0x5A827999;
+      } else if (i < 40) {
+        f = b ^ c ^ d;
+        k = 0x6ED9EBA1;
+      } else if (i < 60) {
+        f = (b & c) | (b & d) | (c & d);
+        k = 0x8F1BBCDC;
+      } else {
+        f = b ^ c ^ d;
+        k = 0xCA62C1D6;
+      }
+      uint32_t temp = RotateLeft(a, 5) + f + e + k + w[i];
+      e = d;
+      d = c;
+      c = RotateLeft(b, 30);
+      b = a;
+      a = temp;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+  }
+
+  std::array<uint8_t, 20> digest;
+  for (int i = 0; i < 20; ++i) digest[i] = h[i / 4] >> (24 - 8 * (i % 4));
+  return digest;
+}
+
+std::string Base64(const uint8_t* data, size_t size) {
+  constexpr char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out;
+  for (size_t i = 0; i < size; i += 3) {
+    uint32_t group = static_cast<uint32_t>(data[i]) << 16;
+    if (i + 1 < size) group |= static_cast<uint32_t>(data[i + 1]) << 8;
+    if (i + 2 < size) group |= data[i + 2];
+    out.push_back(kAlphabet[(group >> 18) & 0x3F]);
+    out.push_back(kAlphabet[(group >> 12) & 0x3F]);
+    out.push_back(i + 1 < size ? kAlphabet[(group >> 6) & 0x3F] : '=');
+    out.push_back(i + 2 < size ? kAlphabet[group & 0x3F] : '=');
+  }
+  return out;
+}
+
+// Computes the Sec-WebSocket-Accept header value for a Sec-WebSocket-Key.
+std::string AcceptKey(const std::string& key) {
+  auto digest = Sha1(key + kAcceptGuid);
+  return Base64(digest.data(), digest.size());
+}
+
+// Builds an unmasked frame, as sent by servers.
+std::shared_ptr<const std::vector<uint8_t>> MakeFrame(uint8_t opcode,
+                                                      const void* data,
+                                                      size_t size) {
+  auto frame = std::make_shared<std::vector<uint8_t>>();
+  frame->reserve(kMaxHeaderSize + size);
+  frame->push_back(kFinBit | opcode);
+  if (size < kLength16) {
+    frame->push_back(size);
+  } else if (size <= 0xFFFF) {
+    frame->push_back(kLength16);
+    frame->push_back(size >> 8);
+    frame->push_back(size);
+  } else {
+    frame->push_back(kLength64);
+    for (int i = 7; i >= 0; --i)
+      frame->push_back(static_cast<uint64_t>(size) >> (8 * i));
+  }
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  frame->insert(frame->end(), bytes, bytes + size);
+  return frame;
+}
+
+HttpServer::Generator ErrorResponse(const char* headers) {
+  HttpServer::Generator generator;
+  generator.fill = [](uint8_t*, size_t) { return 0; };
+  generator.size = 0;
+  generator.headers = headers;
+  return generator;
+}
+}  // namespace
+
+// Sends frames to one WebSocket client and parses the frames it sends. This
+// runs on the lwIP TCP/IP thread, except for the functions that are called
+// with the server mutex held, which any task can call.
+class WebSocketServer::Client {
+ public:
+  explicit Client(WebSocketServer* server) : server_(server) {
+    MutexLock lock(server_->mutex_);
+    id_ = server_->next_client_id_++;
+    server_->clients_.push_back(this);
+    ++server_->stats_.clients;
+  }
+
+  ~Client() {
+    MutexLock lock(server_->mutex_);
+    auto& clients = server_->clients_;
+    clients.erase(std::remove(clients.begin(), clients.end(), this),
+                  clients.end());
+    --server_->stats_.clients;
+  }
+
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  int id() const { return id_; }
+
+  // Queues a data frame, dropping frames if the queue is full. Called with
+  // the server mutex held.
+  bool Queue(std::shared_ptr<const Frame> frame) {
+    if (closing_) return false;
+    auto& stats = server_->stats_;
+    const size_t max_queued_bytes = server_->max_queued_bytes_;
+    if (queued_bytes_ > 0 && queued_bytes_ + frame->size() > max_queued_bytes) {
+      if (server_->drop_policy_ == DropPolicy::kDropNewest) {
+        ++stats.messages_dropped;
+        return false;
+      }
+      while (queued_bytes_ > 0 &&
+             queued_bytes_ + frame->size() > max_queued_bytes) {
+        auto it = std::find_if(queue_.begin(), queue_.end(),
+                               [](const Queued& queued) {
+                                 return !queued.control;
+                               });
+        queued_bytes_ -= it->frame->size();
+        queue_.erase(it);
+        ++stats.messages_dropped;
+      }
+    }
+    queued_bytes_ += frame->size();
+    queue_.push_back({std::move(frame), false});
+    return true;
+  }
+
+  // Sends a ping, or closes the connection if the previous ping wasn't
+  // answered. Called with the server mutex held.
+  void Ping(std::shared_ptr<const Frame> ping) {
+    if (closing_) return;
+    if (awaiting_pong_) {
+      Abort();
+      return;
+    }
+    awaiting_pong_ = true;
+    QueueControl(std::move(ping));
+  }
+
+  int Fill(uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+      if (!frame_ && !NextFrame()) break;
+      auto len = std::min(size - written, frame_->size() - offset_);
+      std::memcpy(buffer + written, frame_->data() + offset_, len);
+      offset_ += len;
+      written += len;
+      if (offset_ == frame_->size()) frame_.reset();
+    }
+    if (written > 0) return written;
+    MutexLock lock(server_->mutex_);
+    return closing_ && queue_.empty() ? 0 : HttpServer::Generator::kPending;
+  }
+
+  // Parses frames from the client. `size` is 0 once the client closed the
+  // connection.
+  void Receive(const uint8_t* data, size_t size) {
+    if (size == 0) {
+      {
+        MutexLock lock(server_->mutex_);
+        Abort();
+      }
+      receiving_ = false;
+      HttpServer::ResumeGenerators();
+      return;
+    }
+
+    while (size > 0 && receiving_) {
+      if (!in_payload_) {
+        const size_t needed = header_size_ < 2 ? 2 : HeaderSize();
+        auto len = std::min(needed - header_size_, size);
+        std::memcpy(header_ + header_size_, data, len);
+        header_size_ += len;
+        data += len;
+        size -= len;
+        if (header_size_ < 2 || header_size_ < HeaderSize()) continue;
+        if (StartFrame() && payload_size_ == 0) EndFrame();
+        continue;
+      }
+
+      auto len = static_cast<size_t>(
+          std::min<uint64_t>(size, payload_size_ - payload_received_));
+      for (size_t i = 0; i < len; ++i) {
+        payload_->push_back(data[i] ^
+                            mask_[(payload_received_ + i) % kMaskSize]);
+      }
+      payload_received_ += len;
+      data += len;
+      size -= len;
+      if (payload_received_ == payload_size_) EndFrame();
+    }
+  }
+
+ private:
+  struct Queued {
+    std::shared_ptr<const Frame> frame;
+    bool control;
+  };
+
+  // Queues a control frame ahead of the data frames, which may be delayed by
+  // a slow connection. Called with the server mutex held.
+  void QueueControl(std::shared_ptr<const Frame> frame) {
+    auto it = std::find_if(queue_.begin(), queue_.end(),
+                           [](const Queued& queued) {
+                             return !queued.control;
+                           });
+    queue_.insert(it, {std::move(frame), true});
+  }
+
+  // Drops all queued frames and ends the response once the current frame is
+  // sent. Called with the server mutex held.
+  void Abort() {
+    queue_.clear();
+    queued_bytes_ = 0;
+    closing_ = true;
+  }
+
+  bool NextFrame() {
+    MutexLock lock(server_->mutex_);
+    if (queue_.empty()) return false;
+    auto& queued = queue_.front();
+    if (!queued.control) {
+      queued_bytes_ -= queued.frame->size();
+      ++server_->stats_.messages_sent;
+    }
+    frame_ = std::move(queued.frame);
+    offset_ = 0;
+    queue_.pop_front();
+    return true;
+  }
+
+  // Sends a close frame as the last frame and stops parsing frames.
+  void Close(const uint8_t* payload, size_t size) {
+    {
+      MutexLock lock(server_->mutex_);
+      Abort();
+      queue_.push_back({MakeFrame(kClose, payload, size), true});
+    }
+    receiving_ = false;
+    HttpServer::ResumeGenerators();
+  }
+
+  void Close(uint16_t code) {
+    const uint8_t payload[] = {static_cast<uint8_t>(code >> 8),
+                               static_cast<uint8_t>(code)};
+    Close(payload, sizeof(payload));
+  }
+
+  size_t HeaderSize() const {
+    size_t size = 2;
+    const uint8_t length = header_[1] & kLengthBits;
+    if (length == kLength16) size += 2;
+    if (length == kLength64) size += 8;
+    if (header_[1] & kMaskBit) size += kMaskSize;
+    return size;
+  }
+
+  // Validates the frame header in `header_`. Returns false after closing the
+  // connection if the frame is invalid.
+  bool StartFrame() {
+    const size_t header_size = header_size_;
+    header_size_ = 0;
+    const uint8_t opcode = header_[0] & kOpcodeBits;
+    // Frames from clients must be masked.
+    if ((header_[0] & kReservedBits) || !(header_[1] & kMaskBit)) {
+      Close(kProtocolError);
+      return false;
+    }
+
+    const uint8_t length = header_[1] & kLengthBits;
+    if (length == kLength16 || length == kLength64) {
+      const size_t length_size = length == kLength16 ? 2 : 8;
+      payload_size_ = 0;
+      for (size_t i = 0; i < length_size; ++i)
+        payload_size_ = payload_size_ << 8 | header_[2 + i];
+    } else {
+      payload_size_ = length;
+    }
+    payload_received_ = 0;
+    fin_ = header_[0] & kFinBit;
+    opcode_ = opcode;
+    std::memcpy(mask_, header_ + header_size - kMaskSize, kMaskSize);
+
+    if (opcode & kControlBit) {
+      if ((opcode != kClose && opcode != kPing && opcode != kPong) || !fin_ ||
+          payload_size_ > kMaxControlPayloadSize) {
+        Close(kProtocolError);
+        return false;
+      }
+      control_.clear();
+      payload_ = &control_;
+    } else {
+      const bool valid = opcode == kContinuation
+                             ? in_message_
+                             : (opcode == kText || opcode == kBinary) &&
+                                   !in_message_;
+      if (!valid) {
+        Close(kProtocolError);
+        return false;
+      }
+      if (opcode != kContinuation) {
+        in_message_ = true;
+        binary_ = opcode == kBinary;
+        message_.clear();
+      }
+      if (payload_size_ > server_->max_message_size_ - message_.size()) {
+        Close(kMessageTooBig);
+        return false;
+      }
+      payload_ = &message_;
+    }
+    payload_->reserve(payload_->size() + payload_size_);
+    in_payload_ = true;
+    return true;
+  }
+
+  void EndFrame() {
+    in_payload_ = false;
+    switch (opcode_) {
+      case kClose:
+        // Echoes the status code, if any, and closes the connection.
+        Close(control_.data(), std::min<size_t>(control_.size(), 2));
+        break;
+      case kPing: {
+        {
+          MutexLock lock(server_->mutex_);
+          if (!closing_)
+            QueueControl(MakeFrame(kPong, control_.data(), control_.size()));
+        }
+        HttpServer::ResumeGenerators();
+        break;
+      }
+      case kPong: {
+        MutexLock lock(server_->mutex_);
+        awaiting_pong_ = false;
+        break;
+      }
+      default:
+        if (!fin_) break;
+        in_message_ = false;
+        {
+          MutexLock lock(server_->mutex_);
+          ++server_->stats_.messages_received;
+        }
+        if (server_->message_handler_)
+          server_->message_handler_(id_, binary_, message_.data(),
+                                    message_.size());
+        break;
+    }
+  }
+
+  WebSocketServer* server_;
+  int id_;
+
+  // Sending state. `queue_`, `queued_bytes_`, `closing_` and `awaiting_pong_`
+  // are guarded by the server mutex.
+  std::deque<Queued> queue_;
+  size_t queued_bytes_ = 0;
+  bool closing_ = false;
+  bool awaiting_pong_ = false;
+  std::shared_ptr<const Frame> frame_;
+  size_t offset_ = 0;
+
+  // Receiving state.
+  bool receiving_ = true;
+  uint8_t header_[kMaxHeaderSize];
+  size_t header_size_ = 0;
+  bool in_payload_ = false;
+  uint8_t opcode_ = 0;
+  bool fin_ = false;
+  uint8_t mask_[kMaskSize];
+  uint64_t payload_size_ = 0;
+  uint64_t payload_received_ = 0;
+  std::vector<uint8_t>* payload_ = nullptr;
+  std::vector<uint8_t> control_;
+  bool in_message_ = false;
+  bool binary_ = false;
+  std::vector<uint8_t> message_;
+};
+
+WebSocketServer::WebSocketServer(size_t max_queued_bytes,
+                                 DropPolicy drop_policy, int ping_interval_ms,
+                                 size_t max_message_size)
+    : mutex_(xSemaphoreCreateMutex()),
+      max_queued_bytes_(max_queued_bytes),
+      drop_policy_(drop_policy),
+      max_message_size_(max_message_size) {
+  CHECK(mutex_);
+  if (ping_interval_ms > 0) {
+    ping_timer_ =
+        xTimerCreate("websocket_ping", pdMS_TO_TICKS(ping_interval_ms),
+                     pdTRUE, this, PingCallback);
+    CHECK(ping_timer_);
+    CHECK(xTimerStart(ping_timer_, portMAX_DELAY) == pdPASS);
+  }
+}
+
+WebSocketServer::~WebSocketServer() {
+  if (ping_timer_) xTimerDelete(ping_timer_, portMAX_DELAY);
+  vSemaphoreDelete(mutex_);
+}
+
+void WebSocketServer::SetMessageHandler(MessageHandler handler) {
+  message_handler_ = std::move(handler);
+}
+
+HttpServer::Content WebSocketServer::Accept(const char* uri) {
+  auto upgrade = HttpServer::RequestHeader(uri, "Upgrade");
+  auto key = HttpServer::RequestHeader(uri, "Sec-WebSocket-Key");
+  if (strcasecmp(upgrade.c_str(), "websocket") != 0 || key.empty())
+    return ErrorResponse(kBadRequest);
+  if (HttpServer::RequestHeader(uri, "Sec-WebSocket-Version") != "13")
+    return ErrorResponse(kUpgradeRequired);
+
+  auto client = std::make_shared<Client>(this);
+  HttpServer::Generator generator;
+  generator.headers =
+      "HTTP/1.1 101 Switching Protocols\r\n"
+      "Upgrade: websocket\r\n"
+      "Connection: Upgrade\r\n"
+      "Sec-WebSocket-Accept: " +
+      AcceptKey(key) + "\r\n\r\n";
+  generator.fill = [client](uint8_t* buffer, size_t size) {
+    return client->Fill(buffer, size);
+  };
+  generator.receive = [client](const uint8_t* data, size_t size) {
+    client->Receive(data, size);
+  };
+  generator.chunked = false;
+  return generator;
+}
+
+void WebSocketServer::SendText(const std::string& text) {
+  if (!HasClients()) return;
+  SendFrame(MakeFrame(kText, text.data(), text.size()));
+}
+
+void WebSocketServer::SendBinary(const void* data, size_t size) {
+  if (!HasClients()) return;
+  SendFrame(MakeFrame(kBinary, data, size));
+}
+
+bool WebSocketServer::Send(int client, bool binary, const void* data,
+                           size_t size) {
+  auto frame = MakeFrame(binary ? kBinary : kText, data, size);
+  {
+    MutexLock lock(mutex_);
+    auto it = std::find_if(clients_.begin(), clients_.end(),
+                           [client](const Client* c) {
+                             return c->id() == client;
+                           });
+    if (it == clients_.end() || !(*it)->Queue(std::move(frame))) return false;
+  }
+  HttpServer::ResumeGenerators();
+  return true;
+}
+
+void WebSocketServer::SendFrame(std::shared_ptr<const Frame> frame) {
+  {
+    MutexLock lock(mutex_);
+    for (auto* client : clients_) client->Queue(frame);
+  }
+  HttpServer::ResumeGenerators();
+}
+
+void WebSocketServer::PingCallback(TimerHandle_t timer) {
+  auto* server = static_cast<WebSocketServer*>(pvTimerGetTimerID(timer));
+  {
+    MutexLock lock(server->mutex_);
+    if (server->clients_.empty()) return;
+    auto ping = MakeFrame(kPing, nullptr, 0);
+    for (auto* client : server->clients_) client->Ping(ping);
+  }
+  HttpServer::ResumeGenerators();
+}
+
+bool WebSocketServer::HasClients() {
+  MutexLock lock(mutex_);
+  return stats_.clients > 0;
+}
+
+WebSocketServer::Stats WebSocketServer::GetStats() {
+  MutexLock lock(mutex_);
+  return stats_;
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,168 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_BASE_WEBSOCKET_SERVER_H_
+#define LIBS_BASE_WEBSOCKET_SERVER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libs/base/http_server.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/freertos_kernel/include/timers.h"
+
+namespace coralmicro {
+
+// Pushes messages to WebSocket clients, such as browser dashboards that
+// display inference results as they are produced.
+//
+// WebSocket connections share the port of the `HttpServer`: return
+// `Accept()` from an `HttpServer::UriHandler` for the URI that clients
+// connect to, for example `new WebSocket("ws://10.10.10.1/ws")` in a browser.
+//
+// Messages passed to `SendText()` or `SendBinary()` are framed once and
+// queued to every connected client. Each client's queue holds at most
+// `max_queued_bytes`, so a slow client never delays the others: when a
+// message doesn't fit, the oldest queued message or the new one is dropped
+// for that client, depending on the `DropPolicy`. A message is only dropped
+// as a whole, and a message larger than the limit is still queued if nothing
+// else is.
+//
+// The server pings each client every `ping_interval_ms`, and closes the
+// connection of a client that didn't answer the previous ping. The interval
+// must be shorter than the idle timeout of the HTTP server (8 seconds), which
+// closes connections that send nothing.
+//
+// The handshake requires the request headers to arrive in a single TCP
+// segment (see `HttpServer::RequestHeader()`), which browsers always do.
+//
+// The server must outlive all connections returned by `Accept()`.
+class WebSocketServer {
+ public:
+  // What to drop when a message doesn't fit in a client's queue.
+  enum class DropPolicy {
+    // Drop queued messages, starting with the oldest, so that clients always
+    // get the latest messages. Suits streams of results or frames.
+    kDropOldest,
+    // Drop the new message, so that clients get the messages they already
+    // queued. Suits messages that build on each other.
+    kDropNewest,
+  };
+
+  // Counters describing the server's activity.
+  struct Stats {
+    // Number of connected clients.
+    int clients;
+    // Number of messages sent, summed over all clients.
+    uint32_t messages_sent;
+    // Number of messages dropped, summed over all clients.
+    uint32_t messages_dropped;
+    // Number of messages received from clients.
+    uint32_t messages_received;
+  };
+
+  // Called with each message received from a client. This runs on the lwIP
+  // TCP/IP thread, so it must not block; it can call the `Send` functions.
+  //
+  // @param client The ID of the client, for `Send()`.
+  // @param binary True for a binary message, false for a text message.
+  // @param data The message payload.
+  // @param size The size of the message.
+  using MessageHandler = std::function<void(int client, bool binary,
+                                            const uint8_t* data, size_t size)>;
+
+  // @param max_queued_bytes The size limit of each client's queue.
+  // @param drop_policy What to drop when a client's queue is full.
+  // @param ping_interval_ms The interval between pings, or 0 to not ping
+  //   clients.
+  // @param max_message_size The size limit of messages from clients. Clients
+  //   sending larger messages are disconnected.
+  explicit WebSocketServer(size_t max_queued_bytes = 64 * 1024,
+                           DropPolicy drop_policy = DropPolicy::kDropOldest,
+                           int ping_interval_ms = 5000,
+                           size_t max_message_size = 4096);
+  ~WebSocketServer();
+
+  WebSocketServer(const WebSocketServer&) = delete;
+  WebSocketServer& operator=(const WebSocketServer&) = delete;
+
+  // Sets the function called with messages from clients. Call this before
+  // clients connect.
+  //
+  // @param handler The message handler.
+  void SetMessageHandler(MessageHandler handler);
+
+  // Accepts a WebSocket connection. Return this from an
+  // `HttpServer::UriHandler`.
+  //
+  // @param uri The URI passed to the `UriHandler`.
+  // @returns The response content, which is an error response if the request
+  //   isn't a valid WebSocket handshake.
+  HttpServer::Content Accept(const char* uri);
+
+  // Sends a text message to all clients. Can be called from any task.
+  //
+  // @param text The message, which must be valid UTF-8.
+  void SendText(const std::string& text);
+
+  // Sends a binary message to all clients. Can be called from any task.
+  //
+  // @param data The message payload.
+  // @param size The size of the message.
+  void SendBinary(const void* data, size_t size);
+
+  // Sends a message to one client. Can be called from any task.
+  //
+  // @param client The ID of the client, as passed to the `MessageHandler`.
+  // @param binary True for a binary message, false for a text message.
+  // @param data The message payload.
+  // @param size The size of the message.
+  // @returns False if the client is disconnected or the message was dropped.
+  bool Send(int client, bool binary, const void* data, size_t size);
+
+  // Returns whether any client is connected. Producers can use this to skip
+  // computing messages that nobody receives.
+  bool HasClients();
+
+  // Gets the server's counters.
+  Stats GetStats();
+
+ private:
+  class Client;
+  using Frame = std::vector<uint8_t>;
+
+  void SendFrame(std::shared_ptr<const Frame> frame);
+  static void PingCallback(TimerHandle_t timer);
+
+  SemaphoreHandle_t mutex_;
+  TimerHandle_t ping_timer_ = nullptr;
+  size_t max_queued_bytes_;
+  DropPolicy drop_policy_;
+  size_t max_message_size_;
+  MessageHandler message_handler_;
+  std::vector<Client*> clients_;
+  int next_client_id_ = 0;
+  Stats stats_{};
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_BASE_WEBSOCKET_SERVER_H_
@@ -18,6 +18,8 @@
 
 #include "libs/base/check.h"
 #include "libs/base/gpio.h"
+#include "libs/base/metrics.h"
+#include "libs/base/trace.h"
 #include "libs/pmic/pmic.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_csi.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_lpi2c.h"
@@ -36,10 +38,17 @@ namespace coralmicro {
 namespace {
 constexpr uint8_t kCameraAddress = 0x24;
 constexpr int kFramebufferCount = 4;
-constexpr float kRedCoefficient = .2126;
-constexpr float kGreenCoefficient = .7152;
-constexpr float kBlueCoefficient = .0722;
-constexpr float kUint8Max = 255.0;
+
+Counter g_frames("coralmicro_camera_frames_total",
+                 "Frames received from the camera, including discarded ones.");
+Counter g_discarded_frames(
+    "coralmicro_camera_discarded_frames_total",
+    "Frames discarded with CameraTask::DiscardFrames().");
+Counter g_frame_errors("coralmicro_camera_frame_errors_total",
+                       "Calls to CameraTask::GetFrame() that failed.");
+Histogram g_get_frame_latency(
+    "coralmicro_camera_get_frame_microseconds",
+    "Time spent in CameraTask::GetFrame(), including waiting for a frame.");
 
 constexpr uint8_t kModelIdHExpected = 0x01;
 constexpr uint8_t kModelIdLExpected = 0xB0;
@@ -128,332 +137,6 @@ int FramebufferPtrToIndex(const uint8_t* framebuffer_ptr) {
   return -1;
 }
 
-void ResizeNearestNeighbor(const uint8_t* src, int src_w, int src_h,
-                           uint8_t* dst, int dst_w, int dst_h, int comps,
-                           bool preserve_aspect) {
-  int src_p = src_w * comps;
-  int dst_p = dst_w * comps;
-  float ratio_src = (float)src_w / src_h;
-  float ratio_dst = (float)dst_w / dst_h;
-  int scaled_w =
-      preserve_aspect
-          ? (ratio_dst > ratio_src ? src_w * (float)dst_h / src_h : dst_w)
-          : dst_w;
-  int scaled_h =
-      preserve_aspect
-          ? (ratio_dst > ratio_src ? dst_h : src_h * (float)dst_w / src_w)
-          : dst_h;
-  float ratio_x = (float)src_w / scaled_w;
-  float ratio_y = (float)src_h / scaled_h;
-
-  for (int y = 0; y < dst_h; y++) {
-    if (y >= scaled_h) {
-      std::memset(dst, 0, dst_p);
-      dst += dst_p;
-      continue;
-    }
-
-    int offset_y = static_cast<int>(y * ratio_y) * src_p;
-    for (int x = 0; x < dst_w; x++) {
-      int offset_x = static_cast<int>(x * ratio_x) * comps;
-      const uint8_t* src_y = src + offset_y;
-      for (int i = 0; i < comps; i++) {
-        *dst++ = x < scaled_w ? src_y[offset_x + i] : 0;
-      }
-    }
-  }
-}
-
-template <typename Callback>
-void BayerInternal(const uint8_t* camera_raw, int width, int height,
-                   CameraFilterMethod filter, Callback callback) {
-  if (filter == CameraFilterMethod::kNearestNeighbor) {
-    bool blue = true, green = false;
-    for (int y = 2; y < height - 2; y++) {
-      int start = green ? 3 : 2;
-      for (int x = start; x < width - 2; x += 2) {
-        int g1x = x + 1, g1y = y;
-        int g2x = x + 2, g2y = y + 1;
-        int r1x, r1y, r2x, r2y;
-        int b1x, b1y, b2x, b2y;
-        if (blue) {
-          r1x = r2x = x + 1;
-          r1y = r2y = y + 1;
-          b1x = x;
-          b1y = y;
-          b2x = x + 2;
-          b2y = y;
-        } else {
-          r1x = x;
-          r1y = y;
-          r2x = x + 2;
-          r2y = y;
-          b1x = b2x = x + 1;
-          b1y = b2y = y + 1;
-        }
-        uint8_t r1 = camera_raw[r1x + (r1y * width)];
-        uint8_t g1 = camera_raw[g1x + (g1y * width)];
-        uint8_t b1 = camera_raw[b1x + (b1y * width)];
-        uint8_t r2 = camera_raw[r2x + (r2y * width)];
-        uint8_t g2 = camera_raw[g2x + (g2y * width)];
-        uint8_t b2 = camera_raw[b2x + (b2y * width)];
-        callback(x, y, r1, g1, b1);
-        callback(x + 1, y, r2, g2, b2);
-      }
-      blue = !blue;
-      green = !green;
-    }
-  } else if (filter == CameraFilterMethod::kBilinear) {
-    int bayer_stride = width;
-
-    size_t bayer_offset = 0;
-    for (int y = 2; y < height - 2; y++) {
-      bool odd_row = y & 1;
-      int x = 1;
-      size_t bayer_end = bayer_offset + (width - 2);
-
-      if (odd_row) {
-        uint8_t r = (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-                     static_cast<uint32_t>(
-                         camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-                     1) >>
-                    1;
-        uint8_t b =
-            (static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride + 2)]) +
-             1) >>
-            1;
-        uint8_t g = camera_raw[bayer_offset + (bayer_stride + 1)];
-        callback(x, y, r, g, b);
-        bayer_offset += 1;
-        ++x;
-      }
-
-      while (bayer_offset <= (bayer_end - 2)) {
-        uint8_t r1 = 0, g1 = 0, b1 = 0, r2 = 0, g2 = 0, b2 = 0;
-        uint8_t t0 = (static_cast<uint32_t>(camera_raw[bayer_offset]) +
-                      static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      2) >>
-                     2;
-        g1 = (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-              static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-              static_cast<uint32_t>(
-                  camera_raw[bayer_offset + (bayer_stride + 2)]) +
-              static_cast<uint32_t>(
-                  camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-              2) >>
-             2;
-        uint8_t t1 = (static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      1) >>
-                     1;
-        uint8_t t2 = (static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride + 1)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride + 3)]) +
-                      1) >>
-                     1;
-        uint8_t t3 = camera_raw[bayer_offset + (bayer_stride + 1)];
-        g2 = camera_raw[bayer_offset + (bayer_stride + 2)];
-        if (odd_row) {
-          r1 = t0;
-          b1 = t3;
-
-          r2 = t1;
-          b2 = t2;
-        } else {
-          b1 = t0;
-          r1 = t3;
-
-          b2 = t1;
-          r2 = t2;
-        }
-        callback(x, y, r1, g1, b1);
-        callback(x + 1, y, r2, g2, b2);
-        bayer_offset += 2;
-        x += 2;
-      }
-
-      while (bayer_offset < bayer_end) {
-        uint8_t t0 = (static_cast<uint32_t>(camera_raw[bayer_offset]) +
-                      static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      2) >>
-                     2;
-        uint8_t g =
-            (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-             static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride + 2)]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-             2) >>
-            2;
-        uint8_t t1 = camera_raw[bayer_offset + bayer_stride + 1];
-        if (odd_row) {
-          callback(x, y, t0, g, t1);
-        } else {
-          callback(x, y, t1, g, t0);
-        }
-        bayer_offset += 1;
-        ++x;
-      }
-
-      bayer_offset += 2;
-    }
-  }
-}
-
-void RotateXY(CameraRotation rotation, int in_x, int in_y, int* out_x,
-              int* out_y) {
-  CHECK(out_x);
-  CHECK(out_y);
-
-  // Short-circuit for no rotation
-  if (rotation == CameraRotation::k0) {
-    *out_x = in_x;
-    *out_y = in_y;
-    return;
-  }
-
-  // Shift our coordinates so that the center of the image is 0,0
-  in_x = in_x - (CameraTask::kWidth / 2);
-  in_y = in_y - (CameraTask::kHeight / 2);
-
-  // Simple rotation around origin
-  switch (rotation) {
-    case CameraRotation::k90:
-      *out_x = -in_y;
-      *out_y = in_x;
-      break;
-    case CameraRotation::k180:
-      *out_x = -in_x;
-      *out_y = -in_y;
-      break;
-    case CameraRotation::k270:
-      *out_x = in_y;
-      *out_y = -in_x;
-      break;
-    case CameraRotation::k0:
-    default:
-      CHECK(false);
-  }
-
-  // Undo coordinate space shift
-  *out_x = *out_x + (CameraTask::kWidth / 2);
-  *out_y = *out_y + (CameraTask::kHeight / 2);
-  CHECK(*out_x >= 0);
-  CHECK(*out_x < static_cast<int>(CameraTask::kWidth));
-  CHECK(*out_y >= 0);
-  CHECK(*out_y < static_cast<int>(CameraTask::kHeight));
-}
-
-void BayerToRgb(const uint8_t* camera_raw, uint8_t* camera_rgb, int width,
-                int height, CameraFilterMethod filter,
-                CameraRotation rotation) {
-  std::memset(camera_rgb, 0, width * height * 3);
-  BayerInternal(camera_raw, width, height, filter,
-                [camera_rgb, width, height, rotation](int x, int y, uint8_t r,
-                                                      uint8_t g, uint8_t b) {
-                  int rot_x, rot_y;
-                  RotateXY(rotation, x, y, &rot_x, &rot_y);
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 0] = r;
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 1] = g;
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 2] = b;
-                });
-}
-
-void BayerToGrayscale(const uint8_t* camera_raw, uint8_t* camera_grayscale,
-                      int width, int height, CameraFilterMethod filter,
-                      CameraRotation rotation) {
-  BayerInternal(camera_raw, width, height, filter,
-                [camera_grayscale, width, height, rotation](
-                    int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-                  int rot_x, rot_y;
-                  RotateXY(rotation, x, y, &rot_x, &rot_y);
-                  float r_f = static_cast<float>(r) / kUint8Max;
-                  float g_f = static_cast<float>(g) / kUint8Max;
-                  float b_f = static_cast<float>(b) / kUint8Max;
-                  camera_grayscale[rot_x + (rot_y * width)] =
-                      static_cast<uint8_t>(((kRedCoefficient * r_f * r_f) +
-                                            (kGreenCoefficient * g_f * g_f) +
-                                            (kBlueCoefficient * b_f * b_f)) *
-                                           kUint8Max);
-                });
-}
-
-void RgbToGrayscale(const uint8_t* camera_rgb, uint8_t* camera_grayscale,
-                    int width, int height) {
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      float r_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 0]) /
-          kUint8Max;
-      float g_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 1]) /
-          kUint8Max;
-      float b_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 2]) /
-          kUint8Max;
-      camera_grayscale[x + (y * width)] = static_cast<uint8_t>(
-          ((kRedCoefficient * r_f * r_f) + (kGreenCoefficient * g_f * g_f) +
-           (kBlueCoefficient * b_f * b_f)) *
-          kUint8Max);
-    }
-  }
-}
-
-void AutoWhiteBalance(uint8_t* camera_rgb, int width, int height) {
-  unsigned int r_sum = 0, g_sum = 0, b_sum = 0;
-  float r_sum_f = 0.0, g_sum_f = 0.0, b_sum_f = 0.0;
-  float threshold = 0.9f;
-  uint16_t threshold16 = static_cast<uint16_t>(threshold * 255);
-  uint16_t min_rgb, max_rgb;
-  for (int i = 0; i < width * height; ++i) {
-    uint8_t r = camera_rgb[i * 3 + 0];
-    uint8_t g = camera_rgb[i * 3 + 1];
-    uint8_t b = camera_rgb[i * 3 + 2];
-    min_rgb = static_cast<uint16_t>(std::min(r, std::min(g, b)));
-    max_rgb = static_cast<uint16_t>(std::max(r, std::max(g, b)));
-    if (((max_rgb - min_rgb) * 255) > (threshold16 * max_rgb)) {
-      continue;
-    }
-    r_sum += r;
-    g_sum += g;
-    b_sum += b;
-  }
-  r_sum_f = static_cast<float>(r_sum);
-  g_sum_f = static_cast<float>(g_sum);
-  b_sum_f = static_cast<float>(b_sum);
-  float max_channel = std::max(r_sum_f, std::max(g_sum_f, b_sum_f));
-  float epsilon = 0.1;
-  float r_gain_f = r_sum_f < epsilon ? 0.0f : max_channel / r_sum_f;
-  float g_gain_f = g_sum_f < epsilon ? 0.0f : max_channel / g_sum_f;
-  float b_gain_f = b_sum_f < epsilon ? 0.0f : max_channel / b_sum_f;
-  uint16_t r_gain_i = static_cast<uint16_t>(r_gain_f * (1 << 8));
-  uint16_t g_gain_i = static_cast<uint16_t>(g_gain_f * (1 << 8));
-  uint16_t b_gain_i = static_cast<uint16_t>(b_gain_f * (1 << 8));
-  for (int i = 0; i < width * height; ++i) {
-    uint8_t r = camera_rgb[i * 3 + 0];
-    uint8_t g = camera_rgb[i * 3 + 1];
-    uint8_t b = camera_rgb[i * 3 + 2];
-    camera_rgb[i * 3 + 0] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(r) * r_gain_i) >> 8));
-    camera_rgb[i * 3 + 1] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(g) * g_gain_i) >> 8));
-    camera_rgb[i * 3 + 2] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(b) * b_gain_i) >> 8));
-  }
-}
 }  // namespace
 
 extern "C" void CSI_DriverIRQHandler(void);
@@ -474,12 +157,16 @@ int CameraFormatBpp(CameraFormat fmt) {
 }
 
 bool CameraTask::GetFrame(const std::vector<CameraFrameFormat>& fmts) {
+  TRACE_ZONE("camera/GetFrame");
+  HistogramTimer timer(&g_get_frame_latency);
   if (!enabled_) {
     printf("Camera is not enabled, cannot capture frame.\r\n");
+    g_frame_errors.Increment();
     return false;
   }
   if (mode_ == CameraMode::kTrigger && !GpioGet(Gpio::kCameraTrigger)) {
     printf("Camera is in trigger mode but was never triggered\r\n");
+    g_frame_errors.Increment();
     return false;
   }
 
@@ -487,6 +174,7 @@ bool CameraTask::GetFrame(const std::vector<CameraFrameFormat>& fmts) {
   uint8_t* raw = nullptr;
   int index = GetFrame(&raw, true);
   if (!raw) {
+    g_frame_errors.Increment();
     return false;
   }
   if (mode_ == CameraMode::kTrigger) {
@@ -553,6 +241,7 @@ bool CameraTask::GetFrame(const std::vector<CameraFrameFormat>& fmts) {
   }
 
   GetSingleton()->ReturnFrame(index);
+  if (!ret) g_frame_errors.Increment();
   return ret;
 }
 
@@ -827,6 +516,7 @@ camera::FrameResponse CameraTask::HandleFrameRequest(
     if (status == kStatus_Success) {
       DCACHE_InvalidateByRange(buffer, kHeight * kWidth);
       resp.index = FramebufferPtrToIndex(reinterpret_cast<uint8_t*>(buffer));
+      g_frames.Increment();
     }
   } else {  // RETURN
     buffer = reinterpret_cast<uint32_t>(IndexToFramebufferPtr(frame.index));
@@ -863,6 +553,7 @@ void CameraTask::HandleDiscardRequest(const camera::DiscardRequest& discard) {
     if (resp.index != -1) {
       // Return the frame, and increment the discard counter.
       discarded++;
+      g_discarded_frames.Increment();
       request.index = resp.index;
       HandleFrameRequest(request);
     }
@@ -23,6 +23,7 @@
 
 #include "libs/base/queue_task.h"
 #include "libs/base/tasks.h"
+#include "libs/camera/image_utils.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_csi.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_lpi2c_freertos.h"
 
@@ -171,26 +172,6 @@ enum class CameraFormat {
 // @return The number of bytes per pixel.
 int CameraFormatBpp(CameraFormat fmt);
 
-// Image resampling method (when resizing the image).
-enum class CameraFilterMethod {
-  kBilinear,
-  kNearestNeighbor,
-};
-
-// Clockwise image rotations.
-enum class CameraRotation {
-  // The natural orientation for the camera module
-  k0,
-  // Rotated 90-degrees clockwise.
-  // Upside down, relative to the board's "Coral" label.
-  k90,
-  // Rotated 180-degrees clockwise.
-  k180,
-  // Rotated 270-degrees clockwise.
-  // Right-side up, relative to the board's "Coral" label.
-  k270,
-};
-
 // Specifies your image buffer location and any image processing you want to
 // perform when fetching images with `CameraTask::GetFrame()`.
 struct CameraFrameFormat {
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_CAMERA_IMAGE_UTILS_H_
+#define LIBS_CAMERA_IMAGE_UTILS_H_
+
+#include <cstdint>
+
+namespace coralmicro {
+
+// Image resampling method (when resizing the image).
+enum class CameraFilterMethod {
+  kBilinear,
+  kNearestNeighbor,
+};
+
+// Clockwise image rotations.
+enum class CameraRotation {
+  // The natural orientation for the camera module
+  k0,
+  // Rotated 90-degrees clockwise.
+  // Upside down, relative to the board's "Coral" label.
+  k90,
+  // Rotated 180-degrees clockwise.
+  k180,
+  // Rotated 270-degrees clockwise.
+  // Right-side up, relative to the board's "Coral" label.
+  k270,
+};
+
+// Resizes an image with nearest-neighbor sampling.
+//
+// @param src The source image.
+// @param src_w The source image's width.
+// @param src_h The source image's height.
+// @param dst The buffer to receive the resized image.
+// @param dst_w The resized image's width.
+// @param dst_h The resized image's height.
+// @param comps The number of bytes per pixel.
+// @param preserve_aspect True to keep the source's aspect ratio, filling the
+//   rest of `dst` with zeros; false to stretch the image to fill `dst`.
+void ResizeNearestNeighbor(const uint8_t* src, int src_w, int src_h,
+                           uint8_t* dst, int dst_w, int dst_h, int comps,
+                           bool preserve_aspect);
+
+// Converts a raw Bayer image to RGB.
+//
+// @param camera_raw The raw Bayer image, as fetched with `CameraFormat::kRaw`.
+// @param camera_rgb The buffer to receive `width * height` RGB pixels.
+// @param width The image's width.
+// @param height The image's height.
+// @param filter The filter method to use.
+// @param rotation The rotation to apply. Rotations other than
+//   `CameraRotation::k0` require a square image.
+void BayerToRgb(const uint8_t* camera_raw, uint8_t* camera_rgb, int width,
+                int height, CameraFilterMethod filter,
+                CameraRotation rotation);
+
+// Converts a raw Bayer image to grayscale.
+//
+// @param camera_raw The raw Bayer image, as fetched with `CameraFormat::kRaw`.
+// @param camera_grayscale The buffer to receive `width * height` pixels.
+// @param width The image's width.
+// @param height The image's height.
+// @param filter The filter method to use.
+// @param rotation The rotation to apply. Rotations other than
+//   `CameraRotation::k0` require a square image.
+void BayerToGrayscale(const uint8_t* camera_raw, uint8_t* camera_grayscale,
+                      int width, int height, CameraFilterMethod filter,
+                      CameraRotation rotation);
+
+// Converts one row of a raw Bayer image to RGB, without rotation or white
+// balance. This allows processing a raw frame row by row, such as with
+// `JpegEncoder`, without holding the whole RGB image in memory.
+//
+// @param camera_raw The raw Bayer image, as fetched with `CameraFormat::kRaw`.
+// @param width The image's width.
+// @param height The image's height.
+// @param y The row to convert.
+// @param filter The filter method to use.
+// @param rgb_row The buffer to receive `width` RGB pixels.
+void BayerToRgbRow(const uint8_t* camera_raw, int width, int height, int y,
+                   CameraFilterMethod filter, uint8_t* rgb_row);
+
+// Converts an RGB image to grayscale.
+//
+// @param camera_rgb The RGB image.
+// @param camera_grayscale The buffer to receive `width * height` pixels.
+// @param width The image's width.
+// @param height The image's height.
+void RgbToGrayscale(const uint8_t* camera_rgb, uint8_t* camera_grayscale,
+                    int width, int height);
+
+// Applies gray-world white balancing to an RGB image in place.
+//
+// @param camera_rgb The RGB image.
+// @param width The image's width.
+// @param height The image's height.
+void AutoWhiteBalance(uint8_t* camera_rgb, int width, int height);
+
+}  // namespace coralmicro
+
+#endif  // LIBS_CAMERA_IMAGE_UTILS_H_
@@ -27,13 +27,21 @@
 extern "C" void start_dhcp_server(uint32_t local_addr);
 
 #include <cstring>
-#include <memory>
-#include <vector>
 
 #define DATA_OUT (1)
 #define DATA_IN (0)
 
 namespace coralmicro {
+namespace {
+// Every EEM data packet ends with a CRC, or this sentinel in its place.
+constexpr uint32_t kCrcSentinel = PP_HTONL(0xdeadbeef);
+
+// Size of an EEM data packet carrying a frame of `frame_length` bytes.
+constexpr size_t EemPacketSize(size_t frame_length) {
+  return sizeof(uint16_t) + frame_length + sizeof(uint32_t);
+}
+}  // namespace
+
 std::map<class_handle_t, CdcEem *> CdcEem::handle_map_;
 
 void CdcEem::Init(uint8_t bulk_in_ep, uint8_t bulk_out_ep, uint8_t data_iface) {
@@ -43,8 +51,11 @@ void CdcEem::Init(uint8_t bulk_in_ep, uint8_t bulk_out_ep, uint8_t data_iface) {
   cdc_eem_data_endpoints_[DATA_OUT].endpointAddress =
       bulk_out_ep | (USB_OUT << 7);
   cdc_eem_interfaces_[0].interfaceNumber = data_iface;
-  tx_queue_ = xQueueCreate(10, sizeof(void *));
+  tx_queue_ = xQueueCreate(kTxQueueLength, sizeof(struct pbuf *));
   CHECK(tx_queue_);
+  tx_done_ = xSemaphoreCreateBinary();
+  CHECK(tx_done_);
+  xSemaphoreGive(tx_done_);
   CHECK(xTaskCreate(CdcEem::StaticTaskFunction, "cdc_eem_task",
                     configMINIMAL_STACK_SIZE * 10, this, kUsbDeviceTaskPriority,
                     nullptr) == pdPASS);
@@ -65,11 +76,21 @@ void CdcEem::Init(uint8_t bulk_in_ep, uint8_t bulk_out_ep, uint8_t data_iface) {
 }
 
 void CdcEem::TaskFunction(void *param) {
+  struct pbuf *next = nullptr;
   while (true) {
-    std::vector<uint8_t> *packet;
-    if (xQueueReceive(tx_queue_, &packet, portMAX_DELAY) == pdTRUE) {
-      TransmitFrame(packet->data(), packet->size());
-      delete packet;
+    if (!next && xQueueReceive(tx_queue_, &next, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    uint8_t *buffer = tx_buffers_[tx_index_];
+    size_t length = AggregateFrames(buffer, 0, &next);
+    // Wait for the other buffer to go out, then pick up whatever was queued
+    // in the meantime.
+    xSemaphoreTake(tx_done_, portMAX_DELAY);
+    length = AggregateFrames(buffer, length, &next);
+    if (TransmitFrames(buffer, length) == ERR_OK) {
+      tx_index_ ^= 1;
+    } else {
+      xSemaphoreGive(tx_done_);
     }
   }
 }
@@ -79,7 +100,7 @@ err_t CdcEem::NetifInit(struct netif *netif) {
   netif->name[1] = 's';
   netif->output = etharp_output;
   netif->linkoutput = CdcEem::StaticTxFunc;
-  netif->mtu = 300;
+  netif->mtu = 1500;
   netif->hwaddr_len = 6;
   netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
 
@@ -94,49 +115,95 @@ err_t CdcEem::NetifInit(struct netif *netif) {
 }
 
 err_t CdcEem::TxFunc(struct netif *netif, struct pbuf *p) {
-  auto *packet = new std::vector<uint8_t>(p->tot_len);
-  if (pbuf_copy_partial(p, packet->data(), p->tot_len, 0) != p->tot_len) {
-    delete packet;
+  if (endianness_ == Endianness::kUnknown) {
     return ERR_IF;
   }
 
-  if (xQueueSendToBack(tx_queue_, &packet, 0) != pdTRUE) {
-    delete packet;
+  // The frame is copied straight from the pbuf chain into a transfer buffer
+  // by the task, so just hold a reference until then.
+  pbuf_ref(p);
+  if (xQueueSendToBack(tx_queue_, &p, 0) != pdTRUE) {
+    pbuf_free(p);
     return ERR_IF;
   }
 
   return ERR_OK;
 }
 
-err_t CdcEem::TransmitFrame(void *buffer, uint32_t length) {
-  if (endianness_ == Endianness::kUnknown) {
-    return ERR_IF;
+void CdcEem::WriteHeader(uint8_t *buffer, uint16_t header) {
+  if (endianness_ == Endianness::kBigEndian) {
+    buffer[0] = header >> 8;
+    buffer[1] = header & 0xFF;
+  } else {
+    buffer[0] = header & 0xFF;
+    buffer[1] = header >> 8;
   }
-  usb_status_t status;
-  uint32_t crc = PP_HTONL(0xdeadbeef);
-  uint16_t *header = reinterpret_cast<uint16_t *>(tx_buffer_);
-  *header = (0 << EEM_DATA_CRC_SHIFT) |
-            ((length + sizeof(uint32_t)) & EEM_DATA_LEN_MASK);
+}
+
+uint16_t CdcEem::ReadHeader(const uint8_t *buffer) {
   if (endianness_ == Endianness::kBigEndian) {
-    *header = htons(*header);
+    return (buffer[0] << 8) | buffer[1];
   }
-  std::memcpy(tx_buffer_ + sizeof(uint16_t), buffer, length);
-  std::memcpy(tx_buffer_ + sizeof(uint16_t) + length, &crc, sizeof(uint32_t));
-  while (true) {
-    status = USB_DeviceCdcEemSend(class_handle_, bulk_in_ep_, tx_buffer_,
-                                  sizeof(uint16_t) + length + sizeof(uint32_t));
-    if (status == kStatus_USB_Busy) {
-      taskYIELD();
+  return buffer[0] | (buffer[1] << 8);
+}
+
+size_t CdcEem::AppendFrame(uint8_t *buffer, size_t offset, struct pbuf *p) {
+  uint8_t *packet = buffer + offset;
+  uint16_t len = p->tot_len + sizeof(uint32_t);
+  WriteHeader(packet, (0 << EEM_DATA_CRC_SHIFT) | (len & EEM_DATA_LEN_MASK));
+  pbuf_copy_partial(p, packet + sizeof(uint16_t), p->tot_len, 0);
+  std::memcpy(packet + sizeof(uint16_t) + p->tot_len, &kCrcSentinel,
+              sizeof(kCrcSentinel));
+  return offset + EemPacketSize(p->tot_len);
+}
+
+size_t CdcEem::AggregateFrames(uint8_t *buffer, size_t length,
+                               struct pbuf **next) {
+  // Leave room to pad the transfer with a zero-length EEM packet.
+  constexpr size_t kCapacity = kTxBufferSize - sizeof(uint16_t);
+  while (*next || xQueueReceive(tx_queue_, next, 0) == pdTRUE) {
+    size_t packet_size = EemPacketSize((*next)->tot_len);
+    if (length + packet_size > kCapacity) {
+      if (length != 0) {
+        // Keep the frame for the next transfer.
+        break;
+      }
+      DbgConsole_Printf("[EEM] Dropping %u byte frame\r\n",
+                        (*next)->tot_len);
     } else {
+      length = AppendFrame(buffer, length, *next);
+    }
+    pbuf_free(*next);
+    *next = nullptr;
+  }
+  return length;
+}
+
+err_t CdcEem::TransmitFrames(uint8_t *buffer, size_t length) {
+  if (length == 0 || endianness_ == Endianness::kUnknown) {
+    return ERR_IF;
+  }
+  // Rather than following a transfer that ends on a packet boundary with a
+  // zero-length USB packet, end it with a zero-length EEM packet.
+  if (length % cdc_eem_data_endpoints_[DATA_IN].maxPacketSize == 0) {
+    WriteHeader(buffer + length, 0);
+    length += sizeof(uint16_t);
+  }
+  usb_status_t status;
+  while (true) {
+    status = USB_DeviceCdcEemSend(class_handle_, bulk_in_ep_, buffer, length);
+    if (status != kStatus_USB_Busy) {
       break;
     }
+    // Something else is on the endpoint, wait for it to complete.
+    xSemaphoreTake(tx_done_, pdMS_TO_TICKS(10));
   }
   if (status != kStatus_USB_Success) {
     DbgConsole_Printf("[EEM] USB_DeviceCdcEemSend failed, ERR_IF\r\n");
     return ERR_IF;
   }
 
-  return (status == kStatus_USB_Success) ? ERR_OK : ERR_IF;
+  return ERR_OK;
 }
 
 err_t CdcEem::ReceiveFrame(uint8_t *buffer, uint32_t length) {
@@ -230,53 +297,80 @@ void CdcEem::DetectEndianness(uint32_t packet_length) {
 }
 
 void CdcEem::ProcessPacket(uint32_t packet_length) {
-  DetectEndianness(packet_length);
+  if (rx_length_ == 0) {
+    DetectEndianness(packet_length);
+  }
   if (endianness_ == Endianness::kUnknown) {
     return;
   }
-
-  uint16_t packet_hdr = *reinterpret_cast<uint16_t *>(rx_buffer_);
-  if (endianness_ == Endianness::kBigEndian) {
-    packet_hdr = ntohs(packet_hdr);
-  }
-
-  if (packet_hdr & EEM_HEADER_TYPE_MASK) {
-    uint16_t opcode =
-        (packet_hdr & EEM_COMMAND_OPCODE_MASK) >> EEM_COMMAND_OPCODE_SHIFT;
-    uint16_t param =
-        (packet_hdr & EEM_COMMAND_PARAM_MASK) >> EEM_COMMAND_PARAM_SHIFT;
-    uint8_t *data = rx_buffer_ + sizeof(uint16_t);
-    (void)param;
-    (void)data;
-    switch (opcode) {
-      case EEM_COMMAND_ECHO_RESPONSE:
-        break;
-      default:
-        DbgConsole_Printf("Unhandled EEM opcode: %u\r\n", opcode);
+  rx_length_ += packet_length;
+
+  // A transfer can hold any number of EEM packets, the last of which may be
+  // continued in the next transfer.
+  size_t offset = 0;
+  while (rx_length_ - offset >= sizeof(uint16_t)) {
+    uint8_t *packet = rx_buffer_ + offset;
+    uint16_t packet_hdr = ReadHeader(packet);
+    size_t packet_size = sizeof(uint16_t);
+    if (packet_hdr & EEM_HEADER_TYPE_MASK) {
+      uint16_t opcode =
+          (packet_hdr & EEM_COMMAND_OPCODE_MASK) >> EEM_COMMAND_OPCODE_SHIFT;
+      uint16_t param =
+          (packet_hdr & EEM_COMMAND_PARAM_MASK) >> EEM_COMMAND_PARAM_SHIFT;
+      switch (opcode) {
+        case EEM_COMMAND_ECHO:
+        case EEM_COMMAND_ECHO_RESPONSE:
+          // The param is the length of the echoed data.
+          packet_size += param;
+          break;
+        default:
+          DbgConsole_Printf("Unhandled EEM opcode: %u\r\n", opcode);
+      }
+    } else {
+      uint16_t checksum =
+          (packet_hdr & EEM_DATA_CRC_MASK) >> EEM_DATA_CRC_SHIFT;
+      uint16_t len = (packet_hdr & EEM_DATA_LEN_MASK) >> EEM_DATA_LEN_SHIFT;
+      packet_size += len;
+      // TODO(atv): We should validate checksum. But we won't (for now). See if
+      // the stack handles that?
+      (void)checksum;
+      if (len > sizeof(uint32_t) && rx_length_ - offset >= packet_size) {
+        ReceiveFrame(packet + sizeof(uint16_t), len - sizeof(uint32_t));
+      }
     }
-  } else {
-    uint16_t checksum = (packet_hdr & EEM_DATA_CRC_MASK) >> EEM_DATA_CRC_SHIFT;
-    uint16_t len = (packet_hdr & EEM_DATA_LEN_MASK) >> EEM_DATA_LEN_SHIFT;
-    if (len == 0) {
-      return;
+    if (rx_length_ - offset < packet_size) {
+      break;
     }
-    uint8_t *data = rx_buffer_ + sizeof(uint16_t);
-    uint16_t data_len = len - sizeof(uint32_t);
-    // TODO(atv): We should validate checksum. But we won't (for now). See if
-    // the stack handles that?
-    (void)checksum;
-    ReceiveFrame(data, data_len);
+    offset += packet_size;
+  }
+
+  rx_length_ -= offset;
+  if (rx_length_ + cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize >
+      kRxBufferSize) {
+    DbgConsole_Printf("[EEM] Dropping oversized packet\r\n");
+    rx_length_ = 0;
+  } else if (rx_length_ != 0) {
+    std::memmove(rx_buffer_, rx_buffer_ + offset, rx_length_);
   }
 }
 
+usb_status_t CdcEem::ArmReceive() {
+  // Receive whole max-size packets into the free part of the buffer.
+  uint32_t max_packet_size = cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize;
+  uint32_t length = kRxBufferSize - rx_length_;
+  length -= length % max_packet_size;
+  return USB_DeviceCdcEemRecv(class_handle_, bulk_out_ep_,
+                              rx_buffer_ + rx_length_, length);
+}
+
 bool CdcEem::HandleEvent(uint32_t event, void *param) {
   usb_status_t status;
   switch (event) {
     case kUSB_DeviceEventSetConfiguration:
       break;
     case kUSB_DeviceEventSetInterface:
-      USB_DeviceCdcEemRecv(class_handle_, bulk_out_ep_, rx_buffer_,
-                           cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize);
+      rx_length_ = 0;
+      ArmReceive();
       break;
     default:
       DbgConsole_Printf("%s unhandled event %d\r\n", __PRETTY_FUNCTION__,
@@ -295,23 +389,20 @@ usb_status_t CdcEem::Handler(uint32_t event, void *param) {
 
   switch (event) {
     case kUSB_DeviceEemEventRecvResponse: {
-      ProcessPacket(ep_cb->length);
-      ret =
-          USB_DeviceCdcEemRecv(class_handle_, bulk_out_ep_, rx_buffer_,
-                               cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize);
+      if (ep_cb->length == USB_UNINITIALIZED_VAL_32) {
+        rx_length_ = 0;
+      } else {
+        ProcessPacket(ep_cb->length);
+      }
+      ret = ArmReceive();
       break;
     }
     case kUSB_DeviceEemEventSendResponse:
-      if (ep_cb->length != 0 &&
-          (ep_cb->length % cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize) ==
-              0) {
-        ret = USB_DeviceCdcEemSend(class_handle_, bulk_in_ep_, nullptr, 0);
-      } else {
-        if (ep_cb->buffer || (!ep_cb->buffer && ep_cb->length == 0)) {
-          ret = USB_DeviceCdcEemRecv(
-              class_handle_, bulk_out_ep_, rx_buffer_,
-              cdc_eem_data_endpoints_[DATA_OUT].maxPacketSize);
-        }
+      // Transfers are padded in TransmitFrames(), so no zero-length packet
+      // is needed here.
+      xSemaphoreGive(tx_done_);
+      if (ep_cb->buffer || (!ep_cb->buffer && ep_cb->length == 0)) {
+        ret = ArmReceive();
       }
       break;
     case kUSB_DeviceCdcEventSetControlLineState:
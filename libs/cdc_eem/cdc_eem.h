@@ -21,6 +21,8 @@
 
 /* clang-format off */
 #include "libs/usb/descriptors.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/netifapi.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/device/usb_device.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/include/usb.h"
@@ -75,8 +77,11 @@ class CdcEem {
   }
   void TaskFunction(void *param);
 
-  err_t TransmitFrame(void *buffer, uint32_t length);
+  size_t AppendFrame(uint8_t *buffer, size_t offset, struct pbuf *p);
+  size_t AggregateFrames(uint8_t *buffer, size_t length, struct pbuf **next);
+  err_t TransmitFrames(uint8_t *buffer, size_t length);
   err_t ReceiveFrame(uint8_t *buffer, uint32_t length);
+  usb_status_t ArmReceive();
 
   usb_device_endpoint_struct_t cdc_eem_data_endpoints_[2] = {
       {
@@ -156,10 +161,23 @@ class CdcEem {
                  .interval = 0},
   };
 
-  uint8_t tx_buffer_[512];
-  uint8_t rx_buffer_[512];
+  // Outgoing frames are queued as referenced pbufs, and the task packs as
+  // many of them as fit into one USB transfer. While one transfer buffer is
+  // on the bus, the other is filled.
+  static constexpr int kTxQueueLength = 32;
+  static constexpr size_t kTxBufferSize = 8 * 1024;
+  // Incoming transfers may hold several EEM packets, and a packet may span
+  // transfers; the unparsed tail of one transfer is kept for the next.
+  static constexpr size_t kRxBufferSize = 4 * 1024;
+
+  uint8_t tx_buffers_[2][kTxBufferSize];
+  int tx_index_ = 0;
+  uint8_t rx_buffer_[kRxBufferSize];
+  size_t rx_length_ = 0;
   uint8_t bulk_in_ep_, bulk_out_ep_;
   QueueHandle_t tx_queue_;
+  // Given when the bulk in endpoint is idle.
+  SemaphoreHandle_t tx_done_;
   class_handle_t class_handle_;
 
   ip4_addr_t netif_ipaddr_, netif_netmask_, netif_gw_;
@@ -172,6 +190,8 @@ class CdcEem {
   };
   Endianness endianness_ = Endianness::kUnknown;
   void DetectEndianness(uint32_t packet_length);
+  void WriteHeader(uint8_t *buffer, uint16_t header);
+  uint16_t ReadHeader(const uint8_t *buffer);
 };
 
 }  // namespace coralmicro
@@ -0,0 +1,497 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/cdc_ncm/cdc_ncm.h"
+
+#include "libs/base/check.h"
+#include "libs/base/tasks.h"
+#include "libs/base/utils.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/etharp.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/netif/ethernet.h"
+
+extern "C" void start_dhcp_server(uint32_t local_addr);
+
+#include <algorithm>
+#include <cstring>
+
+#define DATA_IN (0)
+#define DATA_OUT (1)
+
+namespace coralmicro {
+namespace {
+// NTB-16 structures (NCM 1.0, section 3), all little-endian like the core.
+struct Nth16 {
+  uint32_t signature;
+  uint16_t header_length;
+  uint16_t sequence;
+  uint16_t block_length;
+  uint16_t ndp_index;
+} __attribute__((packed));
+
+struct Ndp16 {
+  uint32_t signature;
+  uint16_t length;
+  uint16_t next_ndp_index;
+} __attribute__((packed));
+
+struct Dpe16 {
+  uint16_t datagram_index;
+  uint16_t datagram_length;
+} __attribute__((packed));
+
+// Reply to GET_NTB_PARAMETERS (NCM 1.0, section 6.2.1).
+struct NtbParameters {
+  uint16_t length;
+  uint16_t ntb_formats_supported;
+  uint32_t ntb_in_max_size;
+  uint16_t ndp_in_divisor;
+  uint16_t ndp_in_payload_remainder;
+  uint16_t ndp_in_alignment;
+  uint16_t reserved;
+  uint32_t ntb_out_max_size;
+  uint16_t ndp_out_divisor;
+  uint16_t ndp_out_payload_remainder;
+  uint16_t ndp_out_alignment;
+  uint16_t ntb_out_max_datagrams;
+} __attribute__((packed));
+
+// Datagrams and NDPs are 4-byte aligned in both directions.
+constexpr size_t kNtbAlignment = 4;
+// Smallest NTB input size a host may ask for.
+constexpr uint32_t kNtbMinInSize = 2048;
+// Bound on chained NDPs in a received NTB, in case of a malformed chain.
+constexpr int kMaxNdpsPerNtb = 4;
+
+constexpr size_t Align(size_t offset) {
+  return (offset + kNtbAlignment - 1) & ~(kNtbAlignment - 1);
+}
+
+// Size of an NDP referencing `count` datagrams, with its terminating entry.
+constexpr size_t NdpSize(int count) {
+  return sizeof(Ndp16) + (count + 1) * sizeof(Dpe16);
+}
+}  // namespace
+
+std::map<class_handle_t, CdcNcm *> CdcNcm::handle_map_;
+
+void CdcNcm::Init(uint8_t interrupt_in_ep, uint8_t bulk_ep, uint8_t comm_iface,
+                  uint8_t data_iface, uint8_t mac_address_string) {
+  interrupt_in_ep_ = interrupt_in_ep;
+  bulk_ep_ = bulk_ep;
+  data_iface_ = data_iface;
+  // Both data directions share one endpoint number, to stay within the
+  // endpoints the controller is configured for.
+  cdc_ncm_comm_endpoints_[0].endpointAddress =
+      interrupt_in_ep | (USB_IN << 7);
+  cdc_ncm_data_endpoints_[DATA_IN].endpointAddress = bulk_ep | (USB_IN << 7);
+  cdc_ncm_data_endpoints_[DATA_OUT].endpointAddress = bulk_ep | (USB_OUT << 7);
+  cdc_ncm_interfaces_[0].interfaceNumber = comm_iface;
+  cdc_ncm_interfaces_[1].interfaceNumber = data_iface;
+
+  descriptor_.iad0.first_interface = comm_iface;
+  descriptor_.comm_iface.interface_number = comm_iface;
+  descriptor_.comm_union_fd.controller_iface = comm_iface;
+  descriptor_.comm_union_fd.peripheral_iface0 = data_iface;
+  descriptor_.comm_ether_fd.mac_address = mac_address_string;
+  descriptor_.comm_ep.endpoint_address = interrupt_in_ep | 0x80;
+  descriptor_.data_iface_alt0.interface_number = data_iface;
+  descriptor_.data_iface_alt1.interface_number = data_iface;
+  descriptor_.in_ep.endpoint_address = bulk_ep | 0x80;
+  descriptor_.out_ep.endpoint_address = bulk_ep & 0x7F;
+
+  tx_queue_ = xQueueCreate(kTxQueueLength, sizeof(struct pbuf *));
+  CHECK(tx_queue_);
+  tx_done_ = xSemaphoreCreateBinary();
+  CHECK(tx_done_);
+  xSemaphoreGive(tx_done_);
+  CHECK(xTaskCreate(CdcNcm::StaticTaskFunction, "cdc_ncm_task",
+                    configMINIMAL_STACK_SIZE * 10, this, kUsbDeviceTaskPriority,
+                    nullptr) == pdPASS);
+
+  std::string usb_ip;
+  if (!GetUsbIpAddress(&usb_ip) ||
+      !ipaddr_aton(usb_ip.c_str(), &netif_ipaddr_)) {
+    IP4_ADDR(&netif_ipaddr_, 10, 10, 10, 1);
+  }
+  IP4_ADDR(&netif_netmask_, 255, 255, 255, 0);
+  IP4_ADDR(&netif_gw_, 0, 0, 0, 0);
+  netifapi_netif_add(&netif_, &netif_ipaddr_, &netif_netmask_, &netif_gw_, this,
+                     CdcNcm::StaticNetifInit, tcpip_input);
+  netifapi_netif_set_default(&netif_);
+  netifapi_netif_set_link_up(&netif_);
+  netifapi_netif_set_up(&netif_);
+  start_dhcp_server(netif_ipaddr_.addr);
+}
+
+void CdcNcm::TaskFunction(void *param) {
+  struct pbuf *next = nullptr;
+  while (true) {
+    if (!next && xQueueReceive(tx_queue_, &next, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    uint8_t *ntb = tx_ntbs_[tx_index_];
+    tx_datagram_count_ = 0;
+    size_t length = AggregateFrames(ntb, sizeof(Nth16), &next);
+    // Wait for the other NTB to go out, then pick up whatever was queued in
+    // the meantime.
+    xSemaphoreTake(tx_done_, portMAX_DELAY);
+    length = AggregateFrames(ntb, length, &next);
+    if (tx_datagram_count_ == 0 || !connected_) {
+      xSemaphoreGive(tx_done_);
+      continue;
+    }
+    length = FinishNtb(ntb, length);
+    usb_status_t status;
+    while (true) {
+      status = USB_DeviceCdcNcmSend(class_handle_, bulk_ep_, ntb, length);
+      if (status != kStatus_USB_Busy) {
+        break;
+      }
+      xSemaphoreTake(tx_done_, pdMS_TO_TICKS(10));
+    }
+    if (status == kStatus_USB_Success) {
+      tx_index_ ^= 1;
+    } else {
+      DbgConsole_Printf("[NCM] USB_DeviceCdcNcmSend failed\r\n");
+      xSemaphoreGive(tx_done_);
+    }
+  }
+}
+
+err_t CdcNcm::NetifInit(struct netif *netif) {
+  netif->name[0] = 'u';
+  netif->name[1] = 's';
+  netif->output = etharp_output;
+  netif->linkoutput = CdcNcm::StaticTxFunc;
+  netif->mtu = 1500;
+  netif->hwaddr_len = 6;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP;
+
+  netif->hwaddr[0] = 0x00;
+  netif->hwaddr[1] = 0x1A;
+  netif->hwaddr[2] = 0x11;
+  netif->hwaddr[3] = 0xBA;
+  netif->hwaddr[4] = 0xDF;
+  netif->hwaddr[5] = 0xAD;
+
+  return ERR_OK;
+}
+
+err_t CdcNcm::TxFunc(struct netif *netif, struct pbuf *p) {
+  if (!connected_) {
+    return ERR_IF;
+  }
+
+  // The frame is copied straight from the pbuf chain into an NTB by the
+  // task, so just hold a reference until then.
+  pbuf_ref(p);
+  if (xQueueSendToBack(tx_queue_, &p, 0) != pdTRUE) {
+    pbuf_free(p);
+    return ERR_IF;
+  }
+
+  return ERR_OK;
+}
+
+size_t CdcNcm::AggregateFrames(uint8_t *ntb, size_t length,
+                               struct pbuf **next) {
+  while (*next || xQueueReceive(tx_queue_, next, 0) == pdTRUE) {
+    size_t index = Align(length);
+    size_t end = index + (*next)->tot_len;
+    if (tx_datagram_count_ == kMaxDatagramsPerNtb ||
+        Align(end) + NdpSize(tx_datagram_count_ + 1) > ntb_in_size_) {
+      if (tx_datagram_count_ != 0) {
+        // Keep the frame for the next NTB.
+        break;
+      }
+      DbgConsole_Printf("[NCM] Dropping %u byte frame\r\n", (*next)->tot_len);
+    } else {
+      std::memset(ntb + length, 0, index - length);
+      pbuf_copy_partial(*next, ntb + index, (*next)->tot_len, 0);
+      tx_datagrams_[tx_datagram_count_++] = {
+          static_cast<uint16_t>(index), (*next)->tot_len};
+      length = end;
+    }
+    pbuf_free(*next);
+    *next = nullptr;
+  }
+  return length;
+}
+
+size_t CdcNcm::FinishNtb(uint8_t *ntb, size_t length) {
+  // The NDP goes after the datagrams, since their count isn't known upfront.
+  size_t ndp_index = Align(length);
+  std::memset(ntb + length, 0, ndp_index - length);
+  Ndp16 ndp = {
+      .signature = NCM_NDP16_SIGNATURE,
+      .length = static_cast<uint16_t>(NdpSize(tx_datagram_count_)),
+      .next_ndp_index = 0,
+  };
+  std::memcpy(ntb + ndp_index, &ndp, sizeof(ndp));
+  uint8_t *entries = ntb + ndp_index + sizeof(ndp);
+  std::memcpy(entries, tx_datagrams_, tx_datagram_count_ * sizeof(Dpe16));
+  std::memset(entries + tx_datagram_count_ * sizeof(Dpe16), 0, sizeof(Dpe16));
+  length = ndp_index + ndp.length;
+
+  // The host reads into ntb_in_size_ buffers, so a shorter NTB that ends on
+  // a packet boundary gets a padding byte to end the transfer.
+  if (length < ntb_in_size_ &&
+      length % cdc_ncm_data_endpoints_[DATA_IN].maxPacketSize == 0) {
+    ntb[length++] = 0;
+  }
+
+  Nth16 nth = {
+      .signature = NCM_NTH16_SIGNATURE,
+      .header_length = sizeof(Nth16),
+      .sequence = tx_sequence_++,
+      .block_length = static_cast<uint16_t>(length),
+      .ndp_index = static_cast<uint16_t>(ndp_index),
+  };
+  std::memcpy(ntb, &nth, sizeof(nth));
+  return length;
+}
+
+err_t CdcNcm::ReceiveFrame(uint8_t *buffer, uint32_t length) {
+  struct pbuf *frame = pbuf_alloc(PBUF_RAW, length, PBUF_POOL);
+  if (!frame) {
+    printf("Failed to allocate pbuf\r\n");
+    return ERR_BUF;
+  }
+  pbuf_take(frame, buffer, length);
+  err_t ret = netif_.input(frame, &netif_);
+  if (ret != ERR_OK) {
+    printf("tcpip_input() failed %d\r\n", ret);
+    pbuf_free_callback(frame);
+    return ERR_IF;
+  }
+
+  return ERR_OK;
+}
+
+void CdcNcm::ProcessNtb(uint32_t length) {
+  Nth16 nth;
+  if (length < sizeof(nth)) {
+    return;
+  }
+  std::memcpy(&nth, rx_ntb_, sizeof(nth));
+  if (nth.signature != NCM_NTH16_SIGNATURE ||
+      nth.header_length != sizeof(nth) || nth.block_length > length) {
+    DbgConsole_Printf("[NCM] Invalid NTB header\r\n");
+    return;
+  }
+
+  size_t ndp_index = nth.ndp_index;
+  for (int i = 0; i < kMaxNdpsPerNtb && ndp_index != 0; ++i) {
+    Ndp16 ndp;
+    if (ndp_index % kNtbAlignment != 0 ||
+        ndp_index + sizeof(ndp) > nth.block_length) {
+      break;
+    }
+    std::memcpy(&ndp, rx_ntb_ + ndp_index, sizeof(ndp));
+    if (ndp.signature != NCM_NDP16_SIGNATURE || ndp.length < NdpSize(1) ||
+        ndp_index + ndp.length > nth.block_length) {
+      DbgConsole_Printf("[NCM] Invalid NDP\r\n");
+      break;
+    }
+    const uint8_t *entries = rx_ntb_ + ndp_index + sizeof(ndp);
+    size_t count = (ndp.length - sizeof(ndp)) / sizeof(Dpe16);
+    for (size_t j = 0; j < count; ++j) {
+      Dpe16 dpe;
+      std::memcpy(&dpe, entries + j * sizeof(dpe), sizeof(dpe));
+      if (dpe.datagram_index == 0 || dpe.datagram_length == 0) {
+        break;
+      }
+      if (dpe.datagram_index + dpe.datagram_length > nth.block_length) {
+        continue;
+      }
+      ReceiveFrame(rx_ntb_ + dpe.datagram_index, dpe.datagram_length);
+    }
+    ndp_index = ndp.next_ndp_index;
+  }
+}
+
+usb_status_t CdcNcm::ArmReceive() {
+  return USB_DeviceCdcNcmRecv(class_handle_, bulk_ep_, rx_ntb_,
+                              sizeof(rx_ntb_));
+}
+
+void CdcNcm::SendNotification() {
+  // Reports the link speed, then that the link is up, which is what makes the
+  // host bring up its interface.
+  const uint16_t comm_iface = cdc_ncm_interfaces_[0].interfaceNumber;
+  uint32_t length = 8;
+  notification_buffer_[0] = 0xA1;  // Class request, device to host, interface
+  notification_buffer_[2] = 0;
+  notification_buffer_[4] = comm_iface & 0xFF;
+  notification_buffer_[5] = comm_iface >> 8;
+  notification_buffer_[7] = 0;
+  switch (notification_) {
+    case 0: {
+      constexpr uint32_t kBitRate = 480000000;
+      notification_buffer_[1] =
+          USB_DEVICE_CDC_NCM_NOTIF_CONNECTION_SPEED_CHANGE;
+      notification_buffer_[3] = 0;
+      notification_buffer_[6] = 2 * sizeof(kBitRate);
+      std::memcpy(&notification_buffer_[8], &kBitRate, sizeof(kBitRate));
+      std::memcpy(&notification_buffer_[12], &kBitRate, sizeof(kBitRate));
+      length += 2 * sizeof(kBitRate);
+      break;
+    }
+    case 1:
+      notification_buffer_[1] = USB_DEVICE_CDC_NCM_NOTIF_NETWORK_CONNECTION;
+      notification_buffer_[3] = connected_ ? 1 : 0;
+      notification_buffer_[6] = 0;
+      break;
+    default:
+      return;
+  }
+  if (USB_DeviceCdcNcmNotify(class_handle_, interrupt_in_ep_,
+                             notification_buffer_,
+                             length) == kStatus_USB_Success) {
+    ++notification_;
+  }
+}
+
+usb_status_t CdcNcm::HandleClassRequest(
+    usb_device_cdc_ncm_request_param_struct_t *ncm_param) {
+  switch (ncm_param->request) {
+    case USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_PARAMETERS: {
+      static NtbParameters parameters;
+      parameters = {
+          .length = sizeof(NtbParameters),
+          .ntb_formats_supported = 0x0001,  // NTB-16 only
+          .ntb_in_max_size = kNtbInMaxSize,
+          .ndp_in_divisor = kNtbAlignment,
+          .ndp_in_payload_remainder = 0,
+          .ndp_in_alignment = kNtbAlignment,
+          .reserved = 0,
+          .ntb_out_max_size = kNtbOutMaxSize,
+          .ndp_out_divisor = kNtbAlignment,
+          .ndp_out_payload_remainder = 0,
+          .ndp_out_alignment = kNtbAlignment,
+          .ntb_out_max_datagrams = 0,  // No limit
+      };
+      *ncm_param->buffer = reinterpret_cast<uint8_t *>(&parameters);
+      *ncm_param->length = sizeof(parameters);
+      return kStatus_USB_Success;
+    }
+    case USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_INPUT_SIZE:
+      std::memcpy(control_buffer_, &ntb_in_size_, sizeof(ntb_in_size_));
+      *ncm_param->buffer = control_buffer_;
+      *ncm_param->length = sizeof(ntb_in_size_);
+      return kStatus_USB_Success;
+    case USB_DEVICE_CDC_NCM_REQUEST_SET_NTB_INPUT_SIZE: {
+      if (ncm_param->isSetup) {
+        // The size, optionally followed by a maximum datagram count that we
+        // don't need to honor since we don't advertise support for it.
+        if (*ncm_param->length < sizeof(uint32_t) ||
+            *ncm_param->length > sizeof(control_buffer_)) {
+          return kStatus_USB_InvalidRequest;
+        }
+        *ncm_param->buffer = control_buffer_;
+        return kStatus_USB_Success;
+      }
+      uint32_t size;
+      std::memcpy(&size, *ncm_param->buffer, sizeof(size));
+      if (size < kNtbMinInSize || size > kNtbInMaxSize) {
+        return kStatus_USB_InvalidRequest;
+      }
+      ntb_in_size_ = size;
+      return kStatus_USB_Success;
+    }
+    case USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_FORMAT:
+      std::memset(control_buffer_, 0, sizeof(uint16_t));  // NTB-16
+      *ncm_param->buffer = control_buffer_;
+      *ncm_param->length = sizeof(uint16_t);
+      return kStatus_USB_Success;
+    case USB_DEVICE_CDC_NCM_REQUEST_SET_NTB_FORMAT:
+      return ncm_param->setupValue == 0 ? kStatus_USB_Success
+                                        : kStatus_USB_InvalidRequest;
+    case USB_DEVICE_CDC_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER:
+      // Everything is passed to lwIP, which does its own filtering.
+      return kStatus_USB_Success;
+    default:
+      DbgConsole_Printf("[NCM] Unhandled class request %x\r\n",
+                        ncm_param->request);
+      return kStatus_USB_InvalidRequest;
+  }
+}
+
+bool CdcNcm::HandleEvent(uint32_t event, void *param) {
+  switch (event) {
+    case kUSB_DeviceEventSetConfiguration:
+      connected_ = false;
+      break;
+    case kUSB_DeviceEventSetInterface: {
+      uint16_t interface_alternate = *static_cast<uint16_t *>(param);
+      if ((interface_alternate >> 8) != data_iface_) {
+        break;
+      }
+      // The host selects alternate setting 1 to start the data flow, which
+      // resets the function's state.
+      connected_ = (interface_alternate & 0xFF) == 1;
+      ntb_in_size_ = kNtbInMaxSize;
+      tx_sequence_ = 0;
+      if (connected_) {
+        ArmReceive();
+      }
+      notification_ = 0;
+      SendNotification();
+      break;
+    }
+    default:
+      DbgConsole_Printf("%s unhandled event %d\r\n", __PRETTY_FUNCTION__,
+                        event);
+      return false;
+  }
+  return true;
+}
+
+usb_status_t CdcNcm::Handler(uint32_t event, void *param) {
+  usb_status_t ret = kStatus_USB_Error;
+  auto *ep_cb =
+      static_cast<usb_device_endpoint_callback_message_struct_t *>(param);
+
+  switch (event) {
+    case kUSB_DeviceNcmEventRecvResponse:
+      if (!connected_) {
+        break;
+      }
+      if (ep_cb->length != USB_UNINITIALIZED_VAL_32) {
+        ProcessNtb(ep_cb->length);
+      }
+      ret = ArmReceive();
+      break;
+    case kUSB_DeviceNcmEventSendResponse:
+      xSemaphoreGive(tx_done_);
+      ret = kStatus_USB_Success;
+      break;
+    case kUSB_DeviceNcmEventNotifyResponse:
+      SendNotification();
+      ret = kStatus_USB_Success;
+      break;
+    case kUSB_DeviceNcmEventClassRequest:
+      ret = HandleClassRequest(
+          static_cast<usb_device_cdc_ncm_request_param_struct_t *>(param));
+      break;
+    default:
+      DbgConsole_Printf("Unhandled NCM event: %d\r\n", event);
+  }
+
+  return ret;
+}
+
+}  // namespace coralmicro
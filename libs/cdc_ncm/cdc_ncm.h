@@ -0,0 +1,358 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_CDC_NCM_CDC_NCM_H_
+#define LIBS_CDC_NCM_CDC_NCM_H_
+
+#include <map>
+
+/* clang-format off */
+#include "libs/usb/descriptors.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/netifapi.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/device/usb_device.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/include/usb.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/output/source/device/class/usb_device_class.h"  // Must be above other class headers.
+#include "libs/nxp/rt1176-sdk/usb_device_cdc_ncm.h"
+/* clang-format on */
+
+// Largest NTB (NCM Transfer Block) the device sends to the host. The host can
+// ask for smaller ones.
+#ifndef CDC_NCM_NTB_IN_MAX_SIZE
+#define CDC_NCM_NTB_IN_MAX_SIZE (8 * 1024)
+#endif
+
+// Largest NTB the host may send to the device.
+#ifndef CDC_NCM_NTB_OUT_MAX_SIZE
+#define CDC_NCM_NTB_OUT_MAX_SIZE (8 * 1024)
+#endif
+
+namespace coralmicro {
+
+// USB network function implementing the CDC Network Control Model.
+//
+// Compared to CDC-EEM, NCM batches many Ethernet frames into each USB
+// transfer in both directions, and is supported natively by Linux, macOS and
+// Windows hosts. It provides the same lwIP network interface and DHCP server
+// as `CdcEem`, and is used instead of it when built with `USE_USB_NCM`.
+class CdcNcm {
+ public:
+  // MAC address of the host end of the link, as reported to the host.
+  static constexpr char kHostMacAddress[] = "001A11BADFAE";
+
+  CdcNcm() = default;
+  CdcNcm(const CdcNcm &) = delete;
+  CdcNcm &operator=(const CdcNcm &) = delete;
+  // Initializes the function.
+  //
+  // @param interrupt_in_ep The notification endpoint number.
+  // @param bulk_ep The endpoint number used for both data directions.
+  // @param comm_iface The communication interface number.
+  // @param data_iface The data interface number.
+  // @param mac_address_string Index of a string descriptor holding
+  //   `kHostMacAddress`.
+  void Init(uint8_t interrupt_in_ep, uint8_t bulk_ep, uint8_t comm_iface,
+            uint8_t data_iface, uint8_t mac_address_string);
+  const usb_device_class_config_struct_t &config_data() const {
+    return config_;
+  }
+  const void *descriptor_data() const { return &descriptor_; }
+  size_t descriptor_data_size() const { return sizeof(descriptor_); }
+  void SetClassHandle(class_handle_t class_handle) {
+    handle_map_[class_handle] = this;
+    class_handle_ = class_handle;
+  }
+  bool HandleEvent(uint32_t event, void *param);
+
+ private:
+  usb_status_t HandleClassRequest(
+      usb_device_cdc_ncm_request_param_struct_t *ncm_param);
+  void ProcessNtb(uint32_t length);
+  usb_status_t ArmReceive();
+  void SendNotification();
+
+  static std::map<class_handle_t, CdcNcm *> handle_map_;
+  static usb_status_t StaticHandler(class_handle_t class_handle, uint32_t event,
+                                    void *param) {
+    return handle_map_[class_handle]->Handler(event, param);
+  }
+  usb_status_t Handler(uint32_t event, void *param);
+
+  // LwIP hooks
+  static err_t StaticNetifInit(struct netif *netif) {
+    return static_cast<CdcNcm *>(netif->state)->NetifInit(netif);
+  }
+  err_t NetifInit(struct netif *netif);
+
+  static err_t StaticTxFunc(struct netif *netif, struct pbuf *p) {
+    return static_cast<CdcNcm *>(netif->state)->TxFunc(netif, p);
+  }
+  err_t TxFunc(struct netif *netif, struct pbuf *p);
+
+  static void StaticTaskFunction(void *param) {
+    static_cast<CdcNcm *>(param)->TaskFunction(param);
+  }
+  void TaskFunction(void *param);
+
+  size_t AggregateFrames(uint8_t *ntb, size_t length, struct pbuf **next);
+  size_t FinishNtb(uint8_t *ntb, size_t length);
+  err_t ReceiveFrame(uint8_t *buffer, uint32_t length);
+
+  usb_device_endpoint_struct_t cdc_ncm_comm_endpoints_[1] = {
+      {
+          .endpointAddress = 0,  // set in Init
+          .transferType = USB_ENDPOINT_INTERRUPT,
+          .maxPacketSize = 16,
+          .interval = 9,
+      },
+  };
+  usb_device_endpoint_struct_t cdc_ncm_data_endpoints_[2] = {
+      {
+          .endpointAddress = 0,  // set in Init
+          .transferType = USB_ENDPOINT_BULK,
+          .maxPacketSize = 512,
+          .interval = 0,
+      },
+      {
+          .endpointAddress = 0,  // set in Init
+          .transferType = USB_ENDPOINT_BULK,
+          .maxPacketSize = 512,
+          .interval = 0,
+      },
+  };
+  usb_device_interface_struct_t cdc_ncm_comm_interface_[1] = {
+      {
+          .alternateSetting = 0,
+          .endpointList =
+              {
+                  .count = ARRAY_SIZE(cdc_ncm_comm_endpoints_),
+                  .endpoint = cdc_ncm_comm_endpoints_,
+              },
+          .classSpecific = nullptr,
+      },
+  };
+  usb_device_interface_struct_t cdc_ncm_data_interface_[2] = {
+      {
+          .alternateSetting = 0,
+          .endpointList =
+              {
+                  .count = 0,
+                  .endpoint = nullptr,
+              },
+          .classSpecific = nullptr,
+      },
+      {
+          .alternateSetting = 1,
+          .endpointList =
+              {
+                  .count = ARRAY_SIZE(cdc_ncm_data_endpoints_),
+                  .endpoint = cdc_ncm_data_endpoints_,
+              },
+          .classSpecific = nullptr,
+      },
+  };
+  usb_device_interfaces_struct_t cdc_ncm_interfaces_[2] = {
+      {
+          .classCode = USB_DEVICE_CONFIG_CDC_COMM_CLASS_CODE,
+          .subclassCode = USB_DEVICE_CONFIG_CDC_NCM_SUBCLASS_CODE,
+          .protocolCode = 0x00,
+          .interfaceNumber = 0,  // set in Init
+          .interface = cdc_ncm_comm_interface_,
+          .count = ARRAY_SIZE(cdc_ncm_comm_interface_),
+      },
+      {
+          .classCode = USB_DEVICE_CONFIG_CDC_DATA_CLASS_CODE,
+          .subclassCode = 0x00,
+          .protocolCode = USB_DEVICE_CONFIG_CDC_NCM_DATA_PROTOCOL_CODE,
+          .interfaceNumber = 0,  // set in Init
+          .interface = cdc_ncm_data_interface_,
+          .count = ARRAY_SIZE(cdc_ncm_data_interface_),
+      },
+  };
+  usb_device_interface_list_t cdc_ncm_interface_list_[1] = {
+      {
+          .count = ARRAY_SIZE(cdc_ncm_interfaces_),
+          .interfaces = cdc_ncm_interfaces_,
+      },
+  };
+  usb_device_class_struct_t class_struct_{
+      .interfaceList = cdc_ncm_interface_list_,
+      .type = kUSB_DeviceClassTypeNcm,
+      .configurations = ARRAY_SIZE(cdc_ncm_interface_list_),
+  };
+  usb_device_class_config_struct_t config_{
+      .classCallback = StaticHandler,
+      .classHandle = nullptr,
+      .classInfomation = &class_struct_,
+  };
+  // Interface, endpoint and string numbers are set in Init.
+  CdcNcmClassDescriptor descriptor_ = {
+      .iad0 =
+          {
+              .length = sizeof(InterfaceAssociationDescriptor),
+              .descriptor_type = 0x0B,
+              .first_interface = 0,
+              .interface_count = 2,
+              .function_class = 0x02,
+              .function_subclass = 0x0D,
+              .function_protocol = 0x00,
+              .interface = 0,
+          },
+      .comm_iface =
+          {
+              .length = sizeof(InterfaceDescriptor),
+              .descriptor_type = 0x04,
+              .interface_number = 0,
+              .alternate_setting = 0,
+              .num_endpoints = 1,
+              .interface_class = 0x02,
+              .interface_subclass = 0x0D,
+              .interface_protocol = 0x00,
+              .interface = 0,
+          },
+      .comm_hdr_fd =
+          {
+              .length = sizeof(CdcHeaderFunctionalDescriptor),
+              .descriptor_type = 0x24,
+              .descriptor_subtype = 0x00,
+              .cdc = 0x0110,
+          },
+      .comm_union_fd =
+          {
+              .function_length = sizeof(CdcUnionFunctionalDescriptor),
+              .descriptor_type = 0x24,
+              .descriptor_subtype = 0x06,
+              .controller_iface = 0,
+              .peripheral_iface0 = 0,
+          },
+      .comm_ether_fd =
+          {
+              .function_length =
+                  sizeof(CdcEthernetNetworkingFunctionalDescriptor),
+              .descriptor_type = 0x24,
+              .descriptor_subtype = 0x0F,
+              .mac_address = 0,
+              .ethernet_statistics = 0,
+              .max_segment_size = 1514,
+              .num_mc_filters = 0,
+              .num_power_filters = 0,
+          },
+      .comm_ncm_fd =
+          {
+              .function_length = sizeof(CdcNcmFunctionalDescriptor),
+              .descriptor_type = 0x24,
+              .descriptor_subtype = 0x1A,
+              .bcd_ncm_version = 0x0100,
+              .network_capabilities = 0,
+          },
+      .comm_ep =
+          {
+              .length = sizeof(EndpointDescriptor),
+              .descriptor_type = 0x05,
+              .endpoint_address = 0,
+              .attributes = 0x03,
+              .max_packet_size = 16,
+              .interval = 9,
+          },
+      .data_iface_alt0 =
+          {
+              .length = sizeof(InterfaceDescriptor),
+              .descriptor_type = 0x04,
+              .interface_number = 0,
+              .alternate_setting = 0,
+              .num_endpoints = 0,
+              .interface_class = 0x0A,
+              .interface_subclass = 0x00,
+              .interface_protocol = 0x01,
+              .interface = 0,
+          },
+      .data_iface_alt1 =
+          {
+              .length = sizeof(InterfaceDescriptor),
+              .descriptor_type = 0x04,
+              .interface_number = 0,
+              .alternate_setting = 1,
+              .num_endpoints = 2,
+              .interface_class = 0x0A,
+              .interface_subclass = 0x00,
+              .interface_protocol = 0x01,
+              .interface = 0,
+          },
+      .in_ep =
+          {
+              .length = sizeof(EndpointDescriptor),
+              .descriptor_type = 0x05,
+              .endpoint_address = 0,
+              .attributes = 0x02,
+              .max_packet_size = 512,
+              .interval = 0,
+          },
+      .out_ep =
+          {
+              .length = sizeof(EndpointDescriptor),
+              .descriptor_type = 0x05,
+              .endpoint_address = 0,
+              .attributes = 0x02,
+              .max_packet_size = 512,
+              .interval = 0,
+          },
+  };
+
+  static constexpr size_t kNtbInMaxSize = CDC_NCM_NTB_IN_MAX_SIZE;
+  static constexpr size_t kNtbOutMaxSize = CDC_NCM_NTB_OUT_MAX_SIZE;
+  static_assert(kNtbInMaxSize >= 2048 && kNtbInMaxSize <= 65535,
+                "NTB-16 blocks must be between 2048 and 65535 bytes");
+  static_assert(kNtbOutMaxSize >= 2048 && kNtbOutMaxSize <= 65535 &&
+                    kNtbOutMaxSize % 512 == 0,
+                "NTB-16 blocks must be between 2048 and 65535 bytes");
+  static constexpr int kTxQueueLength = 32;
+  static constexpr int kMaxDatagramsPerNtb = 32;
+
+  struct Datagram {
+    uint16_t index;
+    uint16_t length;
+  };
+
+  // Outgoing frames are queued as referenced pbufs, and the task packs as
+  // many of them as fit into one NTB. While one NTB is on the bus, the other
+  // is filled.
+  uint8_t tx_ntbs_[2][kNtbInMaxSize];
+  int tx_index_ = 0;
+  Datagram tx_datagrams_[kMaxDatagramsPerNtb];
+  int tx_datagram_count_ = 0;
+  uint16_t tx_sequence_ = 0;
+  uint8_t rx_ntb_[kNtbOutMaxSize];
+  // NTB size requested by the host with SET_NTB_INPUT_SIZE.
+  uint32_t ntb_in_size_ = kNtbInMaxSize;
+  uint8_t control_buffer_[8];
+  uint8_t notification_buffer_[16];
+  int notification_ = 0;
+  bool connected_ = false;
+
+  uint8_t interrupt_in_ep_, bulk_ep_, data_iface_;
+  QueueHandle_t tx_queue_;
+  // Given when the bulk in endpoint is idle.
+  SemaphoreHandle_t tx_done_;
+  class_handle_t class_handle_;
+
+  ip4_addr_t netif_ipaddr_, netif_netmask_, netif_gw_;
+  struct netif netif_;
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_CDC_NCM_CDC_NCM_H_
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 
+#include "libs/base/trace.h"
 #include "third_party/nxp/rt1176-sdk/middleware/libjpeg/inc/jpeglib.h"
 
 namespace coralmicro {
@@ -37,11 +38,13 @@ METHODDEF(boolean)
 empty_vector_output_buffer(j_compress_ptr cinfo) {
   auto* dest = reinterpret_cast<vector_destination_mgr*>(cinfo->dest);
 
+  // Grow geometrically, so large images only need a few reallocations.
   auto size = dest->out->size();
-  dest->out->resize(size + kVectorSizeIncrement);
+  auto increment = std::max(size, kVectorSizeIncrement);
+  dest->out->resize(size + increment);
 
   dest->pub.next_output_byte = dest->out->data() + size;
-  dest->pub.free_in_buffer = kVectorSizeIncrement;
+  dest->pub.free_in_buffer = increment;
 
   return TRUE;
 }
@@ -53,24 +56,32 @@ term_vector_destination(j_compress_ptr cinfo) {
   dest->out->resize(dest->out->size() - dest->pub.free_in_buffer);
 }
 
-void jpeg_vector_dest(j_compress_ptr cinfo, std::vector<uint8_t>* out) {
-  if (cinfo->dest == nullptr) {
-    cinfo->dest = (struct jpeg_destination_mgr*)(*cinfo->mem->alloc_small)(
-        (j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(vector_destination_mgr));
-  }
-
-  out->resize(kVectorSizeIncrement);
+void init_vector_dest(vector_destination_mgr* dest, std::vector<uint8_t>* out,
+                      size_t initial_size) {
+  // Only the expected output size is made available up front, so resize()
+  // zero-fills no more than the bytes about to be written; the vector keeps
+  // its capacity, so this doesn't reallocate when reused.
+  out->resize(initial_size);
 
-  auto* dest = reinterpret_cast<vector_destination_mgr*>(cinfo->dest);
   dest->pub.init_destination = init_vector_destination;
   dest->pub.empty_output_buffer = empty_vector_output_buffer;
   dest->pub.term_destination = term_vector_destination;
   dest->pub.next_output_byte = out->data();
-  dest->pub.free_in_buffer = kVectorSizeIncrement;
+  dest->pub.free_in_buffer = out->size();
 
   dest->out = out;
 }
 
+void jpeg_vector_dest(j_compress_ptr cinfo, std::vector<uint8_t>* out) {
+  if (cinfo->dest == nullptr) {
+    cinfo->dest = (struct jpeg_destination_mgr*)(*cinfo->mem->alloc_small)(
+        (j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(vector_destination_mgr));
+  }
+
+  init_vector_dest(reinterpret_cast<vector_destination_mgr*>(cinfo->dest), out,
+                   kVectorSizeIncrement);
+}
+
 struct buf_destination_mgr {
   struct jpeg_destination_mgr pub;
   unsigned long size;
@@ -110,20 +121,31 @@ void jpeg_buf_dest(j_compress_ptr cinfo, unsigned char* buf, unsigned long size,
   dest->out_size = out_size;
 }
 
+// The library is configured for BGR pixel order, so RGB rows are copied with
+// red and blue swapped.
+void CopyRgbToBgr(const uint8_t* rgb, uint8_t* bgr, int width) {
+  for (int j = 0; j < width; ++j) {
+    bgr[3 * j + 0] = rgb[3 * j + 2];
+    bgr[3 * j + 1] = rgb[3 * j + 1];
+    bgr[3 * j + 2] = rgb[3 * j + 0];
+  }
+}
+
 void JpegCompressImpl(struct jpeg_compress_struct* cinfo, unsigned char* rgb,
                       int quality) {
+  TRACE_ZONE("jpeg/Compress");
   jpeg_set_defaults(cinfo);
   jpeg_set_quality(cinfo, quality, TRUE);
 
   jpeg_start_compress(cinfo, TRUE);
 
-  JSAMPROW row_pointer[1];
   const int row_stride = cinfo->image_width * 3;
+  JSAMPROW row_pointer[1];
+  row_pointer[0] = static_cast<JSAMPROW>((*cinfo->mem->alloc_small)(
+      reinterpret_cast<j_common_ptr>(cinfo), JPOOL_IMAGE, row_stride));
   while (cinfo->next_scanline < cinfo->image_height) {
-    auto* line = &rgb[cinfo->next_scanline * row_stride];
-    for (JDIMENSION j = 0; j < cinfo->image_width; ++j)
-      std::swap(line[3 * j], line[3 * j + 2]);
-    row_pointer[0] = line;
+    CopyRgbToBgr(&rgb[cinfo->next_scanline * row_stride], row_pointer[0],
+                 cinfo->image_width);
     jpeg_write_scanlines(cinfo, row_pointer, 1);
   }
   jpeg_finish_compress(cinfo);
@@ -187,4 +209,98 @@ void JpegCompressRgb(unsigned char* rgb, int width, int height, int quality,
   JpegCompressImpl(&cinfo, rgb, quality);
 }
 
+struct JpegEncoder::Impl {
+  struct jpeg_compress_struct cinfo;
+  struct jpeg_error_mgr jerr;
+  vector_destination_mgr dest;
+  // Settings of the last image, to only update the tables when they change.
+  bool has_format = false;
+  JpegPixelFormat format;
+  int quality = -1;
+  // Size of the last image, a good guess for the size of the next one.
+  size_t last_size = 0;
+  // Rows in the order expected by the library, and from `RowCallback`.
+  std::vector<uint8_t> row;
+  std::vector<uint8_t> input_row;
+};
+
+JpegEncoder::JpegEncoder() : impl_(std::make_unique<Impl>()) {
+  impl_->cinfo.err = jpeg_std_error(&impl_->jerr);
+  jpeg_create_compress(&impl_->cinfo);
+  impl_->cinfo.dest = &impl_->dest.pub;
+}
+
+JpegEncoder::~JpegEncoder() { jpeg_destroy_compress(&impl_->cinfo); }
+
+void JpegEncoder::Start(int width, int height, JpegPixelFormat format,
+                        int quality, std::vector<uint8_t>* out) {
+  auto* cinfo = &impl_->cinfo;
+  if (!impl_->has_format || impl_->format != format) {
+    if (format == JpegPixelFormat::kRgb) {
+      cinfo->input_components = 3;
+      cinfo->in_color_space = JCS_RGB;
+    } else {
+      cinfo->input_components = 1;
+      cinfo->in_color_space = JCS_GRAYSCALE;
+    }
+    jpeg_set_defaults(cinfo);
+    impl_->has_format = true;
+    impl_->format = format;
+    impl_->quality = -1;
+  }
+  if (impl_->quality != quality) {
+    jpeg_set_quality(cinfo, quality, TRUE);
+    impl_->quality = quality;
+  }
+  cinfo->image_width = width;
+  cinfo->image_height = height;
+
+  init_vector_dest(&impl_->dest, out,
+                   std::max(impl_->last_size + impl_->last_size / 4,
+                            kVectorSizeIncrement));
+  jpeg_start_compress(cinfo, TRUE);
+}
+
+void JpegEncoder::WriteRow(const uint8_t* row) {
+  auto* cinfo = &impl_->cinfo;
+  JSAMPROW row_pointer[1];
+  if (impl_->format == JpegPixelFormat::kRgb) {
+    impl_->row.resize(cinfo->image_width * 3);
+    CopyRgbToBgr(row, impl_->row.data(), cinfo->image_width);
+    row_pointer[0] = impl_->row.data();
+  } else {
+    // The library only reads the row.
+    row_pointer[0] = const_cast<JSAMPROW>(row);
+  }
+  jpeg_write_scanlines(cinfo, row_pointer, 1);
+}
+
+void JpegEncoder::Finish() {
+  jpeg_finish_compress(&impl_->cinfo);
+  impl_->last_size = impl_->dest.out->size();
+}
+
+void JpegEncoder::Encode(const uint8_t* pixels, int width, int height,
+                         JpegPixelFormat format, int quality,
+                         std::vector<uint8_t>* out) {
+  TRACE_ZONE("jpeg/Encode");
+  Start(width, height, format, quality, out);
+  const int row_stride = width * (format == JpegPixelFormat::kRgb ? 3 : 1);
+  for (int y = 0; y < height; ++y) WriteRow(pixels + y * row_stride);
+  Finish();
+}
+
+void JpegEncoder::Encode(int width, int height, JpegPixelFormat format,
+                         int quality, const RowCallback& get_row,
+                         std::vector<uint8_t>* out) {
+  TRACE_ZONE("jpeg/Encode");
+  Start(width, height, format, quality, out);
+  impl_->input_row.resize(width * (format == JpegPixelFormat::kRgb ? 3 : 1));
+  for (int y = 0; y < height; ++y) {
+    get_row(y, impl_->input_row.data());
+    WriteRow(impl_->input_row.data());
+  }
+  Finish();
+}
+
 }  // namespace coralmicro
@@ -18,6 +18,8 @@
 #define LIBS_LIBJPEG_JPEG_H_
 
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <vector>
 
 namespace coralmicro {
@@ -67,6 +69,70 @@ JpegBuffer JpegCompressRgb(unsigned char* rgb, int width, int height,
 void JpegCompressRgb(unsigned char* rgb, int width, int height, int quality,
                      std::vector<uint8_t>* out);
 
+// Pixel formats accepted by `JpegEncoder`.
+enum class JpegPixelFormat {
+  // 3 bytes per pixel in R, G, B order.
+  kRgb,
+  // 1 byte per pixel, encoded as a grayscale JPEG.
+  kGrayscale,
+};
+
+// Converts images to JPEG format, keeping the compressor, its quantization
+// tables, and its working buffers between images. Use this instead of
+// `JpegCompressRgb()` to encode a stream of frames.
+//
+// An encoder must only be used by one task at a time.
+class JpegEncoder {
+ public:
+  // Callback that writes row `y` of the image into `row`, which has room for
+  // `width` pixels. Rows are requested in order, from top to bottom.
+  using RowCallback = std::function<void(int y, uint8_t* row)>;
+
+  JpegEncoder();
+  ~JpegEncoder();
+
+  JpegEncoder(const JpegEncoder&) = delete;
+  JpegEncoder& operator=(const JpegEncoder&) = delete;
+
+  // Converts an image to JPEG format. The image is not modified.
+  //
+  // @param pixels The image, with rows stored one after the other.
+  // @param width The image's width.
+  // @param height The image's height.
+  // @param format The image's pixel format.
+  // @param quality The quality of the image after compression (must be within
+  // [0-100]).
+  // @param out The output vector to return the resulting JPEG image to. Its
+  // memory is reused if it already has enough capacity.
+  void Encode(const uint8_t* pixels, int width, int height,
+              JpegPixelFormat format, int quality, std::vector<uint8_t>* out);
+
+  // Converts an image to JPEG format, getting the image one row at a time so
+  // that it never has to be held in memory as a whole. For example, rows can
+  // be converted from a raw camera frame with `BayerToRgbRow()`.
+  //
+  // @param width The image's width.
+  // @param height The image's height.
+  // @param format The pixel format of the rows.
+  // @param quality The quality of the image after compression (must be within
+  // [0-100]).
+  // @param get_row Callback that produces each row of the image.
+  // @param out The output vector to return the resulting JPEG image to. Its
+  // memory is reused if it already has enough capacity.
+  void Encode(int width, int height, JpegPixelFormat format, int quality,
+              const RowCallback& get_row, std::vector<uint8_t>* out);
+
+ private:
+  struct Impl;
+
+  void Start(int width, int height, JpegPixelFormat format, int quality,
+             std::vector<uint8_t>* out);
+  void WriteRow(const uint8_t* row);
+  void Finish();
+
+  std::unique_ptr<Impl> impl_;
+};
+
 }  // namespace coralmicro
 
 #endif  // LIBS_LIBJPEG_JPEG_H_
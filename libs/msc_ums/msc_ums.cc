@@ -16,10 +16,12 @@
 
 #include "libs/msc_ums/msc_ums.h"
 
+#include <algorithm>
 #include <cstring>
 
 #include "fsl_cache.h"
 #include "libs/base/check.h"
+#include "libs/base/tasks.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
 #include "third_party/freertos_kernel/include/task.h"
 #include "third_party/nxp/rt1176-sdk/components/flash/nand/fsl_nand_flash.h"
@@ -38,11 +40,63 @@ constexpr int kPagesPerBlock = 64;
 constexpr int kFilesystemBaseBlock = 12;
 constexpr size_t kPageSize = 2048;
 constexpr size_t kFlashSize = 0x10000 * 1024;
+constexpr uint32_t kTotalPages =
+    kFlashSize / kPageSize - kFilesystemBaseBlock * kPagesPerBlock;
 constexpr uint32_t kInvalidDataPattern = __htonl(0xdeadbeef);
+// Each MSC data stage is split into chunks of up to one erase block, so a
+// sequential write programs a whole block's worth of pages back to back.
+constexpr size_t kTransferSize = kPageSize * kPagesPerBlock;
+
+status_t ReadPages(nand_handle_t *nand, uint32_t page_index, uint8_t *buf,
+                   size_t size) {
+  uint8_t *start = buf;
+  size_t total = size;
+  while (size != 0) {
+    auto read_size = std::min(kPageSize, size);
+    auto read_index = kFilesystemBaseBlock * kPagesPerBlock + page_index;
+    status_t status = Nand_Flash_Read_Page(nand, read_index, buf, read_size);
+    if (status != kStatus_Success) {
+      printf("Nand_Flash_Read_Page(%lu, %u) failed (%ld), page %lu\r\n",
+             read_index, read_size, status, page_index);
+      return status;
+    }
+    ++page_index;
+    buf += read_size;
+    size -= read_size;
+  }
+  // The pages were copied in by the CPU; push them out for the USB DMA.
+  DCACHE_CleanByRange(reinterpret_cast<uint32_t>(start), total);
+  return kStatus_Success;
+}
+
+status_t ProgramPages(nand_handle_t *nand, uint32_t page_index,
+                      const uint8_t *buf, size_t size) {
+  while (size != 0) {
+    auto write_size = std::min(kPageSize, size);
+    auto write_index = kFilesystemBaseBlock * kPagesPerBlock + page_index;
+    status_t status = Nand_Flash_Page_Program(nand, write_index, buf,
+                                              write_size);
+    if (status != kStatus_Success) {
+      printf("Nand_Flash_Page_Program(%lu, %u) failed (%ld), page %lu\r\n",
+             write_index, write_size, status, page_index);
+      return status;
+    }
+    ++page_index;
+    buf += write_size;
+    size -= write_size;
+  }
+  return kStatus_Success;
+}
 }  // namespace
 
-uint32_t g_mscReadRequestBuffer[kPageSize];
-uint32_t g_mscWriteRequestBuffer[kPageSize];
+// Two read buffers so USB transfers overlap NAND reads. Writes are programmed
+// before the command's status is sent, so they only need one buffer. They are
+// too large for DTCM, so they live in SDRAM and are kept coherent with the
+// USB DMA by hand.
+__attribute__((section(".sdram_bss,\"aw\",%nobits @")))
+__attribute__((aligned(64))) uint8_t g_mscReadRequestBuffer[2][kTransferSize];
+__attribute__((section(".sdram_bss,\"aw\",%nobits @")))
+__attribute__((aligned(64))) uint8_t g_mscWriteRequestBuffer[kTransferSize];
 
 usb_device_inquiry_data_fromat_struct_t g_InquiryInfo = {
     (USB_DEVICE_MSC_UFI_PERIPHERAL_QUALIFIER
@@ -77,6 +131,100 @@ void MscUms::Init(uint8_t bulk_in_ep, uint8_t bulk_out_ep, uint8_t data_iface) {
   msc_ums_data_endpoints_[DATA_OUT].endpointAddress =
       bulk_out_ep | (USB_OUT << 7);
   msc_ums_interfaces_[0].interfaceNumber = data_iface;
+  job_queue_ = xQueueCreate(1, sizeof(NandJob));
+  CHECK(job_queue_);
+  job_done_ = xSemaphoreCreateBinary();
+  CHECK(job_done_);
+  CHECK(xTaskCreate(MscUms::StaticTaskFunction, "msc_ums_task",
+                    configMINIMAL_STACK_SIZE * 10, this, kUsbDeviceTaskPriority,
+                    nullptr) == pdPASS);
+}
+
+void MscUms::TaskFunction(void *param) {
+  nand_handle_t *nand = BOARD_GetNANDHandle();
+  CHECK(nand);
+  NandJob job;
+  while (true) {
+    CHECK(xQueueReceive(job_queue_, &job, portMAX_DELAY) == pdTRUE);
+    job_status_ = ReadPages(nand, job.page, job.buffer, job.size);
+    xSemaphoreGive(job_done_);
+  }
+}
+
+void MscUms::StartJob(uint32_t page, uint8_t *buffer, size_t size) {
+  CHECK(!job_pending_);
+  job_ = {page, buffer, size};
+  job_pending_ = true;
+  CHECK(xQueueSendToBack(job_queue_, &job_, portMAX_DELAY) == pdTRUE);
+}
+
+void MscUms::FinishJob() {
+  if (!job_pending_) return;
+  xSemaphoreTake(job_done_, portMAX_DELAY);
+  job_pending_ = false;
+  if (job_status_ != kStatus_Success) prefetch_valid_ = false;
+}
+
+uint8_t *MscUms::ReadRequest(uint32_t offset, size_t size, status_t *status) {
+  FinishJob();
+  uint8_t *buffer = g_mscReadRequestBuffer[read_index_];
+  *status = kStatus_Success;
+  if (!prefetch_valid_ || offset != prefetch_offset_ ||
+      size > prefetch_size_) {
+    *status = ReadPages(BOARD_GetNANDHandle(), offset, buffer, size);
+  }
+  prefetch_valid_ = false;
+  read_index_ ^= 1;
+  if (*status != kStatus_Success) {
+    for (size_t i = 0; i < size; i += sizeof(kInvalidDataPattern)) {
+      std::memcpy(buffer + i, &kInvalidDataPattern,
+                  sizeof(kInvalidDataPattern));
+    }
+    DCACHE_CleanByRange(reinterpret_cast<uint32_t>(buffer), size);
+    return buffer;
+  }
+
+  // Once reads are sequential, read the next chunk into the other buffer
+  // while this one goes out over USB, sized like this request. Random reads,
+  // such as FAT and directory lookups, would only wait on a wasted read.
+  const bool sequential = offset == next_read_offset_;
+  uint32_t next = offset + size / kPageSize;
+  next_read_offset_ = next;
+  if (sequential && next < kTotalPages) {
+    prefetch_offset_ = next;
+    prefetch_size_ = std::min<size_t>(size, (kTotalPages - next) * kPageSize);
+    prefetch_valid_ = true;
+    StartJob(prefetch_offset_, g_mscReadRequestBuffer[read_index_],
+             prefetch_size_);
+  }
+  return buffer;
+}
+
+status_t MscUms::WriteResponse(uint32_t offset, uint8_t *buffer, size_t size) {
+  // Drop anything the CPU may have cached while the USB DMA filled the buffer.
+  DCACHE_InvalidateByRange(reinterpret_cast<uint32_t>(buffer), size);
+  // Let a prefetch finish before using the NAND, and drop it since the pages
+  // it holds may be about to change.
+  FinishJob();
+  prefetch_valid_ = false;
+
+  if (offset == 0 && std::memcmp(buffer, &kInvalidDataPattern,
+                                 sizeof(kInvalidDataPattern)) == 0) {
+    uint32_t block = __ntohl(
+        *reinterpret_cast<uint32_t *>(buffer + sizeof(kInvalidDataPattern)));
+    uint32_t erase_block = kFilesystemBaseBlock + block;
+    status_t status =
+        Nand_Flash_Erase_Block(BOARD_GetNANDHandle(), erase_block);
+    if (status != kStatus_Success) {
+      printf("Nand_Flash_Erase_Block(%lu) failed (%ld), block %lu\r\n",
+             erase_block, status, block);
+    }
+    return status;
+  }
+
+  // Program before returning, so a failure fails the command that carried
+  // the data instead of being lost when the host sends no further write.
+  return ProgramPages(BOARD_GetNANDHandle(), offset, buffer, size);
 }
 
 void MscUms::SetClassHandle(class_handle_t class_handle) {
@@ -101,12 +249,10 @@ bool MscUms::HandleEvent(uint32_t event, void *param) {
 usb_status_t MscUms::Handler(uint32_t event, void *param) {
   usb_status_t error = kStatus_USB_Success;
   status_t errorCode = kStatus_Success;
-  nand_handle_t *nand = BOARD_GetNANDHandle();
   usb_device_lba_information_struct_t *lbaInformation;
   usb_device_lba_app_struct_t *lba;
   usb_device_ufi_app_struct_t *ufi;
   usb_device_capacity_information_struct_t *capacityInformation;
-  CHECK(nand);
 
   switch (event) {
     case kUSB_DeviceMscEventReadResponse:
@@ -114,38 +260,7 @@ usb_status_t MscUms::Handler(uint32_t event, void *param) {
       break;
     case kUSB_DeviceMscEventWriteResponse:
       lba = (usb_device_lba_app_struct_t *)param;
-      if (lba->offset == 0 && std::memcmp(lba->buffer, &kInvalidDataPattern,
-                                          sizeof(kInvalidDataPattern)) == 0) {
-        uint32_t block = __ntohl(*reinterpret_cast<uint32_t *>(
-            lba->buffer + sizeof(kInvalidDataPattern)));
-        uint32_t erase_block = kFilesystemBaseBlock + block;
-        errorCode = Nand_Flash_Erase_Block(nand, erase_block);
-        if (errorCode != kStatus_Success) {
-          printf("Nand_Flash_Erase_Block(%lu) failed (%ld), block %lu\r\n",
-                 erase_block, errorCode, block);
-        }
-      } else {
-        size_t size = lba->size;
-        uint8_t *buf = lba->buffer;
-        uint32_t page_index = lba->offset;
-        while (size != 0) {
-          auto write_size = std::min(kPageSize, size);
-          auto write_index = kFilesystemBaseBlock * kPagesPerBlock + page_index;
-          DCACHE_CleanInvalidateByRange(reinterpret_cast<uint32_t>(buf),
-                                        write_size);
-          errorCode =
-              Nand_Flash_Page_Program(nand, write_index, buf, write_size);
-          if (errorCode != kStatus_Success) {
-            printf(
-                "Nand_Flash_Page_Program(%lu, %u) failed (%ld), page %lu\r\n",
-                write_index, write_size, errorCode, page_index);
-            break;
-          }
-          ++page_index;
-          buf += write_size;
-          size -= write_size;
-        }
-      }
+      errorCode = WriteResponse(lba->offset, lba->buffer, lba->size);
       if (errorCode != kStatus_Success) {
         error = kStatus_USB_InvalidRequest;
       }
@@ -153,38 +268,12 @@ usb_status_t MscUms::Handler(uint32_t event, void *param) {
     case kUSB_DeviceMscEventWriteRequest:
       lba = (usb_device_lba_app_struct_t *)param;
       /*get a buffer to store the data from host*/
-      lba->buffer = (uint8_t *)&g_mscWriteRequestBuffer[0];
+      lba->buffer = g_mscWriteRequestBuffer;
       break;
     case kUSB_DeviceMscEventReadRequest:
       lba = (usb_device_lba_app_struct_t *)param;
-      lba->buffer = (uint8_t *)&g_mscReadRequestBuffer[0];
-      {
-        size_t size = lba->size;
-        uint8_t *buf = lba->buffer;
-        uint32_t page_index = lba->offset;
-        while (size != 0) {
-          auto read_size = std::min(kPageSize, size);
-          auto read_index = kFilesystemBaseBlock * kPagesPerBlock + page_index;
-          errorCode = Nand_Flash_Read_Page(nand, read_index, buf, read_size);
-          if (errorCode != kStatus_Success) {
-            printf("Nand_Flash_Read_Page(%lu, %u) failed (%ld), page %lu\r\n",
-                   read_index, read_size, errorCode, page_index);
-            break;
-          }
-          ++page_index;
-          buf += read_size;
-          size -= read_size;
-        }
-        DCACHE_InvalidateByRange(reinterpret_cast<uint32_t>(lba->buffer),
-                                 lba->size);
-      }
+      lba->buffer = ReadRequest(lba->offset, lba->size, &errorCode);
       if (errorCode != kStatus_Success) {
-        for (size_t i = 0;
-             i < sizeof(g_mscReadRequestBuffer) / sizeof(kInvalidDataPattern);
-             ++i) {
-          memcpy(&g_mscReadRequestBuffer[i * sizeof(kInvalidDataPattern)],
-                 &kInvalidDataPattern, sizeof(kInvalidDataPattern));
-        }
         error = kStatus_USB_InvalidRequest;
       }
       break;
@@ -193,11 +282,11 @@ usb_status_t MscUms::Handler(uint32_t event, void *param) {
       lbaInformation->logicalUnitNumberSupported = LOGICAL_UNIT_SUPPORTED;
       lbaInformation->logicalUnitInformations[0].lengthOfEachLba = kPageSize;
       lbaInformation->logicalUnitInformations[0].totalLbaNumberSupports =
-          kFlashSize / kPageSize - kFilesystemBaseBlock * kPagesPerBlock;
+          kTotalPages;
       lbaInformation->logicalUnitInformations[0].bulkInBufferSize =
-          sizeof(g_mscReadRequestBuffer);
+          kTransferSize;
       lbaInformation->logicalUnitInformations[0].bulkOutBufferSize =
-          sizeof(g_mscWriteRequestBuffer);
+          kTransferSize;
       break;
     case kUSB_DeviceMscEventTestUnitReady:
       /*change the test unit ready command's sense data if need, be careful to
@@ -226,14 +315,12 @@ usb_status_t MscUms::Handler(uint32_t event, void *param) {
     case kUSB_DeviceMscEventReadCapacity:
       capacityInformation = (usb_device_capacity_information_struct_t *)param;
       capacityInformation->lengthOfEachLba = kPageSize;
-      capacityInformation->totalLbaNumberSupports =
-          kFlashSize / kPageSize - kFilesystemBaseBlock * kPagesPerBlock;
+      capacityInformation->totalLbaNumberSupports = kTotalPages;
       break;
     case kUSB_DeviceMscEventReadFormatCapacity:
       capacityInformation = (usb_device_capacity_information_struct_t *)param;
       capacityInformation->lengthOfEachLba = kPageSize;
-      capacityInformation->totalLbaNumberSupports =
-          kFlashSize / kPageSize - kFilesystemBaseBlock * kPagesPerBlock;
+      capacityInformation->totalLbaNumberSupports = kTotalPages;
       break;
     default:
       error = kStatus_USB_InvalidRequest;
@@ -21,6 +21,10 @@
 
 /* clang-format off */
 #include "libs/usb/descriptors.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/queue.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_common.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/device/usb_device.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/include/usb.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/output/source/device/class/usb_device_class.h"  // Must be above other class headers.
@@ -45,6 +49,24 @@ class MscUms {
   static usb_status_t Handler(class_handle_t class_handle, uint32_t event,
                               void *param);
   usb_status_t Handler(uint32_t event, void *param);
+
+  // NAND reads handed off to the worker task. At most one job is
+  // outstanding: while USB sends one transfer buffer, the worker prefetches
+  // into the other.
+  struct NandJob {
+    uint32_t page;
+    uint8_t *buffer;
+    size_t size;
+  };
+  static void StaticTaskFunction(void *param) {
+    static_cast<MscUms *>(param)->TaskFunction(param);
+  }
+  void TaskFunction(void *param);
+  void StartJob(uint32_t page, uint8_t *buffer, size_t size);
+  void FinishJob();
+  uint8_t *ReadRequest(uint32_t offset, size_t size, status_t *status);
+  status_t WriteResponse(uint32_t offset, uint8_t *buffer, size_t size);
+
   usb_device_endpoint_struct_t msc_ums_data_endpoints_[2] = {
       {
           0,  // set in Init
@@ -112,6 +134,21 @@ class MscUms {
   uint8_t bulk_in_ep_, bulk_out_ep_;
   class_handle_t class_handle_;
 
+  QueueHandle_t job_queue_;
+  SemaphoreHandle_t job_done_;
+  NandJob job_;
+  bool job_pending_ = false;
+  status_t job_status_ = kStatus_Success;
+
+  // Index of the read buffer the next prefetch lands in, and which pages it
+  // holds once valid. Any write or erase invalidates it.
+  int read_index_ = 0;
+  bool prefetch_valid_ = false;
+  uint32_t prefetch_offset_ = 0;
+  size_t prefetch_size_ = 0;
+  // The page right after the previous read, to detect sequential reads.
+  uint32_t next_read_offset_ = 0;
+
   static std::map<class_handle_t, MscUms *> handle_map_;
 };
 
@@ -0,0 +1,30 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/nxp/rt1176-sdk/lwip_hooks.h"
+
+static lwip_tcp_input_observer_t g_tcp_input_observer;
+
+void lwip_set_tcp_input_observer(lwip_tcp_input_observer_t observer) {
+  g_tcp_input_observer = observer;
+}
+
+// Installed as LWIP_HOOK_TCP_INPACKET_PCB in lwipopts.h.
+s8_t lwip_hook_tcp_inpacket(struct tcp_pcb* pcb, struct pbuf* p) {
+  lwip_tcp_input_observer_t observer = g_tcp_input_observer;
+  if (observer && p->tot_len != 0) observer(pcb, p);
+  return ERR_OK;
+}
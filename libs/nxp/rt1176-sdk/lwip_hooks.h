@@ -0,0 +1,41 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBS_NXP_RT1176_SDK_LWIP_HOOKS_H_
+#define _LIBS_NXP_RT1176_SDK_LWIP_HOOKS_H_
+
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/pbuf.h"
+#include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/tcp.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+// Called on the lwIP TCP/IP thread with every TCP segment that carries data,
+// right before the segment is passed to its pcb. Neither the pcb nor the
+// segment may be modified from the observer.
+typedef void (*lwip_tcp_input_observer_t)(struct tcp_pcb* pcb,
+                                          const struct pbuf* p);
+
+// Sets the function that observes incoming TCP segments, or NULL to stop
+// observing them. There is only one observer.
+void lwip_set_tcp_input_observer(lwip_tcp_input_observer_t observer);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  // _LIBS_NXP_RT1176_SDK_LWIP_HOOKS_H_
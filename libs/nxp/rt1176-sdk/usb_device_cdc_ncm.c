@@ -0,0 +1,428 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// clang-format off
+#include "third_party/modified/nxp/rt1176-sdk/usb_device_config.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/device/usb_device.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/include/usb.h"
+#include "third_party/nxp/rt1176-sdk/middleware/usb/output/source/device/class/usb_device_class.h"
+// clang-format on
+
+#if USB_DEVICE_CONFIG_CDC_NCM
+#include "libs/nxp/rt1176-sdk/usb_device_cdc_ncm.h"
+
+USB_GLOBAL USB_RAM_ADDRESS_ALIGNMENT(
+    USB_DATA_ALIGN_SIZE) static usb_device_cdc_ncm_struct_t
+    g_cdcNcmHandle[USB_DEVICE_CONFIG_CDC_NCM];
+
+static usb_status_t USB_DeviceCdcNcmAllocateHandle(
+    usb_device_cdc_ncm_struct_t **handle) {
+  uint32_t count;
+  for (count = 0; count < USB_DEVICE_CONFIG_CDC_NCM; ++count) {
+    if (g_cdcNcmHandle[count].handle == NULL) {
+      *handle = &g_cdcNcmHandle[count];
+      return kStatus_USB_Success;
+    }
+  }
+  return kStatus_USB_Busy;
+}
+
+static usb_status_t USB_DeviceCdcNcmFreeHandle(
+    usb_device_cdc_ncm_struct_t *handle) {
+  handle->handle = NULL;
+  handle->configStruct = NULL;
+  handle->configuration = 0;
+  handle->alternate = 0;
+  return kStatus_USB_Success;
+}
+
+static usb_status_t USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle,
+    usb_device_interface_struct_t **interface) {
+  usb_status_t error = kStatus_USB_Error;
+  uint32_t count;
+
+  if (*interface == NULL) {
+    return error;
+  }
+
+  for (count = 0; count < (*interface)->endpointList.count; ++count) {
+    error = USB_DeviceDeinitEndpoint(
+        cdcNcmHandle->handle,
+        (*interface)->endpointList.endpoint[count].endpointAddress);
+  }
+  *interface = NULL;
+
+  return error;
+}
+
+static usb_status_t USB_DeviceCdcNcmEndpointCallback(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle, usb_device_cdc_ncm_pipe_t *pipe,
+    usb_device_cdc_ncm_event_t event,
+    usb_device_endpoint_callback_message_struct_t *message) {
+  usb_status_t status = kStatus_USB_Error;
+
+  if (!cdcNcmHandle) {
+    return kStatus_USB_InvalidHandle;
+  }
+  pipe->isBusy = 0;
+
+  if (cdcNcmHandle->configStruct && cdcNcmHandle->configStruct->classCallback) {
+    status = cdcNcmHandle->configStruct->classCallback(
+        (class_handle_t)cdcNcmHandle, event, message);
+  }
+
+  return status;
+}
+
+static usb_status_t USB_DeviceCdcNcmInterruptIn(
+    usb_device_handle handle,
+    usb_device_endpoint_callback_message_struct_t *message,
+    void *callbackParam) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle =
+      (usb_device_cdc_ncm_struct_t *)callbackParam;
+  return USB_DeviceCdcNcmEndpointCallback(
+      cdcNcmHandle, &cdcNcmHandle->interruptIn,
+      kUSB_DeviceNcmEventNotifyResponse, message);
+}
+
+static usb_status_t USB_DeviceCdcNcmBulkIn(
+    usb_device_handle handle,
+    usb_device_endpoint_callback_message_struct_t *message,
+    void *callbackParam) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle =
+      (usb_device_cdc_ncm_struct_t *)callbackParam;
+  return USB_DeviceCdcNcmEndpointCallback(cdcNcmHandle, &cdcNcmHandle->bulkIn,
+                                          kUSB_DeviceNcmEventSendResponse,
+                                          message);
+}
+
+static usb_status_t USB_DeviceCdcNcmBulkOut(
+    usb_device_handle handle,
+    usb_device_endpoint_callback_message_struct_t *message,
+    void *callbackParam) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle =
+      (usb_device_cdc_ncm_struct_t *)callbackParam;
+  return USB_DeviceCdcNcmEndpointCallback(cdcNcmHandle, &cdcNcmHandle->bulkOut,
+                                          kUSB_DeviceNcmEventRecvResponse,
+                                          message);
+}
+
+// Finds the current alternate setting of an interface of the current
+// configuration, identified by its class and subclass codes.
+static usb_device_interface_struct_t *USB_DeviceCdcNcmFindInterface(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle, uint8_t classCode,
+    uint8_t subclassCode, uint8_t alternate, uint8_t *interfaceNumber) {
+  usb_device_interface_list_t *interfaceList;
+  uint32_t count;
+  uint32_t index;
+
+  if ((cdcNcmHandle->configuration == 0) ||
+      (cdcNcmHandle->configuration >
+       cdcNcmHandle->configStruct->classInfomation->configurations)) {
+    return NULL;
+  }
+
+  interfaceList = &cdcNcmHandle->configStruct->classInfomation
+                       ->interfaceList[cdcNcmHandle->configuration - 1];
+  for (count = 0; count < interfaceList->count; ++count) {
+    if (interfaceList->interfaces[count].classCode != classCode ||
+        interfaceList->interfaces[count].subclassCode != subclassCode) {
+      continue;
+    }
+    *interfaceNumber = interfaceList->interfaces[count].interfaceNumber;
+    for (index = 0; index < interfaceList->interfaces[count].count; index++) {
+      if (interfaceList->interfaces[count].interface[index].alternateSetting ==
+          alternate) {
+        return &interfaceList->interfaces[count].interface[index];
+      }
+    }
+    break;
+  }
+  return NULL;
+}
+
+static usb_status_t USB_DeviceCdcNcmInterfaceEndpointsInit(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle,
+    usb_device_interface_struct_t *interface) {
+  usb_status_t error = kStatus_USB_Success;
+  uint32_t count;
+
+  for (count = 0; count < interface->endpointList.count; ++count) {
+    usb_device_endpoint_init_struct_t epInitStruct;
+    usb_device_endpoint_callback_struct_t epCallback;
+    uint8_t direction;
+    epInitStruct.zlt = 0;
+    epInitStruct.interval = interface->endpointList.endpoint[count].interval;
+    epInitStruct.endpointAddress =
+        interface->endpointList.endpoint[count].endpointAddress;
+    epInitStruct.maxPacketSize =
+        interface->endpointList.endpoint[count].maxPacketSize;
+    epInitStruct.transferType =
+        interface->endpointList.endpoint[count].transferType;
+    direction = (epInitStruct.endpointAddress &
+                 USB_DESCRIPTOR_ENDPOINT_ADDRESS_DIRECTION_MASK) >>
+                USB_DESCRIPTOR_ENDPOINT_ADDRESS_DIRECTION_SHIFT;
+
+    if (direction == USB_IN &&
+        epInitStruct.transferType == USB_ENDPOINT_INTERRUPT) {
+      cdcNcmHandle->interruptIn.isBusy = 0;
+      epCallback.callbackFn = USB_DeviceCdcNcmInterruptIn;
+    } else if (direction == USB_IN &&
+               epInitStruct.transferType == USB_ENDPOINT_BULK) {
+      cdcNcmHandle->bulkIn.isBusy = 0;
+      epCallback.callbackFn = USB_DeviceCdcNcmBulkIn;
+    } else if (direction == USB_OUT &&
+               epInitStruct.transferType == USB_ENDPOINT_BULK) {
+      cdcNcmHandle->bulkOut.isBusy = 0;
+      epCallback.callbackFn = USB_DeviceCdcNcmBulkOut;
+    } else {
+      continue;
+    }
+    epCallback.callbackParam = cdcNcmHandle;
+    error = USB_DeviceInitEndpoint(cdcNcmHandle->handle, &epInitStruct,
+                                   &epCallback);
+  }
+
+  return error;
+}
+
+// Initializes the endpoints of the communication interface, and of the
+// current alternate setting of the data interface.
+static usb_status_t USB_DeviceCdcNcmEndpointsInit(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle) {
+  usb_device_interface_struct_t *interface;
+  usb_status_t error;
+
+  if (cdcNcmHandle->commInterfaceHandle == NULL) {
+    interface = USB_DeviceCdcNcmFindInterface(
+        cdcNcmHandle, USB_DEVICE_CONFIG_CDC_COMM_CLASS_CODE,
+        USB_DEVICE_CONFIG_CDC_NCM_SUBCLASS_CODE, 0,
+        &cdcNcmHandle->commInterfaceNumber);
+    if (interface == NULL) {
+      return kStatus_USB_Error;
+    }
+    error = USB_DeviceCdcNcmInterfaceEndpointsInit(cdcNcmHandle, interface);
+    if (error != kStatus_USB_Success) {
+      return error;
+    }
+    cdcNcmHandle->commInterfaceHandle = interface;
+  }
+
+  interface = USB_DeviceCdcNcmFindInterface(
+      cdcNcmHandle, USB_DEVICE_CONFIG_CDC_DATA_CLASS_CODE, 0,
+      cdcNcmHandle->alternate, &cdcNcmHandle->dataInterfaceNumber);
+  if (interface == NULL) {
+    return kStatus_USB_Error;
+  }
+  cdcNcmHandle->dataInterfaceHandle = interface;
+  return USB_DeviceCdcNcmInterfaceEndpointsInit(cdcNcmHandle, interface);
+}
+
+usb_status_t USB_DeviceCdcNcmInit(uint8_t controllerId,
+                                  usb_device_class_config_struct_t *config,
+                                  class_handle_t *handle) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+  usb_status_t error;
+
+  error = USB_DeviceCdcNcmAllocateHandle(&cdcNcmHandle);
+  if (error != kStatus_USB_Success) {
+    return error;
+  }
+
+  error = USB_DeviceClassGetDeviceHandle(controllerId, &cdcNcmHandle->handle);
+  if (error != kStatus_USB_Success) {
+    return error;
+  }
+
+  if (NULL == cdcNcmHandle->handle) {
+    return kStatus_USB_InvalidHandle;
+  }
+
+  cdcNcmHandle->configStruct = config;
+  cdcNcmHandle->configuration = 0;
+  cdcNcmHandle->alternate = 0xFF;
+  cdcNcmHandle->commInterfaceHandle = NULL;
+  cdcNcmHandle->dataInterfaceHandle = NULL;
+
+  *handle = (class_handle_t)cdcNcmHandle;
+  return error;
+}
+
+usb_status_t USB_DeviceCdcNcmDeinit(class_handle_t handle) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+  usb_status_t error;
+
+  cdcNcmHandle = (usb_device_cdc_ncm_struct_t *)handle;
+  if (cdcNcmHandle == NULL) {
+    return kStatus_USB_InvalidHandle;
+  }
+
+  error = USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+      cdcNcmHandle, &cdcNcmHandle->dataInterfaceHandle);
+  (void)USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+      cdcNcmHandle, &cdcNcmHandle->commInterfaceHandle);
+  (void)USB_DeviceCdcNcmFreeHandle(cdcNcmHandle);
+
+  return error;
+}
+
+usb_status_t USB_DeviceCdcNcmEvent(void *handle, uint32_t event, void *param) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+  usb_device_class_event_t eventCode = (usb_device_class_event_t)event;
+  usb_status_t error = kStatus_USB_Error;
+  uint16_t interfaceAlternate;
+  uint8_t alternate;
+  uint8_t *temp8;
+
+  usb_device_cdc_ncm_request_param_struct_t reqParam;
+
+  if (!param || !handle) {
+    return kStatus_USB_InvalidHandle;
+  }
+  cdcNcmHandle = (usb_device_cdc_ncm_struct_t *)handle;
+
+  switch (eventCode) {
+    case kUSB_DeviceClassEventDeviceReset:
+      cdcNcmHandle->configuration = 0;
+      break;
+    case kUSB_DeviceClassEventSetConfiguration:
+      temp8 = (uint8_t *)param;
+      if (cdcNcmHandle->configStruct == NULL) {
+        break;
+      }
+      if (*temp8 == cdcNcmHandle->configuration) {
+        break;
+      }
+      (void)USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+          cdcNcmHandle, &cdcNcmHandle->dataInterfaceHandle);
+      (void)USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+          cdcNcmHandle, &cdcNcmHandle->commInterfaceHandle);
+      cdcNcmHandle->configuration = *temp8;
+      cdcNcmHandle->alternate = 0;
+      error = USB_DeviceCdcNcmEndpointsInit(cdcNcmHandle);
+      if (error != kStatus_USB_Success) {
+        DbgConsole_Printf("NcmEndpointsInit failed\r\n");
+      }
+      break;
+    case kUSB_DeviceClassEventClassRequest: {
+      usb_device_control_request_struct_t *controlRequest =
+          (usb_device_control_request_struct_t *)param;
+      if ((controlRequest->setup->wIndex & 0xFF) !=
+          cdcNcmHandle->commInterfaceNumber) {
+        break;
+      }
+
+      reqParam.buffer = &(controlRequest->buffer);
+      reqParam.length = &(controlRequest->length);
+      reqParam.interfaceIndex = controlRequest->setup->wIndex;
+      reqParam.setupValue = controlRequest->setup->wValue;
+      reqParam.request = controlRequest->setup->bRequest;
+      reqParam.isSetup = controlRequest->isSetup;
+
+      error = cdcNcmHandle->configStruct->classCallback(
+          (class_handle_t)cdcNcmHandle, kUSB_DeviceNcmEventClassRequest,
+          &reqParam);
+      break;
+    }
+    case kUSB_DeviceClassEventSetInterface:
+      if (cdcNcmHandle->configStruct == NULL) {
+        break;
+      }
+      interfaceAlternate = *((uint16_t *)param);
+      alternate = (uint8_t)(interfaceAlternate & 0xFF);
+
+      // Only the data interface has alternate settings.
+      if (cdcNcmHandle->dataInterfaceNumber !=
+          ((uint8_t)(interfaceAlternate >> 8))) {
+        break;
+      }
+
+      if (alternate == cdcNcmHandle->alternate) {
+        error = kStatus_USB_Success;
+        break;
+      }
+      (void)USB_DeviceCdcNcmInterfaceEndpointsDeinit(
+          cdcNcmHandle, &cdcNcmHandle->dataInterfaceHandle);
+      cdcNcmHandle->alternate = alternate;
+      error = USB_DeviceCdcNcmEndpointsInit(cdcNcmHandle);
+      break;
+    default:
+      break;
+  }
+
+  return error;
+}
+
+static usb_status_t USB_DeviceCdcNcmTransfer(
+    usb_device_cdc_ncm_struct_t *cdcNcmHandle, usb_device_cdc_ncm_pipe_t *pipe,
+    uint8_t ep, uint8_t *buffer, uint32_t length, uint8_t direction) {
+  usb_status_t status;
+
+  if (pipe->isBusy) {
+    return kStatus_USB_Busy;
+  }
+  pipe->isBusy = 1;
+
+  if (direction == USB_IN) {
+    status = USB_DeviceSendRequest(cdcNcmHandle->handle, ep, buffer, length);
+  } else {
+    status = USB_DeviceRecvRequest(cdcNcmHandle->handle, ep, buffer, length);
+  }
+  if (status != kStatus_USB_Success) {
+    pipe->isBusy = 0;
+  }
+
+  return status;
+}
+
+usb_status_t USB_DeviceCdcNcmSend(class_handle_t handle, uint8_t ep,
+                                  uint8_t *buffer, uint32_t length) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+
+  if (!handle) {
+    return kStatus_USB_InvalidHandle;
+  }
+  cdcNcmHandle = (usb_device_cdc_ncm_struct_t *)handle;
+  return USB_DeviceCdcNcmTransfer(cdcNcmHandle, &cdcNcmHandle->bulkIn, ep,
+                                  buffer, length, USB_IN);
+}
+
+usb_status_t USB_DeviceCdcNcmRecv(class_handle_t handle, uint8_t ep,
+                                  uint8_t *buffer, uint32_t length) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+
+  if (!handle) {
+    return kStatus_USB_InvalidHandle;
+  }
+  cdcNcmHandle = (usb_device_cdc_ncm_struct_t *)handle;
+  return USB_DeviceCdcNcmTransfer(cdcNcmHandle, &cdcNcmHandle->bulkOut, ep,
+                                  buffer, length, USB_OUT);
+}
+
+usb_status_t USB_DeviceCdcNcmNotify(class_handle_t handle, uint8_t ep,
+                                    uint8_t *buffer, uint32_t length) {
+  usb_device_cdc_ncm_struct_t *cdcNcmHandle;
+
+  if (!handle) {
+    return kStatus_USB_InvalidHandle;
+  }
+  cdcNcmHandle = (usb_device_cdc_ncm_struct_t *)handle;
+  return USB_DeviceCdcNcmTransfer(cdcNcmHandle, &cdcNcmHandle->interruptIn,
+                                  ep, buffer, length, USB_IN);
+}
+
+#endif  // USB_DEVICE_CONFIG_CDC_NCM
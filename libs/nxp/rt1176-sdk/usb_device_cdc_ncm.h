@@ -0,0 +1,113 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _USB_DEVICE_CDC_NCM_H_
+#define _USB_DEVICE_CDC_NCM_H_
+
+#ifndef USB_DEVICE_CONFIG_CDC_COMM_CLASS_CODE
+#define USB_DEVICE_CONFIG_CDC_COMM_CLASS_CODE (0x02)
+#endif
+
+#ifndef USB_DEVICE_CONFIG_CDC_DATA_CLASS_CODE
+#define USB_DEVICE_CONFIG_CDC_DATA_CLASS_CODE (0x0A)
+#endif
+
+#define USB_DEVICE_CONFIG_CDC_NCM_SUBCLASS_CODE (0x0D)
+#define USB_DEVICE_CONFIG_CDC_NCM_DATA_PROTOCOL_CODE (0x01)
+
+// The SDK has no class type for NCM, so use one well clear of its own.
+#define kUSB_DeviceClassTypeNcm ((usb_device_class_type_t)0x80U)
+
+// Class-specific requests (NCM 1.0, section 6.2).
+#define USB_DEVICE_CDC_NCM_REQUEST_SET_ETHERNET_PACKET_FILTER (0x43)
+#define USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_PARAMETERS (0x80)
+#define USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_FORMAT (0x83)
+#define USB_DEVICE_CDC_NCM_REQUEST_SET_NTB_FORMAT (0x84)
+#define USB_DEVICE_CDC_NCM_REQUEST_GET_NTB_INPUT_SIZE (0x85)
+#define USB_DEVICE_CDC_NCM_REQUEST_SET_NTB_INPUT_SIZE (0x86)
+
+// Notifications (CDC 1.2, section 6.3).
+#define USB_DEVICE_CDC_NCM_NOTIF_NETWORK_CONNECTION (0x00)
+#define USB_DEVICE_CDC_NCM_NOTIF_CONNECTION_SPEED_CHANGE (0x2A)
+
+// NTB structure signatures (NCM 1.0, section 3).
+#define NCM_NTH16_SIGNATURE (0x484D434EU)  // "NCMH"
+#define NCM_NDP16_SIGNATURE (0x304D434EU)  // "NCM0", no CRC
+
+typedef enum _usb_device_cdc_ncm_event {
+  kUSB_DeviceNcmEventRecvResponse = 0x1,
+  kUSB_DeviceNcmEventSendResponse,
+  kUSB_DeviceNcmEventNotifyResponse,
+  kUSB_DeviceNcmEventClassRequest,
+} usb_device_cdc_ncm_event_t;
+
+typedef struct _usb_device_cdc_ncm_pipe {
+  uint8_t isBusy;
+} usb_device_cdc_ncm_pipe_t;
+
+typedef struct _usb_device_cdc_ncm_struct {
+  usb_device_handle handle;
+  usb_device_class_config_struct_t *configStruct;
+  usb_device_interface_struct_t *commInterfaceHandle;
+  usb_device_interface_struct_t *dataInterfaceHandle;
+  usb_device_cdc_ncm_pipe_t interruptIn;
+  usb_device_cdc_ncm_pipe_t bulkIn;
+  usb_device_cdc_ncm_pipe_t bulkOut;
+  uint8_t configuration;
+  uint8_t alternate;
+  uint8_t commInterfaceNumber;
+  uint8_t dataInterfaceNumber;
+} usb_device_cdc_ncm_struct_t;
+
+/*! @brief Definition of parameters for CDC NCM request. */
+typedef struct _usb_device_cdc_ncm_request_param_struct {
+  uint8_t **buffer; /*!< The pointer to the address of the buffer for CDC class
+                       request. */
+  uint32_t *length; /*!< The pointer to the length of the buffer for CDC class
+                       request. */
+  uint16_t interfaceIndex; /*!< The interface index of the setup packet. */
+  uint16_t setupValue;     /*!< The wValue field of the setup packet. */
+  uint8_t request;         /*!< The bRequest field of the setup packet. */
+  uint8_t isSetup; /*!< The flag indicates if it is a setup packet, 1: yes, 0:
+                      no. */
+} usb_device_cdc_ncm_request_param_struct_t;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+usb_status_t USB_DeviceCdcNcmInit(uint8_t controllerId,
+                                  usb_device_class_config_struct_t *config,
+                                  class_handle_t *handle);
+
+usb_status_t USB_DeviceCdcNcmDeinit(class_handle_t handle);
+
+usb_status_t USB_DeviceCdcNcmEvent(void *handle, uint32_t event, void *param);
+
+usb_status_t USB_DeviceCdcNcmSend(class_handle_t handle, uint8_t ep,
+                                  uint8_t *buffer, uint32_t length);
+
+usb_status_t USB_DeviceCdcNcmRecv(class_handle_t handle, uint8_t ep,
+                                  uint8_t *buffer, uint32_t length);
+
+usb_status_t USB_DeviceCdcNcmNotify(class_handle_t handle, uint8_t ep,
+                                    uint8_t *buffer, uint32_t length);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif  // _USB_DEVICE_CDC_NCM_H_
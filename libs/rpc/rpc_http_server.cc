@@ -16,18 +16,28 @@
 
 #include "libs/rpc/rpc_http_server.h"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <utility>
 
+#include "libs/base/metrics.h"
+#include "libs/rpc/rpc_utils.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/apps/fs.h"
 #include "third_party/nxp/rt1176-sdk/middleware/lwip/src/include/lwip/apps/httpd.h"
 
 #define FS_FILE_FLAGS_JSON_RPC (1 << 7)
+#define FS_FILE_FLAGS_BINARY_RPC (1 << 6)
 
 namespace coralmicro {
 namespace {
+constexpr size_t kMaxBinaryRpcJsonSize = 64 * 1024;
+constexpr uint32_t kMaxBinaryRpcBlobs = 16;
+
+Histogram g_rpc_latency(
+    "coralmicro_rpc_latency_microseconds",
+    "Time spent processing JSON-RPC requests, including the method.");
 int Append(const char* buf, int len, void* userdata) {
   auto* v = static_cast<std::vector<char>*>(userdata);
   v->insert(v->end(), buf, buf + len);
@@ -44,11 +54,196 @@ void* FindPointerParam(const char* param, int iNumParams, char** pcParam,
 }
 }  // namespace
 
+// A call over the binary transport. The request is parsed as it arrives, and
+// the response is read straight from the JSON reply and the response blobs.
+struct BinaryRpcCall {
+  enum class State {
+    kJsonSize,
+    kJson,
+    kBlobCount,
+    kBlobSize,
+    kBlob,
+    kDone,
+    kError,
+  };
+
+  explicit BinaryRpcCall(size_t content_len) : body_left(content_len) {}
+
+  void Receive(const uint8_t* data, size_t size) {
+    if (size > body_left) {
+      state = State::kError;
+      return;
+    }
+
+    while (size > 0) {
+      switch (state) {
+        case State::kJsonSize:
+        case State::kBlobCount:
+        case State::kBlobSize: {
+          auto len = std::min(sizeof(word) - word_size, size);
+          std::memcpy(word + word_size, data, len);
+          word_size += len;
+          data += len;
+          size -= len;
+          body_left -= len;
+          if (word_size == sizeof(word)) {
+            word_size = 0;
+            OnWord(word[0] | word[1] << 8 | word[2] << 16 |
+                   static_cast<uint32_t>(word[3]) << 24);
+          }
+        } break;
+        case State::kJson:
+        case State::kBlob: {
+          auto len = std::min(target_left, size);
+          std::memcpy(target, data, len);
+          target += len;
+          target_left -= len;
+          data += len;
+          size -= len;
+          body_left -= len;
+          if (target_left == 0) OnTargetFilled();
+        } break;
+        case State::kDone:
+        case State::kError:
+          state = State::kError;
+          return;
+      }
+    }
+  }
+
+  void OnWord(uint32_t value) {
+    switch (state) {
+      case State::kJsonSize:
+        if (value == 0 || value > kMaxBinaryRpcJsonSize || value > body_left) {
+          state = State::kError;
+          return;
+        }
+        json.resize(value);
+        Fill(State::kJson, reinterpret_cast<uint8_t*>(json.data()), value);
+        break;
+      case State::kBlobCount:
+        if (value > kMaxBinaryRpcBlobs) {
+          state = State::kError;
+          return;
+        }
+        blobs_left = value;
+        blobs.request.reserve(value);
+        state = value ? State::kBlobSize : State::kDone;
+        break;
+      case State::kBlobSize: {
+        if (value > body_left) {
+          state = State::kError;
+          return;
+        }
+        auto& blob = blobs.request.emplace_back(value);
+        Fill(State::kBlob, blob.data(), value);
+      } break;
+      default:
+        break;
+    }
+  }
+
+  void Fill(State next, uint8_t* data, size_t size) {
+    state = next;
+    target = data;
+    target_left = size;
+    if (size == 0) OnTargetFilled();
+  }
+
+  void OnTargetFilled() {
+    if (state == State::kJson) {
+      state = State::kBlobCount;
+    } else if (state == State::kBlob) {
+      state = --blobs_left ? State::kBlobSize : State::kDone;
+    }
+  }
+
+  void Process(struct jsonrpc_ctx* ctx) {
+    if (state == State::kDone) {
+      HistogramTimer timer(&g_rpc_latency);
+      jsonrpc_ctx_process(ctx, json.data(), json.size(), Append, &reply,
+                          &blobs);
+    } else {
+      mjson_printf(Append, &reply, "{%Q:null,%Q:{%Q:%d,%Q:%Q}}", "id", "error",
+                   "code", JSONRPC_ERROR_INVALID, "message",
+                   "invalid binary request");
+      blobs.response.clear();
+    }
+    json = std::vector<char>();
+    blobs.request.clear();
+
+    // Integers are sent in the native little-endian byte order.
+    reply_size = reply.size();
+    blob_count = blobs.response.size();
+    blob_sizes.resize(blob_count);
+    segments.push_back({&reply_size, sizeof(reply_size)});
+    segments.push_back({reply.data(), reply.size()});
+    segments.push_back({&blob_count, sizeof(blob_count)});
+    for (size_t i = 0; i < blob_count; ++i) {
+      blob_sizes[i] = blobs.response[i].size();
+      segments.push_back({&blob_sizes[i], sizeof(blob_sizes[i])});
+      segments.push_back({blobs.response[i].data(), blobs.response[i].size()});
+    }
+  }
+
+  size_t ResponseSize() const {
+    size_t size = 0;
+    for (const auto& segment : segments) size += segment.second;
+    return size;
+  }
+
+  int Read(char* buffer, int count) {
+    int total = 0;
+    while (total < count && segment < segments.size()) {
+      const auto& [data, size] = segments[segment];
+      auto len = std::min(size - offset, static_cast<size_t>(count - total));
+      std::memcpy(buffer + total, static_cast<const char*>(data) + offset, len);
+      total += len;
+      offset += len;
+      if (offset == size) {
+        ++segment;
+        offset = 0;
+      }
+    }
+    return total;
+  }
+
+  // Request.
+  State state = State::kJsonSize;
+  size_t body_left;
+  uint8_t word[4];
+  size_t word_size = 0;
+  uint8_t* target = nullptr;
+  size_t target_left = 0;
+  uint32_t blobs_left = 0;
+  std::vector<char> json;
+  JsonRpcBlobs blobs;
+
+  // Response.
+  std::vector<char> reply;
+  uint32_t reply_size = 0;
+  uint32_t blob_count = 0;
+  std::vector<uint32_t> blob_sizes;
+  std::vector<std::pair<const void*, size_t>> segments;
+  size_t segment = 0;
+  size_t offset = 0;
+};
+
+JsonRpcHttpServer::JsonRpcHttpServer(struct jsonrpc_ctx* ctx) : ctx_(ctx) {}
+
+JsonRpcHttpServer::~JsonRpcHttpServer() = default;
+
 err_t JsonRpcHttpServer::PostBegin(void* connection, const char* uri,
                                    const char* http_request,
                                    u16_t http_request_len, int content_len,
                                    char* response_uri, u16_t response_uri_len,
                                    u8_t* post_auto_wnd) {
+  if (std::strcmp("/binrpc", uri) == 0) {
+    if (content_len <= 0) return ERR_ARG;
+    binary_calls_[connection] = std::make_unique<BinaryRpcCall>(content_len);
+    return ERR_OK;
+  }
+
   if (std::strcmp("/jsonrpc", uri) != 0) return ERR_ARG;
 
   buffers_[connection].reserve(content_len);
@@ -56,6 +251,13 @@ err_t JsonRpcHttpServer::PostBegin(void* connection, const char* uri,
 };
 
 err_t JsonRpcHttpServer::PostReceiveData(void* connection, struct pbuf* p) {
+  if (auto it = binary_calls_.find(connection); it != binary_calls_.end()) {
+    for (auto* q = p; q != nullptr; q = q->next)
+      it->second->Receive(static_cast<const uint8_t*>(q->payload), q->len);
+    pbuf_free(p);
+    return ERR_OK;
+  }
+
   auto& buf = buffers_[connection];
   auto off = buf.size();
   buf.resize(buf.size() + p->tot_len);
@@ -67,9 +269,19 @@ err_t JsonRpcHttpServer::PostReceiveData(void* connection, struct pbuf* p) {
 
 void JsonRpcHttpServer::PostFinished(void* connection, char* response_uri,
                                      u16_t response_uri_len) {
+  if (auto it = binary_calls_.find(connection); it != binary_calls_.end()) {
+    it->second->Process(ctx_);
+    snprintf(response_uri, response_uri_len,
+             "/binrpc/response.bin?connection=%p", connection);
+    return;
+  }
+
   auto& buf = buffers_[connection];
   std::vector<char> reply;
-  jsonrpc_ctx_process(ctx_, buf.data(), buf.size(), Append, &reply, nullptr);
+  {
+    HistogramTimer timer(&g_rpc_latency);
+    jsonrpc_ctx_process(ctx_, buf.data(), buf.size(), Append, &reply, nullptr);
+  }
   buf = std::move(reply);
   snprintf(response_uri, response_uri_len,
            "/jsonrpc/response.json?connection=%p", connection);
@@ -93,6 +305,22 @@ void JsonRpcHttpServer::CgiHandler(struct fs_file* file, const char* uri,
     return;
   }
 
+  if (file->flags & FS_FILE_FLAGS_BINARY_RPC) {
+    void* connection =
+        FindPointerParam("connection", iNumParams, pcParam, pcValue);
+    assert(connection);
+
+    auto& call = binary_calls_[connection];
+    assert(call);
+
+    file->pextension = connection;
+    file->data = nullptr;
+    file->len = call->ResponseSize();
+    file->index = 0;
+    file->flags |= FS_FILE_FLAGS_HEADER_PERSISTENT;
+    return;
+  }
+
   HttpServer::CgiHandler(file, uri, iNumParams, pcParam, pcValue);
 }
 
@@ -103,15 +331,40 @@ int JsonRpcHttpServer::FsOpenCustom(struct fs_file* file, const char* name) {
     return 1;
   }
 
+  if (std::strcmp("/binrpc/response.bin", name) == 0) {
+    std::memset(file, 0, sizeof(*file));
+    file->flags |= FS_FILE_FLAGS_BINARY_RPC;
+    return 1;
+  }
+
   return HttpServer::FsOpenCustom(file, name);
 }
 
+int JsonRpcHttpServer::FsReadCustom(struct fs_file* file, char* buffer,
+                                    int count) {
+  if (file->flags & FS_FILE_FLAGS_BINARY_RPC) {
+    auto it = binary_calls_.find(file->pextension);
+    if (it == binary_calls_.end()) return FS_READ_EOF;
+    auto len = it->second->Read(buffer, count);
+    if (len == 0) return FS_READ_EOF;
+    file->index += len;
+    return len;
+  }
+
+  return HttpServer::FsReadCustom(file, buffer, count);
+}
+
 void JsonRpcHttpServer::FsCloseCustom(struct fs_file* file) {
   if (file->flags & FS_FILE_FLAGS_JSON_RPC) {
     buffers_.erase(file->pextension);
     return;
   }
 
+  if (file->flags & FS_FILE_FLAGS_BINARY_RPC) {
+    binary_calls_.erase(file->pextension);
+    return;
+  }
+
   HttpServer::FsCloseCustom(file);
 };
 
@@ -18,6 +18,7 @@
 #define LIBS_RPC_RPC_HTTP_SERVER_H_
 
 #include <map>
+#include <memory>
 #include <vector>
 
 #include "libs/base/http_server.h"
@@ -25,10 +26,28 @@
 
 namespace coralmicro {
 
+struct BinaryRpcCall;
+
+// Serves JSON-RPC requests posted to `/jsonrpc`.
+//
+// The same methods can also be called over a binary transport by posting to
+// `/binrpc`, which carries large payloads as raw bytes instead of base64
+// strings. Both the request and the response body are laid out as:
+//
+// ```
+// uint32 json_size, char json[json_size], uint32 blob_count,
+// blob_count x (uint32 blob_size, uint8 blob[blob_size])
+// ```
+//
+// where `json` is a JSON-RPC message and all integers are little-endian.
+// The JSON refers to blobs as `{"blob": <index>}`, see `JsonRpcBlobs`.
+// Request blobs are received directly into their own buffers, and response
+// blobs are sent from the buffers passed to `JsonRpcPrintBlob()`.
 class JsonRpcHttpServer : public coralmicro::HttpServer {
  public:
-  explicit JsonRpcHttpServer(struct jsonrpc_ctx* ctx = &jsonrpc_default_context)
-      : ctx_(ctx) {}
+  explicit JsonRpcHttpServer(
+      struct jsonrpc_ctx* ctx = &jsonrpc_default_context);
+  ~JsonRpcHttpServer() override;
 
   err_t PostBegin(void* connection, const char* uri, const char* http_request,
                   u16_t http_request_len, int content_len, char* response_uri,
@@ -41,11 +60,14 @@ class JsonRpcHttpServer : public coralmicro::HttpServer {
                   char** pcParam, char** pcValue) override;
 
   int FsOpenCustom(struct fs_file* file, const char* name) override;
+  int FsReadCustom(struct fs_file* file, char* buffer, int count) override;
   void FsCloseCustom(struct fs_file* file) override;
 
  private:
   struct jsonrpc_ctx* ctx_;
   std::map<void*, std::vector<char>> buffers_;  // connection-to-buffer map
+  // Connection-to-call map for the binary transport.
+  std::map<void*, std::unique_ptr<BinaryRpcCall>> binary_calls_;
 };
 
 }  // namespace coralmicro
@@ -17,7 +17,9 @@
 #include "libs/rpc/rpc_utils.h"
 
 #include <memory>
+#include <utility>
 
+#include "libs/base/metrics.h"
 #include "third_party/mjson/src/mjson.h"
 
 namespace coralmicro {
@@ -97,6 +99,20 @@ bool JsonRpcGetBase64Param(struct jsonrpc_request* request,
   ssize_t size = 0;
   int tok = mjson_find(request->params, request->params_len,
                        param_pattern.get(), nullptr, &size);
+  if (auto* blobs = JsonRpcGetBlobs(request);
+      blobs && tok == MJSON_TOK_OBJECT) {
+    std::string pattern = param_pattern.get();
+    pattern += ".blob";
+    double index;
+    if (mjson_get_number(request->params, request->params_len,
+                         pattern.c_str(), &index) == 0 ||
+        index < 0 || index >= blobs->request.size()) {
+      JsonRpcReturnBadParam(request, "invalid blob", param_name);
+      return false;
+    }
+    *out = std::move(blobs->request[static_cast<size_t>(index)]);
+    return true;
+  }
   if (tok != MJSON_TOK_STRING) {
     JsonRpcReturnBadParam(request, "invalid param", param_name);
     return false;
@@ -113,4 +129,25 @@ bool JsonRpcGetBase64Param(struct jsonrpc_request* request,
   return true;
 }
 
-}  // namespace coralmicro
\ No newline at end of file
+JsonRpcBlobs* JsonRpcGetBlobs(struct jsonrpc_request* request) {
+  return static_cast<JsonRpcBlobs*>(request->userdata);
+}
+
+int JsonRpcPrintBlob(mjson_print_fn_t fn, void* fn_data, va_list* ap) {
+  auto* request = va_arg(*ap, struct jsonrpc_request*);
+  auto* blob = va_arg(*ap, std::vector<uint8_t>*);
+
+  if (auto* blobs = JsonRpcGetBlobs(request)) {
+    blobs->response.push_back(std::move(*blob));
+    return mjson_printf(fn, fn_data, "{%Q:%d}", "blob",
+                        static_cast<int>(blobs->response.size() - 1));
+  }
+  return mjson_printf(fn, fn_data, "%V", static_cast<int>(blob->size()),
+                      blob->data());
+}
+
+void JsonRpcGetMetrics(struct jsonrpc_request* request) {
+  jsonrpc_return_success(request, "%s", MetricsJson().c_str());
+}
+
+}  // namespace coralmicro
@@ -17,6 +17,7 @@
 #ifndef LIBS_RPC_RPC_UTILS_H_
 #define LIBS_RPC_RPC_UTILS_H_
 
+#include <cstdarg>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -61,6 +62,10 @@ bool JsonRpcGetStringParam(struct jsonrpc_request* request,
 
 // Gets a base64 encoded string param from RPC request.
 //
+// Over the binary RPC transport (see `JsonRpcHttpServer`), the param can also
+// be a reference to a raw blob sent with the request, written as
+// `{"blob": <index>}`. The blob is then moved to `out` without decoding.
+//
 // @param request The request to parse the string.
 // @param param_name The name of the parameter to parse.
 // @param out The output array to return the value to.
@@ -68,6 +73,49 @@ bool JsonRpcGetStringParam(struct jsonrpc_request* request,
 bool JsonRpcGetBase64Param(struct jsonrpc_request* request,
                            const char* param_name, std::vector<uint8_t>* out);
 
+// Binary data of a request made over the binary RPC transport of
+// `JsonRpcHttpServer`. Blobs are referenced from the JSON params and result
+// as `{"blob": <index>}`.
+struct JsonRpcBlobs {
+  // Blobs received with the request.
+  std::vector<std::vector<uint8_t>> request;
+  // Blobs to send with the response.
+  std::vector<std::vector<uint8_t>> response;
+};
+
+// Gets the binary data of a request.
+//
+// @param request The request.
+// @returns The request's blobs, or nullptr if the request was not made over
+// the binary RPC transport.
+JsonRpcBlobs* JsonRpcGetBlobs(struct jsonrpc_request* request);
+
+// Prints binary data into a JSON-RPC result, to be used with mjson's `%M`
+// format specifier. It takes the request and a `std::vector<uint8_t>*` as
+// arguments, for example:
+//
+// ```
+// jsonrpc_return_success(r, "{%Q: %M}", "image", JsonRpcPrintBlob, r, &image);
+// ```
+//
+// Over the binary RPC transport, the vector is moved into the response and
+// sent as raw bytes after the JSON result, which avoids both copying and
+// base64 encoding it. Otherwise, it is printed as a base64 string like `%V`.
+//
+// @returns The number of bytes printed.
+int JsonRpcPrintBlob(mjson_print_fn_t fn, void* fn_data, va_list* ap);
+
+// JSON-RPC method that returns the metrics of the current core, as produced by
+// `MetricsJson()` (see libs/base/metrics.h). It takes no params. Register it
+// with:
+//
+// ```
+// jsonrpc_export("get_metrics", JsonRpcGetMetrics);
+// ```
+//
+// @param request The request to respond to.
+void JsonRpcGetMetrics(struct jsonrpc_request* request);
+
 }  // namespace coralmicro
 
 #endif  // define LIBS_RPC_RPC_UTILS_H_
@@ -18,6 +18,7 @@
 
 #include "libs/base/check.h"
 #include "libs/base/filesystem.h"
+#include "libs/base/trace.h"
 #include "libs/tpu/edgetpu_op.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
 
@@ -121,6 +122,7 @@ void PreprocessAudioInput(const int16_t* audio_data,
                           FrontendState* frontend_state, AudioModel model_type,
                           std::vector<int16_t>& feature_buffer,
                           size_t num_samples) {
+  TRACE_ZONE("audio/Frontend");
   CHECK(frontend_state);
   // Run frontend process for raw audio data.
   // TODO(michaelbrooks): Properly slice the data so that we don't need to
@@ -191,7 +191,8 @@ void RunTestConv1(struct jsonrpc_request* request) {
   }
   constexpr char kConv1ModelFile[] = "/models/testconv1-edgetpu.tflite";
   std::vector<uint8_t> testconv1_edgetpu_tflite;
-  if (!coralmicro::LfsReadFile(kConv1ModelFile, &testconv1_edgetpu_tflite)) {
+  if (!coralmicro::LfsReadCompressedFile(kConv1ModelFile,
+                                         &testconv1_edgetpu_tflite)) {
     jsonrpc_return_error(request, -1, "failed to open %s", kConv1ModelFile);
     return;
   }
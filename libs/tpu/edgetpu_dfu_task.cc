@@ -16,9 +16,11 @@
 
 #include "libs/tpu/edgetpu_dfu_task.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <functional>
 
+#include "libs/base/crc32.h"
 #include "libs/tpu/edgetpu_manager.h"
 #include "libs/usb/usb_host_task.h"
 #include "third_party/nxp/rt1176-sdk/middleware/usb/host/class/usb_host_dfu.h"
@@ -31,6 +33,41 @@ namespace coralmicro {
 
 using namespace edgetpu_dfu;
 
+namespace {
+constexpr uint8_t kDfuFunctionalDescriptorType = 0x21;
+constexpr size_t kDfuFunctionalDescriptorLength = 9;
+constexpr size_t kDfuTransferSizeOffset = 5;
+// Upper bound for the block size, which is also the size of the read back
+// buffer.
+constexpr size_t kMaxTransferSize = 4096;
+
+// Gets `wTransferSize` from the DFU functional descriptor, which follows the
+// DFU interface descriptor.
+size_t GetTransferSize(const usb_host_interface_t *interface) {
+  const uint8_t *extension = interface->interfaceExtension;
+  size_t length = interface->interfaceExtensionLength;
+  while (extension && length >= 2 && extension[0] >= 2 &&
+         extension[0] <= length) {
+    if (extension[1] == kDfuFunctionalDescriptorType &&
+        extension[0] >= kDfuFunctionalDescriptorLength) {
+      size_t size = extension[kDfuTransferSizeOffset] |
+                    (extension[kDfuTransferSizeOffset + 1] << 8);
+      if (size == 0) break;
+      return std::min(size, kMaxTransferSize);
+    }
+    length -= extension[0];
+    extension += extension[0];
+  }
+  return kDefaultTransferSize;
+}
+
+uint32_t FirmwareCrc() {
+  static const uint32_t crc =
+      Crc32(apex_latest_single_ep_bin, apex_latest_single_ep_bin_len);
+  return crc;
+}
+}  // namespace
+
 void EdgeTpuDfuTask::SetNextState(DfuState next_state) {
   Request req;
   req.type = RequestType::kNextState;
@@ -58,6 +95,7 @@ usb_status_t EdgeTpuDfuTask::USB_DFUHostEvent(
         if (id == USB_HOST_DFU_SUBCLASS_CODE) {
           SetDeviceHandle(device_handle);
           SetInterfaceHandle(interface_ptr);
+          SetTransferSize(GetTransferSize(interface_ptr));
           break;
         }
       }
@@ -142,7 +180,12 @@ void EdgeTpuDfuTask::ZeroLengthTransferCallback(void *param, uint8_t *data,
 
   task->SetCurrentBlockNumber(0);
   task->SetBytesTransferred(0);
-  task->SetNextState(DfuState::kReadBack);
+  task->SetReadBackCrc(0);
+  if (task->verification() == EdgeTpuFirmwareVerification::kNone) {
+    task->SetNextState(DfuState::kDetach);
+  } else {
+    task->SetNextState(DfuState::kReadBack);
+  }
 }
 
 void EdgeTpuDfuTask::ReadBackCallback(void *param, uint8_t *data,
@@ -155,6 +198,9 @@ void EdgeTpuDfuTask::ReadBackCallback(void *param, uint8_t *data,
     return;
   }
 
+  task->SetReadBackCrc(Crc32Update(task->read_back_crc(),
+                                   task->read_back_block().data(),
+                                   data_length));
   task->SetCurrentBlockNumber(task->current_block_number() + 1);
   task->SetBytesTransferred(task->bytes_transferred() + data_length);
 #if 0
@@ -178,15 +224,13 @@ void EdgeTpuDfuTask::GetStatusReadCallback(void *param, uint8_t *data,
   if (task->bytes_transferred() < task->bytes_to_transfer()) {
     task->SetNextState(DfuState::kReadBack);
   } else {
-    if (memcmp(apex_latest_single_ep_bin, task->read_back_data(),
-               apex_latest_single_ep_bin_len) != 0) {
+    if (task->read_back_crc() != FirmwareCrc()) {
       printf("Read back firmware does not match!\r\n");
       task->SetNextState(DfuState::kError);
     } else {
       task->SetNextState(DfuState::kDetach);
     }
-    free(task->read_back_data());
-    task->SetReadBackData(nullptr);
+    task->read_back_block() = std::vector<uint8_t>();
     task->SetCurrentBlockNumber(0);
     task->SetBytesTransferred(0);
   }
@@ -253,9 +297,8 @@ void EdgeTpuDfuTask::HandleNextState(NextStateRequest &req) {
       }
       break;
     case DfuState::kTransfer:
-      transfer_length =
-          std::min(256U /* get from descriptor */,
-                   apex_latest_single_ep_bin_len - bytes_transferred());
+      transfer_length = std::min<size_t>(
+          transfer_size(), apex_latest_single_ep_bin_len - bytes_transferred());
       ret = USB_HostDfuDnload(class_handle(), current_block_number(),
                               apex_latest_single_ep_bin + bytes_transferred(),
                               transfer_length, EdgeTpuDfuTask::TransferCallback,
@@ -273,17 +316,12 @@ void EdgeTpuDfuTask::HandleNextState(NextStateRequest &req) {
       }
       break;
     case DfuState::kReadBack:
-      if (!read_back_data()) {
-        SetReadBackData(
-            static_cast<uint8_t *>(malloc(apex_latest_single_ep_bin_len)));
-      }
-      transfer_length =
-          std::min(256U /* get from descriptor */,
-                   apex_latest_single_ep_bin_len - bytes_transferred());
+      read_back_block_.resize(transfer_size());
+      transfer_length = std::min<size_t>(
+          transfer_size(), apex_latest_single_ep_bin_len - bytes_transferred());
       ret = USB_HostDfuUpload(class_handle(), current_block_number(),
-                              read_back_data() + bytes_transferred(),
-                              transfer_length, EdgeTpuDfuTask::ReadBackCallback,
-                              this);
+                              read_back_block_.data(), transfer_length,
+                              EdgeTpuDfuTask::ReadBackCallback, this);
       if (ret != kStatus_USB_Success) {
         SetNextState(DfuState::kError);
       }
@@ -18,6 +18,7 @@
 #define LIBS_TPU_EDGETPU_DFU_TASK_H_
 
 #include <functional>
+#include <vector>
 
 #include "libs/base/queue_task.h"
 #include "libs/base/tasks.h"
@@ -35,8 +36,22 @@ namespace coralmicro {
 inline constexpr int kDfuVid = 0x1A6E;
 inline constexpr int kDfuPid = 0x089A;
 
+// How the Edge TPU firmware is checked after it is downloaded to the Edge TPU
+// (see `EdgeTpuDfuTask::SetVerification()`).
+enum class EdgeTpuFirmwareVerification : uint8_t {
+  // Reads the firmware back from the Edge TPU and compares its CRC-32 with the
+  // CRC-32 of the embedded image. Only one transfer block is held in memory.
+  kCrc,
+  // Skips reading the firmware back, which halves the time spent in DFU. The
+  // download itself is still checked with the DFU status after each block.
+  kNone,
+};
+
 namespace edgetpu_dfu {
 
+// Block size used when the DFU functional descriptor doesn't report one.
+inline constexpr size_t kDefaultTransferSize = 256;
+
 enum class DfuState : uint8_t {
   kUnattached,
   kAttached,
@@ -142,10 +157,22 @@ class EdgeTpuDfuTask
   void SetCurrentBlockNumber(size_t block) { current_block_number_ = block; }
   size_t current_block_number() const { return current_block_number_; }
 
-  void SetReadBackData(uint8_t *read_back_data) {
-    read_back_data_ = read_back_data;
+  // Maximum number of bytes per DFU block, from the DFU functional descriptor.
+  void SetTransferSize(size_t bytes) { transfer_size_ = bytes; }
+  size_t transfer_size() const { return transfer_size_; }
+
+  std::vector<uint8_t> &read_back_block() { return read_back_block_; }
+
+  void SetReadBackCrc(uint32_t crc) { read_back_crc_ = crc; }
+  uint32_t read_back_crc() const { return read_back_crc_; }
+
+  // Sets how the firmware is checked after it is downloaded, for the next time
+  // the Edge TPU is powered on. The default is
+  // `EdgeTpuFirmwareVerification::kCrc`.
+  void SetVerification(EdgeTpuFirmwareVerification verification) {
+    verification_ = verification;
   }
-  uint8_t *read_back_data() { return read_back_data_; }
+  EdgeTpuFirmwareVerification verification() const { return verification_; }
 
  private:
   void TaskInit() override;
@@ -161,7 +188,11 @@ class EdgeTpuDfuTask
   size_t bytes_transferred_ = 0;
   size_t bytes_to_transfer_ = apex_latest_single_ep_bin_len;
   size_t current_block_number_ = 0;
-  uint8_t *read_back_data_ = nullptr;
+  size_t transfer_size_ = edgetpu_dfu::kDefaultTransferSize;
+  std::vector<uint8_t> read_back_block_;
+  uint32_t read_back_crc_ = 0;
+  EdgeTpuFirmwareVerification verification_ =
+      EdgeTpuFirmwareVerification::kCrc;
 };
 
 }  // namespace coralmicro
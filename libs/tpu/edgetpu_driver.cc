@@ -19,6 +19,7 @@
 #include <cassert>
 
 #include "libs/base/check.h"
+#include "libs/base/trace.h"
 #include "libs/tpu/darwinn/driver/config/beagle/beagle_chip_config.h"
 #include "libs/tpu/darwinn/driver/config/beagle_csr_helper.h"
 #include "libs/tpu/darwinn/driver/config/common_csr_helper.h"
@@ -344,6 +345,7 @@ exit:
 
 bool TpuDriver::BulkOutTransfer(const uint8_t *data,
                                 uint32_t data_length) const {
+  TRACE_ZONE("tpu/BulkOut");
   uint8_t *current_chunk = const_cast<uint8_t *>(data);
   uint32_t bytes_left = data_length;
 
@@ -401,6 +403,7 @@ exit:
 }
 
 bool TpuDriver::BulkInTransfer(uint8_t *data, uint32_t data_length) const {
+  TRACE_ZONE("tpu/BulkIn");
   uint8_t *current_chunk = data;
   uint32_t bytes_left = data_length;
   while (bytes_left > 0) {
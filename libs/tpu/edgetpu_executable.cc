@@ -17,6 +17,7 @@
 #include "libs/tpu/edgetpu_executable.h"
 
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
 
 namespace {
 int TensorDataTypeSize(platforms::darwinn::DataType data_type) {
@@ -40,6 +41,13 @@ int TensorDataTypeSize(platforms::darwinn::DataType data_type) {
       return 0;
   }
 }
+
+// Number of bytes of the tensor of `layer`.
+int LayerSizeBytes(const platforms::darwinn::Layer* layer) {
+  return layer->x_dim() * layer->y_dim() * layer->z_dim() *
+         TensorDataTypeSize(layer->data_type()) *
+         layer->execution_count_per_inference();
+}
 }  // namespace
 
 namespace coralmicro {
@@ -73,11 +81,35 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
                                        TfLiteNode* node) {
   const TfLiteEvalTensor* input_tensor =
       tflite::micro::GetEvalInput(context, node, 0);
-  const int input_size = tflite::micro::GetTensorShape(input_tensor).FlatSize();
   if (!input_tensor) {
     return kTfLiteError;
   }
+  size_t input_size;
+  RETURN_IF_ERROR(TfLiteEvalTensorByteLength(input_tensor, &input_size) ==
+                  kTfLiteOk);
+  RETURN_IF_ERROR(
+      Execute(tpu_driver, input_tensor->data.uint8, input_size) == kTfLiteOk);
+
+  if (!output_layers_.empty()) {
+    for (int i = 0; i < node->outputs->size; ++i) {
+      const TfLiteEvalTensor* output_tensor =
+          tflite::micro::GetEvalOutput(context, node, i);
+      if (!output_tensor) {
+        return kTfLiteError;
+      }
+      size_t output_size;
+      RETURN_IF_ERROR(TfLiteEvalTensorByteLength(output_tensor, &output_size) ==
+                      kTfLiteOk);
+      RETURN_IF_ERROR(
+          CopyOutput(i, output_tensor->data.uint8, output_size) == kTfLiteOk);
+    }
+  }
 
+  return kTfLiteOk;
+}
+
+TfLiteStatus EdgeTpuExecutable::Execute(const TpuDriver& tpu_driver,
+                                        uint8_t* input, int input_size) {
   const platforms::darwinn::DmaDescriptorHint* dma_hint;
   const char* name;
   uint8_t* output;
@@ -95,13 +127,20 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
                 dma_hint->size_in_bytes()));
             break;
           case platforms::darwinn::Description_BASE_ADDRESS_INPUT_ACTIVATION:
+            if (!input) {
+              return kTfLiteError;
+            }
             name = dma_hint->meta()->name()->c_str();
             if (executable_->input_layers()) {
               for (const auto* input_layer : *(executable_->input_layers())) {
                 if (!strcmp(input_layer->name()->c_str(), name)) {
+                  if (input_size < LayerSizeBytes(input_layer)) {
+                    printf("Input is smaller than layer %s\r\n", name);
+                    return kTfLiteError;
+                  }
                   if (OutputLayer::SignedDataType(input_layer->data_type())) {
                     OutputLayer::TransformSignedDataType(
-                        input_tensor->data.uint8, input_size,
+                        input, input_size,
                         TensorDataTypeSize(input_layer->data_type()),
                         input_layer->x_dim(), input_layer->y_dim(),
                         input_layer->z_dim());
@@ -109,9 +148,15 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
                 }
               }
             }
-            RETURN_IF_ERROR(tpu_driver.SendInputs(
-                input_tensor->data.uint8 + dma_hint->offset_in_bytes(),
-                dma_hint->size_in_bytes()));
+            if (static_cast<int64_t>(dma_hint->offset_in_bytes()) +
+                    dma_hint->size_in_bytes() >
+                input_size) {
+              printf("Input is smaller than layer %s\r\n", name);
+              return kTfLiteError;
+            }
+            RETURN_IF_ERROR(
+                tpu_driver.SendInputs(input + dma_hint->offset_in_bytes(),
+                                      dma_hint->size_in_bytes()));
             break;
           case platforms::darwinn::Description_BASE_ADDRESS_OUTPUT_ACTIVATION:
             name = dma_hint->meta()->name()->c_str();
@@ -141,29 +186,55 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
   }
 
   tpu_driver.ReadEvent();
+  return kTfLiteOk;
+}
 
-  if (!output_layers_.empty()) {
-    for (int i = 0; i < node->outputs->size; ++i) {
-      const TfLiteEvalTensor* output_tensor =
-          tflite::micro::GetEvalOutput(context, node, i);
-      const int output_size =
-          tflite::micro::GetTensorShape(output_tensor).FlatSize();
-      if (!output_tensor) {
-        return kTfLiteError;
-      }
-      name = executable_->output_layers()->Get(i)->name()->c_str();
-      if (output_layers_.find(name) == output_layers_.end()) {
-        printf("Executable does not have buffer for %s\r\n", name);
-        return kTfLiteError;
-      }
-      OutputLayer* output_layer = output_layers_[name];
-
-      output_layer->Relayout(output_tensor->data.uint8);
-      output_layer->TransformSignedDataType(output_tensor->data.uint8,
-                                            output_size);
+int EdgeTpuExecutable::input_size_bytes() const {
+  int size = 0;
+  if (executable_->input_layers()) {
+    for (const auto* input_layer : *(executable_->input_layers())) {
+      size += LayerSizeBytes(input_layer);
     }
   }
+  return size;
+}
+
+int EdgeTpuExecutable::output_count() const {
+  return executable_->output_layers() ? executable_->output_layers()->size()
+                                      : 0;
+}
+
+int EdgeTpuExecutable::output_size_bytes(int index) const {
+  const OutputLayer* output_layer = GetOutputLayer(index);
+  return output_layer ? output_layer->SizeBytes() : -1;
+}
+
+OutputLayer* EdgeTpuExecutable::GetOutputLayer(int index) const {
+  if (index < 0 || index >= output_count()) {
+    return nullptr;
+  }
+  const char* name = executable_->output_layers()->Get(index)->name()->c_str();
+  auto it = output_layers_.find(name);
+  if (it == output_layers_.end()) {
+    printf("Executable does not have buffer for %s\r\n", name);
+    return nullptr;
+  }
+  return it->second;
+}
+
+TfLiteStatus EdgeTpuExecutable::CopyOutput(int index, uint8_t* dest,
+                                           int dest_size) {
+  OutputLayer* output_layer = GetOutputLayer(index);
+  if (!output_layer) {
+    return kTfLiteError;
+  }
+  if (dest_size < output_layer->SizeBytes()) {
+    printf("Output buffer is smaller than output %d\r\n", index);
+    return kTfLiteError;
+  }
 
+  output_layer->Relayout(dest);
+  output_layer->TransformSignedDataType(dest, dest_size);
   return kTfLiteOk;
 }
 
@@ -171,6 +242,13 @@ int OutputLayer::DataTypeSize() const {
   return TensorDataTypeSize(output_layer_->data_type());
 }
 
+int OutputLayer::SizeBytes() const {
+  // Only one dimensional outputs keep the results of every execution.
+  const int executions =
+      y_dim() == 1 && x_dim() == 1 ? execution_count_per_inference() : 1;
+  return x_dim() * y_dim() * z_dim() * DataTypeSize() * executions;
+}
+
 bool OutputLayer::SignedDataType() const {
   return SignedDataType(output_layer_->data_type());
 }
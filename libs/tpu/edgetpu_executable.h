@@ -43,6 +43,8 @@ class OutputLayer {
                                       int z_dim);
   void Relayout(uint8_t* dest) const;
   void TransformSignedDataType(uint8_t* buffer, int buffer_size) const;
+  // Number of bytes that `Relayout()` writes.
+  int SizeBytes() const;
 
  private:
   struct YBufferIndex {
@@ -85,14 +87,40 @@ class EdgeTpuExecutable {
   EdgeTpuExecutable(const EdgeTpuExecutable&) = delete;
   EdgeTpuExecutable& operator=(const EdgeTpuExecutable&) = delete;
 
+  // Runs the executable with the input tensor of `node`, and copies the
+  // results into its output tensors.
   TfLiteStatus Invoke(const TpuDriver& tpu_driver, TfLiteContext* context,
                       TfLiteNode* node);
 
+  // Runs the executable, leaving the results in the output layers' buffers
+  // until they are copied with `CopyOutput()`. Signed inputs are converted in
+  // place. `input` can be nullptr for parameter caching executables, and
+  // otherwise must hold at least `input_size_bytes()`.
+  TfLiteStatus Execute(const TpuDriver& tpu_driver, uint8_t* input,
+                       int input_size);
+
+  // Number of bytes of the input, in the layout of the model's input tensor.
+  int input_size_bytes() const;
+
+  // Number of outputs, in the order of the model's output tensors.
+  int output_count() const;
+
+  // Number of bytes of output `index`, or -1 if there is no such output.
+  int output_size_bytes(int index) const;
+
+  // Copies output `index` of the last `Execute()` into `dest`, converting it
+  // to the layout and data type of the model's output tensor. Fails if
+  // `dest_size` is less than `output_size_bytes(index)`.
+  TfLiteStatus CopyOutput(int index, uint8_t* dest, int dest_size);
+
   uint64_t ParameterCachingToken() const {
     return executable_->parameter_caching_token();
   }
 
  private:
+  // Gets the buffer of output `index`, or nullptr if there is none.
+  OutputLayer* GetOutputLayer(int index) const;
+
   const platforms::darwinn::Executable* executable_;
 
   struct Less {
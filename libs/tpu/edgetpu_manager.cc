@@ -16,10 +16,13 @@
 
 #include "libs/tpu/edgetpu_manager.h"
 
+#include <algorithm>
 #include <cstdio>
 
 #include "libs/base/check.h"
+#include "libs/base/metrics.h"
 #include "libs/base/mutex.h"
+#include "libs/base/trace.h"
 #include "libs/tpu/edgetpu_task.h"
 #include "third_party/flatbuffers/include/flatbuffers/flatbuffers.h"
 #include "third_party/flatbuffers/include/flatbuffers/flexbuffers.h"
@@ -31,6 +34,20 @@ constexpr char kKeyVersion[] = "1";
 constexpr char kKeyChipName[] = "2";
 constexpr char kKeyParamCache_DEPRECATED[] = "3";
 constexpr char kKeyExecutable[] = "4";
+
+Histogram g_invoke_latency(
+    "coralmicro_tpu_invoke_microseconds",
+    "Edge TPU invoke latency, including waiting for other invokes.");
+Counter g_param_cache_hits(
+    "coralmicro_tpu_param_cache_hits_total",
+    "Edge TPU invokes whose parameters were already cached on the TPU.");
+Counter g_param_cache_misses(
+    "coralmicro_tpu_param_cache_misses_total",
+    "Edge TPU invokes that had to load parameters into the TPU first.");
+
+// Time for the USB host to release the instance of an Edge TPU that was
+// powered off.
+constexpr TickType_t kPowerOffDelay = pdMS_TO_TICKS(30);
 }  // namespace
 
 EdgeTpuContext::EdgeTpuContext() {
@@ -38,13 +55,71 @@ EdgeTpuContext::EdgeTpuContext() {
 }
 
 EdgeTpuContext::~EdgeTpuContext() {
+  EdgeTpuManager::GetSingleton()->OnContextDestroyed();
+}
+
+EdgeTpuManager::EdgeTpuManager()
+    : mutex_(xSemaphoreCreateMutex()),
+      idle_timer_(xTimerCreate("edgetpu_idle", 1, pdFALSE, this,
+                               IdleTimerCallback)) {
+  CHECK(mutex_);
+  CHECK(idle_timer_);
+}
+
+void EdgeTpuManager::OnContextDestroyed() {
+  // This must not take `mutex_`, because `OpenDevice()` destroys its context
+  // with `mutex_` held when it fails. A device that failed to initialize is
+  // always powered off, so the next `OpenDevice()` starts over.
+  if (initialized_mode_ && (keep_warm_ || idle_timeout_ms_ > 0)) {
+    warm_ = true;
+    if (!keep_warm_) StartIdleTimeout();
+    return;
+  }
   EdgeTpuTask::GetSingleton()->SetPower(false);
   // Small delay ensuring usb instance is released.
-  vTaskDelay(pdMS_TO_TICKS(30));
+  vTaskDelay(kPowerOffDelay);
 }
 
-EdgeTpuManager::EdgeTpuManager() : mutex_(xSemaphoreCreateMutex()) {
-  CHECK(mutex_);
+void EdgeTpuManager::StartIdleTimeout() {
+  // A timeout of 0 powers off on the next tick, which still goes through the
+  // timer so that callers never wait for the `EdgeTpuTask`.
+  const TickType_t ticks =
+      std::max<TickType_t>(1, pdMS_TO_TICKS(idle_timeout_ms_.load()));
+  CHECK(xTimerChangePeriod(idle_timer_, ticks, portMAX_DELAY) == pdPASS);
+}
+
+void EdgeTpuManager::PowerOffIfIdle(const std::function<void()>& power_off) {
+  if (xSemaphoreTake(mutex_, 0) != pdTRUE) {
+    if (warm_ && !keep_warm_) StartIdleTimeout();
+    return;
+  }
+  if (!keep_warm_ && !context_.lock() && warm_.exchange(false)) {
+    power_off();
+    idle_power_off_time_ = xTaskGetTickCount();
+  }
+  CHECK(xSemaphoreGive(mutex_) == pdTRUE);
+}
+
+void EdgeTpuManager::IdleTimerCallback(TimerHandle_t timer) {
+  // The timer service task must not block, so if the `EdgeTpuTask` queue is
+  // full, try again on the next tick.
+  if (!EdgeTpuTask::GetSingleton()->RequestIdlePowerOff()) {
+    xTimerChangePeriod(timer, 1, 0);
+  }
+}
+
+void EdgeTpuManager::SetIdleTimeout(uint32_t timeout_ms) {
+  idle_timeout_ms_ = timeout_ms;
+  if (warm_ && !keep_warm_) StartIdleTimeout();
+}
+
+void EdgeTpuManager::SetKeepWarm(bool keep_warm) {
+  keep_warm_ = keep_warm;
+  if (keep_warm) {
+    CHECK(xTimerStop(idle_timer_, portMAX_DELAY) == pdPASS);
+  } else if (warm_) {
+    StartIdleTimeout();
+  }
 }
 
 void EdgeTpuManager::NotifyConnected(
@@ -54,6 +129,7 @@ void EdgeTpuManager::NotifyConnected(
   // The EdgeTPU has left the USB bus -- clean up state.
   if (!usb_instance_) {
     current_parameter_caching_token_ = 0;
+    initialized_mode_.reset();
   }
 }
 
@@ -66,7 +142,18 @@ std::shared_ptr<EdgeTpuContext> EdgeTpuManager::OpenDevice(
   auto context = context_.lock();
   if (context) return context;
 
+  CHECK(xTimerStop(idle_timer_, portMAX_DELAY) == pdPASS);
+  // The `EdgeTpuTask` doesn't wait after an idle power off, so that wait
+  // happens here instead.
+  if (idle_power_off_time_) {
+    const TickType_t elapsed = xTaskGetTickCount() - *idle_power_off_time_;
+    if (elapsed < kPowerOffDelay) vTaskDelay(kPowerOffDelay - elapsed);
+    idle_power_off_time_.reset();
+  }
   context = std::make_shared<EdgeTpuContext>();
+  // The new context holds its own power reference, so the one kept since the
+  // last context was destroyed can be dropped without powering off.
+  if (warm_.exchange(false)) EdgeTpuTask::GetSingleton()->SetPower(false);
 
   while (!usb_instance_) {
     if (usb_error_) {
@@ -78,9 +165,14 @@ std::shared_ptr<EdgeTpuContext> EdgeTpuManager::OpenDevice(
     vTaskDelay(pdMS_TO_TICKS(100));
   }
 
-  // Got tpu usb instance, init the tpu driver.
-  if (!tpu_driver_.Initialize(usb_instance_, mode)) {
-    return nullptr;
+  // Got tpu usb instance, init the tpu driver. A device that was kept warm is
+  // already initialized, unless the performance mode changed.
+  if (initialized_mode_ != mode) {
+    initialized_mode_.reset();
+    if (!tpu_driver_.Initialize(usb_instance_, mode)) {
+      return nullptr;
+    }
+    initialized_mode_ = mode;
   }
 
   context_ = context;
@@ -165,29 +257,52 @@ EdgeTpuPackage* EdgeTpuManager::RegisterPackage(const char* package_content,
 
 TfLiteStatus EdgeTpuManager::Invoke(EdgeTpuPackage* package,
                                     TfLiteContext* context, TfLiteNode* node) {
+  TRACE_ZONE("tpu/Invoke");
+  HistogramTimer timer(&g_invoke_latency);
+  package->LockOutputs();
+  TfLiteStatus status;
+  {
+    MutexLock lock(mutex_);
+    CacheParameters(package);
+    status = package->inference_exe()->Invoke(tpu_driver_, context, node);
+  }
+  package->UnlockOutputs();
+  return status;
+}
+
+TfLiteStatus EdgeTpuManager::Execute(EdgeTpuPackage* package, uint8_t* input,
+                                     int input_size) {
+  TRACE_ZONE("tpu/Execute");
   MutexLock lock(mutex_);
+  CacheParameters(package);
+  return package->inference_exe()->Execute(tpu_driver_, input, input_size);
+}
+
+void EdgeTpuManager::CacheParameters(EdgeTpuPackage* package) {
   if (package->parameter_caching_exe()) {
     auto token = package->parameter_caching_exe()->ParameterCachingToken();
     if (token != current_parameter_caching_token_) {
+      g_param_cache_misses.Increment();
       cached_packages_.fill(nullptr);
-      package->parameter_caching_exe()->Invoke(tpu_driver_, context, node);
+      package->parameter_caching_exe()->Execute(tpu_driver_, nullptr, 0);
       current_parameter_caching_token_ = token;
       cached_packages_[0] = package;
     } else {
       for (auto& cached_package : cached_packages_) {
         if (cached_package == package) {
+          g_param_cache_hits.Increment();
           break;
         } else if (cached_package == nullptr) {
-          package->parameter_caching_exe()->Invoke(tpu_driver_, context, node);
+          g_param_cache_misses.Increment();
+          package->parameter_caching_exe()->Execute(tpu_driver_, nullptr, 0);
           cached_package = package;
+          break;
         }
       }
     }
   } else {
     current_parameter_caching_token_ = 0;
   }
-
-  return package->inference_exe()->Invoke(tpu_driver_, context, node);
 }
 
 std::optional<float> EdgeTpuManager::GetTemperature() {
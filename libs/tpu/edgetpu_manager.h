@@ -17,17 +17,21 @@
 #ifndef LIBS_TPU_EDGETPU_MANAGER_H_
 #define LIBS_TPU_EDGETPU_MANAGER_H_
 
+#include <atomic>
 #include <cstdlib>
+#include <functional>
 #include <map>
 #include <memory>
 #include <optional>
 
+#include "libs/base/check.h"
 #include "libs/tpu/edgetpu_driver.h"
 #include "libs/tpu/edgetpu_executable.h"
 #include "libs/tpu/executable_generated.h"
 #include "libs/tpu/usb_host_edgetpu.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
 #include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/freertos_kernel/include/timers.h"
 #include "third_party/tflite-micro/tensorflow/lite/c/common.h"
 
 namespace coralmicro {
@@ -39,7 +43,9 @@ namespace coralmicro {
 //
 // The `EdgeTpuContext` can be shared among multiple software components, and
 // the life of this object is directly tied to the Edge TPU power, so the
-// Edge TPU powers down after the last `EdgeTpuContext` reference leaves scope.
+// Edge TPU powers down after the last `EdgeTpuContext` reference leaves scope
+// (unless `EdgeTpuManager::SetIdleTimeout()` or
+// `EdgeTpuManager::SetKeepWarm()` keep it powered for a while longer).
 //
 // The lifetime of the `EdgeTpuContext` must be longer than all associated
 // `tflite::MicroInterpreter` instances.
@@ -56,21 +62,34 @@ class EdgeTpuContext {
 class EdgeTpuPackage {
  public:
   EdgeTpuPackage(const platforms::darwinn::Executable* inference_exe,
-                 const platforms::darwinn::Executable* parameter_caching_exe) {
+                 const platforms::darwinn::Executable* parameter_caching_exe)
+      : outputs_semaphore_(xSemaphoreCreateBinary()) {
     inference_ = std::make_unique<EdgeTpuExecutable>(inference_exe);
     if (parameter_caching_exe) {
       parameter_caching_ =
           std::make_unique<EdgeTpuExecutable>(parameter_caching_exe);
     }
+    CHECK(outputs_semaphore_);
+    xSemaphoreGive(outputs_semaphore_);
   }
+  ~EdgeTpuPackage() { vSemaphoreDelete(outputs_semaphore_); }
   EdgeTpuExecutable* parameter_caching_exe() {
     return parameter_caching_.get();
   }
   EdgeTpuExecutable* inference_exe() { return inference_.get(); }
 
+  // The inference executable keeps its results in its own buffers from
+  // `Execute()` until `CopyOutput()`, so only one inference of a package can
+  // be in that window at a time. This is a semaphore rather than a mutex
+  // because `EdgeTpuInferenceQueue` executes and copies outputs in different
+  // tasks.
+  void LockOutputs() { xSemaphoreTake(outputs_semaphore_, portMAX_DELAY); }
+  void UnlockOutputs() { xSemaphoreGive(outputs_semaphore_); }
+
  private:
   std::unique_ptr<EdgeTpuExecutable> inference_;
   std::unique_ptr<EdgeTpuExecutable> parameter_caching_;
+  SemaphoreHandle_t outputs_semaphore_;
 };
 // @endcond
 
@@ -93,6 +112,10 @@ class EdgeTpuManager {
   EdgeTpuPackage* RegisterPackage(const char* package_content, size_t length);
   TfLiteStatus Invoke(EdgeTpuPackage* package, TfLiteContext* context,
                       TfLiteNode* node);
+  // Runs `package` on `input`, leaving the results in its inference
+  // executable. The caller must hold `package->LockOutputs()`.
+  TfLiteStatus Execute(EdgeTpuPackage* package, uint8_t* input,
+                       int input_size);
   // @endcond
 
   // Gets the default Edge TPU device (and starts it if necessary).
@@ -120,6 +143,11 @@ class EdgeTpuManager {
   // @cond Do not generate docs
   void NotifyError();
   void NotifyConnected(usb_host_edgetpu_instance_t* usb_instance);
+  // Powers off the Edge TPU with `power_off` if it is kept powered without a
+  // context. Runs on the `EdgeTpuTask`, which `OpenDevice()` waits for with
+  // `mutex_` held, so if the Edge TPU is in use this starts the idle timeout
+  // over instead of waiting.
+  void PowerOffIfIdle(const std::function<void()>& power_off);
   // @endcond
 
   // Gets the current Edge TPU junction temperature.
@@ -127,7 +155,44 @@ class EdgeTpuManager {
   // `EdgeTpuContext` is empty.
   std::optional<float> GetTemperature();
 
+  // Sets how long the Edge TPU stays powered after the last `EdgeTpuContext`
+  // is destroyed.
+  //
+  // Powering the Edge TPU on again requires downloading its firmware and
+  // initializing it, which takes hundreds of milliseconds, and also loses the
+  // cached model parameters. If `OpenDevice()` is called again before the
+  // timeout (with the same performance mode), the Edge TPU is reused as is.
+  //
+  // @param timeout_ms The time in milliseconds, or 0 to power off the Edge TPU
+  // as soon as the last `EdgeTpuContext` is destroyed (the default).
+  void SetIdleTimeout(uint32_t timeout_ms);
+
+  // Keeps the Edge TPU powered after the last `EdgeTpuContext` is destroyed,
+  // regardless of the idle timeout.
+  //
+  // This does not power the Edge TPU on by itself, it only prevents
+  // powering it off until this is called again with `false` (after which the
+  // idle timeout applies).
+  //
+  // @param keep_warm True to keep the Edge TPU powered.
+  void SetKeepWarm(bool keep_warm);
+
  private:
+  friend class EdgeTpuContext;
+
+  // Called when the last `EdgeTpuContext` is destroyed, to power off the Edge
+  // TPU now or later depending on the power policy.
+  void OnContextDestroyed();
+  // Loads the parameters of `package` into the Edge TPU, unless they are
+  // already cached there. Requires `mutex_`.
+  void CacheParameters(EdgeTpuPackage* package);
+  // Starts the idle timeout, after which the `EdgeTpuTask` powers off the
+  // Edge TPU.
+  void StartIdleTimeout();
+  // Runs in the timer service task, so it only passes the power off on to
+  // the `EdgeTpuTask`.
+  static void IdleTimerCallback(TimerHandle_t timer);
+
   TpuDriver tpu_driver_;
   std::map<uintptr_t, EdgeTpuPackage*> packages_;
   std::array<EdgeTpuPackage*, 2> cached_packages_;
@@ -136,6 +201,18 @@ class EdgeTpuManager {
   std::weak_ptr<EdgeTpuContext> context_;
   SemaphoreHandle_t mutex_;
   bool usb_error_{false};
+  // Performance mode `tpu_driver_` was initialized with, until the Edge TPU
+  // leaves the USB bus.
+  std::optional<PerformanceMode> initialized_mode_;
+  TimerHandle_t idle_timer_;
+  std::atomic<uint32_t> idle_timeout_ms_{0};
+  std::atomic<bool> keep_warm_{false};
+  // Whether the manager holds the power reference of the last destroyed
+  // `EdgeTpuContext`, keeping the Edge TPU powered without a context.
+  std::atomic<bool> warm_{false};
+  // When the idle timeout last powered off the Edge TPU, until the next
+  // `OpenDevice()`. Requires `mutex_`.
+  std::optional<TickType_t> idle_power_off_time_;
 };
 
 }  // namespace coralmicro
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/tpu/edgetpu_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "libs/base/check.h"
+#include "libs/base/metrics.h"
+#include "libs/base/mutex.h"
+#include "libs/base/tasks.h"
+#include "libs/base/timer.h"
+#include "libs/base/trace.h"
+#include "libs/tpu/edgetpu_op.h"
+
+namespace coralmicro {
+namespace {
+Histogram g_queue_latency(
+    "coralmicro_tpu_queue_latency_microseconds",
+    "Time from EdgeTpuInferenceQueue::Submit() to the request's callback.");
+Gauge g_queue_pending("coralmicro_tpu_queue_pending",
+                      "EdgeTpuInferenceQueue requests waiting to execute.");
+
+// Orders the heap so that the front is the entry to run next.
+struct RunsLater {
+  template <typename Entry>
+  bool operator()(const Entry* a, const Entry* b) const {
+    if (a->request.priority != b->request.priority)
+      return a->request.priority < b->request.priority;
+    return static_cast<int32_t>(a->sequence - b->sequence) > 0;
+  }
+};
+}  // namespace
+
+EdgeTpuInferenceQueue::EdgeTpuInferenceQueue()
+    : mutex_(xSemaphoreCreateMutex()),
+      executed_(xQueueCreate(1, sizeof(Entry*))) {
+  CHECK(mutex_);
+  CHECK(executed_);
+  CHECK(xTaskCreate(StaticExecuteTask, "edgetpu_queue_exec",
+                    configMINIMAL_STACK_SIZE * 4, this,
+                    kEdgeTpuQueueTaskPriority, &execute_task_) == pdPASS);
+  CHECK(xTaskCreate(StaticCompleteTask, "edgetpu_queue_done",
+                    configMINIMAL_STACK_SIZE * 4, this,
+                    kEdgeTpuQueueTaskPriority, &complete_task_) == pdPASS);
+}
+
+bool EdgeTpuInferenceQueue::Submit(EdgeTpuInferenceRequest request) {
+  if (!request.package || !request.input || !request.callback) return false;
+  const auto* exe = request.package->inference_exe();
+  if (static_cast<int>(request.input_size) != exe->input_size_bytes())
+    return false;
+  if (static_cast<int>(request.outputs.size()) != exe->output_count())
+    return false;
+  for (size_t i = 0; i < request.outputs.size(); ++i) {
+    if (!request.outputs[i].data ||
+        static_cast<int>(request.outputs[i].size) != exe->output_size_bytes(i))
+      return false;
+  }
+
+  auto* entry = new Entry{std::move(request), 0, TimerMicros(), false};
+  {
+    MutexLock lock(mutex_);
+    entry->sequence = next_sequence_++;
+    pending_.push_back(entry);
+    std::push_heap(pending_.begin(), pending_.end(), RunsLater());
+  }
+  g_queue_pending.Add(1);
+  xTaskNotifyGive(execute_task_);
+  return true;
+}
+
+size_t EdgeTpuInferenceQueue::pending() {
+  MutexLock lock(mutex_);
+  return pending_.size();
+}
+
+EdgeTpuInferenceQueue::Entry* EdgeTpuInferenceQueue::NextEntry() {
+  MutexLock lock(mutex_);
+  if (pending_.empty()) return nullptr;
+  std::pop_heap(pending_.begin(), pending_.end(), RunsLater());
+  auto* entry = pending_.back();
+  pending_.pop_back();
+  return entry;
+}
+
+void EdgeTpuInferenceQueue::StaticExecuteTask(void* param) {
+  static_cast<EdgeTpuInferenceQueue*>(param)->ExecuteTask();
+}
+
+void EdgeTpuInferenceQueue::StaticCompleteTask(void* param) {
+  static_cast<EdgeTpuInferenceQueue*>(param)->CompleteTask();
+}
+
+void EdgeTpuInferenceQueue::ExecuteTask() {
+  while (true) {
+    auto* entry = NextEntry();
+    if (!entry) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      continue;
+    }
+    g_queue_pending.Add(-1);
+
+    auto& request = entry->request;
+    // Released by the complete stage once the outputs are copied.
+    request.package->LockOutputs();
+    entry->success =
+        EdgeTpuManager::GetSingleton()->Execute(
+            request.package, request.input, request.input_size) == kTfLiteOk;
+    CHECK(xQueueSendToBack(executed_, &entry, portMAX_DELAY) == pdTRUE);
+  }
+}
+
+void EdgeTpuInferenceQueue::CompleteTask() {
+  while (true) {
+    Entry* entry;
+    CHECK(xQueueReceive(executed_, &entry, portMAX_DELAY) == pdTRUE);
+
+    auto& request = entry->request;
+    auto* exe = request.package->inference_exe();
+    {
+      TRACE_ZONE("tpu/CopyOutputs");
+      for (size_t i = 0; entry->success && i < request.outputs.size(); ++i) {
+        const auto& output = request.outputs[i];
+        entry->success =
+            exe->CopyOutput(i, output.data, output.size) == kTfLiteOk;
+      }
+    }
+    request.package->UnlockOutputs();
+
+    g_queue_latency.Record(
+        static_cast<uint32_t>(TimerMicros() - entry->submit_micros));
+    request.callback(entry->success);
+    delete entry;
+  }
+}
+
+EdgeTpuPackage* GetEdgeTpuPackage(const tflite::Model* model) {
+  if (!model || !model->subgraphs() || model->subgraphs()->size() == 0 ||
+      !model->operator_codes())
+    return nullptr;
+
+  const auto* operators = model->subgraphs()->Get(0)->operators();
+  if (!operators) return nullptr;
+  for (const auto* op : *operators) {
+    const auto* opcode = model->operator_codes()->Get(op->opcode_index());
+    if (!opcode->custom_code() ||
+        std::strcmp(opcode->custom_code()->c_str(), kCustomOp) != 0)
+      continue;
+    const auto* options = op->custom_options();
+    if (!options) return nullptr;
+    return EdgeTpuManager::GetSingleton()->RegisterPackage(
+        reinterpret_cast<const char*>(options->data()), options->size());
+  }
+  return nullptr;
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TPU_EDGETPU_QUEUE_H_
+#define LIBS_TPU_EDGETPU_QUEUE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "libs/tpu/edgetpu_manager.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/queue.h"
+#include "third_party/freertos_kernel/include/semphr.h"
+#include "third_party/freertos_kernel/include/task.h"
+#include "third_party/tflite-micro/tensorflow/lite/schema/schema_generated.h"
+
+namespace coralmicro {
+
+// A buffer that receives one output of an `EdgeTpuInferenceRequest`.
+struct EdgeTpuOutputBuffer {
+  // The buffer, in the layout and data type of the model's output tensor.
+  uint8_t* data;
+  // The size of `data` in bytes.
+  size_t size;
+};
+
+// An inference to run with `EdgeTpuInferenceQueue::Submit()`.
+struct EdgeTpuInferenceRequest {
+  // The model to run, from `GetEdgeTpuPackage()`.
+  EdgeTpuPackage* package = nullptr;
+  // The input, in the layout and data type of the model's input tensor. Inputs
+  // with a signed data type are converted in place, so the buffer must stay
+  // valid (and unchanged) until the callback is called.
+  uint8_t* input = nullptr;
+  // The size of `input` in bytes.
+  size_t input_size = 0;
+  // One buffer per output, in the order of the model's output tensors.
+  std::vector<EdgeTpuOutputBuffer> outputs;
+  // Requests with a higher priority start first. Requests with the same
+  // priority start in the order they were submitted.
+  int priority = 0;
+  // Called once the outputs are filled (with true), or if the inference failed
+  // (with false). It runs in the queue's completion task, so it should only
+  // hand the result over to another task, for example with a semaphore.
+  std::function<void(bool success)> callback;
+};
+
+// Runs Edge TPU inferences asynchronously, in priority order.
+//
+// This is an alternative to invoking a `tflite::MicroInterpreter` for models
+// that are compiled entirely for the Edge TPU (the whole graph is a single
+// `edgetpu-custom-op`). Instead of blocking until the Edge TPU is done, the
+// caller submits requests and gets a callback when each one completes, so
+// several models (or several frames of one model) can be in flight at once.
+//
+// Requests go through two stages, each in its own task:
+//
+//   1. Execute: loads the parameters (if they are not cached), sends the
+//      instructions and the input, and reads the raw output from the Edge
+//      TPU. This holds the Edge TPU, like `tflite::MicroInterpreter::Invoke()`
+//      does.
+//   2. Complete: converts the raw output into the output buffers and calls
+//      the callback.
+//
+// The stages overlap, so the Edge TPU runs the next request while the outputs
+// of the previous one are converted. Two requests for the same package can't
+// overlap though, because the raw outputs are kept by the package.
+//
+// An `EdgeTpuContext` must be open (see `EdgeTpuManager::OpenDevice()`)
+// while requests are submitted and running.
+//
+// For example:
+//
+// ```
+// auto* package = GetEdgeTpuPackage(tflite::GetModel(model.data()));
+// EdgeTpuInferenceRequest request;
+// request.package = package;
+// request.input = input.data();
+// request.input_size = input.size();
+// request.outputs = {{output.data(), output.size()}};
+// request.callback = [task = xTaskGetCurrentTaskHandle()](bool success) {
+//   xTaskNotifyGive(task);
+// };
+// EdgeTpuInferenceQueue::GetSingleton()->Submit(std::move(request));
+// ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+// ```
+class EdgeTpuInferenceQueue {
+ public:
+  // Gets the `EdgeTpuInferenceQueue` singleton, starting its tasks the first
+  // time it is called.
+  static EdgeTpuInferenceQueue* GetSingleton() {
+    static EdgeTpuInferenceQueue queue;
+    return &queue;
+  }
+
+  EdgeTpuInferenceQueue(const EdgeTpuInferenceQueue&) = delete;
+  EdgeTpuInferenceQueue& operator=(const EdgeTpuInferenceQueue&) = delete;
+
+  // Adds an inference to the queue.
+  //
+  // @param request The inference to run.
+  // @returns False if the request is invalid (it has no package, input or
+  // callback, or its input or output buffers don't match the size of the
+  // model's tensors), in which case the callback is not called.
+  bool Submit(EdgeTpuInferenceRequest request);
+
+  // Gets the number of requests that haven't started executing yet.
+  size_t pending();
+
+ private:
+  struct Entry {
+    EdgeTpuInferenceRequest request;
+    uint32_t sequence;
+    uint64_t submit_micros;
+    bool success;
+  };
+
+  EdgeTpuInferenceQueue();
+  static void StaticExecuteTask(void* param);
+  static void StaticCompleteTask(void* param);
+  [[noreturn]] void ExecuteTask();
+  [[noreturn]] void CompleteTask();
+  Entry* NextEntry();
+
+  SemaphoreHandle_t mutex_;
+  // Heap of `Entry*`, ordered by priority and then by sequence.
+  std::vector<Entry*> pending_;
+  uint32_t next_sequence_ = 0;
+  // Executed entries, waiting for the complete stage.
+  QueueHandle_t executed_;
+  TaskHandle_t execute_task_;
+  TaskHandle_t complete_task_;
+};
+
+// Gets the Edge TPU package of a model that's compiled entirely for the Edge
+// TPU, to run with `EdgeTpuInferenceQueue`.
+//
+// @param model The model, from `tflite::GetModel()`. It must stay in memory
+// as long as the package is used.
+// @returns The package of the model's first `edgetpu-custom-op`, or nullptr if
+// it has none.
+EdgeTpuPackage* GetEdgeTpuPackage(const tflite::Model* model);
+
+}  // namespace coralmicro
+
+#endif  // LIBS_TPU_EDGETPU_QUEUE_H_
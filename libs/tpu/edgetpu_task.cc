@@ -209,6 +209,12 @@ void EdgeTpuTask::SetPower(bool enable) {
   SendRequest(req);
 }
 
+bool EdgeTpuTask::RequestIdlePowerOff() {
+  Request req;
+  req.type = RequestType::kIdlePowerOff;
+  return xQueueSend(request_queue_, &req, 0) == pdTRUE;
+}
+
 void EdgeTpuTask::RequestHandler(Request *req) {
   Response resp;
   resp.type = req->type;
@@ -222,6 +228,13 @@ void EdgeTpuTask::RequestHandler(Request *req) {
     case RequestType::kGetPower:
       resp.response.get_power.enabled = HandleGetPowerRequest();
       break;
+    case RequestType::kIdlePowerOff:
+      // This task can't send itself a power request, so it handles it here.
+      EdgeTpuManager::GetSingleton()->PowerOffIfIdle([this] {
+        SetPowerRequest power_off{/*enable=*/false};
+        HandleSetPowerRequest(power_off);
+      });
+      break;
   }
 
   if (req->callback) {
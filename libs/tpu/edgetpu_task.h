@@ -48,6 +48,7 @@ enum class RequestType : uint8_t {
   kNextState,
   kSetPower,
   kGetPower,
+  kIdlePowerOff,
 };
 
 struct NextStateRequest {
@@ -89,6 +90,11 @@ class EdgeTpuTask
  public:
   bool GetPower();
   void SetPower(bool enable);
+  // Asks the task to power off the Edge TPU if `EdgeTpuManager` keeps it
+  // powered without a context. Doesn't block, so it's safe to call from a
+  // timer callback.
+  // @returns False if the request queue is full.
+  bool RequestIdlePowerOff();
   static EdgeTpuTask *GetSingleton() {
     static EdgeTpuTask task;
     return &task;
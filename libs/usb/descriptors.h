@@ -126,6 +126,41 @@ struct CdcAcmClassDescriptor {
   EndpointDescriptor out_ep;
 } __attribute__((packed));
 
+struct CdcEthernetNetworkingFunctionalDescriptor {
+  uint8_t function_length;
+  uint8_t descriptor_type;
+  uint8_t descriptor_subtype;
+  uint8_t mac_address;
+  uint32_t ethernet_statistics;
+  uint16_t max_segment_size;
+  uint16_t num_mc_filters;
+  uint8_t num_power_filters;
+} __attribute__((packed));
+
+struct CdcNcmFunctionalDescriptor {
+  uint8_t function_length;
+  uint8_t descriptor_type;
+  uint8_t descriptor_subtype;
+  uint16_t bcd_ncm_version;
+  uint8_t network_capabilities;
+} __attribute__((packed));
+
+struct CdcNcmClassDescriptor {
+  InterfaceAssociationDescriptor iad0;
+  // Communication
+  InterfaceDescriptor comm_iface;
+  CdcHeaderFunctionalDescriptor comm_hdr_fd;
+  CdcUnionFunctionalDescriptor comm_union_fd;
+  CdcEthernetNetworkingFunctionalDescriptor comm_ether_fd;
+  CdcNcmFunctionalDescriptor comm_ncm_fd;
+  EndpointDescriptor comm_ep;
+  // Data, with no endpoints in the default alternate setting
+  InterfaceDescriptor data_iface_alt0;
+  InterfaceDescriptor data_iface_alt1;
+  EndpointDescriptor in_ep;
+  EndpointDescriptor out_ep;
+} __attribute__((packed));
+
 struct CdcEemClassDescriptor {
   InterfaceDescriptor iface;
   EndpointDescriptor in_ep;
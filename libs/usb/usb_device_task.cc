@@ -31,6 +31,8 @@ extern "C" void USB_OTG1_IRQHandler(void) {
 namespace coralmicro {
 namespace {
 constexpr int kUSBControllerId = kUSB_ControllerEhci0;
+// Manufacturer, product, and serial number come first.
+constexpr int kFirstAddedString = 4;
 
 // Super-basic unicode "conversion" function (no conversion really, just
 // ascii into 2-byte expansion).
@@ -106,10 +108,18 @@ usb_status_t UsbDeviceTask::Handler(usb_device_handle device_handle,
           ToUsbStringDescriptor(serial_number_.c_str(), string_desc);
           ret = kStatus_USB_Success;
           break;
-        default:
+        default: {
+          size_t index = string_desc->stringIndex - kFirstAddedString;
+          if (string_desc->stringIndex >= kFirstAddedString &&
+              index < strings_.size()) {
+            ToUsbStringDescriptor(strings_[index].c_str(), string_desc);
+            ret = kStatus_USB_Success;
+            break;
+          }
           printf("Unhandled string request: %d\r\n", string_desc->stringIndex);
           ret = kStatus_USB_InvalidRequest;
           break;
+        }
       }
       break;
     }
@@ -169,6 +179,11 @@ void UsbDeviceTask::AddDevice(const usb_device_class_config_struct_t& config,
   p_composite_descriptor->conf.total_length = composite_descriptor_size_;
 }
 
+uint8_t UsbDeviceTask::AddString(const char* str) {
+  strings_.emplace_back(str);
+  return kFirstAddedString + strings_.size() - 1;
+}
+
 bool UsbDeviceTask::Init() {
   config_list_ = {configs_.data(), &UsbDeviceTask::StaticHandler,
                   static_cast<uint8_t>(configs_.size())};
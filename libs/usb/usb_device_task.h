@@ -55,6 +55,12 @@ class UsbDeviceTask {
   }
   void UsbDeviceTaskFn();
 
+  // Adds a string descriptor, for class descriptors that refer to one.
+  //
+  // @param str The ASCII string.
+  // @returns The index of the string descriptor.
+  uint8_t AddString(const char* str);
+
   uint8_t next_descriptor_value() { return ++next_descriptor_value_; }
   uint8_t next_interface_value() {
     uint8_t next_interface = next_interface_value_;
@@ -112,6 +118,8 @@ class UsbDeviceTask {
   std::vector<UsbSetHandleCallback> set_handle_callbacks_;
   std::vector<UsbHandleEventCallback> handle_event_callbacks_;
   std::string serial_number_;
+  // Strings added with AddString(), following the serial number.
+  std::vector<std::string> strings_;
 };
 
 }  // namespace coralmicro
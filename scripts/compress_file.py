@@ -0,0 +1,228 @@
+#!/usr/bin/python3
+# Copyright 2022 Google LLC
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+"""
+Packs files into the compressed container read by LfsReadCompressedFile().
+
+The container is a 16-byte header ('CMZ1' magic, uncompressed size, block size,
+CRC-32 of the uncompressed data, all little-endian uint32) followed by blocks.
+Each block is prefixed with a uint32 holding its stored size; when bit 31 is set
+the block is stored uncompressed, otherwise it is a raw LZ4 block.
+
+Usage:
+  python3 compress_file.py models/bodypix.tflite bodypix.tflite.cmz
+  python3 compress_file.py --decompress bodypix.tflite.cmz bodypix.tflite
+"""
+
+import argparse
+import struct
+import sys
+import zlib
+
+try:
+  import lz4.block as lz4_block
+except ImportError:
+  lz4_block = None
+
+MAGIC = b'CMZ1'
+HEADER_FORMAT = '<4sIII'
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+STORED_BLOCK_FLAG = 0x80000000
+DEFAULT_BLOCK_SIZE = 64 * 1024
+# Must match kMaxCompressedBlockSize in libs/base/filesystem.cc.
+MAX_BLOCK_SIZE = 1024 * 1024
+
+MIN_MATCH = 4
+LAST_LITERALS = 5
+MF_LIMIT = 12
+MAX_OFFSET = 65535
+
+
+def _write_length(out, length):
+  while length >= 255:
+    out.append(255)
+    length -= 255
+  out.append(length)
+
+
+def _write_sequence(out, literals, offset=0, match_len=0):
+  literal_len = len(literals)
+  token = min(literal_len, 15) << 4
+  if match_len:
+    token |= min(match_len - MIN_MATCH, 15)
+  out.append(token)
+  if literal_len >= 15:
+    _write_length(out, literal_len - 15)
+  out += literals
+  if match_len:
+    out += struct.pack('<H', offset)
+    if match_len - MIN_MATCH >= 15:
+      _write_length(out, match_len - MIN_MATCH - 15)
+
+
+def lz4_compress_block(data):
+  """Compresses data into a single raw LZ4 block."""
+  if lz4_block:
+    return lz4_block.compress(bytes(data), mode='high_compression',
+                              store_size=False)
+
+  out = bytearray()
+  n = len(data)
+  anchor = 0
+  table = {}
+  i = 0
+  misses = 0
+  match_limit = n - MF_LIMIT
+  end_limit = n - LAST_LITERALS
+  while i < match_limit:
+    key = data[i:i + MIN_MATCH]
+    ref = table.get(key)
+    table[key] = i
+    if ref is None or i - ref > MAX_OFFSET:
+      # Skip faster through data that does not compress.
+      misses += 1
+      i += 1 + (misses >> 6)
+      continue
+    misses = 0
+    m = i + MIN_MATCH
+    r = ref + MIN_MATCH
+    while m < end_limit and data[m] == data[r]:
+      m += 1
+      r += 1
+    _write_sequence(out, data[anchor:i], i - ref, m - i)
+    i = anchor = m
+  _write_sequence(out, data[anchor:])
+  return bytes(out)
+
+
+def lz4_decompress_block(block, max_size):
+  """Decompresses a raw LZ4 block, mirroring libs/base/lz4.cc."""
+  out = bytearray()
+  i = 0
+  n = len(block)
+
+  def read_length(length):
+    nonlocal i
+    while True:
+      b = block[i]
+      i += 1
+      length += b
+      if b != 255:
+        return length
+
+  while i < n:
+    token = block[i]
+    i += 1
+    literal_len = token >> 4
+    if literal_len == 15:
+      literal_len = read_length(literal_len)
+    out += block[i:i + literal_len]
+    i += literal_len
+    if i >= n:
+      break
+    offset = block[i] | (block[i + 1] << 8)
+    i += 2
+    match_len = token & 0x0F
+    if match_len == 15:
+      match_len = read_length(match_len)
+    match_len += MIN_MATCH
+    if offset == 0 or offset > len(out):
+      raise ValueError('Corrupt LZ4 block')
+    start = len(out) - offset
+    for k in range(match_len):
+      out.append(out[start + k])
+  if len(out) > max_size:
+    raise ValueError('LZ4 block larger than the container block size')
+  return bytes(out)
+
+
+def is_compressed(data):
+  return len(data) >= HEADER_SIZE and data[:len(MAGIC)] == MAGIC
+
+
+def compress(data, block_size=DEFAULT_BLOCK_SIZE):
+  """Returns data packed into a compressed container."""
+  if block_size <= 0 or block_size > MAX_BLOCK_SIZE:
+    raise ValueError(f'block_size must be in (0, {MAX_BLOCK_SIZE}]')
+  out = bytearray(struct.pack(HEADER_FORMAT, MAGIC, len(data), block_size,
+                              zlib.crc32(data) & 0xFFFFFFFF))
+  view = memoryview(data)
+  for offset in range(0, len(data), block_size):
+    chunk = bytes(view[offset:offset + block_size])
+    packed = lz4_compress_block(chunk)
+    if len(packed) < len(chunk):
+      out += struct.pack('<I', len(packed))
+      out += packed
+    else:
+      out += struct.pack('<I', len(chunk) | STORED_BLOCK_FLAG)
+      out += chunk
+  return bytes(out)
+
+
+def decompress(data):
+  """Unpacks a compressed container and verifies its CRC-32."""
+  if not is_compressed(data):
+    raise ValueError('Not a compressed container')
+  _, size, block_size, crc = struct.unpack_from(HEADER_FORMAT, data)
+  out = bytearray()
+  i = HEADER_SIZE
+  while len(out) < size:
+    (block_header,) = struct.unpack_from('<I', data, i)
+    i += 4
+    stored_size = block_header & ~STORED_BLOCK_FLAG
+    block = data[i:i + stored_size]
+    i += stored_size
+    if block_header & STORED_BLOCK_FLAG:
+      out += block
+    else:
+      out += lz4_decompress_block(block, block_size)
+  if len(out) != size or (zlib.crc32(out) & 0xFFFFFFFF) != crc:
+    raise ValueError('CRC mismatch')
+  return bytes(out)
+
+
+def main():
+  parser = argparse.ArgumentParser(
+      description='Dev Board Micro compressed file packer',
+      formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+  parser.add_argument('input', type=str, help='File to read.')
+  parser.add_argument('output', type=str, help='File to write.')
+  parser.add_argument('--block_size', type=int, default=DEFAULT_BLOCK_SIZE,
+                      help='Uncompressed bytes per block. The device needs a '
+                      'scratch buffer of about this size while reading.')
+  parser.add_argument('--decompress', action='store_true',
+                      help='Unpack a compressed container instead.')
+  args = parser.parse_args()
+
+  with open(args.input, 'rb') as f:
+    data = f.read()
+
+  if args.decompress:
+    result = decompress(data)
+  else:
+    result = compress(data, args.block_size)
+    # Always check the round trip before the file goes to a device.
+    if decompress(result) != data:
+      print('Round trip check failed!')
+      return 1
+    print(f'{args.input}: {len(data)} -> {len(result)} bytes '
+          f'({100.0 * len(result) / max(len(data), 1):.1f}%)')
+
+  with open(args.output, 'wb') as f:
+    f.write(result)
+  return 0
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -15,6 +15,7 @@
 
 from progress.bar import Bar, Progress
 import argparse
+import compress_file
 import contextlib
 import hexformat
 import hid
@@ -33,6 +34,7 @@ import tempfile
 import textwrap
 import time
 import usb.core
+import zlib
 
 
 class ArduinoBar(Progress):
@@ -112,6 +114,7 @@ ETHERNET_SPEED_FILE = '/ethernet_speed'
 ETHERNET_IP_FILE = '/ethernet_ip'
 ETHERNET_SUBNET_MASK_FILE = '/ethernet_subnet_mask'
 ETHERNET_GATEWAY_FILE = '/ethernet_gateway'
+DEFAULT_ELF_CRC_FILE = '/default.elf.crc32'
 
 ELFLOADER_SETSIZE = 0
 ELFLOADER_BYTES = 1
@@ -120,10 +123,30 @@ ELFLOADER_RESET_TO_BOOTLOADER = 3
 ELFLOADER_TARGET = 4
 ELFLOADER_RESET_TO_FLASH = 5
 ELFLOADER_FORMAT = 6
+ELFLOADER_CHUNK = 7
+ELFLOADER_QUERY = 8
+ELFLOADER_SEEK = 9
 
 ELFLOADER_TARGET_RAM = 0
 ELFLOADER_TARGET_PATH = 1
 ELFLOADER_TARGET_FILESYSTEM = 2
+ELFLOADER_TARGET_PATCH_PATH = 3
+
+ELFLOADER_CHUNK_FLAG_ACK = 1
+
+ELFLOADER_STATUS_OK = 0
+ELFLOADER_STATUS_CRC_ERROR = 1
+ELFLOADER_STATUS_WRITE_ERROR = 2
+
+# Chunks sent before waiting for an acknowledgement.
+ELFLOADER_CHUNK_WINDOW = 32
+ELFLOADER_ACK_TIMEOUT_MS = 5000
+ELFLOADER_MAX_RETRIES = 5
+
+# Files already on the device are compared in blocks of this size, so only
+# the changed parts of a large model are resent.
+ELFLOADER_DELTA_BLOCK_SIZE = 64 * 1024
+ELFLOADER_QUERY_TIMEOUT_MS = 10000
 
 SCRIPT_DIR = os.path.dirname(os.path.realpath(__file__))
 BUILD_DIR = os.path.join(SCRIPT_DIR, '..', 'build')
@@ -133,13 +156,37 @@ def elfloader_msg_setsize(size):
   return struct.pack('=BBl', 0, ELFLOADER_SETSIZE, size)
 
 
-# 64 bytes HID packet, adjust for header and padding
-ELFLOADER_MAX_BYTES_PER_PACKET = 64 - struct.calcsize('=BBll') + 1
+# 1024 bytes HID report, less the command byte and chunk header
+ELFLOADER_REPORT_SIZE = 1024
+ELFLOADER_MAX_BYTES_PER_CHUNK = (ELFLOADER_REPORT_SIZE -
+                                 struct.calcsize('=BIHBI'))
+
+
+def elfloader_msg_chunk(offset, data, ack):
+  flags = ELFLOADER_CHUNK_FLAG_ACK if ack else 0
+  return struct.pack('=BBIHBI%ds' % len(data), 0, ELFLOADER_CHUNK, offset,
+                     len(data), flags, zlib.crc32(data), data)
+
 
+def elfloader_parse_ack(report):
+  return struct.unpack('=BI', bytes(report[:struct.calcsize('=BI')]))
 
-def elfloader_msg_bytes(offset, data):
-  return struct.pack('=BBll%ds' % len(data), 0, ELFLOADER_BYTES,
-                     len(data), offset, data)
+
+def elfloader_msg_query(path, block_size):
+  return struct.pack('=BBI%dsx' % len(path), 0, ELFLOADER_QUERY, block_size,
+                     path)
+
+
+def elfloader_parse_query_response(report):
+  header = struct.calcsize('=iIH')
+  size, crc, num_block_crcs = struct.unpack('=iIH', bytes(report[:header]))
+  block_crcs = struct.unpack('=%dI' % num_block_crcs,
+                             bytes(report[header:header + 4 * num_block_crcs]))
+  return size, crc, list(block_crcs)
+
+
+def elfloader_msg_seek(offset):
+  return struct.pack('=BBI', 0, ELFLOADER_SEEK, offset)
 
 
 def elfloader_msg_done():
@@ -623,19 +670,26 @@ def StateProgram(blhost_path, sbfile_path):
   return StateLoadElfloader
 
 
-def ElfloaderTransferData(h, data, target, bar=None):
+def ElfloaderTransferData(h, data, target, bar=None, ranges=None):
+  """Sends data to the elfloader.
+
+  If ranges is given, only those (start, end) byte ranges are sent, into a file
+  opened with ELFLOADER_TARGET_PATCH_PATH.
+  """
   warned = False
 
   def read_byte():
     if skip_hid_readback is True:
-      return
+      return None
     try:
-      h.read(1, timeout_ms=1000)
+      report = h.read(1, timeout_ms=1000)
+      return report[0] if report else None
     except:
       nonlocal warned
       if not warned:
         print('Warning: failed to read ACK byte after TX')
         warned = True
+      return None
 
   total_bytes = len(data)
   h.write(elfloader_msg_target(target))
@@ -644,22 +698,112 @@ def ElfloaderTransferData(h, data, target, bar=None):
   h.write(elfloader_msg_setsize(total_bytes))
   read_byte()
 
-  bytes_transferred = 0
-  while bytes_transferred < total_bytes:
-    bytes_this_packet = min(ELFLOADER_MAX_BYTES_PER_PACKET,
-                            total_bytes - bytes_transferred)
-    h.write(elfloader_msg_bytes(bytes_transferred,
-                                data[bytes_transferred:bytes_transferred + bytes_this_packet]))
-    read_byte()
-    bytes_transferred += bytes_this_packet
-    if bar:
-      bar.goto(bytes_transferred)
+  # Send a window of chunks, then wait for the device to report how far it
+  # got. On a CRC error the device drops the rest of the window, and sending
+  # resumes from the offset it acknowledged.
+  bytes_sent = 0
+  for start, end in ranges if ranges is not None else [(0, total_bytes)]:
+    if start != 0:
+      h.write(elfloader_msg_seek(start))
+      read_byte()
+    bytes_transferred = start
+    retries = 0
+    while bytes_transferred < end:
+      offset = bytes_transferred
+      for i in range(ELFLOADER_CHUNK_WINDOW):
+        bytes_this_chunk = min(ELFLOADER_MAX_BYTES_PER_CHUNK, end - offset)
+        last = (i == ELFLOADER_CHUNK_WINDOW - 1 or
+                offset + bytes_this_chunk == end)
+        h.write(elfloader_msg_chunk(offset,
+                                    data[offset:offset + bytes_this_chunk],
+                                    ack=last and not skip_hid_readback))
+        offset += bytes_this_chunk
+        if last:
+          break
+
+      if skip_hid_readback is True:
+        bytes_transferred = offset
+      else:
+        # Skip any one-byte ACK left over from an earlier command.
+        report = h.read(64, timeout_ms=ELFLOADER_ACK_TIMEOUT_MS)
+        while 0 < len(report) < struct.calcsize('=BI'):
+          report = h.read(64, timeout_ms=ELFLOADER_ACK_TIMEOUT_MS)
+        if not report:
+          status, next_offset = ELFLOADER_STATUS_CRC_ERROR, bytes_transferred
+        else:
+          status, next_offset = elfloader_parse_ack(report)
+        if status == ELFLOADER_STATUS_WRITE_ERROR:
+          raise RuntimeError('Device failed to store data at offset %d' %
+                             next_offset)
+        if next_offset < offset:
+          retries += 1
+          if retries > ELFLOADER_MAX_RETRIES:
+            raise RuntimeError('Transfer stalled at offset %d' % next_offset)
+        else:
+          retries = 0
+        bytes_transferred = next_offset
+      if bar:
+        bar.goto(bytes_sent + bytes_transferred - start)
+    bytes_sent += end - start
   h.write(elfloader_msg_done())
-  read_byte()
+  if read_byte() == ELFLOADER_STATUS_WRITE_ERROR:
+    raise RuntimeError('Device failed to store the data')
   if bar:
     bar.finish()
 
 
+def ElfLoadCrc(elf):
+  """Returns the CRC-32 of the ELF's loadable segment data, in the order the
+  elfloader loads it."""
+  phoff, = struct.unpack_from('<I', elf, 0x1c)
+  phentsize, phnum = struct.unpack_from('<HH', elf, 0x2a)
+  crc = 0
+  for i in range(phnum):
+    p_type, p_offset, _, _, p_filesz = struct.unpack_from(
+        '<IIIII', elf, phoff + i * phentsize)
+    if p_type == 1 and p_filesz:  # PT_LOAD
+      crc = zlib.crc32(elf[p_offset:p_offset + p_filesz], crc)
+  return crc
+
+
+def ElfloaderQueryFile(h, path, block_size=0):
+  """Returns (size, crc32, block_crc32s) of a file on the device.
+
+  The size is -1 if the file does not exist. Returns None if the device can't
+  answer, in which case the file should just be sent.
+  """
+  if skip_hid_readback is True:
+    return None
+  h.write(elfloader_msg_query(path, block_size))
+  # Skip any one-byte ACK left over from an earlier command.
+  header = struct.calcsize('=iIH')
+  report = h.read(ELFLOADER_REPORT_SIZE,
+                  timeout_ms=ELFLOADER_QUERY_TIMEOUT_MS)
+  while 0 < len(report) < header:
+    report = h.read(ELFLOADER_REPORT_SIZE,
+                    timeout_ms=ELFLOADER_QUERY_TIMEOUT_MS)
+  if not report:
+    return None
+  return elfloader_parse_query_response(report)
+
+
+def ElfloaderChangedRanges(data, block_crcs):
+  """Returns the (start, end) byte ranges of data that differ from the blocks
+  whose CRCs are given, merging adjacent ones."""
+  ranges = []
+  for start in range(0, len(data), ELFLOADER_DELTA_BLOCK_SIZE):
+    end = min(start + ELFLOADER_DELTA_BLOCK_SIZE, len(data))
+    index = start // ELFLOADER_DELTA_BLOCK_SIZE
+    if (index < len(block_crcs) and
+        zlib.crc32(data[start:end]) == block_crcs[index]):
+      continue
+    if ranges and ranges[-1][1] == start:
+      ranges[-1] = (ranges[-1][0], end)
+    else:
+      ranges.append((start, end))
+  return ranges
+
+
 def StateProgramElfloader(elf_path, arduino, debug=False, serial_number=None):
   with OpenHidDevice(ELFLOADER_VID, ELFLOADER_PID, serial_number) as h:
     data = read_file(elf_path)
@@ -676,12 +820,20 @@ def StateProgramElfloader(elf_path, arduino, debug=False, serial_number=None):
 
 def StateProgramDataFiles(
         elf_path, data_files, usb_ip_address, arduino, dns_server=None, ethernet_config=None, wifi_config=None, wifi_ssid=None, wifi_psk=None,
-        wifi_country=None, wifi_revision=None, serial_number=None, ethernet_speed=None, program=True, data=True):
+        wifi_country=None, wifi_revision=None, serial_number=None, ethernet_speed=None, program=True, data=True,
+        compress_models=False, resend_all=False):
   with OpenHidDevice(ELFLOADER_VID, ELFLOADER_PID, serial_number) as h:
-    if program and data:
+    # Without HID readback the device can't be asked what it already has, so
+    # start from a clean filesystem and send everything.
+    sync = not resend_all and skip_hid_readback is not True
+    if program and data and not sync:
       h.write(elfloader_msg_format())
     if program:
       data_files[elf_path] = '/default.elf'
+      # Lets the elfloader check the segments it loads at boot.
+      elf = read_file(elf_path)
+      data_files[struct.pack('<II', len(elf), ElfLoadCrc(elf))] = (
+          DEFAULT_ELF_CRC_FILE)
     data_files[str(usb_ip_address).encode()] = USB_IP_ADDRESS_FILE
     if dns_server is not None:
       data_files[str(dns_server).encode()] = DNS_SERVER_FILE
@@ -756,14 +908,34 @@ def StateProgramDataFiles(
       else:
         raise RuntimeError('src_file must be "str" or "bytes"')
 
+      if compress_models and target_file.endswith('.tflite'):
+        data = compress_file.compress(data)
+
+      ranges = None
+      path_target = ELFLOADER_TARGET_PATH
+      existing = ElfloaderQueryFile(
+          h, target_file.encode(),
+          ELFLOADER_DELTA_BLOCK_SIZE) if sync else None
+      if existing is not None:
+        size, crc, block_crcs = existing
+        if size == len(data) and crc == zlib.crc32(data):
+          print(f'{target_file} is unchanged, skipping')
+          continue
+        if size >= 0 and block_crcs:
+          ranges = ElfloaderChangedRanges(data, block_crcs)
+          path_target = ELFLOADER_TARGET_PATCH_PATH
+      send_size = len(data)
+      if ranges is not None:
+        send_size = sum(end - start for start, end in ranges)
+
       if not arduino:
-        bar = Bar(target_file, max=len(data))
+        bar = Bar(target_file, max=send_size)
       else:
-        bar = ArduinoBar(target_file, max=len(data))
+        bar = ArduinoBar(target_file, max=send_size)
 
-      ElfloaderTransferData(h, target_file.encode(), ELFLOADER_TARGET_PATH)
+      ElfloaderTransferData(h, target_file.encode(), path_target)
       ElfloaderTransferData(h, data, ELFLOADER_TARGET_FILESYSTEM,
-                            bar=bar)
+                            bar=bar, ranges=ranges)
     return StateResetToFlash
 
 
@@ -998,6 +1170,16 @@ def main():
       '--nodata', dest='nodata', action='store_true',
       help='Prevents flashing the app data (only program code is flashed, \
         unless --noprogram is also specified).')
+  advanced_group.add_argument(
+      '--compress_models', dest='compress_models', action='store_true',
+      help='Stores .tflite data files LZ4-compressed, which takes less flash \
+        space and transfer time. The app must load its models with \
+        LfsReadCompressedFile().')
+  advanced_group.add_argument(
+      '--resend_all', dest='resend_all', action='store_true',
+      help='Formats the filesystem and sends every data file. By default, \
+        files already on the board are only resent (in part) if they \
+        changed, and other files on the board are kept.')
   parser.add_argument(
       '--arduino', dest='arduino', action='store_true',
       help=argparse.SUPPRESS)
@@ -1154,6 +1336,8 @@ def main():
       'program': program,
       'data': data,
       'arduino': args.arduino,
+      'compress_models': args.compress_models,
+      'resend_all': args.resend_all,
   }
 
   serial_number = os.getenv('CORAL_MICRO_SERIAL')
@@ -69,6 +69,82 @@ void sys_check_core_locking(void);
 void sys_mark_tcpip_thread(void);
 #define LWIP_MARK_TCPIP_THREAD() sys_mark_tcpip_thread()
 
+/* ---------- Tuning profiles ---------- */
+/**
+ * CORAL_MICRO_LWIP_PROFILE selects the buffer sizes below, and is set with the
+ * LWIP_PROFILE CMake option. Options that are already defined, for example
+ * with -D, take precedence over the profile.
+ *
+ * BALANCED: the default sizes, which sustain a camera or audio stream with
+ *   moderate memory use.
+ * LOW_MEMORY: small windows and pools, for apps that need the RAM for models
+ *   and only exchange small messages.
+ * HIGH_THROUGHPUT: a full 16-bit receive window, larger send buffers and
+ *   pools, for bulk transfers and high frame rate streams.
+ */
+#define CORAL_MICRO_LWIP_PROFILE_BALANCED        0
+#define CORAL_MICRO_LWIP_PROFILE_LOW_MEMORY      1
+#define CORAL_MICRO_LWIP_PROFILE_HIGH_THROUGHPUT 2
+
+#ifndef CORAL_MICRO_LWIP_PROFILE
+#define CORAL_MICRO_LWIP_PROFILE CORAL_MICRO_LWIP_PROFILE_BALANCED
+#endif
+
+#if CORAL_MICRO_LWIP_PROFILE == CORAL_MICRO_LWIP_PROFILE_LOW_MEMORY
+#ifndef MEMP_NUM_PBUF
+#define MEMP_NUM_PBUF 10
+#endif
+#ifndef MEMP_NUM_TCP_SEG
+#define MEMP_NUM_TCP_SEG 12
+#endif
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE 16
+#endif
+#ifndef TCP_SND_BUF
+#define TCP_SND_BUF (2 * TCP_MSS)
+#endif
+#ifndef TCP_SND_QUEUELEN
+#define TCP_SND_QUEUELEN ((4 * TCP_SND_BUF) / TCP_MSS)
+#endif
+#ifndef TCP_WND
+#define TCP_WND (8 * TCP_MSS)
+#endif
+#ifndef TCPIP_MBOX_SIZE
+#define TCPIP_MBOX_SIZE 16
+#endif
+#elif CORAL_MICRO_LWIP_PROFILE == CORAL_MICRO_LWIP_PROFILE_HIGH_THROUGHPUT
+#ifndef MEMP_NUM_PBUF
+#define MEMP_NUM_PBUF 32
+#endif
+#ifndef MEMP_NUM_TCP_SEG
+#define MEMP_NUM_TCP_SEG 48
+#endif
+#ifndef PBUF_POOL_SIZE
+#define PBUF_POOL_SIZE 64
+#endif
+#ifndef TCP_SND_BUF
+#define TCP_SND_BUF (16 * TCP_MSS)
+#endif
+#ifndef TCP_SND_QUEUELEN
+#define TCP_SND_QUEUELEN ((3 * TCP_SND_BUF) / TCP_MSS)
+#endif
+/* The largest window without window scaling. */
+#ifndef TCP_WND
+#define TCP_WND (44 * TCP_MSS)
+#endif
+#ifndef TCPIP_MBOX_SIZE
+#define TCPIP_MBOX_SIZE 64
+#endif
+#ifndef DEFAULT_TCP_RECVMBOX_SIZE
+#define DEFAULT_TCP_RECVMBOX_SIZE 32
+#endif
+#ifndef DEFAULT_UDP_RECVMBOX_SIZE
+#define DEFAULT_UDP_RECVMBOX_SIZE 32
+#endif
+#elif CORAL_MICRO_LWIP_PROFILE != CORAL_MICRO_LWIP_PROFILE_BALANCED
+#error "Unknown CORAL_MICRO_LWIP_PROFILE"
+#endif
+
 /* ---------- Memory options ---------- */
 /**
  * MEM_ALIGNMENT: should be set to the alignment of the CPU
@@ -82,6 +158,7 @@ void sys_mark_tcpip_thread(void);
 /**
  * MEM_SIZE: the size of the heap memory. If the application will send
  * a lot of data that needs to be copied, this should be set high.
+ * Unused with MEM_LIBC_MALLOC, which allocates from the C library's heap.
  */
 #ifndef MEM_SIZE
 #define MEM_SIZE (22 * 1024)
@@ -299,9 +376,13 @@ Some MCU allow computing and verifying the IP, UDP, TCP and ICMP checksums by ha
 #define SZT_F "u"
 #endif
 
+#ifndef TCPIP_MBOX_SIZE
 #define TCPIP_MBOX_SIZE        32
+#endif
 #define TCPIP_THREAD_STACKSIZE 1024
+#ifndef TCPIP_THREAD_PRIO
 #define TCPIP_THREAD_PRIO      8
+#endif
 
 /**
  * DEFAULT_RAW_RECVMBOX_SIZE: The mailbox size for the incoming packets on a
@@ -315,14 +396,18 @@ Some MCU allow computing and verifying the IP, UDP, TCP and ICMP checksums by ha
  * NETCONN_UDP. The queue size value itself is platform-dependent, but is passed
  * to sys_mbox_new() when the recvmbox is created.
  */
+#ifndef DEFAULT_UDP_RECVMBOX_SIZE
 #define DEFAULT_UDP_RECVMBOX_SIZE 12
+#endif
 
 /**
  * DEFAULT_TCP_RECVMBOX_SIZE: The mailbox size for the incoming packets on a
  * NETCONN_TCP. The queue size value itself is platform-dependent, but is passed
  * to sys_mbox_new() when the recvmbox is created.
  */
+#ifndef DEFAULT_TCP_RECVMBOX_SIZE
 #define DEFAULT_TCP_RECVMBOX_SIZE 12
+#endif
 
 /**
  * DEFAULT_ACCEPTMBOX_SIZE: The mailbox size for the incoming connections.
@@ -338,6 +423,17 @@ u32_t lwip_rand(void);
 #define LWIP_RAND() lwip_rand()
 #endif
 
+/**
+ * LWIP_HOOK_TCP_INPACKET_PCB: Lets applications observe incoming TCP data
+ * before it reaches its pcb (see libs/nxp/rt1176-sdk/lwip_hooks.h).
+ */
+#include "lwip/arch.h"
+struct tcp_pcb;
+struct pbuf;
+s8_t lwip_hook_tcp_inpacket(struct tcp_pcb *pcb, struct pbuf *p);
+#define LWIP_HOOK_TCP_INPACKET_PCB(pcb, hdr, optlen, opt1len, opt2, p) \
+    lwip_hook_tcp_inpacket(pcb, p)
+
 #if defined(__cplusplus)
 }
 #endif
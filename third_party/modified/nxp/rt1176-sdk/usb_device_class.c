@@ -27,6 +27,10 @@
 #include "usb_device_cdc_eem.h"
 #endif
 
+#if ((defined(USB_DEVICE_CONFIG_CDC_NCM)) && (USB_DEVICE_CONFIG_CDC_NCM > 0U))
+#include "usb_device_cdc_ncm.h"
+#endif
+
 #if ((defined(USB_DEVICE_CONFIG_MSC)) && (USB_DEVICE_CONFIG_MSC > 0U))
 #include "usb_device_msc.h"
 #endif
@@ -91,6 +95,10 @@ static const usb_device_class_map_t s_UsbDeviceClassInterfaceMap[] = {
     {USB_DeviceCdcEemInit, USB_DeviceCdcEemDeinit, USB_DeviceCdcEemEvent, kUSB_DeviceClassTypeEem},
 #endif
 
+#if ((defined(USB_DEVICE_CONFIG_CDC_NCM)) && (USB_DEVICE_CONFIG_CDC_NCM > 0U))
+    {USB_DeviceCdcNcmInit, USB_DeviceCdcNcmDeinit, USB_DeviceCdcNcmEvent, kUSB_DeviceClassTypeNcm},
+#endif
+
 #if ((defined(USB_DEVICE_CONFIG_MSC)) && (USB_DEVICE_CONFIG_MSC > 0U))
     {USB_DeviceMscInit, USB_DeviceMscDeinit, USB_DeviceMscEvent, kUSB_DeviceClassTypeMsc},
 #endif
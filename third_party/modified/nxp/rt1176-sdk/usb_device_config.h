@@ -54,6 +54,9 @@
 /*! @brief CDC EEM instance count */
 #define USB_DEVICE_CONFIG_CDC_EEM (1U)
 
+/*! @brief CDC NCM instance count */
+#define USB_DEVICE_CONFIG_CDC_NCM (1U)
+
 /*! @brief CDC RNDIS instance count */
 #define USB_DEVICE_CONFIG_CDC_RNDIS (0U)
 